@@ -1,5 +1,7 @@
 #include "BluetoothMonitor.h"
 #include "logger.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <QDebug>
 #include <QDBusObjectPath>
@@ -19,7 +21,6 @@ BluetoothMonitor::BluetoothMonitor(QObject *parent)
     }
 
     registerDBusService();
-    checkAlreadyConnectedDevices(); // Check for already connected devices on startup
 }
 
 BluetoothMonitor::~BluetoothMonitor()
@@ -63,22 +64,30 @@ QString BluetoothMonitor::getDeviceName(const QString &devicePath)
     return "Unknown";
 }
 
-bool BluetoothMonitor::checkAlreadyConnectedDevices()
+void BluetoothMonitor::checkAlreadyConnectedDevices()
 {
-    QDBusInterface objectManager("org.bluez", "/", "org.freedesktop.DBus.ObjectManager", m_dbus);
-    QDBusMessage reply = objectManager.call("GetManagedObjects");
-
-    if (reply.type() == QDBusMessage::ErrorMessage)
+    // Asynchronous, so startup does not wait for bluetoothd; results arrive as deviceConnected()
+    const qint64 startNs = Metrics::nowNs();
+    QDBusMessage message = QDBusMessage::createMethodCall("org.bluez", "/", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
+    QDBusPendingCallWatcher *pending = new QDBusPendingCallWatcher(m_dbus.asyncCall(message), this);
+    connect(pending, &QDBusPendingCallWatcher::finished, this, [this, startNs](QDBusPendingCallWatcher *watcher)
     {
-        LOG_WARN("Failed to get managed objects: " << reply.errorMessage());
-        return false;
-    }
+        watcher->deleteLater();
+        Trace::complete("bluez.GetManagedObjects", startNs, Metrics::nowNs());
 
-    QVariant firstArg = reply.arguments().constFirst();
-    QDBusArgument arg = firstArg.value<QDBusArgument>();
-    ManagedObjectList managedObjects;
-    arg >> managedObjects;
+        QDBusPendingReply<ManagedObjectList> reply = *watcher;
+        if (reply.isError())
+        {
+            LOG_WARN("Failed to get managed objects: " << reply.error().message());
+            emit alreadyConnectedDevicesChecked(false);
+            return;
+        }
+        emit alreadyConnectedDevicesChecked(handleManagedObjects(reply.value()));
+    });
+}
 
+bool BluetoothMonitor::handleManagedObjects(const ManagedObjectList &managedObjects)
+{
     bool deviceFound = false;
 
     for (auto it = managedObjects.constBegin(); it != managedObjects.constEnd(); ++it)
@@ -102,6 +111,7 @@ bool BluetoothMonitor::checkAlreadyConnectedDevices()
 
             if (isAirPods)
             {
+                m_devicePaths.insert(deviceProps["Address"].toString(), objPath.path());
                 bool connected = deviceProps["Connected"].toBool();
                 if (connected)
                 {
@@ -146,6 +156,7 @@ void BluetoothMonitor::onPropertiesChanged(const QString &interface, const QVari
         }
         QString macAddress = addrReply.value().toString();
         QString deviceName = getDeviceName(path);
+        m_devicePaths.insert(macAddress, path);
 
         if (connected)
         {
@@ -158,4 +169,54 @@ void BluetoothMonitor::onPropertiesChanged(const QString &interface, const QVari
             LOG_DEBUG("AirPods device disconnected:" << macAddress << " Name:" << deviceName);
         }
     }
-}
\ No newline at end of file
+}
+
+QString BluetoothMonitor::devicePath(const QString &macAddress) const
+{
+    const QString path = m_devicePaths.value(macAddress);
+    if (!path.isEmpty())
+    {
+        return path;
+    }
+    // Not seen through BlueZ yet in this run; the first adapter is by far the most likely
+    return "/org/bluez/hci0/dev_" + QString(macAddress).replace(':', '_');
+}
+
+void BluetoothMonitor::connectDevice(const QString &macAddress)
+{
+    const qint64 startNs = Metrics::nowNs();
+    QDBusMessage message = QDBusMessage::createMethodCall("org.bluez", devicePath(macAddress), "org.bluez.Device1", "Connect");
+    QDBusPendingCallWatcher *pending = new QDBusPendingCallWatcher(m_dbus.asyncCall(message), this);
+    connect(pending, &QDBusPendingCallWatcher::finished, this, [this, macAddress, startNs](QDBusPendingCallWatcher *watcher)
+    {
+        watcher->deleteLater();
+        static Metrics::Histogram &connectDuration = Metrics::histogram("bluez_connect");
+        const qint64 nowNs = Metrics::nowNs();
+        connectDuration.record(nowNs - startNs);
+        Trace::complete("bluez.Connect", startNs, nowNs);
+
+        QDBusPendingReply<> reply = *watcher;
+        if (reply.isError())
+        {
+            LOG_INFO("BlueZ could not connect " << macAddress << ": " << reply.error().message());
+            emit connectFinished(macAddress, false, reply.error().message());
+            return;
+        }
+        emit connectFinished(macAddress, true, QString());
+    });
+}
+
+void BluetoothMonitor::cancelConnect(const QString &macAddress)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall("org.bluez", devicePath(macAddress), "org.bluez.Device1", "Disconnect");
+    QDBusPendingCallWatcher *pending = new QDBusPendingCallWatcher(m_dbus.asyncCall(message), this);
+    connect(pending, &QDBusPendingCallWatcher::finished, this, [macAddress](QDBusPendingCallWatcher *watcher)
+    {
+        watcher->deleteLater();
+        QDBusPendingReply<> reply = *watcher;
+        if (reply.isError())
+        {
+            LOG_DEBUG("BlueZ could not disconnect " << macAddress << ": " << reply.error().message());
+        }
+    });
+}
@@ -15,11 +15,19 @@ public:
     explicit BluetoothMonitor(QObject *parent = nullptr);
     ~BluetoothMonitor();
 
-    bool checkAlreadyConnectedDevices();
+    // Queries BlueZ without blocking; emits deviceConnected() per AirPods found, then alreadyConnectedDevicesChecked()
+    void checkAlreadyConnectedDevices();
+
+    // Device1.Connect without blocking; the result arrives as connectFinished()
+    void connectDevice(const QString &macAddress);
+    // Device1.Disconnect, which also aborts a Connect that is still in progress
+    void cancelConnect(const QString &macAddress);
 
 signals:
     void deviceConnected(const QString &macAddress, const QString &deviceName);
     void deviceDisconnected(const QString &macAddress, const QString &deviceName);
+    void alreadyConnectedDevicesChecked(bool found);
+    void connectFinished(const QString &macAddress, bool success, const QString &error);
 
 private slots:
     void onPropertiesChanged(const QString &interface, const QVariantMap &changedProps, const QStringList &invalidatedProps);
@@ -27,8 +35,12 @@ private slots:
 private:
     QDBusConnection m_dbus;
     void registerDBusService();
+    bool handleManagedObjects(const ManagedObjectList &managedObjects);
     bool isAirPodsDevice(const QString &devicePath);
     QString getDeviceName(const QString &devicePath);
+    QString devicePath(const QString &macAddress) const;
+
+    QHash<QString, QString> m_devicePaths; // AirPods address -> BlueZ object path
 };
 
 #endif // BLUETOOTHMONITOR_H
\ No newline at end of file
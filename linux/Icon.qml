@@ -8,6 +8,6 @@ Text {
 
     FontLoader {
         id: iconFont
-        source: "qrc:/icons/assets/fonts/SF-Symbols-6.ttf"
+        source: "qrc:/icons/assets/fonts/icons.ttf"
     }
 }
\ No newline at end of file
@@ -57,7 +57,7 @@ ApplicationWindow {
 
     FontLoader {
         id: iconFont
-        source: "qrc:/icons/assets/fonts/SF-Symbols-6.ttf"
+        source: "qrc:/icons/assets/fonts/icons.ttf"
     }
 
     Component {
@@ -68,6 +68,18 @@ ApplicationWindow {
                 spacing: 20
                 padding: 20
 
+                // Device selection, only with more than one pair of AirPods
+                ComboBox {
+                    anchors.horizontalCenter: parent.horizontalCenter
+                    width: 220
+                    visible: airPodsTrayApp.devices.devices.length > 1
+                    model: airPodsTrayApp.devices.devices
+                    textRole: "deviceName"
+                    displayText: airPodsTrayApp.deviceInfo.deviceName || airPodsTrayApp.deviceInfo.bluetoothAddress
+                    currentIndex: airPodsTrayApp.devices.devices.indexOf(airPodsTrayApp.deviceInfo)
+                    onActivated: airPodsTrayApp.devices.select(model[currentIndex].bluetoothAddress)
+                }
+
                 // Connection status indicator (Apple-like pill shape)
                 Rectangle {
                     anchors.horizontalCenter: parent.horizontalCenter
@@ -229,6 +241,18 @@ ApplicationWindow {
                         }
                     }
 
+                    Switch {
+                        text: qsTr("Connect When the Case Opens")
+                        checked: airPodsTrayApp.preConnectEnabled
+                        onCheckedChanged: airPodsTrayApp.preConnectEnabled = checked
+                    }
+
+                    Switch {
+                        text: qsTr("Headset Profile for Any Recording")
+                        checked: airPodsTrayApp.headsetForAnyRecording
+                        onCheckedChanged: airPodsTrayApp.headsetForAnyRecording = checked
+                    }
+
                     Switch {
                         text: qsTr("Auto-Start on Login")
                         checked: airPodsTrayApp.autoStartManager.autoStartEnabled
@@ -301,6 +325,66 @@ ApplicationWindow {
                     }
 
 
+                    Switch {
+                        visible: airPodsTrayApp.audioAdjustments.available
+                        text: qsTr("Loud Sound Reduction")
+                        checked: airPodsTrayApp.audioAdjustments.loudSoundReduction
+                        onToggled: airPodsTrayApp.audioAdjustments.loudSoundReduction = checked
+                    }
+
+                    Column {
+                        id: transparencyTuning
+                        property var tuning: airPodsTrayApp.audioAdjustments.transparency
+                        visible: airPodsTrayApp.audioAdjustments.available
+                        width: parent.width - 40
+                        spacing: 5
+
+                        Switch {
+                            text: qsTr("Customize Transparency Mode")
+                            checked: airPodsTrayApp.audioAdjustments.customTransparency
+                            onToggled: airPodsTrayApp.audioAdjustments.customTransparency = checked
+                        }
+
+                        // Sliders write on every move; the ATT client only keeps the latest pending value
+                        Label { text: qsTr("Amplification") }
+                        Slider {
+                            width: parent.width
+                            from: -1; to: 1
+                            value: transparencyTuning.tuning.amplification
+                            onMoved: transparencyTuning.tuning.amplification = value
+                        }
+
+                        Label { text: qsTr("Balance") }
+                        Slider {
+                            width: parent.width
+                            from: -1; to: 1
+                            value: transparencyTuning.tuning.balance
+                            onMoved: transparencyTuning.tuning.balance = value
+                        }
+
+                        Label { text: qsTr("Tone") }
+                        Slider {
+                            width: parent.width
+                            from: -1; to: 1
+                            value: transparencyTuning.tuning.tone
+                            onMoved: transparencyTuning.tuning.tone = value
+                        }
+
+                        Label { text: qsTr("Ambient Noise Reduction") }
+                        Slider {
+                            width: parent.width
+                            from: 0; to: 1
+                            value: transparencyTuning.tuning.ambientNoiseReduction
+                            onMoved: transparencyTuning.tuning.ambientNoiseReduction = value
+                        }
+
+                        Switch {
+                            text: qsTr("Conversation Boost")
+                            checked: transparencyTuning.tuning.conversationBoost
+                            onToggled: transparencyTuning.tuning.conversationBoost = checked
+                        }
+                    }
+
                     Button {
                         text: qsTr("Show Magic Cloud Keys QR")
                         onClicked: keysQrDialog.show()
@@ -0,0 +1,238 @@
+#include "attclient.h"
+#include "io/transport.h"
+#include "io/transports.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QTimer>
+
+namespace
+{
+    constexpr quint8 OPCODE_ERROR_RESPONSE = 0x01;
+    constexpr quint8 OPCODE_READ_REQUEST = 0x0A;
+    constexpr quint8 OPCODE_READ_RESPONSE = 0x0B;
+    constexpr quint8 OPCODE_WRITE_REQUEST = 0x12;
+    constexpr quint8 OPCODE_WRITE_RESPONSE = 0x13;
+    constexpr quint8 OPCODE_HANDLE_VALUE_NTF = 0x1B;
+    constexpr quint8 OPCODE_HANDLE_VALUE_IND = 0x1D;
+    constexpr quint8 OPCODE_HANDLE_VALUE_CFM = 0x1E;
+
+    constexpr int RESPONSE_TIMEOUT_MS = 2000;
+
+    quint16 readHandle(const QByteArray &pdu, int offset)
+    {
+        return static_cast<quint8>(pdu[offset]) | (static_cast<quint8>(pdu[offset + 1]) << 8);
+    }
+}
+
+AttClient::AttClient(QObject *parent)
+    : QObject(parent), m_responseTimer(new QTimer(this))
+{
+    m_responseTimer->setSingleShot(true);
+    m_responseTimer->setInterval(RESPONSE_TIMEOUT_MS);
+    connect(m_responseTimer, &QTimer::timeout, this, &AttClient::onResponseTimeout);
+}
+
+AttClient::~AttClient()
+{
+    dropTransport();
+}
+
+void AttClient::connectToDevice(const QBluetoothAddress &address)
+{
+    dropTransport();
+
+    LOG_INFO("Connecting ATT channel to " << address.toString());
+    m_transport = Transports::createAttTransport(address, this);
+    connect(m_transport, &Transport::connected, this, [this]()
+    {
+        LOG_INFO("ATT channel connected");
+        emit connected();
+        sendNext();
+    });
+    // One recv() per readyRead(), so each readAll() in the handler is exactly one PDU
+    connect(m_transport, &Transport::readyRead, this, &AttClient::onReadyRead);
+    connect(m_transport, &Transport::disconnected, this, [this]()
+    {
+        LOG_INFO("ATT channel disconnected");
+        dropTransport();
+        emit disconnected();
+    });
+    connect(m_transport, &Transport::errorOccurred, this, [this](const QString &message)
+    {
+        LOG_WARN("ATT channel error: " << message);
+        dropTransport();
+        emit errorOccurred(message);
+    });
+    m_transport->open();
+}
+
+void AttClient::disconnectFromDevice()
+{
+    if (m_transport)
+    {
+        dropTransport();
+        emit disconnected();
+    }
+}
+
+bool AttClient::isConnected() const
+{
+    return m_transport && m_transport->isOpen();
+}
+
+void AttClient::read(quint16 handle)
+{
+    enqueue({OPCODE_READ_REQUEST, handle, QByteArray()});
+}
+
+void AttClient::write(quint16 handle, const QByteArray &value)
+{
+    // Latest wins: only the value of a write that has not been sent yet can still be replaced
+    const auto waiting = m_awaitingResponse ? m_queue.begin() + 1 : m_queue.begin();
+    for (auto it = waiting; it != m_queue.end(); ++it)
+    {
+        if (it->opcode == OPCODE_WRITE_REQUEST && it->handle == handle)
+        {
+            static Metrics::Counter &coalesced = Metrics::counter("att_writes_coalesced_total");
+            coalesced.add();
+            it->value = value;
+            return;
+        }
+    }
+    enqueue({OPCODE_WRITE_REQUEST, handle, value});
+}
+
+void AttClient::subscribe(quint16 handle)
+{
+    write(handle + 1, QByteArray::fromHex("0100"));
+}
+
+void AttClient::enqueue(Request request)
+{
+    m_queue.push_back(std::move(request));
+    sendNext();
+}
+
+void AttClient::sendNext()
+{
+    if (m_awaitingResponse || m_queue.empty() || !isConnected())
+    {
+        return;
+    }
+
+    const Request &request = m_queue.front();
+    QByteArray pdu;
+    pdu.reserve(3 + request.value.size());
+    pdu.append(static_cast<char>(request.opcode));
+    pdu.append(static_cast<char>(request.handle & 0xFF));
+    pdu.append(static_cast<char>(request.handle >> 8));
+    pdu.append(request.value);
+
+    LOG_DEBUG("ATT request: " << pdu.toHex());
+    if (m_transport->write(pdu) < 0)
+    {
+        LOG_WARN("Failed to send ATT request: " << m_transport->errorString());
+        return;
+    }
+    m_awaitingResponse = true;
+    m_sentNs = Metrics::nowNs();
+    m_responseTimer->start();
+}
+
+void AttClient::onReadyRead()
+{
+    const QByteArray pdu = m_transport->readAll();
+    if (pdu.isEmpty())
+    {
+        return;
+    }
+    LOG_DEBUG("ATT PDU: " << pdu.toHex());
+
+    const quint8 opcode = static_cast<quint8>(pdu[0]);
+    if (opcode == OPCODE_HANDLE_VALUE_NTF || opcode == OPCODE_HANDLE_VALUE_IND)
+    {
+        if (pdu.size() < 3)
+        {
+            return;
+        }
+        if (opcode == OPCODE_HANDLE_VALUE_IND)
+        {
+            m_transport->write(QByteArray(1, static_cast<char>(OPCODE_HANDLE_VALUE_CFM)));
+        }
+        static Metrics::Counter &notifications = Metrics::counter("att_notifications_total");
+        notifications.add();
+        emit notified(readHandle(pdu, 1), pdu.mid(3));
+        return;
+    }
+
+    if (!m_awaitingResponse)
+    {
+        LOG_WARN("Unexpected ATT PDU with opcode " << Qt::hex << int(opcode));
+        return;
+    }
+
+    const Request request = m_queue.front();
+    switch (opcode)
+    {
+    case OPCODE_READ_RESPONSE:
+        completeRequest();
+        emit valueRead(request.handle, pdu.mid(1));
+        break;
+    case OPCODE_WRITE_RESPONSE:
+    {
+        static Metrics::Histogram &writeLatency = Metrics::histogram("att_write_to_response");
+        writeLatency.record(Metrics::nowNs() - m_sentNs);
+        completeRequest();
+        emit writeCompleted(request.handle);
+        break;
+    }
+    case OPCODE_ERROR_RESPONSE:
+    {
+        const quint8 errorCode = pdu.size() >= 5 ? static_cast<quint8>(pdu[4]) : 0;
+        LOG_WARN("ATT request " << Qt::hex << int(request.opcode) << " on handle " << request.handle
+                 << " failed with error " << int(errorCode));
+        completeRequest();
+        emit requestFailed(request.handle, errorCode);
+        break;
+    }
+    default:
+        LOG_WARN("Unknown ATT response opcode " << Qt::hex << int(opcode));
+        return;
+    }
+    sendNext();
+}
+
+void AttClient::onResponseTimeout()
+{
+    if (!m_awaitingResponse)
+    {
+        return;
+    }
+    const Request request = m_queue.front();
+    LOG_WARN("No ATT response for handle " << Qt::hex << request.handle);
+    completeRequest();
+    emit requestFailed(request.handle, 0);
+    sendNext();
+}
+
+void AttClient::completeRequest()
+{
+    m_responseTimer->stop();
+    m_awaitingResponse = false;
+    m_queue.pop_front();
+}
+
+void AttClient::dropTransport()
+{
+    m_responseTimer->stop();
+    m_awaitingResponse = false;
+    m_queue.clear();
+    if (m_transport)
+    {
+        m_transport->disconnect(this);
+        m_transport->close();
+        m_transport->deleteLater();
+        m_transport = nullptr;
+    }
+}
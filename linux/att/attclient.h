@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QBluetoothAddress>
+#include <deque>
+
+class QTimer;
+class Transport;
+
+/**
+ * ATT client for the AirPods' audio tuning characteristics, over L2CAP PSM 31.
+ *
+ * ATT allows one outstanding request per bearer, so requests are queued and sent
+ * one at a time. Notifications are dispatched as soon as the socket becomes
+ * readable. A write queued for a handle that already has a write waiting replaces
+ * that write's value: while a slider is dragged, at most one write is in flight and
+ * one is waiting, and the waiting one always carries the latest value.
+ */
+class AttClient : public QObject
+{
+    Q_OBJECT
+public:
+    enum Handle : quint16
+    {
+        Transparency = 0x18,
+        LoudSoundReduction = 0x1B,
+        HearingAid = 0x2A,
+    };
+    Q_ENUM(Handle)
+
+    explicit AttClient(QObject *parent = nullptr);
+    ~AttClient();
+
+    void connectToDevice(const QBluetoothAddress &address);
+    void disconnectFromDevice();
+    bool isConnected() const;
+
+    // Results arrive as valueRead() / writeCompleted(), or requestFailed()
+    void read(quint16 handle);
+    void write(quint16 handle, const QByteArray &value);
+    // Enables notifications through the client configuration descriptor at handle + 1
+    void subscribe(quint16 handle);
+
+signals:
+    void connected();
+    void disconnected();
+    void errorOccurred(const QString &message);
+    void valueRead(quint16 handle, const QByteArray &value);
+    void notified(quint16 handle, const QByteArray &value);
+    void writeCompleted(quint16 handle);
+    void requestFailed(quint16 handle, quint8 errorCode);
+
+private:
+    struct Request
+    {
+        quint8 opcode;
+        quint16 handle;
+        QByteArray value;
+    };
+
+    void enqueue(Request request);
+    void sendNext();
+    void onReadyRead();
+    void onResponseTimeout();
+    void completeRequest();
+    void dropTransport();
+
+    Transport *m_transport = nullptr;
+    std::deque<Request> m_queue; // Front is in flight while m_awaitingResponse is set
+    bool m_awaitingResponse = false;
+    qint64 m_sentNs = 0;
+    QTimer *m_responseTimer = nullptr;
+};
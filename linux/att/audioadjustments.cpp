@@ -0,0 +1,199 @@
+#include "audioadjustments.h"
+#include "attclient.h"
+#include "logger.h"
+
+void TuningModel::setAmplification(qreal amplification)
+{
+    m_parameters.setAmplificationAndBalance(amplification, m_parameters.balance());
+    apply();
+}
+
+void TuningModel::setBalance(qreal balance)
+{
+    m_parameters.setAmplificationAndBalance(m_parameters.amplification(), balance);
+    apply();
+}
+
+void TuningModel::setTone(qreal tone)
+{
+    m_parameters.setTone(tone);
+    apply();
+}
+
+void TuningModel::setAmbientNoiseReduction(qreal reduction)
+{
+    m_parameters.setAmbientNoiseReduction(reduction);
+    apply();
+}
+
+void TuningModel::setConversationBoost(bool enabled)
+{
+    m_parameters.setConversationBoost(enabled);
+    apply();
+}
+
+void TuningModel::setParameters(const AudioTuning::Parameters &parameters)
+{
+    m_parameters = parameters;
+    apply();
+}
+
+void TuningModel::update(const AudioTuning::Parameters &parameters)
+{
+    m_parameters = parameters;
+    emit changed();
+}
+
+void TuningModel::setAvailable(bool available)
+{
+    if (m_available != available)
+    {
+        m_available = available;
+        emit changed();
+    }
+}
+
+void TuningModel::apply()
+{
+    emit changed();
+    if (m_available)
+    {
+        emit edited();
+    }
+}
+
+AudioAdjustments::AudioAdjustments(QObject *parent)
+    : QObject(parent), m_att(new AttClient(this)), m_transparency(new TuningModel(this)), m_hearingAid(new TuningModel(this))
+{
+    connect(m_att, &AttClient::connected, this, [this]()
+    {
+        for (quint16 handle : {AttClient::Transparency, AttClient::LoudSoundReduction, AttClient::HearingAid})
+        {
+            m_att->subscribe(handle);
+            m_att->read(handle);
+        }
+        setAvailable(true);
+    });
+    connect(m_att, &AttClient::disconnected, this, [this]() { setAvailable(false); });
+    connect(m_att, &AttClient::errorOccurred, this, [this]() { setAvailable(false); });
+    connect(m_att, &AttClient::valueRead, this, &AudioAdjustments::onValue);
+    connect(m_att, &AttClient::notified, this, &AudioAdjustments::onValue);
+
+    connect(m_transparency, &TuningModel::edited, this, &AudioAdjustments::writeTransparency);
+    connect(m_hearingAid, &TuningModel::edited, this, &AudioAdjustments::writeHearingAid);
+}
+
+void AudioAdjustments::connectToDevice(const QBluetoothAddress &address)
+{
+    m_att->connectToDevice(address);
+}
+
+void AudioAdjustments::disconnectFromDevice()
+{
+    m_att->disconnectFromDevice();
+}
+
+void AudioAdjustments::setLoudSoundReduction(bool enabled)
+{
+    if (m_loudSoundReduction == enabled)
+    {
+        return;
+    }
+    m_loudSoundReduction = enabled;
+    emit loudSoundReductionChanged(enabled);
+    if (m_available)
+    {
+        m_att->write(AttClient::LoudSoundReduction, AudioTuning::encodeLoudSoundReduction(enabled));
+    }
+}
+
+void AudioAdjustments::setCustomTransparency(bool enabled)
+{
+    if (m_customTransparency == enabled)
+    {
+        return;
+    }
+    m_customTransparency = enabled;
+    emit customTransparencyChanged(enabled);
+    if (m_available)
+    {
+        writeTransparency();
+    }
+}
+
+void AudioAdjustments::onValue(quint16 handle, const QByteArray &value)
+{
+    switch (handle)
+    {
+    case AttClient::Transparency:
+        if (std::optional<AudioTuning::Transparency> transparency = AudioTuning::parseTransparency(value))
+        {
+            if (m_customTransparency != transparency->enabled)
+            {
+                m_customTransparency = transparency->enabled;
+                emit customTransparencyChanged(m_customTransparency);
+            }
+            m_transparencyRead = true;
+            m_transparency->update(transparency->parameters);
+        }
+        break;
+    case AttClient::LoudSoundReduction:
+        if (std::optional<bool> enabled = AudioTuning::parseLoudSoundReduction(value))
+        {
+            if (m_loudSoundReduction != *enabled)
+            {
+                m_loudSoundReduction = *enabled;
+                emit loudSoundReductionChanged(m_loudSoundReduction);
+            }
+        }
+        break;
+    case AttClient::HearingAid:
+        if (std::optional<AudioTuning::Parameters> parameters = AudioTuning::parseHearingAid(value))
+        {
+            m_hearingAidValue = value;
+            m_hearingAid->update(*parameters);
+        }
+        break;
+    default:
+        LOG_DEBUG("Ignoring ATT value for handle " << handle);
+        return;
+    }
+}
+
+void AudioAdjustments::setAvailable(bool available)
+{
+    if (m_available == available)
+    {
+        return;
+    }
+    m_available = available;
+    m_transparency->setAvailable(available);
+    m_hearingAid->setAvailable(available);
+    if (!available)
+    {
+        m_transparencyRead = false;
+        m_hearingAidValue.clear();
+    }
+    emit availableChanged(available);
+}
+
+void AudioAdjustments::writeTransparency()
+{
+    if (!m_transparencyRead)
+    {
+        LOG_WARN("Transparency settings not read yet, not writing them");
+        return;
+    }
+    m_att->write(AttClient::Transparency, AudioTuning::encodeTransparency({m_customTransparency, m_transparency->parameters()}));
+}
+
+void AudioAdjustments::writeHearingAid()
+{
+    if (m_hearingAidValue.isEmpty())
+    {
+        // The header is device-specific; wait until it has been read once
+        LOG_WARN("Hearing aid settings not read yet, not writing them");
+        return;
+    }
+    m_att->write(AttClient::HearingAid, AudioTuning::encodeHearingAid(m_hearingAid->parameters(), m_hearingAidValue));
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QBluetoothAddress>
+
+#include "audiotuning.h"
+
+class AttClient;
+
+/**
+ * One tuning parameter block (transparency or hearing aid) as QML properties.
+ *
+ * Setters update the block and emit edited(); the owner turns that into an ATT
+ * write. Values reported by the AirPods only emit changed().
+ */
+class TuningModel : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool available READ available NOTIFY changed)
+    Q_PROPERTY(qreal amplification READ amplification WRITE setAmplification NOTIFY changed)
+    Q_PROPERTY(qreal balance READ balance WRITE setBalance NOTIFY changed)
+    Q_PROPERTY(qreal tone READ tone WRITE setTone NOTIFY changed)
+    Q_PROPERTY(qreal ambientNoiseReduction READ ambientNoiseReduction WRITE setAmbientNoiseReduction NOTIFY changed)
+    Q_PROPERTY(bool conversationBoost READ conversationBoost WRITE setConversationBoost NOTIFY changed)
+
+public:
+    using QObject::QObject;
+
+    bool available() const { return m_available; }
+    qreal amplification() const { return m_parameters.amplification(); }
+    qreal balance() const { return m_parameters.balance(); }
+    qreal tone() const { return m_parameters.left.tone; }
+    qreal ambientNoiseReduction() const { return m_parameters.left.ambientNoiseReduction; }
+    bool conversationBoost() const { return m_parameters.left.conversationBoost; }
+
+    void setAmplification(qreal amplification);
+    void setBalance(qreal balance);
+    void setTone(qreal tone);
+    void setAmbientNoiseReduction(qreal reduction);
+    void setConversationBoost(bool enabled);
+
+    const AudioTuning::Parameters &parameters() const { return m_parameters; }
+    // Replaces the whole block, audiogram included
+    void setParameters(const AudioTuning::Parameters &parameters);
+
+signals:
+    void changed();
+    void edited();
+
+private:
+    friend class AudioAdjustments;
+    void update(const AudioTuning::Parameters &parameters);
+    void setAvailable(bool available);
+    void apply();
+
+    bool m_available = false;
+    AudioTuning::Parameters m_parameters;
+};
+
+/**
+ * Transparency customisation, loud sound reduction and hearing aid tuning, read and
+ * written over the ATT channel while AirPods are connected.
+ */
+class AudioAdjustments : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool available READ available NOTIFY availableChanged)
+    Q_PROPERTY(bool loudSoundReduction READ loudSoundReduction WRITE setLoudSoundReduction NOTIFY loudSoundReductionChanged)
+    Q_PROPERTY(bool customTransparency READ customTransparency WRITE setCustomTransparency NOTIFY customTransparencyChanged)
+    Q_PROPERTY(TuningModel *transparency READ transparency CONSTANT)
+    Q_PROPERTY(TuningModel *hearingAid READ hearingAid CONSTANT)
+
+public:
+    explicit AudioAdjustments(QObject *parent = nullptr);
+
+    void connectToDevice(const QBluetoothAddress &address);
+    void disconnectFromDevice();
+
+    bool available() const { return m_available; }
+    bool loudSoundReduction() const { return m_loudSoundReduction; }
+    void setLoudSoundReduction(bool enabled);
+    bool customTransparency() const { return m_customTransparency; }
+    void setCustomTransparency(bool enabled);
+    TuningModel *transparency() const { return m_transparency; }
+    TuningModel *hearingAid() const { return m_hearingAid; }
+
+signals:
+    void availableChanged(bool available);
+    void loudSoundReductionChanged(bool enabled);
+    void customTransparencyChanged(bool enabled);
+
+private:
+    void onValue(quint16 handle, const QByteArray &value);
+    void setAvailable(bool available);
+    void writeTransparency();
+    void writeHearingAid();
+
+    AttClient *m_att;
+    TuningModel *m_transparency;
+    TuningModel *m_hearingAid;
+    bool m_available = false;
+    bool m_loudSoundReduction = false;
+    bool m_customTransparency = false;
+    bool m_transparencyRead = false; // Writes carry the audiogram too, so never write one we have not read
+    QByteArray m_hearingAidValue; // Last value from the AirPods; its header is echoed back on write
+};
@@ -0,0 +1,166 @@
+#include "audiotuning.h"
+
+#include <QtEndian>
+#include <algorithm>
+
+namespace
+{
+    constexpr int PREFIX_SIZE = 4;
+    constexpr int EAR_SIZE = (AudioTuning::BANDS + 4) * 4;
+    constexpr int PARAMETERS_SIZE = PREFIX_SIZE + 2 * EAR_SIZE;  // 100 bytes
+    constexpr int OWN_VOICE_OFFSET = PARAMETERS_SIZE;            // Optional, 104 bytes with it
+    constexpr quint8 HEARING_AID_WRITE_MARKER = 0x64;
+
+    float readFloat(const char *data, int offset)
+    {
+        return qFromLittleEndian<float>(data + offset);
+    }
+
+    void writeFloat(char *data, int offset, float value)
+    {
+        qToLittleEndian<float>(value, data + offset);
+    }
+
+    AudioTuning::Ear readEar(const char *data, int offset)
+    {
+        AudioTuning::Ear ear;
+        for (int band = 0; band < AudioTuning::BANDS; ++band)
+        {
+            ear.loss[band] = readFloat(data, offset + band * 4);
+        }
+        offset += AudioTuning::BANDS * 4;
+        ear.amplification = readFloat(data, offset);
+        ear.tone = readFloat(data, offset + 4);
+        ear.conversationBoost = readFloat(data, offset + 8) > 0.5f;
+        ear.ambientNoiseReduction = readFloat(data, offset + 12);
+        return ear;
+    }
+
+    void writeEar(char *data, int offset, const AudioTuning::Ear &ear)
+    {
+        for (int band = 0; band < AudioTuning::BANDS; ++band)
+        {
+            writeFloat(data, offset + band * 4, ear.loss[band]);
+        }
+        offset += AudioTuning::BANDS * 4;
+        writeFloat(data, offset, ear.amplification);
+        writeFloat(data, offset + 4, ear.tone);
+        writeFloat(data, offset + 8, ear.conversationBoost ? 1.0f : 0.0f);
+        writeFloat(data, offset + 12, ear.ambientNoiseReduction);
+    }
+
+    std::optional<AudioTuning::Parameters> readParameters(const QByteArray &value)
+    {
+        if (value.size() < PARAMETERS_SIZE)
+        {
+            return std::nullopt;
+        }
+        AudioTuning::Parameters parameters;
+        parameters.left = readEar(value.constData(), PREFIX_SIZE);
+        parameters.right = readEar(value.constData(), PREFIX_SIZE + EAR_SIZE);
+        if (value.size() >= OWN_VOICE_OFFSET + 4)
+        {
+            parameters.ownVoiceAmplification = readFloat(value.constData(), OWN_VOICE_OFFSET);
+        }
+        return parameters;
+    }
+
+    void writeParameters(QByteArray &value, const AudioTuning::Parameters &parameters)
+    {
+        const int size = parameters.ownVoiceAmplification ? OWN_VOICE_OFFSET + 4 : PARAMETERS_SIZE;
+        if (value.size() < size)
+        {
+            value.append(QByteArray(size - value.size(), '\0'));
+        }
+        writeEar(value.data(), PREFIX_SIZE, parameters.left);
+        writeEar(value.data(), PREFIX_SIZE + EAR_SIZE, parameters.right);
+        if (parameters.ownVoiceAmplification)
+        {
+            writeFloat(value.data(), OWN_VOICE_OFFSET, *parameters.ownVoiceAmplification);
+        }
+    }
+}
+
+namespace AudioTuning
+{
+    float Parameters::amplification() const
+    {
+        return std::clamp((left.amplification + right.amplification) / 2, -1.0f, 1.0f);
+    }
+
+    float Parameters::balance() const
+    {
+        return std::clamp(right.amplification - left.amplification, -1.0f, 1.0f);
+    }
+
+    void Parameters::setAmplificationAndBalance(float amplification, float balance)
+    {
+        // Same mapping as the Android app and hearing-aid-adjustments.py
+        left.amplification = balance < 0 ? amplification + (0.5f - balance) * amplification * 2 : amplification;
+        right.amplification = balance > 0 ? amplification + (balance - 0.5f) * amplification * 2 : amplification;
+    }
+
+    void Parameters::setTone(float tone)
+    {
+        left.tone = right.tone = tone;
+    }
+
+    void Parameters::setAmbientNoiseReduction(float reduction)
+    {
+        left.ambientNoiseReduction = right.ambientNoiseReduction = reduction;
+    }
+
+    void Parameters::setConversationBoost(bool enabled)
+    {
+        left.conversationBoost = right.conversationBoost = enabled;
+    }
+
+    std::optional<Transparency> parseTransparency(const QByteArray &value)
+    {
+        std::optional<Parameters> parameters = readParameters(value);
+        if (!parameters)
+        {
+            return std::nullopt;
+        }
+        return Transparency{readFloat(value.constData(), 0) > 0.5f, *parameters};
+    }
+
+    QByteArray encodeTransparency(const Transparency &transparency)
+    {
+        QByteArray value(PREFIX_SIZE, '\0');
+        writeFloat(value.data(), 0, transparency.enabled ? 1.0f : 0.0f);
+        writeParameters(value, transparency.parameters);
+        return value;
+    }
+
+    std::optional<Parameters> parseHearingAid(const QByteArray &value)
+    {
+        return readParameters(value);
+    }
+
+    QByteArray encodeHearingAid(const Parameters &parameters, const QByteArray &current)
+    {
+        QByteArray value = current;
+        if (value.size() < PREFIX_SIZE)
+        {
+            value.append(QByteArray(PREFIX_SIZE - value.size(), '\0'));
+        }
+        value[2] = static_cast<char>(HEARING_AID_WRITE_MARKER);
+        writeParameters(value, parameters);
+        return value;
+    }
+
+    std::optional<bool> parseLoudSoundReduction(const QByteArray &value)
+    {
+        if (value.isEmpty())
+        {
+            return std::nullopt;
+        }
+        return value[0] != 0;
+    }
+
+    QByteArray encodeLoudSoundReduction(bool enabled)
+    {
+        return QByteArray(1, enabled ? 1 : 0);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QByteArray>
+#include <array>
+#include <optional>
+
+/**
+ * Typed views of the tuning values stored in the AirPods' ATT characteristics.
+ *
+ * Transparency (0x18) and hearing aid (0x2A) share one parameter block of
+ * little-endian floats, after a 4-byte prefix: the transparency "enabled" flag, or
+ * the hearing aid header. Loud sound reduction (0x1B) is a single byte.
+ */
+namespace AudioTuning
+{
+    constexpr int BANDS = 8; // 250 Hz, 500 Hz, 1, 2, 3, 4, 6 and 8 kHz
+
+    struct Ear
+    {
+        std::array<float, BANDS> loss{}; // dBHL per band
+        float amplification = 0;
+        float tone = 0;
+        bool conversationBoost = false;
+        float ambientNoiseReduction = 0;
+    };
+
+    struct Parameters
+    {
+        Ear left;
+        Ear right;
+        std::optional<float> ownVoiceAmplification; // Missing on older firmware
+
+        // Both ears together, the way the Apple UI presents them
+        float amplification() const;
+        float balance() const;
+        void setAmplificationAndBalance(float amplification, float balance);
+        void setTone(float tone);
+        void setAmbientNoiseReduction(float reduction);
+        void setConversationBoost(bool enabled);
+    };
+
+    struct Transparency
+    {
+        bool enabled = false;
+        Parameters parameters;
+    };
+
+    std::optional<Transparency> parseTransparency(const QByteArray &value);
+    QByteArray encodeTransparency(const Transparency &transparency);
+
+    std::optional<Parameters> parseHearingAid(const QByteArray &value);
+    // The header and anything past the known fields are kept from current, the last value read
+    QByteArray encodeHearingAid(const Parameters &parameters, const QByteArray &current);
+
+    std::optional<bool> parseLoudSoundReduction(const QByteArray &value);
+    QByteArray encodeLoudSoundReduction(bool enabled);
+}
@@ -0,0 +1,391 @@
+#include "advertisementmonitor.h"
+#include "BluetoothMonitor.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QDBusArgument>
+#include <QDBusMetaType>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+#include <QDBusVariant>
+#include <QTimer>
+
+namespace
+{
+    constexpr quint16 APPLE_COMPANY_ID = 0x004C;
+    constexpr quint8 AD_TYPE_MANUFACTURER_DATA = 0xFF;
+    constexpr quint8 PROXIMITY_PAIRING = 0x07;
+    constexpr int INITIAL_RETRY_MS = 1000;
+    constexpr int MAX_RETRY_MS = 60000;
+    // Same adapter as BluetoothMonitor assumes
+    const QString ADAPTER_PATH = QStringLiteral("/org/bluez/hci0");
+    const QString ROOT_PATH = QStringLiteral("/me/kavishdevar/librepods/advmonitor");
+    const QString MONITOR_PATH = ROOT_PATH + QStringLiteral("/proximity");
+    const QString MONITOR_INTERFACE = QStringLiteral("org.bluez.AdvertisementMonitor1");
+    const QString MANAGER_INTERFACE = QStringLiteral("org.bluez.AdvertisementMonitorManager1");
+    const QString DEVICE_INTERFACE = QStringLiteral("org.bluez.Device1");
+    const QString PROPERTIES_INTERFACE = QStringLiteral("org.freedesktop.DBus.Properties");
+    const QString OBJECT_MANAGER_INTERFACE = QStringLiteral("org.freedesktop.DBus.ObjectManager");
+
+    // One entry of the Patterns property, a(yyay)
+    struct MonitorPattern
+    {
+        quint8 start = 0;
+        quint8 adType = 0;
+        QByteArray content;
+    };
+
+    QByteArray appleDataFrom(const QVariant &manufacturerData)
+    {
+        QMap<quint16, QDBusVariant> byCompany;
+        manufacturerData.value<QDBusArgument>() >> byCompany;
+        return byCompany.value(APPLE_COMPANY_ID).variant().toByteArray();
+    }
+}
+
+Q_DECLARE_METATYPE(MonitorPattern)
+
+QDBusArgument &operator<<(QDBusArgument &argument, const MonitorPattern &pattern)
+{
+    argument.beginStructure();
+    argument << pattern.start << pattern.adType << pattern.content;
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, MonitorPattern &pattern)
+{
+    argument.beginStructure();
+    argument >> pattern.start >> pattern.adType >> pattern.content;
+    argument.endStructure();
+    return argument;
+}
+
+// The application root BlueZ enumerates to find our monitors and their patterns
+class MonitorRoot : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.DBus.ObjectManager")
+public:
+    using QObject::QObject;
+
+public slots:
+    ManagedObjectList GetManagedObjects()
+    {
+        // Manufacturer data is matched after the AD type, from the company ID on
+        const QByteArray content{"\x4C\x00", 2};
+        const QList<MonitorPattern> patterns{{0, AD_TYPE_MANUFACTURER_DATA, content + char(PROXIMITY_PAIRING)}};
+        QVariantMap properties;
+        properties.insert("Type", QStringLiteral("or_patterns"));
+        properties.insert("Patterns", QVariant::fromValue(patterns));
+
+        ManagedObjectList objects;
+        objects[QDBusObjectPath(MONITOR_PATH)].insert(MONITOR_INTERFACE, properties);
+        return objects;
+    }
+};
+
+class MonitorObject : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.bluez.AdvertisementMonitor1")
+public:
+    explicit MonitorObject(AdvertisementMonitor *owner) : QObject(owner), m_owner(owner) {}
+
+public slots:
+    void Release()
+    {
+        m_owner->onLost(QStringLiteral("released by BlueZ"));
+    }
+
+    void Activate()
+    {
+        LOG_INFO("Advertisement monitor active on " << m_owner->m_adapterPath);
+        m_owner->m_state = AdvertisementMonitor::State::Active;
+        m_owner->m_hasBeenActive = true;
+        m_owner->m_retryMs = INITIAL_RETRY_MS;
+        emit m_owner->active();
+    }
+
+    void DeviceFound(const QDBusObjectPath &device) { m_owner->onDeviceFound(device); }
+    void DeviceLost(const QDBusObjectPath &device) { m_owner->onDeviceLost(device); }
+
+private:
+    AdvertisementMonitor *m_owner;
+};
+
+AdvertisementMonitor::AdvertisementMonitor(const QDBusConnection &bus, const QString &service, QObject *parent)
+    : QObject(parent), m_bus(bus), m_service(service), m_retryMs(INITIAL_RETRY_MS)
+{
+    qDBusRegisterMetaType<MonitorPattern>();
+    qDBusRegisterMetaType<QList<MonitorPattern>>();
+    qDBusRegisterMetaType<ManagedObjectList>();
+
+    m_retryTimer = new QTimer(this);
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, &QTimer::timeout, this, &AdvertisementMonitor::retry);
+
+    // bluetoothd restarting drops every registration without a Release
+    auto *serviceWatcher = new QDBusServiceWatcher(m_service, m_bus, QDBusServiceWatcher::WatchForUnregistration, this);
+    connect(serviceWatcher, &QDBusServiceWatcher::serviceUnregistered, this, [this]()
+            { onLost(QStringLiteral("lost, BlueZ went away")); });
+    m_bus.connect(m_service, QStringLiteral("/"), OBJECT_MANAGER_INTERFACE, "InterfacesAdded", this,
+                  SLOT(onInterfacesAdded(QDBusMessage)));
+}
+
+AdvertisementMonitor::~AdvertisementMonitor()
+{
+    stop();
+}
+
+void AdvertisementMonitor::start()
+{
+    if (m_state != State::Stopped)
+    {
+        return;
+    }
+    m_state = State::Registering;
+
+    // Check the adapter can filter for us before exporting anything
+    const QString adapterPath = ADAPTER_PATH;
+    QDBusMessage get = QDBusMessage::createMethodCall(m_service, adapterPath, PROPERTIES_INTERFACE, "Get");
+    get << MANAGER_INTERFACE << QStringLiteral("SupportedMonitorTypes");
+    auto *watcher = new QDBusPendingCallWatcher(m_bus.asyncCall(get), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, adapterPath](QDBusPendingCallWatcher *call)
+    {
+        call->deleteLater();
+        if (m_state != State::Registering)
+        {
+            return; // Stopped meanwhile
+        }
+        QDBusPendingReply<QDBusVariant> reply = *call;
+        if (reply.isError())
+        {
+            checkFailed(reply.error().message());
+            return;
+        }
+        if (!reply.value().variant().toStringList().contains("or_patterns"))
+        {
+            checkFailed(QStringLiteral("or_patterns monitors are not supported"));
+            return;
+        }
+        registerWith(adapterPath);
+    });
+}
+
+void AdvertisementMonitor::registerWith(const QString &adapterPath)
+{
+    m_adapterPath = adapterPath;
+    m_root = new MonitorRoot(this);
+    m_monitor = new MonitorObject(this);
+    if (!m_bus.registerObject(ROOT_PATH, m_root, QDBusConnection::ExportAllSlots)
+        || !m_bus.registerObject(MONITOR_PATH, m_monitor, QDBusConnection::ExportAllSlots))
+    {
+        fail(m_bus.lastError().message());
+        return;
+    }
+
+    QDBusMessage registerMonitor = QDBusMessage::createMethodCall(m_service, adapterPath, MANAGER_INTERFACE, "RegisterMonitor");
+    registerMonitor << QVariant::fromValue(QDBusObjectPath(ROOT_PATH));
+    auto *watcher = new QDBusPendingCallWatcher(m_bus.asyncCall(registerMonitor), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *call)
+    {
+        call->deleteLater();
+        QDBusPendingReply<> reply = *call;
+        if (reply.isError() && m_state == State::Registering)
+        {
+            fail(reply.error().message());
+        }
+        // Otherwise Activate() follows once BlueZ has read the patterns
+    });
+}
+
+void AdvertisementMonitor::stop()
+{
+    m_retryTimer->stop();
+    if (m_state == State::Stopped)
+    {
+        return;
+    }
+    if (m_root)
+    {
+        QDBusMessage unregisterMonitor = QDBusMessage::createMethodCall(m_service, m_adapterPath, MANAGER_INTERFACE, "UnregisterMonitor");
+        unregisterMonitor << QVariant::fromValue(QDBusObjectPath(ROOT_PATH));
+        m_bus.asyncCall(unregisterMonitor);
+    }
+    unregisterObjects();
+    m_state = State::Stopped;
+}
+
+void AdvertisementMonitor::fail(const QString &reason)
+{
+    LOG_WARN("BlueZ advertisement monitor unavailable: " << reason);
+    unregisterObjects();
+    m_state = State::Stopped;
+    emit failed(reason);
+}
+
+void AdvertisementMonitor::checkFailed(const QString &reason)
+{
+    if (!m_hasBeenActive)
+    {
+        fail(reason);
+        return;
+    }
+    // E.g. bluetoothd is still starting up after a restart
+    LOG_DEBUG("Advertisement monitor not registered yet: " << reason);
+    scheduleRetry();
+}
+
+void AdvertisementMonitor::onLost(const QString &reason)
+{
+    if (m_state == State::Stopped || m_state == State::Retrying)
+    {
+        return;
+    }
+    static Metrics::Counter &lost = Metrics::counter("ble_monitor_lost_total");
+    lost.add();
+    LOG_INFO("Advertisement monitor " << reason << ", registering it again in " << m_retryMs << " ms");
+    const bool wasActive = m_state == State::Active;
+    scheduleRetry();
+    if (wasActive)
+    {
+        emit inactive();
+    }
+}
+
+void AdvertisementMonitor::scheduleRetry()
+{
+    unregisterObjects();
+    m_state = State::Retrying;
+    m_retryTimer->start(m_retryMs);
+    m_retryMs = qMin(m_retryMs * 2, MAX_RETRY_MS);
+}
+
+void AdvertisementMonitor::retry()
+{
+    if (m_state != State::Retrying)
+    {
+        return;
+    }
+    m_retryTimer->stop();
+    m_state = State::Stopped;
+    start();
+}
+
+void AdvertisementMonitor::onInterfacesAdded(const QDBusMessage &message)
+{
+    const QList<QVariant> arguments = message.arguments();
+    if (m_state != State::Retrying || arguments.size() < 2
+        || arguments.at(0).value<QDBusObjectPath>().path() != ADAPTER_PATH)
+    {
+        return;
+    }
+    QMap<QString, QVariantMap> interfaces;
+    arguments.at(1).value<QDBusArgument>() >> interfaces;
+    if (interfaces.contains(MANAGER_INTERFACE))
+    {
+        LOG_INFO("Adapter is back, registering the advertisement monitor again");
+        retry();
+    }
+}
+
+void AdvertisementMonitor::unregisterObjects()
+{
+    for (auto it = m_devices.constBegin(); it != m_devices.constEnd(); ++it)
+    {
+        m_bus.disconnect(m_service, it.key(), PROPERTIES_INTERFACE, "PropertiesChanged", this,
+                         SLOT(onPropertiesChanged(QString, QVariantMap, QStringList, QDBusMessage)));
+    }
+    m_devices.clear();
+    if (m_root)
+    {
+        m_bus.unregisterObject(MONITOR_PATH);
+        m_bus.unregisterObject(ROOT_PATH);
+        m_monitor->deleteLater();
+        m_root->deleteLater();
+        m_monitor = nullptr;
+        m_root = nullptr;
+    }
+}
+
+void AdvertisementMonitor::onDeviceFound(const QDBusObjectPath &path)
+{
+    static Metrics::Counter &found = Metrics::counter("ble_monitor_devices_found_total");
+    found.add();
+    const QString devicePath = path.path();
+    if (m_devices.contains(devicePath))
+    {
+        return;
+    }
+    m_devices.insert(devicePath, Device{});
+    m_bus.connect(m_service, devicePath, PROPERTIES_INTERFACE, "PropertiesChanged", this,
+                  SLOT(onPropertiesChanged(QString, QVariantMap, QStringList, QDBusMessage)));
+
+    // The advertisement that matched is already in the device's properties
+    QDBusMessage getAll = QDBusMessage::createMethodCall(m_service, devicePath, PROPERTIES_INTERFACE, "GetAll");
+    getAll << DEVICE_INTERFACE;
+    auto *watcher = new QDBusPendingCallWatcher(m_bus.asyncCall(getAll), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, devicePath](QDBusPendingCallWatcher *call)
+    {
+        call->deleteLater();
+        QDBusPendingReply<QVariantMap> reply = *call;
+        if (!reply.isError())
+        {
+            onDeviceProperties(devicePath, reply.value());
+        }
+    });
+}
+
+void AdvertisementMonitor::onDeviceLost(const QDBusObjectPath &path)
+{
+    if (m_devices.remove(path.path()))
+    {
+        m_bus.disconnect(m_service, path.path(), PROPERTIES_INTERFACE, "PropertiesChanged", this,
+                         SLOT(onPropertiesChanged(QString, QVariantMap, QStringList, QDBusMessage)));
+    }
+}
+
+void AdvertisementMonitor::onPropertiesChanged(const QString &interface, const QVariantMap &changed,
+                                               const QStringList &, const QDBusMessage &message)
+{
+    if (interface == DEVICE_INTERFACE)
+    {
+        onDeviceProperties(message.path(), changed);
+    }
+}
+
+void AdvertisementMonitor::onDeviceProperties(const QString &path, const QVariantMap &properties)
+{
+    const auto it = m_devices.find(path);
+    if (it == m_devices.end())
+    {
+        return; // Lost meanwhile
+    }
+    if (properties.contains("Address"))
+    {
+        it->address = properties.value("Address").toString();
+    }
+    if (properties.contains("Alias"))
+    {
+        it->name = properties.value("Alias").toString();
+    }
+    const bool rssiChanged = properties.contains("RSSI");
+    if (rssiChanged)
+    {
+        it->rssi = static_cast<qint16>(properties.value("RSSI").toInt());
+    }
+    QByteArray appleData;
+    if (properties.contains("ManufacturerData"))
+    {
+        appleData = appleDataFrom(properties.value("ManufacturerData"));
+    }
+    if (it->address.isEmpty() || (!rssiChanged && appleData.isEmpty()))
+    {
+        return;
+    }
+    emit advertisementReceived(it->address, it->name, rssiChanged ? it->rssi : 0, appleData);
+}
+
+#include "advertisementmonitor.moc"
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+#include <QHash>
+#include <QString>
+#include <QVariantMap>
+
+/**
+ * Receives Apple proximity pairing advertisements through a BlueZ AdvertisementMonitor1.
+ *
+ * QBluetoothDeviceDiscoveryAgent reports every LE advertisement in range, and in a busy
+ * room nearly all of them are dropped again right away. This registers an or_patterns
+ * monitor for manufacturer data starting with 4C 00 07 (Apple, proximity pairing), so
+ * bluetoothd, or the controller where it supports offloading, does the filtering and we
+ * only hear about matching devices. BlueZ then reports DeviceFound(), and every later
+ * advertisement that changes the device's ManufacturerData or RSSI arrives as a
+ * PropertiesChanged on that device only.
+ *
+ * Losing the monitor is not the same as not having one. When BlueZ releases it, or
+ * bluetoothd goes away, it is registered again after a backoff, or right away once the
+ * adapter reappears. Only an adapter without or_patterns support, or a RegisterMonitor
+ * call that BlueZ rejects, is reported as failed().
+ *
+ * The bus and service name are parameters so this can run against a stand-in BlueZ,
+ * e.g. tools/fakebluez.cpp on the session bus.
+ */
+class QTimer;
+
+class AdvertisementMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AdvertisementMonitor(const QDBusConnection &bus = QDBusConnection::systemBus(),
+                                  const QString &service = QStringLiteral("org.bluez"), QObject *parent = nullptr);
+    ~AdvertisementMonitor();
+
+    // Registers the monitor with the first adapter that supports or_patterns; active() or failed() follows
+    void start();
+    void stop();
+    bool isActive() const { return m_state == State::Active; }
+
+signals:
+    void active();
+    // Released or lost after active(); registering again is already under way
+    void inactive();
+    // No adapter supports it, or BlueZ refused the monitor; final
+    void failed(const QString &reason);
+    // rssi is 0 and data empty when unchanged
+    void advertisementReceived(const QString &address, const QString &name, qint16 rssi, const QByteArray &appleData);
+
+private slots:
+    void onPropertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated,
+                             const QDBusMessage &message);
+    void onInterfacesAdded(const QDBusMessage &message);
+
+private:
+    friend class MonitorObject;
+    friend class MonitorRoot;
+
+    enum class State
+    {
+        Stopped,
+        Registering,
+        Active,
+        Retrying, // Lost; waiting for the backoff or the adapter
+    };
+
+    struct Device
+    {
+        QString address;
+        QString name;
+        qint16 rssi = 0;
+    };
+
+    void registerWith(const QString &adapterPath);
+    void fail(const QString &reason);
+    // Before RegisterMonitor: final the first time, retried once the monitor has worked
+    void checkFailed(const QString &reason);
+    void onLost(const QString &reason);
+    void scheduleRetry();
+    void retry();
+    void onDeviceFound(const QDBusObjectPath &path);
+    void onDeviceLost(const QDBusObjectPath &path);
+    void onDeviceProperties(const QString &path, const QVariantMap &properties);
+    void unregisterObjects();
+
+    QDBusConnection m_bus;
+    QString m_service;
+    QString m_adapterPath;
+    State m_state = State::Stopped;
+    bool m_hasBeenActive = false;
+    QTimer *m_retryTimer = nullptr;
+    int m_retryMs;
+    QObject *m_root = nullptr;    // org.freedesktop.DBus.ObjectManager for BlueZ to enumerate our monitors
+    QObject *m_monitor = nullptr; // The one org.bluez.AdvertisementMonitor1
+    QHash<QString, Device> m_devices; // BlueZ object path -> what we know of it
+};
@@ -1,8 +1,11 @@
 #include "blemanager.h"
+#include "advertisementmonitor.h"
 #include "enums.h"
 #include <QDebug>
 #include <QTimer>
+#include <QThread>
 #include "logger.h"
+#include "metrics.h"
 #include <QMap>
 
 AirpodsTrayApp::Enums::AirPodsModel getModelName(quint16 modelId)
@@ -82,8 +85,75 @@ QString getConnectionStateName(BleInfo::ConnectionState state)
     }
 }
 
-BleManager::BleManager(QObject *parent) : QObject(parent)
+namespace
 {
+    bool readUseMonitor()
+    {
+        const QByteArray name = qgetenv("LIBREPODS_BLE_SCANNER").toLower();
+        if (name == "agent")
+        {
+            LOG_INFO("Using the QtBluetooth discovery agent for BLE advertisements");
+            return false;
+        }
+        if (!name.isEmpty() && name != "monitor")
+        {
+            LOG_WARN("Unknown LIBREPODS_BLE_SCANNER '" << name << "', using the BlueZ advertisement monitor");
+        }
+        return true;
+    }
+
+    // A stand-in BlueZ such as tools/fakebluez.cpp runs on the session bus
+    QDBusConnection monitorBus()
+    {
+        if (qgetenv("LIBREPODS_BLE_MONITOR_BUS") == "session")
+        {
+            LOG_INFO("Registering the advertisement monitor on the session bus");
+            return QDBusConnection::sessionBus();
+        }
+        return QDBusConnection::systemBus();
+    }
+}
+
+BleManager::BleManager(QObject *parent) : QObject(parent), m_useMonitor(readUseMonitor())
+{
+    // The scanners are created lazily so they live on whatever thread this object has been moved to
+}
+
+BleManager::~BleManager()
+{
+    delete m_monitor;
+    delete discoveryAgent;
+}
+
+void BleManager::onMonitorFailed()
+{
+    LOG_INFO("Falling back to the QtBluetooth discovery agent for BLE advertisements");
+    m_useMonitor = false;
+    setMonitorActive(false);
+    if (m_scanning)
+    {
+        ensureDiscoveryAgent();
+        discoveryAgent->start(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
+    }
+    emit scannerChanged();
+}
+
+void BleManager::setMonitorActive(bool active)
+{
+    if (m_monitorActive != active)
+    {
+        m_monitorActive = active;
+        emit monitorActiveChanged(active);
+    }
+}
+
+void BleManager::ensureDiscoveryAgent()
+{
+    if (discoveryAgent)
+    {
+        return;
+    }
+
     discoveryAgent = new QBluetoothDeviceDiscoveryAgent(this);
     discoveryAgent->setLowEnergyDiscoveryTimeout(0); // Continuous scanning
 
@@ -95,129 +165,232 @@ BleManager::BleManager(QObject *parent) : QObject(parent)
             this, &BleManager::onErrorOccurred);
 }
 
-BleManager::~BleManager()
+void BleManager::setScanNeeded(bool needed)
 {
-    delete discoveryAgent;
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, needed]() { setScanNeeded(needed); }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (m_scanNeeded == needed)
+    {
+        return;
+    }
+    m_scanNeeded = needed;
+    if (needed)
+    {
+        if (m_useMonitor)
+        {
+            startMonitor();
+        }
+        return;
+    }
+    if (m_monitor)
+    {
+        m_monitor->stop();
+    }
+    setMonitorActive(false);
+    m_lastAdvertisement.clear();
+}
+
+void BleManager::startMonitor()
+{
+    if (!m_monitor)
+    {
+        m_monitor = new AdvertisementMonitor(monitorBus(), QStringLiteral("org.bluez"), this);
+        connect(m_monitor, &AdvertisementMonitor::advertisementReceived, this, &BleManager::onAdvertisement);
+        connect(m_monitor, &AdvertisementMonitor::failed, this, &BleManager::onMonitorFailed);
+        connect(m_monitor, &AdvertisementMonitor::active, this, [this]()
+                { setMonitorActive(true); });
+        connect(m_monitor, &AdvertisementMonitor::inactive, this, [this]()
+                { setMonitorActive(false); });
+    }
+    LOG_DEBUG("Registering the BlueZ advertisement monitor");
+    m_monitor->start();
 }
 
 void BleManager::startScan()
 {
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, &BleManager::startScan, Qt::QueuedConnection);
+        return;
+    }
+
+    m_scanning = true;
+    if (m_useMonitor)
+    {
+        return; // Registered since setScanNeeded(); re-registering every phase would undo the offloading
+    }
     LOG_DEBUG("Starting BLE scan...");
+    m_lastAdvertisement.clear();
+    ensureDiscoveryAgent();
     discoveryAgent->start(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
+    m_scanning = discoveryAgent->isActive();
 }
 
 void BleManager::stopScan()
 {
-    LOG_DEBUG("Stopping BLE scan...");
-    discoveryAgent->stop();
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, &BleManager::stopScan, Qt::QueuedConnection);
+        return;
+    }
+
+    m_scanning = false;
+    if (discoveryAgent)
+    {
+        LOG_DEBUG("Stopping BLE scan...");
+        discoveryAgent->stop();
+    }
 }
 
 bool BleManager::isScanning() const
 {
-    return discoveryAgent->isActive();
+    return m_scanning;
 }
 
 void BleManager::onDeviceDiscovered(const QBluetoothDeviceInfo &info)
 {
+    static Metrics::Counter &advertsSeen = Metrics::counter("ble_adverts_seen_total");
+    advertsSeen.add();
+
     // Check for Apple's manufacturer ID (0x004C)
     if (info.manufacturerData().contains(0x004C))
     {
-        QByteArray data = info.manufacturerData().value(0x004C);
-        // Ensure data is long enough and starts with prefix 0x07 (indicates Proximity Pairing Message)
-        if (data.size() >= 10 && data[0] == 0x07)
-        {
-            QString address = info.address().toString();
-            BleInfo deviceInfo;
-            deviceInfo.name = info.name().isEmpty() ? "AirPods" : info.name();
-            deviceInfo.address = address;
-            deviceInfo.rawData = data.left(data.size() - 16);
-            deviceInfo.encryptedPayload = data.mid(data.size() - 16);
-
-            // data[1] is the length of the data, so we can skip it
-
-            // Check if pairing mode is paired (0x01) or pairing (0x00)
-            if (data[2] == 0x00)
-            {
-                return; // Skip pairing mode devices (the values are differently structured)
-            }
-
-            
-            // Parse device model (big-endian: high byte at data[3], low byte at data[4])
-            deviceInfo.modelName = getModelName(static_cast<quint16>(data[4]) | (static_cast<quint8>(data[3]) << 8));
-
-            // Status byte for primary pod and other flags
-            quint8 status = static_cast<quint8>(data[5]);
-            deviceInfo.status = status;
-
-            // Pods battery byte (upper nibble: one pod, lower nibble: other pod)
-            quint8 podsBatteryByte = static_cast<quint8>(data[6]);
-
-            // Flags and case battery byte (upper nibble: case battery, lower nibble: flags)
-            quint8 flagsAndCaseBattery = static_cast<quint8>(data[7]);
-
-            // Lid open counter and device color
-            quint8 lidIndicator = static_cast<quint8>(data[8]);
-            deviceInfo.color = getColorName((quint8)(data[9]));
-
-            deviceInfo.connectionState = static_cast<BleInfo::ConnectionState>(data[10]);
-
-            // Next: Encrypted Payload: 16 bytes
-
-            // Determine primary pod (bit 5 of status) and value flipping
-            bool primaryLeft = (status & 0x20) != 0; // Bit 5: 1 = left primary, 0 = right primary
-            bool areValuesFlipped = !primaryLeft;    // Flipped when right pod is primary
-
-            deviceInfo.primaryLeft = primaryLeft; // Store primary pod information
-
-            // Parse battery levels
-            int leftNibble = areValuesFlipped ? (podsBatteryByte >> 4) & 0x0F : podsBatteryByte & 0x0F;
-            int rightNibble = areValuesFlipped ? podsBatteryByte & 0x0F : (podsBatteryByte >> 4) & 0x0F;
-            deviceInfo.leftPodBattery = (leftNibble == 15) ? -1 : leftNibble * 10;
-            deviceInfo.rightPodBattery = (rightNibble == 15) ? -1 : rightNibble * 10;
-            int caseNibble = flagsAndCaseBattery & 0x0F; // Extracts lower nibble
-            deviceInfo.caseBattery = (caseNibble == 15) ? -1 : caseNibble * 10;
-
-            // Parse charging statuses from flags (uper 4 bits of data[7])
-            quint8 flags = (flagsAndCaseBattery >> 4) & 0x0F;                                        // Extracts lower nibble
-            deviceInfo.rightCharging = areValuesFlipped ? (flags & 0x01) != 0 : (flags & 0x02) != 0; // Depending on primary, bit 0 or 1
-            deviceInfo.leftCharging = areValuesFlipped ? (flags & 0x02) != 0 : (flags & 0x01) != 0;  // Depending on primary, bit 1 or 0
-            deviceInfo.caseCharging = (flags & 0x04) != 0;                                           // bit 2
-
-            // Additional status flags from status byte (data[5])
-            deviceInfo.isThisPodInTheCase = (status & 0x40) != 0; // Bit 6
-            deviceInfo.isOnePodInCase = (status & 0x10) != 0;     // Bit 4
-            deviceInfo.areBothPodsInCase = (status & 0x04) != 0;  // Bit 2
-
-            // In-ear detection with XOR logic
-            bool xorFactor = areValuesFlipped ^ deviceInfo.isThisPodInTheCase;
-            deviceInfo.isLeftPodInEar = xorFactor ? (status & 0x08) != 0 : (status & 0x02) != 0;  // Bit 3 or 1
-            deviceInfo.isRightPodInEar = xorFactor ? (status & 0x02) != 0 : (status & 0x08) != 0; // Bit 1 or 3
-
-            // Determine primary and secondary in-ear status
-            deviceInfo.isPrimaryInEar = primaryLeft ? deviceInfo.isLeftPodInEar : deviceInfo.isRightPodInEar;
-            deviceInfo.isSecondaryInEar = primaryLeft ? deviceInfo.isRightPodInEar : deviceInfo.isLeftPodInEar;
-
-            // Microphone status
-            deviceInfo.isLeftPodMicrophone = primaryLeft ^ deviceInfo.isThisPodInTheCase;
-            deviceInfo.isRightPodMicrophone = !primaryLeft ^ deviceInfo.isThisPodInTheCase;
-
-            deviceInfo.lidOpenCounter = lidIndicator & 0x07; // Extract bits 0-2 (count)
-            quint8 lidState = static_cast<quint8>((lidIndicator >> 3) & 0x01); // Extract bit 3 (lid state)
-            if (deviceInfo.isThisPodInTheCase) {
-                deviceInfo.lidState = static_cast<BleInfo::LidState>(lidState);
-            }
-
-            // Update timestamp
-            deviceInfo.lastSeen = QDateTime::currentDateTime();
-
-            emit deviceFound(deviceInfo); // Emit signal for device found
-        }
+        onAdvertisement(info.address().toString(), info.name(), info.rssi(), info.manufacturerData().value(0x004C));
     }
 }
 
+void BleManager::onAdvertisement(const QString &address, const QString &name, qint16 rssi, const QByteArray &advertisement)
+{
+    static Metrics::Counter &advertsMatched = Metrics::counter("ble_adverts_matched_total");
+    static Metrics::Counter &advertsRepeated = Metrics::counter("ble_adverts_repeated_total");
+    static Metrics::Counter &advertsFar = Metrics::counter("ble_adverts_far_total");
+
+    // The monitor reports RSSI changes on their own; those only feed the proximity estimate
+    if (advertisement.isEmpty())
+    {
+        m_proximity.update(address, rssi, Metrics::nowNs());
+        return;
+    }
+    // Ensure data is long enough and starts with prefix 0x07 (indicates Proximity Pairing Message)
+    const QByteArray &data = advertisement;
+    if (data.size() < 10 || data[0] != 0x07)
+    {
+        return;
+    }
+    advertsMatched.add();
+    QByteArray &lastAdvertisement = m_lastAdvertisement[address];
+    if (lastAdvertisement == data)
+    {
+        advertsRepeated.add();
+    }
+    else
+    {
+        lastAdvertisement = data;
+    }
+
+    // Receivers ignore AirPods across the room, but still get to see them
+    const ProximityEstimator::Estimate proximity = m_proximity.update(address, rssi, Metrics::nowNs());
+    if (!proximity.near)
+    {
+        advertsFar.add();
+    }
+
+    BleInfo deviceInfo;
+    deviceInfo.name = name.isEmpty() ? "AirPods" : name;
+    deviceInfo.address = address;
+    deviceInfo.rawData = data.left(data.size() - 16);
+    deviceInfo.encryptedPayload = data.mid(data.size() - 16);
+    deviceInfo.rssi = static_cast<qint16>(qRound(proximity.rssi));
+    deviceInfo.near = proximity.near;
+    deviceInfo.proximityConfidence = proximity.confidence;
+
+    // data[1] is the length of the data, so we can skip it
+
+    // Check if pairing mode is paired (0x01) or pairing (0x00)
+    if (data[2] == 0x00)
+    {
+        return; // Skip pairing mode devices (the values are differently structured)
+    }
+
+    
+    // Parse device model (big-endian: high byte at data[3], low byte at data[4])
+    deviceInfo.modelName = getModelName(static_cast<quint16>(data[4]) | (static_cast<quint8>(data[3]) << 8));
+
+    // Status byte for primary pod and other flags
+    quint8 status = static_cast<quint8>(data[5]);
+    deviceInfo.status = status;
+
+    // Pods battery byte (upper nibble: one pod, lower nibble: other pod)
+    quint8 podsBatteryByte = static_cast<quint8>(data[6]);
+
+    // Flags and case battery byte (upper nibble: case battery, lower nibble: flags)
+    quint8 flagsAndCaseBattery = static_cast<quint8>(data[7]);
+
+    // Lid open counter and device color
+    quint8 lidIndicator = static_cast<quint8>(data[8]);
+    deviceInfo.color = getColorName((quint8)(data[9]));
+
+    deviceInfo.connectionState = static_cast<BleInfo::ConnectionState>(data[10]);
+
+    // Next: Encrypted Payload: 16 bytes
+
+    // Determine primary pod (bit 5 of status) and value flipping
+    bool primaryLeft = (status & 0x20) != 0; // Bit 5: 1 = left primary, 0 = right primary
+    bool areValuesFlipped = !primaryLeft;    // Flipped when right pod is primary
+
+    deviceInfo.primaryLeft = primaryLeft; // Store primary pod information
+
+    // Parse battery levels
+    int leftNibble = areValuesFlipped ? (podsBatteryByte >> 4) & 0x0F : podsBatteryByte & 0x0F;
+    int rightNibble = areValuesFlipped ? podsBatteryByte & 0x0F : (podsBatteryByte >> 4) & 0x0F;
+    deviceInfo.leftPodBattery = (leftNibble == 15) ? -1 : leftNibble * 10;
+    deviceInfo.rightPodBattery = (rightNibble == 15) ? -1 : rightNibble * 10;
+    int caseNibble = flagsAndCaseBattery & 0x0F; // Extracts lower nibble
+    deviceInfo.caseBattery = (caseNibble == 15) ? -1 : caseNibble * 10;
+
+    // Parse charging statuses from flags (uper 4 bits of data[7])
+    quint8 flags = (flagsAndCaseBattery >> 4) & 0x0F;                                        // Extracts lower nibble
+    deviceInfo.rightCharging = areValuesFlipped ? (flags & 0x01) != 0 : (flags & 0x02) != 0; // Depending on primary, bit 0 or 1
+    deviceInfo.leftCharging = areValuesFlipped ? (flags & 0x02) != 0 : (flags & 0x01) != 0;  // Depending on primary, bit 1 or 0
+    deviceInfo.caseCharging = (flags & 0x04) != 0;                                           // bit 2
+
+    // Additional status flags from status byte (data[5])
+    deviceInfo.isThisPodInTheCase = (status & 0x40) != 0; // Bit 6
+    deviceInfo.isOnePodInCase = (status & 0x10) != 0;     // Bit 4
+    deviceInfo.areBothPodsInCase = (status & 0x04) != 0;  // Bit 2
+
+    // In-ear detection with XOR logic
+    bool xorFactor = areValuesFlipped ^ deviceInfo.isThisPodInTheCase;
+    deviceInfo.isLeftPodInEar = xorFactor ? (status & 0x08) != 0 : (status & 0x02) != 0;  // Bit 3 or 1
+    deviceInfo.isRightPodInEar = xorFactor ? (status & 0x02) != 0 : (status & 0x08) != 0; // Bit 1 or 3
+
+    // Determine primary and secondary in-ear status
+    deviceInfo.isPrimaryInEar = primaryLeft ? deviceInfo.isLeftPodInEar : deviceInfo.isRightPodInEar;
+    deviceInfo.isSecondaryInEar = primaryLeft ? deviceInfo.isRightPodInEar : deviceInfo.isLeftPodInEar;
+
+    // Microphone status
+    deviceInfo.isLeftPodMicrophone = primaryLeft ^ deviceInfo.isThisPodInTheCase;
+    deviceInfo.isRightPodMicrophone = !primaryLeft ^ deviceInfo.isThisPodInTheCase;
+
+    deviceInfo.lidOpenCounter = lidIndicator & 0x07; // Extract bits 0-2 (count)
+    quint8 lidState = static_cast<quint8>((lidIndicator >> 3) & 0x01); // Extract bit 3 (lid state)
+    if (deviceInfo.isThisPodInTheCase) {
+        deviceInfo.lidState = static_cast<BleInfo::LidState>(lidState);
+    }
+
+    // Update timestamp
+    deviceInfo.lastSeen = QDateTime::currentDateTime();
+
+    emit deviceFound(deviceInfo); // Emit signal for device found
+}
+
 void BleManager::onScanFinished()
 {
-    if (discoveryAgent->isActive())
+    if (m_scanning)
     {
         discoveryAgent->start(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
     }
@@ -3,12 +3,16 @@
 
 #include <QObject>
 #include <QBluetoothDeviceDiscoveryAgent>
+#include <QHash>
 #include <QMap>
 #include <QString>
 #include <QDateTime>
+#include <atomic>
 #include "enums.h"
+#include "proximityestimator.h"
 
 class QTimer;
+class AdvertisementMonitor;
 
 class BleInfo
 {
@@ -27,6 +31,9 @@ public:
     quint8 status = 0;
     QByteArray rawData;
     QByteArray encryptedPayload; // 16 bytes of encrypted payload
+    qint16 rssi = 0; // Filtered, see ProximityEstimator; 0 if the adapter does not report it
+    bool near = true; // False for AirPods across the room, which should not be shown or connected
+    qreal proximityConfidence = 0; // How much to trust near, 0..1
 
     // Additional status flags from Kotlin version
     bool isLeftPodInEar = false;
@@ -62,6 +69,7 @@ public:
 
     QDateTime lastSeen; // Timestamp of last detection
 };
+Q_DECLARE_METATYPE(BleInfo)
 
 class BleManager : public QObject
 {
@@ -70,20 +78,48 @@ public:
     explicit BleManager(QObject *parent = nullptr);
     ~BleManager();
 
+    // Safe to call from any thread; the scan itself runs on the thread this object lives in.
+    // setScanNeeded() says whether advertisements are wanted at all: the BlueZ monitor stays
+    // registered for as long as they are, and bluetoothd paces it. startScan() and stopScan()
+    // are the duty cycle, which only the discovery agent follows.
+    void setScanNeeded(bool needed);
     void startScan();
     void stopScan();
     bool isScanning() const;
+    // False while the BlueZ monitor is in use, which ignores startScan() and stopScan()
+    bool followsDutyCycle() const { return !m_useMonitor; }
 
 private slots:
     void onDeviceDiscovered(const QBluetoothDeviceInfo &info);
+    void onAdvertisement(const QString &address, const QString &name, qint16 rssi, const QByteArray &data);
     void onScanFinished();
     void onErrorOccurred(QBluetoothDeviceDiscoveryAgent::Error error);
 
 signals:
+    // Far advertisers too: BleInfo::near and proximityConfidence tell the receiver how close
     void deviceFound(const BleInfo &device);
+    // BlueZ is or is no longer scanning for the monitor
+    void monitorActiveChanged(bool active);
+    // The monitor is gone for good and the discovery agent took over; followsDutyCycle() changed
+    void scannerChanged();
 
 private:
-    QBluetoothDeviceDiscoveryAgent *discoveryAgent;
+    void ensureDiscoveryAgent();
+    void startMonitor();
+    void onMonitorFailed();
+    void setMonitorActive(bool active);
+
+    // BlueZ filters for us through an AdvertisementMonitor where it can; otherwise every
+    // advertisement comes through the discovery agent and is filtered here
+    std::atomic<bool> m_useMonitor;
+    bool m_monitorActive = false;
+    AdvertisementMonitor *m_monitor = nullptr;
+    QBluetoothDeviceDiscoveryAgent *discoveryAgent = nullptr;
+    bool m_scanNeeded = false;
+    std::atomic<bool> m_scanning{false}; // In an on phase of the duty cycle
+    QHash<QString, QByteArray> m_lastAdvertisement; // Per address, to count repeats
+    ProximityEstimator m_proximity;
+
 };
 
 #endif // BLEMANAGER_H
\ No newline at end of file
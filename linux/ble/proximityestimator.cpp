@@ -0,0 +1,68 @@
+#include "proximityestimator.h"
+
+#include <QtMath>
+
+namespace
+{
+    constexpr qreal INITIAL_VARIANCE = 100.0;    // (10 dB)^2: nothing known yet
+    constexpr qreal MEASUREMENT_VARIANCE = 16.0; // (4 dB)^2 between advertisements
+    constexpr qreal DRIFT_PER_SECOND = 4.0;      // How fast the true RSSI can move (someone walking)
+    constexpr qreal NEAR_DBM = -72.0;
+    constexpr qreal FAR_DBM = -80.0;
+    constexpr int CONFIDENT_SAMPLES = 3;         // A low variance from fewer samples is not trusted fully
+    // Random addresses rotate every few minutes; forget them all rather than track their age
+    constexpr int MAX_TRACKS = 256;
+}
+
+ProximityEstimator::Estimate ProximityEstimator::update(const QString &address, qint16 rssi, qint64 nowNs)
+{
+    Estimate estimate;
+    auto it = m_tracks.find(address);
+    if (rssi == 0)
+    {
+        // Some adapters do not report RSSI at all; never hide a device because of that
+        if (it == m_tracks.end())
+        {
+            return estimate;
+        }
+    }
+    else if (it == m_tracks.end())
+    {
+        if (m_tracks.size() >= MAX_TRACKS)
+        {
+            m_tracks.clear();
+        }
+        // One sample is not enough to call it far unless it is clearly so; a rotated address
+        // would otherwise lose its first advertisement every time
+        it = m_tracks.insert(address, Track{rssi, INITIAL_VARIANCE, nowNs, 1, rssi >= FAR_DBM});
+    }
+    else
+    {
+        // Predict: the longer we have not heard from it, the less we know
+        const qreal elapsed = qMax<qint64>(nowNs - it->updatedNs, 0) / 1e9;
+        it->variance = qMin(it->variance + DRIFT_PER_SECOND * elapsed, INITIAL_VARIANCE);
+        // Correct
+        const qreal gain = it->variance / (it->variance + MEASUREMENT_VARIANCE);
+        it->rssi += gain * (rssi - it->rssi);
+        it->variance *= 1 - gain;
+        it->updatedNs = nowNs;
+        it->samples = qMin(it->samples + 1, CONFIDENT_SAMPLES);
+    }
+
+    estimate.rssi = it->rssi;
+    estimate.confidence = qBound(0.0, 1.0 - qSqrt(it->variance / INITIAL_VARIANCE), 1.0)
+                          * it->samples / CONFIDENT_SAMPLES;
+    if (estimate.confidence >= MIN_CONFIDENCE)
+    {
+        if (it->rssi >= NEAR_DBM)
+        {
+            it->near = true;
+        }
+        else if (it->rssi < FAR_DBM)
+        {
+            it->near = false;
+        }
+    }
+    estimate.near = it->near;
+    return estimate;
+}
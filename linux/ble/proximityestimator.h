@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+
+/**
+ * Per-address RSSI filter that tells whether an advertiser is near.
+ *
+ * Each address gets a one-dimensional Kalman filter on the RSSI in dBm. Single
+ * advertisements are noisy (a few dB from one to the next, more when a body is in the
+ * way), so the filter's variance, together with how many samples it has seen, doubles as
+ * a confidence: it grows with every sample and shrinks again while an address is not heard
+ * from. An address counts as near once
+ * the filtered RSSI rises above NEAR_DBM and stays near until it falls below FAR_DBM,
+ * so a pair at the edge of the range does not flap. The first advertisement from an address,
+ * e.g. right after a random address rotated, is only held against that address when it is
+ * already below FAR_DBM; otherwise it counts as near until the filter is confident.
+ * Callers that act on nearness rather than just display it should also check the confidence.
+ *
+ * Not thread-safe; BleManager uses it from the thread it scans on.
+ */
+class ProximityEstimator
+{
+public:
+    // Below this the previous near/far decision stands
+    static constexpr qreal MIN_CONFIDENCE = 0.5;
+
+    struct Estimate
+    {
+        qreal rssi = 0; // Filtered, in dBm
+        qreal confidence = 0; // 0..1; stays 0 while nothing is known
+        bool near = true;
+    };
+
+    // rssi is what the adapter reported; 0 means no new measurement, and the current estimate is returned
+    Estimate update(const QString &address, qint16 rssi, qint64 nowNs);
+
+private:
+    struct Track
+    {
+        qreal rssi = 0;
+        qreal variance = 0;
+        qint64 updatedNs = 0;
+        int samples = 0; // Up to CONFIDENT_SAMPLES
+        bool near = false;
+    };
+
+    QHash<QString, Track> m_tracks;
+};
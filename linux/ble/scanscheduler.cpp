@@ -0,0 +1,276 @@
+#include "scanscheduler.h"
+#include "blemanager.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QMetaEnum>
+#include <QTimer>
+
+namespace
+{
+    struct DutyCycle
+    {
+        int onMs;
+        int offMs; // 0 for continuous
+    };
+
+    constexpr int BURST_MS = 30000;
+    constexpr int ABSENT_AFTER_MS = 5 * 60 * 1000;
+
+    DutyCycle dutyCycleFor(ScanScheduler::Mode mode)
+    {
+        switch (mode)
+        {
+        case ScanScheduler::Mode::Burst:
+            return {BURST_MS, 0};
+        case ScanScheduler::Mode::Active:
+            return {5000, 5000};
+        case ScanScheduler::Mode::Relaxed:
+            return {3000, 27000};
+        case ScanScheduler::Mode::Bounded:
+            return {2000, 28000};
+        case ScanScheduler::Mode::Off:
+        case ScanScheduler::Mode::Paused:
+            break;
+        }
+        return {0, 0};
+    }
+}
+
+ScanScheduler::ScanScheduler(BleManager *bleManager, QObject *parent)
+    : QObject(parent), m_bleManager(bleManager), m_phaseTimer(new QTimer(this)), m_burstTimer(new QTimer(this)),
+      m_absenceTimer(new QTimer(this))
+{
+    m_phaseTimer->setSingleShot(true);
+    m_burstTimer->setSingleShot(true);
+    m_absenceTimer->setSingleShot(true);
+    connect(m_phaseTimer, &QTimer::timeout, this, &ScanScheduler::onPhaseTimeout);
+    connect(m_burstTimer, &QTimer::timeout, this, &ScanScheduler::evaluate);
+    connect(m_absenceTimer, &QTimer::timeout, this, [this]()
+    {
+        LOG_DEBUG("No known AirPods seen for " << ABSENT_AFTER_MS / 1000 << " s, scanning less often");
+        m_absent = true;
+        evaluate();
+    });
+    connect(m_bleManager, &BleManager::monitorActiveChanged, this, [this](bool active)
+    {
+        m_monitorActive = active;
+        if (!m_bleManager->followsDutyCycle())
+        {
+            setRadioOn(active);
+        }
+    });
+    // The discovery agent took over from the monitor; it needs the duty cycle from now on
+    connect(m_bleManager, &BleManager::scannerChanged, this, [this]()
+    {
+        setScanning(false);
+        applyMode();
+    });
+}
+
+void ScanScheduler::setNeeded(bool needed)
+{
+    if (m_needed != needed)
+    {
+        m_needed = needed;
+        if (needed)
+        {
+            m_absent = false;
+            m_absenceTimer->start(ABSENT_AFTER_MS);
+        }
+        evaluate();
+    }
+}
+
+void ScanScheduler::setSomeConnected(bool connected)
+{
+    if (m_someConnected != connected)
+    {
+        m_someConnected = connected;
+        evaluate();
+    }
+}
+
+void ScanScheduler::setWatchingCalls(bool watching)
+{
+    if (m_watchingCalls != watching)
+    {
+        m_watchingCalls = watching;
+        evaluate();
+    }
+}
+
+void ScanScheduler::setOnBattery(bool onBattery)
+{
+    if (m_onBattery != onBattery)
+    {
+        m_onBattery = onBattery;
+        evaluate();
+    }
+}
+
+void ScanScheduler::setScreenLocked(bool locked)
+{
+    if (m_screenLocked != locked)
+    {
+        m_screenLocked = locked;
+        evaluate();
+    }
+}
+
+void ScanScheduler::setSleeping(bool sleeping)
+{
+    if (m_sleeping != sleeping)
+    {
+        m_sleeping = sleeping;
+        evaluate();
+    }
+}
+
+void ScanScheduler::boost(const char *reason)
+{
+    LOG_DEBUG("Scanning continuously for " << BURST_MS / 1000 << " s: " << reason);
+    m_burstTimer->start(BURST_MS);
+    m_absent = false;
+    m_absenceTimer->start(ABSENT_AFTER_MS);
+    evaluate();
+}
+
+void ScanScheduler::onKnownDeviceSeen()
+{
+    m_absenceTimer->start(ABSENT_AFTER_MS);
+    if (m_absent)
+    {
+        m_absent = false;
+        evaluate();
+    }
+}
+
+void ScanScheduler::evaluate()
+{
+    Mode mode;
+    if ((!m_needed && !m_watchingCalls) || m_sleeping)
+    {
+        mode = Mode::Off;
+    }
+    else if (m_onBattery && m_screenLocked)
+    {
+        mode = Mode::Paused;
+    }
+    else if (!m_needed)
+    {
+        mode = Mode::Bounded; // Nothing to find, only the call state to follow
+    }
+    else if (m_burstTimer->isActive())
+    {
+        mode = Mode::Burst;
+    }
+    else if (m_someConnected)
+    {
+        mode = Mode::Bounded;
+    }
+    else if (m_absent)
+    {
+        mode = Mode::Relaxed;
+    }
+    else
+    {
+        mode = Mode::Active;
+    }
+
+    if (mode == m_mode)
+    {
+        return;
+    }
+    const QMetaEnum modes = QMetaEnum::fromType<Mode>();
+    LOG_INFO("BLE scan mode: " << modes.valueToKey(static_cast<int>(m_mode)) << " -> "
+             << modes.valueToKey(static_cast<int>(mode)) << " (" << onTimeNs() / 1000000 << " ms scanned so far)");
+    // Close the running phase so its time is counted against the mode it belonged to
+    setScanning(false);
+    setRadioOn(false);
+    m_mode = mode;
+    if (!m_bleManager->followsDutyCycle())
+    {
+        setRadioOn(m_monitorActive); // Until BlueZ says otherwise
+    }
+    applyMode();
+    emit modeChanged(mode);
+}
+
+void ScanScheduler::applyMode()
+{
+    const DutyCycle cycle = dutyCycleFor(m_mode);
+    m_bleManager->setScanNeeded(cycle.onMs > 0);
+    if (cycle.onMs > 0)
+    {
+        setScanning(true);
+        if (cycle.offMs > 0 && m_bleManager->followsDutyCycle())
+        {
+            m_phaseTimer->start(cycle.onMs);
+        }
+        else
+        {
+            m_phaseTimer->stop();
+        }
+    }
+    else
+    {
+        m_phaseTimer->stop();
+    }
+}
+
+void ScanScheduler::onPhaseTimeout()
+{
+    const DutyCycle cycle = dutyCycleFor(m_mode);
+    if (cycle.offMs == 0 || !m_bleManager->followsDutyCycle())
+    {
+        return;
+    }
+    setScanning(!m_scanning);
+    m_phaseTimer->start(m_scanning ? cycle.onMs : cycle.offMs);
+}
+
+void ScanScheduler::setScanning(bool scanning)
+{
+    if (m_scanning == scanning)
+    {
+        return;
+    }
+    m_scanning = scanning;
+    if (scanning)
+    {
+        m_bleManager->startScan();
+    }
+    else
+    {
+        m_bleManager->stopScan();
+    }
+    if (m_bleManager->followsDutyCycle())
+    {
+        setRadioOn(scanning);
+    }
+}
+
+void ScanScheduler::setRadioOn(bool on)
+{
+    if (m_radioOn == on)
+    {
+        return;
+    }
+    m_radioOn = on;
+    if (on)
+    {
+        m_radioOnSinceNs = Metrics::nowNs();
+        return;
+    }
+
+    static Metrics::CounterFamily &onTimeByMode = Metrics::counterFamily("ble_scan_on_ms_total", "mode");
+    const qint64 elapsedNs = Metrics::nowNs() - m_radioOnSinceNs;
+    m_onTimeNs += elapsedNs;
+    onTimeByMode.at(static_cast<quint8>(m_mode)).add(elapsedNs / 1000000);
+}
+
+qint64 ScanScheduler::onTimeNs() const
+{
+    return m_onTimeNs + (m_radioOn ? Metrics::nowNs() - m_radioOnSinceNs : 0);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QObject>
+
+class BleManager;
+class QTimer;
+
+/**
+ * Decides when BleManager scans, instead of scanning nonstop.
+ *
+ * Continuous LE scanning keeps the radio busy and costs battery, and most of the time
+ * nothing is waiting to be seen. The scheduler picks a duty cycle from what is going on:
+ *
+ *   Burst    continuously for a while after a disconnect, a lid opening, wake-up or startup
+ *   Active   half the time while known AirPods were seen recently
+ *   Relaxed  a few seconds every half minute once they have been absent for a while
+ *   Bounded  briefly, while some AirPods are connected and others are not, or while
+ *            every pair is connected but the active one's call state is wanted
+ *   Paused   on battery with the screen locked
+ *   Off      when every known pair is connected and no call state is wanted, or while
+ *            the system sleeps
+ *
+ * Only the discovery agent follows the on and off phases. With the BlueZ advertisement
+ * monitor the modes come down to on or off: the monitor is registered whenever the mode
+ * scans at all and bluetoothd paces the scanning on its own. ble_scan_on_ms_total counts,
+ * per mode, the on phases of the agent or the time the monitor was actually active.
+ */
+class ScanScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Mode
+    {
+        Off,
+        Burst,
+        Active,
+        Relaxed,
+        Bounded,
+        Paused,
+    };
+    Q_ENUM(Mode)
+
+    explicit ScanScheduler(BleManager *bleManager, QObject *parent = nullptr);
+
+    // Whether any known AirPods can only be seen over BLE right now
+    void setNeeded(bool needed);
+    void setSomeConnected(bool connected);
+    // The active AirPods are connected; whether they are in a call is only advertised over BLE
+    void setWatchingCalls(bool watching);
+    void setOnBattery(bool onBattery);
+    void setScreenLocked(bool locked);
+    void setSleeping(bool sleeping);
+
+    // Scan continuously for a while; reason is only logged
+    void boost(const char *reason);
+    // Known AirPods were heard from, so they are not absent
+    void onKnownDeviceSeen();
+
+    Mode mode() const { return m_mode; }
+    // Total time spent scanning so far
+    qint64 onTimeNs() const;
+
+signals:
+    void modeChanged(ScanScheduler::Mode mode);
+
+private:
+    void evaluate();
+    void applyMode();
+    void onPhaseTimeout();
+    void setScanning(bool scanning);
+    void setRadioOn(bool on);
+
+    BleManager *m_bleManager;
+    QTimer *m_phaseTimer;    // End of the current on or off phase
+    QTimer *m_burstTimer;    // End of the burst
+    QTimer *m_absenceTimer;  // Active -> Relaxed
+    Mode m_mode = Mode::Off;
+    bool m_needed = false;
+    bool m_someConnected = false;
+    bool m_watchingCalls = false;
+    bool m_onBattery = false;
+    bool m_screenLocked = false;
+    bool m_sleeping = false;
+    bool m_absent = false;
+    bool m_scanning = false; // In an on phase
+    bool m_monitorActive = false;
+    bool m_radioOn = false; // What onTimeNs() counts
+    qint64 m_radioOnSinceNs = 0;
+    qint64 m_onTimeNs = 0; // Finished scan phases
+};
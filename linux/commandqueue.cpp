@@ -0,0 +1,183 @@
+#include "commandqueue.h"
+#include "airpods_packets.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QTimer>
+
+#include <utility>
+
+namespace
+{
+    constexpr int MIN_INTERVAL_MS = 100;
+    constexpr int ACK_TIMEOUT_MS = 1000;
+
+    std::optional<quint8> identifierOf(const QByteArray &packet)
+    {
+        if (packet.size() <= ControlCommand::HEADER.size() || !packet.startsWith(ControlCommand::HEADER))
+        {
+            return std::nullopt;
+        }
+        return static_cast<quint8>(packet.at(ControlCommand::HEADER.size()));
+    }
+}
+
+CommandQueue::CommandQueue(QObject *parent) : QObject(parent)
+{
+}
+
+quint64 CommandQueue::keyFor(const QBluetoothAddress &address, quint8 identifier)
+{
+    // Addresses are 48 bits, which leaves the low byte for the identifier
+    return address.toUInt64() << 8 | identifier;
+}
+
+CommandQueue::Command &CommandQueue::commandFor(quint64 key)
+{
+    Command &command = m_commands[key];
+    if (!command.timer)
+    {
+        command.timer = new QTimer(this);
+        command.timer->setSingleShot(true);
+        connect(command.timer, &QTimer::timeout, this, [this, key]() { onTimeout(key); });
+    }
+    return command;
+}
+
+void CommandQueue::submit(const QBluetoothAddress &address, const QByteArray &packet, std::function<void()> rollback)
+{
+    const std::optional<quint8> identifier = identifierOf(packet);
+    if (!identifier)
+    {
+        LOG_WARN("Not a control command, writing it as is: " << packet.toHex());
+        emit writeRequested(address, packet);
+        return;
+    }
+
+    const quint64 key = keyFor(address, *identifier);
+    Command &command = commandFor(key);
+    if (command.inFlight.isEmpty() && command.pending.isEmpty())
+    {
+        // Later writes keep this one: it restores what was there before any of them
+        command.rollback = std::move(rollback);
+        command.confirmed.clear();
+    }
+    if (!command.pending.isEmpty())
+    {
+        static Metrics::Counter &coalesced = Metrics::counter("control_commands_coalesced_total");
+        coalesced.add();
+    }
+    command.pending = packet;
+    if (command.inFlight.isEmpty() && !command.timer->isActive())
+    {
+        sendPendingLater(key, command);
+    }
+}
+
+void CommandQueue::sendPendingLater(quint64 key, Command &command)
+{
+    const qint64 elapsedMs = (Metrics::nowNs() - command.sentNs) / 1000000;
+    if (command.sentNs == 0 || elapsedMs >= MIN_INTERVAL_MS)
+    {
+        send(key, command);
+        return;
+    }
+    command.timer->start(MIN_INTERVAL_MS - static_cast<int>(elapsedMs));
+}
+
+void CommandQueue::send(quint64 key, Command &command)
+{
+    static Metrics::Counter &sent = Metrics::counter("control_commands_sent_total");
+    sent.add();
+    command.inFlight = std::exchange(command.pending, QByteArray());
+    command.sentNs = Metrics::nowNs();
+    command.timer->start(ACK_TIMEOUT_MS);
+    emit writeRequested(QBluetoothAddress(key >> 8), command.inFlight);
+}
+
+bool CommandQueue::onNotification(const QBluetoothAddress &address, const QByteArray &packet)
+{
+    const std::optional<quint8> identifier = identifierOf(packet);
+    if (!identifier)
+    {
+        return true;
+    }
+    const auto it = m_commands.find(keyFor(address, *identifier));
+    if (it == m_commands.end())
+    {
+        return true;
+    }
+
+    // Any notification of this kind counts: the AirPods may have settled on another value
+    if (!it->inFlight.isEmpty())
+    {
+        static Metrics::Histogram &acknowledged = Metrics::histogram("control_command_ack");
+        acknowledged.record(Metrics::nowNs() - it->sentNs);
+        it->inFlight.clear();
+        it->timer->stop();
+    }
+    if (it->pending.isEmpty())
+    {
+        it->rollback = nullptr;
+        it->confirmed.clear();
+        return true;
+    }
+    it->confirmed = packet;
+    if (!it->timer->isActive())
+    {
+        sendPendingLater(it.key(), *it);
+    }
+    return false;
+}
+
+void CommandQueue::onTimeout(quint64 key)
+{
+    Command &command = commandFor(key);
+    if (command.inFlight.isEmpty())
+    {
+        // The rate limit delay is over
+        if (!command.pending.isEmpty())
+        {
+            send(key, command);
+        }
+        return;
+    }
+
+    static Metrics::Counter &timeouts = Metrics::counter("control_command_timeouts_total");
+    timeouts.add();
+    const QByteArray unacknowledged = std::exchange(command.inFlight, QByteArray());
+    if (!command.pending.isEmpty())
+    {
+        // The newer command may still get through, and decides the state if it does
+        LOG_WARN("No acknowledgement for control command " << unacknowledged.toHex() << ", sending the next one");
+        send(key, command);
+        return;
+    }
+
+    LOG_WARN("No acknowledgement for control command " << unacknowledged.toHex() << ", rolling back");
+    const QByteArray confirmed = std::exchange(command.confirmed, QByteArray());
+    const std::function<void()> rollback = std::exchange(command.rollback, nullptr);
+    if (!confirmed.isEmpty())
+    {
+        emit replayRequested(QBluetoothAddress(key >> 8), confirmed);
+    }
+    else if (rollback)
+    {
+        rollback();
+    }
+}
+
+void CommandQueue::clear(const QBluetoothAddress &address)
+{
+    for (auto it = m_commands.begin(); it != m_commands.end(); ++it)
+    {
+        if (it.key() >> 8 == address.toUInt64())
+        {
+            it->timer->stop();
+            it->inFlight.clear();
+            it->pending.clear();
+            it->rollback = nullptr;
+            it->confirmed.clear();
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QObject>
+#include <QBluetoothAddress>
+#include <QByteArray>
+#include <QHash>
+
+#include <functional>
+
+class QTimer;
+
+/**
+ * Paces control commands (04 00 04 00 09 00 <identifier> ...) to each pair of AirPods.
+ *
+ * The AirPods echo every control command they apply as a notification with the same
+ * identifier, which serves as the acknowledgement. Per device and identifier at most one
+ * command is unacknowledged at a time, and commands are at least MIN_INTERVAL_MS apart.
+ * Anything written meanwhile waits, and a newer write replaces it (latest wins), so
+ * dragging a slider sends a handful of packets instead of one per step and does not hold
+ * up battery and ear detection notifications behind them.
+ *
+ * Callers update their state optimistically and hand submit() a rollback. When no echo
+ * arrives in time, the state is put back as it was before the first unacknowledged write.
+ * The queue does not write by itself: it asks through writeRequested().
+ */
+class CommandQueue : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CommandQueue(QObject *parent = nullptr);
+
+    // Sends a control command, or queues it behind the one of the same kind that is in flight
+    void submit(const QBluetoothAddress &address, const QByteArray &packet, std::function<void()> rollback = nullptr);
+    // Forgets everything for a device, e.g. once its link is gone; nothing is rolled back
+    void clear(const QBluetoothAddress &address);
+
+    // For every packet from the AirPods. False for the echo of a command that a newer one is
+    // about to overwrite, which should not be shown; it becomes the state to roll back to.
+    bool onNotification(const QBluetoothAddress &address, const QByteArray &packet);
+
+signals:
+    void writeRequested(const QBluetoothAddress &address, const QByteArray &packet);
+    // Rolling back to a state the AirPods confirmed; parse it like any other packet
+    void replayRequested(const QBluetoothAddress &address, const QByteArray &packet);
+
+private:
+    struct Command
+    {
+        QByteArray inFlight; // Sent, not acknowledged yet
+        QByteArray pending; // Newest write waiting for its turn
+        std::function<void()> rollback; // Restores the state from before the first unacknowledged write
+        QByteArray confirmed; // Withheld echo, restored instead of rollback when set
+        qint64 sentNs = 0;
+        QTimer *timer = nullptr; // Acknowledgement timeout, or the rate limit delay
+    };
+
+    static quint64 keyFor(const QBluetoothAddress &address, quint8 identifier);
+    Command &commandFor(quint64 key);
+    void send(quint64 key, Command &command);
+    void sendPendingLater(quint64 key, Command &command);
+    void onTimeout(quint64 key);
+
+    QHash<quint64, Command> m_commands;
+};
@@ -0,0 +1,197 @@
+#include "connectionsupervisor.h"
+#include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <QMetaEnum>
+#include <QRandomGenerator>
+#include <QTimer>
+
+namespace
+{
+    constexpr int CONNECT_TIMEOUT_MS = 15000; // Paging a device that is out of range gives up well before this
+    constexpr int HANDSHAKE_TIMEOUT_MS = 5000;
+    constexpr int BACKOFF_BASE_MS = 1000;
+    constexpr int BACKOFF_MAX_MS = 30000;
+
+    // Half of the exponential delay is fixed and half is random, so devices that failed
+    // together (e.g. the adapter was reset) do not all retry in the same instant
+    int backoffDelay(int failures)
+    {
+        const int exponential = BACKOFF_BASE_MS << qMin(failures - 1, 5);
+        const int delay = qMin(exponential, BACKOFF_MAX_MS);
+        return delay / 2 + QRandomGenerator::global()->bounded(delay / 2 + 1);
+    }
+}
+
+ConnectionSupervisor::ConnectionSupervisor(QObject *parent) : QObject(parent)
+{
+}
+
+ConnectionSupervisor::Device &ConnectionSupervisor::deviceFor(const QBluetoothAddress &address)
+{
+    Device &device = m_devices[address.toUInt64()];
+    if (!device.timer)
+    {
+        device.timer = new QTimer(this);
+        device.timer->setSingleShot(true);
+        connect(device.timer, &QTimer::timeout, this, [this, address]() { onTimeout(address); });
+    }
+    return device;
+}
+
+ConnectionSupervisor::State ConnectionSupervisor::state(const QBluetoothAddress &address) const
+{
+    const auto it = m_devices.constFind(address.toUInt64());
+    return it != m_devices.constEnd() ? it->state : State::Idle;
+}
+
+void ConnectionSupervisor::setState(const QBluetoothAddress &address, Device &device, State state)
+{
+    if (device.state != state)
+    {
+        const QMetaEnum states = QMetaEnum::fromType<State>();
+        LOG_DEBUG("Connection to " << address.toString() << ": " << states.valueToKey(static_cast<int>(device.state))
+                  << " -> " << states.valueToKey(static_cast<int>(state)));
+        device.state = state;
+        emit stateChanged(address, state);
+    }
+}
+
+void ConnectionSupervisor::connectDevice(const QBluetoothAddress &address)
+{
+    Device &device = deviceFor(address);
+    if (device.state != State::Idle)
+    {
+        LOG_DEBUG("Connection to " << address.toString() << " already in progress");
+        return;
+    }
+    device.attempts = 0;
+    device.startedNs = Metrics::nowNs();
+    attempt(address, device);
+}
+
+void ConnectionSupervisor::attempt(const QBluetoothAddress &address, Device &device)
+{
+    static Metrics::Counter &attempts = Metrics::counter("connect_attempts_total");
+    attempts.add();
+    ++device.attempts;
+    LOG_INFO("Connecting to " << address.toString() << " (attempt " << device.attempts << " of " << m_maxAttempts << ")");
+    device.timer->start(CONNECT_TIMEOUT_MS);
+    setState(address, device, State::Connecting);
+    emit connectRequested(address);
+}
+
+void ConnectionSupervisor::cancel(const QBluetoothAddress &address)
+{
+    const auto it = m_devices.find(address.toUInt64());
+    if (it == m_devices.end() || it->state == State::Idle)
+    {
+        return;
+    }
+    LOG_INFO("No longer connecting to " << address.toString());
+    it->timer->stop();
+    setState(address, *it, State::Idle);
+}
+
+void ConnectionSupervisor::onConnected(const QBluetoothAddress &address)
+{
+    Device &device = deviceFor(address);
+    if (device.state != State::Connecting)
+    {
+        return;
+    }
+    device.timer->start(HANDSHAKE_TIMEOUT_MS);
+    setState(address, device, State::Handshaking);
+}
+
+void ConnectionSupervisor::onPacketReceived(const QBluetoothAddress &address)
+{
+    // Handshake replies are answered on the I/O thread, so any packet that gets here means the link is up
+    const auto it = m_devices.find(address.toUInt64());
+    if (it == m_devices.end() || it->state != State::Handshaking)
+    {
+        return;
+    }
+    static Metrics::Counter &successes = Metrics::counter("connect_success_total");
+    static Metrics::Histogram &connectToReady = Metrics::histogram("connect_to_ready");
+    const qint64 nowNs = Metrics::nowNs();
+    successes.add();
+    connectToReady.record(nowNs - it->startedNs);
+    Trace::complete("airpods.connect_to_ready", it->startedNs, nowNs);
+
+    it->timer->stop();
+    it->attempts = 0;
+    setState(address, *it, State::Ready);
+}
+
+void ConnectionSupervisor::onLinkLost(const QBluetoothAddress &address)
+{
+    const auto it = m_devices.find(address.toUInt64());
+    if (it == m_devices.end() || it->state == State::Idle || it->state == State::BackingOff)
+    {
+        return;
+    }
+    if (it->state == State::Ready)
+    {
+        // A working link went away, most likely out of range: start over with a fresh budget
+        static Metrics::Counter &linkLost = Metrics::counter("connect_link_lost_total");
+        linkLost.add();
+        it->attempts = 0;
+        it->startedNs = Metrics::nowNs();
+    }
+    fail(address, *it, QStringLiteral("link lost"));
+}
+
+void ConnectionSupervisor::onError(const QBluetoothAddress &address, const QString &error)
+{
+    const auto it = m_devices.find(address.toUInt64());
+    if (it == m_devices.end() || it->state == State::Idle || it->state == State::BackingOff)
+    {
+        return;
+    }
+    fail(address, *it, error);
+}
+
+void ConnectionSupervisor::onTimeout(const QBluetoothAddress &address)
+{
+    Device &device = deviceFor(address);
+    switch (device.state)
+    {
+    case State::Connecting:
+        fail(address, device, QStringLiteral("connect timed out"));
+        break;
+    case State::Handshaking:
+        fail(address, device, QStringLiteral("no reply to the handshake"));
+        break;
+    case State::BackingOff:
+        attempt(address, device);
+        break;
+    default:
+        break;
+    }
+}
+
+void ConnectionSupervisor::fail(const QBluetoothAddress &address, Device &device, const QString &reason)
+{
+    static Metrics::Counter &failures = Metrics::counter("connect_failures_total");
+    failures.add();
+    // A link that timed out is still open, and the next attempt would find it so and do nothing
+    emit disconnectRequested(address);
+
+    if (device.attempts >= m_maxAttempts)
+    {
+        static Metrics::Counter &gaveUpTotal = Metrics::counter("connect_gave_up_total");
+        gaveUpTotal.add();
+        LOG_ERROR("Failed to connect to " << address.toString() << " after " << device.attempts << " attempts: " << reason);
+        device.timer->stop();
+        setState(address, device, State::Idle);
+        emit gaveUp(address);
+        return;
+    }
+
+    const int delay = backoffDelay(qMax(device.attempts, 1));
+    LOG_INFO("Connection to " << address.toString() << " failed (" << reason << "), retrying in " << delay << " ms");
+    device.timer->start(delay);
+    setState(address, device, State::BackingOff);
+}
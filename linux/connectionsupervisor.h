@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QObject>
+#include <QBluetoothAddress>
+#include <QHash>
+
+class QTimer;
+
+/**
+ * Decides when to (re)open the AACP link to each pair of AirPods.
+ *
+ * Every device has its own state machine:
+ *
+ *   Idle -> Connecting -> Handshaking -> Ready
+ *              ^    |          |           |
+ *              +- BackingOff <-+-----------+   (socket error, link lost, timeout or no reply)
+ *
+ * Failed attempts are retried after an exponentially growing delay with jitter, so a
+ * pair that is out of range does not keep the adapter busy, and a pair that drops for a
+ * moment is back quickly. cancel() stops everything for a device, e.g. once BlueZ reports
+ * it disconnected. The supervisor only asks for connections through connectRequested(),
+ * and for a failed link to be closed through disconnectRequested() so that the retry
+ * starts from a fresh socket; the caller opens the link and reports back with the on*() calls.
+ */
+class ConnectionSupervisor : public QObject
+{
+    Q_OBJECT
+public:
+    enum class State
+    {
+        Idle,
+        Connecting,
+        Handshaking,
+        Ready,
+        BackingOff,
+    };
+    Q_ENUM(State)
+
+    explicit ConnectionSupervisor(QObject *parent = nullptr);
+
+    // Attempts per connection before giving up, the first one included
+    void setMaxAttempts(int attempts) { m_maxAttempts = qMax(1, attempts); }
+
+    // Starts connecting unless already connecting, connected or waiting to retry
+    void connectDevice(const QBluetoothAddress &address);
+    void cancel(const QBluetoothAddress &address);
+    State state(const QBluetoothAddress &address) const;
+
+    void onConnected(const QBluetoothAddress &address);
+    void onPacketReceived(const QBluetoothAddress &address);
+    void onLinkLost(const QBluetoothAddress &address);
+    void onError(const QBluetoothAddress &address, const QString &error);
+
+signals:
+    void connectRequested(const QBluetoothAddress &address);
+    void disconnectRequested(const QBluetoothAddress &address);
+    void stateChanged(const QBluetoothAddress &address, ConnectionSupervisor::State state);
+    void gaveUp(const QBluetoothAddress &address);
+
+private:
+    struct Device
+    {
+        State state = State::Idle;
+        int attempts = 0;
+        qint64 startedNs = 0; // First attempt of the current connection
+        QTimer *timer = nullptr; // Connect or handshake timeout, or the backoff delay
+    };
+
+    Device &deviceFor(const QBluetoothAddress &address);
+    void setState(const QBluetoothAddress &address, Device &device, State state);
+    void attempt(const QBluetoothAddress &address, Device &device);
+    void fail(const QBluetoothAddress &address, Device &device, const QString &reason);
+    void onTimeout(const QBluetoothAddress &address);
+
+    QHash<quint64, Device> m_devices;
+    int m_maxAttempts = 3;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+// Wire format spoken between librepods and librepodsctl over the local control socket.
+// Deliberately free of Qt so the client stays a plain, fast-starting executable.
+//
+// Every message is a frame: magic byte, message type, payload length (u16, little endian),
+// payload. State and event payloads are a list of fields: key length (u8), key, value
+// type (u8), value. Integers are little-endian int32, strings are u16 length + UTF-8.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <variant>
+
+namespace ControlProtocol
+{
+    constexpr uint8_t MAGIC = 0xA7; // Never the first byte of a legacy text command
+    constexpr std::size_t HEADER_SIZE = 4;
+    constexpr std::size_t MAX_PAYLOAD = 0xFFFF;
+    constexpr const char *SERVER_NAME = "app_server";
+
+    enum class MessageType : uint8_t
+    {
+        // Requests
+        GetState = 0x01,
+        SetNoiseControlMode = 0x02,        // payload: u8 mode
+        SetConversationalAwareness = 0x03, // payload: u8 enabled
+        SetAdaptiveNoiseLevel = 0x04,      // payload: u8 level
+        Rename = 0x05,                     // payload: UTF-8 name
+        Subscribe = 0x06,                  // answered with State, then an Event per change
+        Reopen = 0x07,
+        GetMetrics = 0x08,
+        Activate = 0x09,                   // payload: argv of a second launch, NUL separated
+
+        // Responses
+        Ok = 0x80,
+        Error = 0x81, // payload: UTF-8 message
+        State = 0x82, // payload: fields
+        Event = 0x83, // payload: fields that changed
+        Text = 0x84,  // payload: UTF-8 text
+        TextPart = 0x85, // payload: UTF-8 text continued by the next TextPart or Text frame
+    };
+
+    enum class FieldType : uint8_t
+    {
+        Bool = 0,
+        Int = 1,
+        String = 2,
+    };
+
+    using Value = std::variant<bool, int32_t, std::string>;
+
+    // Same location QLocalServer picks for SERVER_NAME: QDir::tempPath()/app_server
+    inline std::string socketPath()
+    {
+        const char *tmp = std::getenv("TMPDIR");
+        std::string dir = tmp && *tmp ? tmp : "/tmp";
+        while (dir.size() > 1 && dir.back() == '/')
+        {
+            dir.pop_back();
+        }
+        return dir + "/" + SERVER_NAME;
+    }
+
+    inline std::string encodeFrame(MessageType type, const std::string &payload = std::string())
+    {
+        if (payload.size() > MAX_PAYLOAD)
+        {
+            // A cut payload would look complete to the reader
+            return encodeFrame(MessageType::Error, "Reply too large");
+        }
+        const std::size_t size = payload.size();
+        std::string frame;
+        frame.reserve(HEADER_SIZE + size);
+        frame += static_cast<char>(MAGIC);
+        frame += static_cast<char>(type);
+        frame += static_cast<char>(size & 0xFF);
+        frame += static_cast<char>(size >> 8);
+        frame.append(payload, 0, size);
+        return frame;
+    }
+
+    // Text of any length as TextPart frames followed by a final Text frame
+    inline std::string encodeText(const std::string &text)
+    {
+        std::string frames;
+        std::size_t pos = 0;
+        for (; text.size() - pos > MAX_PAYLOAD; pos += MAX_PAYLOAD)
+        {
+            frames += encodeFrame(MessageType::TextPart, text.substr(pos, MAX_PAYLOAD));
+        }
+        frames += encodeFrame(MessageType::Text, text.substr(pos));
+        return frames;
+    }
+
+    inline void encodeField(std::string &out, const std::string &key, const Value &value)
+    {
+        out += static_cast<char>(key.size() < 0xFF ? key.size() : 0xFF);
+        out.append(key, 0, 0xFF);
+        if (const bool *b = std::get_if<bool>(&value))
+        {
+            out += static_cast<char>(FieldType::Bool);
+            out += static_cast<char>(*b ? 1 : 0);
+        }
+        else if (const int32_t *i = std::get_if<int32_t>(&value))
+        {
+            out += static_cast<char>(FieldType::Int);
+            const uint32_t u = static_cast<uint32_t>(*i);
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                out += static_cast<char>((u >> shift) & 0xFF);
+            }
+        }
+        else
+        {
+            const std::string &s = std::get<std::string>(value);
+            const std::size_t size = s.size() < 0xFFFF ? s.size() : 0xFFFF;
+            out += static_cast<char>(FieldType::String);
+            out += static_cast<char>(size & 0xFF);
+            out += static_cast<char>(size >> 8);
+            out.append(s, 0, size);
+        }
+    }
+
+    // Calls handler(key, value) for every field; returns false on a malformed payload
+    template <typename Handler>
+    bool decodeFields(const std::string &payload, Handler &&handler)
+    {
+        std::size_t pos = 0;
+        auto byte = [&](std::size_t at) { return static_cast<uint8_t>(payload[at]); };
+        while (pos < payload.size())
+        {
+            const std::size_t keySize = byte(pos++);
+            if (pos + keySize + 1 > payload.size())
+            {
+                return false;
+            }
+            const std::string key = payload.substr(pos, keySize);
+            pos += keySize;
+            const auto type = static_cast<FieldType>(byte(pos++));
+            switch (type)
+            {
+            case FieldType::Bool:
+                if (pos + 1 > payload.size())
+                {
+                    return false;
+                }
+                handler(key, Value(byte(pos) != 0));
+                pos += 1;
+                break;
+            case FieldType::Int:
+            {
+                if (pos + 4 > payload.size())
+                {
+                    return false;
+                }
+                const uint32_t u = byte(pos) | (byte(pos + 1) << 8) | (byte(pos + 2) << 16) | (uint32_t(byte(pos + 3)) << 24);
+                handler(key, Value(static_cast<int32_t>(u)));
+                pos += 4;
+                break;
+            }
+            case FieldType::String:
+            {
+                if (pos + 2 > payload.size())
+                {
+                    return false;
+                }
+                const std::size_t size = byte(pos) | (byte(pos + 1) << 8);
+                pos += 2;
+                if (pos + size > payload.size())
+                {
+                    return false;
+                }
+                handler(key, Value(payload.substr(pos, size)));
+                pos += size;
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Accumulates stream bytes and hands out complete frames
+    class FrameReader
+    {
+    public:
+        void append(const char *data, std::size_t size) { m_buffer.append(data, size); }
+
+        // Returns false when no complete frame is buffered yet; sets error on a bad magic byte
+        bool next(MessageType &type, std::string &payload, bool &error)
+        {
+            error = false;
+            if (m_buffer.size() < HEADER_SIZE)
+            {
+                return false;
+            }
+            if (static_cast<uint8_t>(m_buffer[0]) != MAGIC)
+            {
+                error = true;
+                return false;
+            }
+            const std::size_t size = static_cast<uint8_t>(m_buffer[2]) | (static_cast<uint8_t>(m_buffer[3]) << 8);
+            if (m_buffer.size() < HEADER_SIZE + size)
+            {
+                return false;
+            }
+            type = static_cast<MessageType>(m_buffer[1]);
+            payload = m_buffer.substr(HEADER_SIZE, size);
+            m_buffer.erase(0, HEADER_SIZE + size);
+            return true;
+        }
+
+    private:
+        std::string m_buffer;
+    };
+}
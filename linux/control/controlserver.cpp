@@ -0,0 +1,258 @@
+#include "controlserver.h"
+#include "dbusservice.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QFile>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+using ControlProtocol::MessageType;
+
+ControlServer::ControlServer(DBusService *state, QObject *parent) : QObject(parent), m_state(state)
+{
+    m_server = new QLocalServer(this);
+    connect(m_server, &QLocalServer::newConnection, this, &ControlServer::onNewConnection);
+    connect(m_state, &DBusService::propertiesChanged, this, &ControlServer::broadcast);
+}
+
+ControlServer::~ControlServer()
+{
+    if (m_server->isListening())
+    {
+        m_server->close();
+    }
+    QLocalServer::removeServer(socketPath());
+}
+
+QString ControlServer::socketPath()
+{
+    return QString::fromStdString(ControlProtocol::socketPath());
+}
+
+bool ControlServer::listen()
+{
+    // Only the instance holding the SingleInstance lock gets here, so a leftover socket is stale
+    QLocalServer::removeServer(socketPath());
+    if (!m_server->listen(socketPath()))
+    {
+        LOG_ERROR("Unable to start the listening server");
+        LOG_DEBUG("Server error: " << m_server->errorString());
+        return false;
+    }
+    LOG_DEBUG("Server started, waiting for connections...");
+    return true;
+}
+
+void ControlServer::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection())
+    {
+        m_clients.insert(socket, Client());
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]()
+                { onReadyRead(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]()
+                {
+            m_clients.remove(socket);
+            socket->deleteLater(); });
+        connect(socket, &QLocalSocket::errorOccurred, this, [socket]()
+                { LOG_DEBUG("Control client error: " << socket->errorString()); });
+    }
+}
+
+void ControlServer::onReadyRead(QLocalSocket *socket)
+{
+    auto it = m_clients.find(socket);
+    if (it == m_clients.end())
+    {
+        return;
+    }
+    Client &client = it.value();
+    const QByteArray data = socket->readAll();
+    if (data.isEmpty())
+    {
+        return;
+    }
+
+    if (!client.binary)
+    {
+        if (static_cast<quint8>(data.at(0)) != ControlProtocol::MAGIC)
+        {
+            handleLegacyCommand(socket, data.trimmed());
+            return;
+        }
+        client.binary = true;
+    }
+
+    client.reader.append(data.constData(), static_cast<std::size_t>(data.size()));
+    MessageType type;
+    std::string payload;
+    bool error = false;
+    while (client.reader.next(type, payload, error))
+    {
+        handleRequest(socket, client, type, payload);
+    }
+    if (error)
+    {
+        LOG_WARN("Malformed control request, closing connection");
+        socket->disconnectFromServer();
+    }
+}
+
+void ControlServer::handleLegacyCommand(QLocalSocket *socket, const QByteArray &command)
+{
+    if (command == "reopen")
+    {
+        emit reopenRequested();
+    }
+    else if (command == "metrics")
+    {
+        socket->write(Metrics::snapshotText().toUtf8());
+    }
+    else
+    {
+        LOG_ERROR("Unknown message received: " << command);
+    }
+    socket->disconnectFromServer();
+}
+
+void ControlServer::handleRequest(QLocalSocket *socket, Client &client, MessageType type, const std::string &payload)
+{
+    auto requireConnected = [this, socket]()
+    {
+        if (!m_state->connected())
+        {
+            send(socket, MessageType::Error, "AirPods are not connected");
+            return false;
+        }
+        return true;
+    };
+    auto requireArgument = [socket, &payload]()
+    {
+        if (payload.empty())
+        {
+            send(socket, MessageType::Error, "Missing argument");
+            return false;
+        }
+        return true;
+    };
+    auto byteArgument = [&payload]() { return static_cast<int>(static_cast<quint8>(payload[0])); };
+
+    switch (type)
+    {
+    case MessageType::GetState:
+        send(socket, MessageType::State, encodeFields(m_state->properties()));
+        break;
+    case MessageType::Subscribe:
+        client.subscribed = true;
+        send(socket, MessageType::State, encodeFields(m_state->properties()));
+        break;
+    case MessageType::SetNoiseControlMode:
+        if (requireArgument() && requireConnected())
+        {
+            reply(socket, m_state->SetNoiseControlMode(byteArgument()));
+        }
+        break;
+    case MessageType::SetConversationalAwareness:
+        if (requireArgument() && requireConnected())
+        {
+            reply(socket, m_state->SetConversationalAwareness(byteArgument() > 0));
+        }
+        break;
+    case MessageType::SetAdaptiveNoiseLevel:
+        if (requireArgument() && requireConnected())
+        {
+            reply(socket, m_state->SetAdaptiveNoiseLevel(byteArgument()));
+        }
+        break;
+    case MessageType::Rename:
+        if (requireArgument() && requireConnected())
+        {
+            reply(socket, m_state->Rename(QString::fromStdString(payload)));
+        }
+        break;
+    case MessageType::Reopen:
+        emit reopenRequested();
+        send(socket, MessageType::Ok);
+        break;
+    case MessageType::Activate:
+    {
+        QStringList arguments;
+        for (const QByteArray &argument : QByteArray::fromStdString(payload).split('\0'))
+        {
+            arguments << QString::fromLocal8Bit(argument);
+        }
+        emit activateRequested(arguments);
+        send(socket, MessageType::Ok);
+        break;
+    }
+    case MessageType::GetMetrics:
+    {
+        const std::string frames = ControlProtocol::encodeText(Metrics::snapshotText().toStdString());
+        socket->write(frames.data(), static_cast<qint64>(frames.size()));
+        break;
+    }
+    default:
+        send(socket, MessageType::Error, "Unknown request");
+        break;
+    }
+}
+
+void ControlServer::broadcast(const QVariantMap &changed)
+{
+    std::string payload;
+    for (auto it = m_clients.begin(); it != m_clients.end(); ++it)
+    {
+        if (!it.value().subscribed)
+        {
+            continue;
+        }
+        if (payload.empty())
+        {
+            payload = encodeFields(changed);
+        }
+        send(it.key(), MessageType::Event, payload);
+    }
+}
+
+void ControlServer::reply(QLocalSocket *socket, bool queued)
+{
+    if (queued)
+    {
+        send(socket, MessageType::Ok);
+    }
+    else
+    {
+        send(socket, MessageType::Error, m_state->errorString().toStdString());
+    }
+}
+
+void ControlServer::send(QLocalSocket *socket, MessageType type, const std::string &payload)
+{
+    const std::string frame = ControlProtocol::encodeFrame(type, payload);
+    socket->write(frame.data(), static_cast<qint64>(frame.size()));
+}
+
+std::string ControlServer::encodeFields(const QVariantMap &fields)
+{
+    std::string payload;
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it)
+    {
+        const std::string key = it.key().toStdString();
+        switch (it.value().typeId())
+        {
+        case QMetaType::Bool:
+            ControlProtocol::encodeField(payload, key, it.value().toBool());
+            break;
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::UChar:
+            ControlProtocol::encodeField(payload, key, static_cast<int32_t>(it.value().toInt()));
+            break;
+        default:
+            ControlProtocol::encodeField(payload, key, it.value().toString().toStdString());
+            break;
+        }
+    }
+    return payload;
+}
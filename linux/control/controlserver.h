@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QVariantMap>
+
+#include "controlprotocol.h"
+
+class DBusService;
+class QLocalServer;
+class QLocalSocket;
+
+/**
+ * Local control socket used by librepodsctl (see controlprotocol.h).
+ *
+ * Reads and changes the same state as the D-Bus service, and pushes its batched
+ * change sets to subscribed clients. Also still understands the plain-text "reopen"
+ * and "metrics" commands that older clients send.
+ */
+class ControlServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ControlServer(DBusService *state, QObject *parent = nullptr);
+    ~ControlServer();
+
+    bool listen();
+    static QString socketPath();
+
+signals:
+    void reopenRequested();
+    // Another launch of librepods handed over its command line (without argv[0])
+    void activateRequested(const QStringList &arguments);
+
+private:
+    struct Client
+    {
+        ControlProtocol::FrameReader reader;
+        bool binary = false;
+        bool subscribed = false;
+    };
+
+    void onNewConnection();
+    void onReadyRead(QLocalSocket *socket);
+    void handleLegacyCommand(QLocalSocket *socket, const QByteArray &command);
+    void handleRequest(QLocalSocket *socket, Client &client, ControlProtocol::MessageType type, const std::string &payload);
+    void broadcast(const QVariantMap &changed);
+
+    // Ok, or Error with the reason the state setter gave
+    void reply(QLocalSocket *socket, bool queued);
+    static void send(QLocalSocket *socket, ControlProtocol::MessageType type, const std::string &payload = std::string());
+    static std::string encodeFields(const QVariantMap &fields);
+
+    DBusService *m_state;
+    QLocalServer *m_server;
+    QHash<QLocalSocket *, Client> m_clients;
+};
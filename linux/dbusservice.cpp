@@ -0,0 +1,253 @@
+#include "dbusservice.h"
+#include "deviceinfo.hpp"
+#include "logger.h"
+
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QDBusMessage>
+#include <QMetaEnum>
+#include <QMetaProperty>
+#include <QTimer>
+#include <QVariantMap>
+
+namespace
+{
+    constexpr const char *INTERFACE_NAME = "me.kavishdevar.librepods.Device";
+
+    QString earStatusName(EarDetection::EarDetectionStatus status)
+    {
+        return QString::fromLatin1(QMetaEnum::fromType<EarDetection::EarDetectionStatus>().valueToKey(static_cast<int>(status)));
+    }
+}
+
+DBusService::DBusService(DeviceInfo *deviceInfo, QObject *parent) : QObject(parent), m_deviceInfo(deviceInfo)
+{
+    // Zero interval: fires once the current batch of events has been processed
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(0);
+    connect(m_flushTimer, &QTimer::timeout, this, &DBusService::flushChanges);
+    bind();
+}
+
+void DBusService::setDeviceInfo(DeviceInfo *deviceInfo)
+{
+    if (m_deviceInfo == deviceInfo)
+    {
+        return;
+    }
+    m_deviceInfo->disconnect(this);
+    m_deviceInfo->getBattery()->disconnect(this);
+    m_deviceInfo->getEarDetection()->disconnect(this);
+    m_deviceInfo = deviceInfo;
+    bind();
+
+    const QMetaObject *meta = metaObject();
+    for (int i = meta->propertyOffset(); i < meta->propertyCount(); ++i)
+    {
+        m_changed.insert(QString::fromLatin1(meta->property(i).name()));
+    }
+    if (!m_flushTimer->isActive())
+    {
+        m_flushTimer->start();
+    }
+}
+
+void DBusService::bind()
+{
+    connect(m_deviceInfo, &DeviceInfo::deviceNameChanged, this, [this]()
+            { markChanged({"Name"}); });
+    connect(m_deviceInfo, &DeviceInfo::modelChanged, this, [this]()
+            { markChanged({"Model"}); });
+    connect(m_deviceInfo, &DeviceInfo::bluetoothAddressChanged, this, [this]()
+            { markChanged({"Address"}); });
+    connect(m_deviceInfo, &DeviceInfo::batteryStatusChanged, this, [this]()
+            { markChanged({"BatteryStatus"}); });
+    connect(m_deviceInfo->getBattery(), &Battery::batteryStatusChanged, this, [this]()
+            { markChanged({"LeftLevel", "LeftCharging", "LeftAvailable", "RightLevel", "RightCharging", "RightAvailable",
+                           "CaseLevel", "CaseCharging", "CaseAvailable", "HeadsetLevel", "HeadsetCharging", "HeadsetAvailable",
+                           "LeftInEar", "RightInEar"}); });
+    connect(m_deviceInfo->getBattery(), &Battery::primaryChanged, this, [this]()
+            { markChanged({"LeftInEar", "RightInEar"}); });
+    connect(m_deviceInfo->getEarDetection(), &EarDetection::statusChanged, this, [this]()
+            { markChanged({"PrimaryEarStatus", "SecondaryEarStatus", "LeftInEar", "RightInEar"}); });
+    connect(m_deviceInfo, &DeviceInfo::noiseControlModeChangedInt, this, [this]()
+            { markChanged({"NoiseControlMode"}); });
+    connect(m_deviceInfo, &DeviceInfo::conversationalAwarenessChanged, this, [this]()
+            { markChanged({"ConversationalAwareness"}); });
+    connect(m_deviceInfo, &DeviceInfo::hearingAidEnabledChanged, this, [this]()
+            { markChanged({"HearingAidEnabled"}); });
+    connect(m_deviceInfo, &DeviceInfo::adaptiveNoiseLevelChanged, this, [this]()
+            { markChanged({"AdaptiveNoiseLevel"}); });
+    connect(m_deviceInfo, &DeviceInfo::oneBudANCModeChanged, this, [this]()
+            { markChanged({"OneBudANCMode"}); });
+}
+
+DBusService::~DBusService()
+{
+    if (m_registered)
+    {
+        QDBusConnection bus = QDBusConnection::sessionBus();
+        bus.unregisterObject(OBJECT_PATH);
+        bus.unregisterService(SERVICE_NAME);
+    }
+}
+
+bool DBusService::registerOnSessionBus()
+{
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    if (!bus.isConnected())
+    {
+        LOG_WARN("Cannot connect to the session D-Bus, not exporting device state");
+        return false;
+    }
+    if (!bus.registerObject(OBJECT_PATH, this, QDBusConnection::ExportAllProperties | QDBusConnection::ExportScriptableSlots))
+    {
+        LOG_ERROR("Failed to register D-Bus object " << OBJECT_PATH << ": " << bus.lastError().message());
+        return false;
+    }
+    if (!bus.registerService(SERVICE_NAME))
+    {
+        LOG_ERROR("Failed to register D-Bus service " << SERVICE_NAME << ": " << bus.lastError().message());
+        bus.unregisterObject(OBJECT_PATH);
+        return false;
+    }
+    m_registered = true;
+    LOG_INFO("Exporting device state on D-Bus as " << SERVICE_NAME);
+    return true;
+}
+
+void DBusService::setConnected(bool connected)
+{
+    if (m_connected != connected)
+    {
+        m_connected = connected;
+        markChanged({"Connected"});
+    }
+}
+
+void DBusService::markChanged(std::initializer_list<const char *> properties)
+{
+    for (const char *property : properties)
+    {
+        m_changed.insert(QString::fromLatin1(property));
+    }
+    if (!m_flushTimer->isActive())
+    {
+        m_flushTimer->start();
+    }
+}
+
+void DBusService::flushChanges()
+{
+    QVariantMap changed;
+    for (const QString &property : std::as_const(m_changed))
+    {
+        changed.insert(property, this->property(property.toLatin1().constData()));
+    }
+    m_changed.clear();
+    if (changed.isEmpty())
+    {
+        return;
+    }
+
+    emit propertiesChanged(changed);
+
+    if (m_registered)
+    {
+        QDBusMessage message = QDBusMessage::createSignal(OBJECT_PATH, "org.freedesktop.DBus.Properties", "PropertiesChanged");
+        message << QString::fromLatin1(INTERFACE_NAME) << changed << QStringList();
+        QDBusConnection::sessionBus().send(message);
+    }
+}
+
+bool DBusService::SetNoiseControlMode(int mode)
+{
+    return finishCall(m_handlers.setNoiseControlMode && m_handlers.setNoiseControlMode(mode),
+                      "Invalid noise control mode");
+}
+
+bool DBusService::SetConversationalAwareness(bool enabled)
+{
+    return finishCall(m_handlers.setConversationalAwareness && m_handlers.setConversationalAwareness(enabled),
+                      "Conversational awareness command was not sent");
+}
+
+bool DBusService::SetHearingAidEnabled(bool enabled)
+{
+    return finishCall(m_handlers.setHearingAidEnabled && m_handlers.setHearingAidEnabled(enabled),
+                      "Hearing aid command was not sent");
+}
+
+bool DBusService::SetAdaptiveNoiseLevel(int level)
+{
+    return finishCall(m_handlers.setAdaptiveNoiseLevel && m_handlers.setAdaptiveNoiseLevel(level),
+                      "Adaptive noise level can only be set in adaptive mode");
+}
+
+bool DBusService::SetOneBudANCMode(bool enabled)
+{
+    return finishCall(m_handlers.setOneBudANCMode && m_handlers.setOneBudANCMode(enabled),
+                      "One Bud ANC mode command was not sent");
+}
+
+bool DBusService::Rename(const QString &name)
+{
+    return finishCall(m_handlers.rename && m_handlers.rename(name), "Name must be 1 to 32 characters");
+}
+
+bool DBusService::finishCall(bool queued, const char *reason)
+{
+    if (queued)
+    {
+        m_errorString.clear();
+        return true;
+    }
+    m_errorString = m_connected ? QString::fromLatin1(reason) : QStringLiteral("AirPods are not connected");
+    if (calledFromDBus())
+    {
+        sendErrorReply(QDBusError::Failed, m_errorString);
+    }
+    return false;
+}
+
+QVariantMap DBusService::properties() const
+{
+    QVariantMap result;
+    const QMetaObject *meta = metaObject();
+    for (int i = meta->propertyOffset(); i < meta->propertyCount(); ++i)
+    {
+        const QMetaProperty property = meta->property(i);
+        result.insert(QString::fromLatin1(property.name()), property.read(this));
+    }
+    return result;
+}
+
+QString DBusService::name() const { return m_deviceInfo->deviceName(); }
+QString DBusService::model() const
+{
+    return QString::fromLatin1(QMetaEnum::fromType<AirPodsModel>().valueToKey(static_cast<int>(m_deviceInfo->model())));
+}
+QString DBusService::address() const { return m_deviceInfo->bluetoothAddress(); }
+QString DBusService::batteryStatus() const { return m_deviceInfo->batteryStatus(); }
+int DBusService::leftLevel() const { return m_deviceInfo->getBattery()->getLeftPodLevel(); }
+bool DBusService::leftCharging() const { return m_deviceInfo->getBattery()->isLeftPodCharging(); }
+bool DBusService::leftAvailable() const { return m_deviceInfo->getBattery()->isLeftPodAvailable(); }
+int DBusService::rightLevel() const { return m_deviceInfo->getBattery()->getRightPodLevel(); }
+bool DBusService::rightCharging() const { return m_deviceInfo->getBattery()->isRightPodCharging(); }
+bool DBusService::rightAvailable() const { return m_deviceInfo->getBattery()->isRightPodAvailable(); }
+int DBusService::caseLevel() const { return m_deviceInfo->getBattery()->getCaseLevel(); }
+bool DBusService::caseCharging() const { return m_deviceInfo->getBattery()->isCaseCharging(); }
+bool DBusService::caseAvailable() const { return m_deviceInfo->getBattery()->isCaseAvailable(); }
+int DBusService::headsetLevel() const { return m_deviceInfo->getBattery()->getHeadsetLevel(); }
+bool DBusService::headsetCharging() const { return m_deviceInfo->getBattery()->isHeadsetCharging(); }
+bool DBusService::headsetAvailable() const { return m_deviceInfo->getBattery()->isHeadsetAvailable(); }
+QString DBusService::primaryEarStatus() const { return earStatusName(m_deviceInfo->getEarDetection()->getprimaryStatus()); }
+QString DBusService::secondaryEarStatus() const { return earStatusName(m_deviceInfo->getEarDetection()->getsecondaryStatus()); }
+bool DBusService::leftInEar() const { return m_deviceInfo->isLeftPodInEar(); }
+bool DBusService::rightInEar() const { return m_deviceInfo->isRightPodInEar(); }
+int DBusService::noiseControlMode() const { return m_deviceInfo->noiseControlModeInt(); }
+bool DBusService::conversationalAwareness() const { return m_deviceInfo->conversationalAwareness(); }
+bool DBusService::hearingAidEnabled() const { return m_deviceInfo->hearingAidEnabled(); }
+int DBusService::adaptiveNoiseLevel() const { return m_deviceInfo->adaptiveNoiseLevel(); }
+bool DBusService::oneBudANCMode() const { return m_deviceInfo->oneBudANCMode(); }
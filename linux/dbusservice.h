@@ -0,0 +1,145 @@
+#pragma once
+
+#include <QObject>
+#include <QDBusContext>
+#include <QSet>
+#include <QString>
+#include <QVariantMap>
+#include <functional>
+#include <initializer_list>
+
+class DeviceInfo;
+class QTimer;
+
+/**
+ * Session bus service me.kavishdevar.librepods, object /me/kavishdevar/librepods.
+ *
+ * Exposes DeviceInfo, its Battery and EarDetection as read-only properties of the
+ * me.kavishdevar.librepods.Device interface, and the setters as methods. Method calls
+ * are forwarded to the Handlers set by the owner, the same setters used by the tray
+ * menu and the QML UI. Each returns whether the command was queued; when it was not,
+ * D-Bus callers get an error reply and errorString() says why.
+ *
+ * Every change marks the affected properties dirty; they are sent in one
+ * PropertiesChanged signal on the next pass through the event loop, so a burst of
+ * updates from one packet or BLE advertisement costs a single emission. The same
+ * batches are available in-process through propertiesChanged(), which the control
+ * socket uses for its subscribers.
+ */
+class DBusService : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "me.kavishdevar.librepods.Device")
+
+    Q_PROPERTY(bool Connected READ connected)
+    Q_PROPERTY(QString Name READ name)
+    Q_PROPERTY(QString Model READ model)
+    Q_PROPERTY(QString Address READ address)
+    Q_PROPERTY(QString BatteryStatus READ batteryStatus)
+    Q_PROPERTY(int LeftLevel READ leftLevel)
+    Q_PROPERTY(bool LeftCharging READ leftCharging)
+    Q_PROPERTY(bool LeftAvailable READ leftAvailable)
+    Q_PROPERTY(int RightLevel READ rightLevel)
+    Q_PROPERTY(bool RightCharging READ rightCharging)
+    Q_PROPERTY(bool RightAvailable READ rightAvailable)
+    Q_PROPERTY(int CaseLevel READ caseLevel)
+    Q_PROPERTY(bool CaseCharging READ caseCharging)
+    Q_PROPERTY(bool CaseAvailable READ caseAvailable)
+    Q_PROPERTY(int HeadsetLevel READ headsetLevel)
+    Q_PROPERTY(bool HeadsetCharging READ headsetCharging)
+    Q_PROPERTY(bool HeadsetAvailable READ headsetAvailable)
+    Q_PROPERTY(QString PrimaryEarStatus READ primaryEarStatus)
+    Q_PROPERTY(QString SecondaryEarStatus READ secondaryEarStatus)
+    Q_PROPERTY(bool LeftInEar READ leftInEar)
+    Q_PROPERTY(bool RightInEar READ rightInEar)
+    Q_PROPERTY(int NoiseControlMode READ noiseControlMode)
+    Q_PROPERTY(bool ConversationalAwareness READ conversationalAwareness)
+    Q_PROPERTY(bool HearingAidEnabled READ hearingAidEnabled)
+    Q_PROPERTY(int AdaptiveNoiseLevel READ adaptiveNoiseLevel)
+    Q_PROPERTY(bool OneBudANCMode READ oneBudANCMode)
+
+public:
+    static constexpr const char *SERVICE_NAME = "me.kavishdevar.librepods";
+    static constexpr const char *OBJECT_PATH = "/me/kavishdevar/librepods";
+
+    // Each returns true once the command is queued, or when there is nothing to change
+    struct Handlers
+    {
+        std::function<bool(int)> setNoiseControlMode;
+        std::function<bool(bool)> setConversationalAwareness;
+        std::function<bool(bool)> setHearingAidEnabled;
+        std::function<bool(int)> setAdaptiveNoiseLevel;
+        std::function<bool(bool)> setOneBudANCMode;
+        std::function<bool(const QString &)> rename;
+    };
+
+    explicit DBusService(DeviceInfo *deviceInfo, QObject *parent = nullptr);
+    ~DBusService();
+
+    void setHandlers(Handlers handlers) { m_handlers = std::move(handlers); }
+    // Why the last setter call returned false
+    QString errorString() const { return m_errorString; }
+
+    bool registerOnSessionBus();
+
+    void setConnected(bool connected);
+    // Exports another device, e.g. when the user switches between AirPods; every property changes
+    void setDeviceInfo(DeviceInfo *deviceInfo);
+
+    // Every exported property by its D-Bus name
+    QVariantMap properties() const;
+
+    bool connected() const { return m_connected; }
+    QString name() const;
+    QString model() const;
+    QString address() const;
+    QString batteryStatus() const;
+    int leftLevel() const;
+    bool leftCharging() const;
+    bool leftAvailable() const;
+    int rightLevel() const;
+    bool rightCharging() const;
+    bool rightAvailable() const;
+    int caseLevel() const;
+    bool caseCharging() const;
+    bool caseAvailable() const;
+    int headsetLevel() const;
+    bool headsetCharging() const;
+    bool headsetAvailable() const;
+    QString primaryEarStatus() const;
+    QString secondaryEarStatus() const;
+    bool leftInEar() const;
+    bool rightInEar() const;
+    int noiseControlMode() const;
+    bool conversationalAwareness() const;
+    bool hearingAidEnabled() const;
+    int adaptiveNoiseLevel() const;
+    bool oneBudANCMode() const;
+
+public slots:
+    Q_SCRIPTABLE bool SetNoiseControlMode(int mode);
+    Q_SCRIPTABLE bool SetConversationalAwareness(bool enabled);
+    Q_SCRIPTABLE bool SetHearingAidEnabled(bool enabled);
+    Q_SCRIPTABLE bool SetAdaptiveNoiseLevel(int level);
+    Q_SCRIPTABLE bool SetOneBudANCMode(bool enabled);
+    Q_SCRIPTABLE bool Rename(const QString &name);
+
+signals:
+    // Not exported on the bus
+    void propertiesChanged(const QVariantMap &changed);
+
+private:
+    void bind();
+    // reason is used unless the AirPods are simply not connected
+    bool finishCall(bool queued, const char *reason);
+    void markChanged(std::initializer_list<const char *> properties);
+    void flushChanges();
+
+    DeviceInfo *m_deviceInfo;
+    Handlers m_handlers;
+    QString m_errorString;
+    bool m_connected = false;
+    bool m_registered = false;
+    QSet<QString> m_changed;
+    QTimer *m_flushTimer;
+};
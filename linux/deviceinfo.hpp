@@ -27,6 +27,7 @@ class DeviceInfo : public QObject
     Q_PROPERTY(bool leftPodInEar READ isLeftPodInEar NOTIFY primaryChanged)
     Q_PROPERTY(bool rightPodInEar READ isRightPodInEar NOTIFY primaryChanged)
     Q_PROPERTY(QString bluetoothAddress READ bluetoothAddress WRITE setBluetoothAddress NOTIFY bluetoothAddressChanged)
+    Q_PROPERTY(bool connected READ isConnected NOTIFY connectedChanged)
     Q_PROPERTY(QString magicAccIRK READ magicAccIRKHex CONSTANT)
     Q_PROPERTY(QString magicAccEncKey READ magicAccEncKeyHex CONSTANT)
 
@@ -144,6 +145,16 @@ public:
         }
     }
 
+    bool isConnected() const { return m_connected; }
+    void setConnected(bool connected)
+    {
+        if (m_connected != connected)
+        {
+            m_connected = connected;
+            emit connectedChanged(connected);
+        }
+    }
+
     QString podIcon() const { return getModelIcon(model()).first; }
     QString caseIcon() const { return getModelIcon(model()).second; }
     bool isLeftPodInEar() const
@@ -165,17 +176,24 @@ public:
     {
         setDeviceName("");
         setModel(AirPodsModel::Unknown);
+        setBluetoothAddress("");
+        resetState();
+    }
+
+    // Clears what only holds while connected; name, model, address and keys stay
+    void resetState()
+    {
         m_battery->reset();
         setBatteryStatus("");
         setNoiseControlMode(NoiseControlMode::Off);
-        setBluetoothAddress("");
         getEarDetection()->reset();
         setHearingAidEnabled(false);
+        setConnected(false);
     }
 
-    void saveToSettings(QSettings &settings)
+    void saveToSettings(QSettings &settings, const QString &group = QStringLiteral("DeviceInfo"))
     {
-        settings.beginGroup("DeviceInfo");
+        settings.beginGroup(group);
         settings.setValue("deviceName", deviceName());
         settings.setValue("model", static_cast<int>(model()));
         settings.setValue("magicAccIRK", magicAccIRK());
@@ -183,13 +201,14 @@ public:
         settings.setValue("hearingAidEnabled", hearingAidEnabled());
         settings.endGroup();
     }
-    void loadFromSettings(const QSettings &settings)
+    void loadFromSettings(const QSettings &settings, const QString &group = QStringLiteral("DeviceInfo"))
     {
-        setDeviceName(settings.value("DeviceInfo/deviceName", "").toString());
-        setModel(static_cast<AirPodsModel>(settings.value("DeviceInfo/model", (int)(AirPodsModel::Unknown)).toInt()));
-        setMagicAccIRK(settings.value("DeviceInfo/magicAccIRK", QByteArray()).toByteArray());
-        setMagicAccEncKey(settings.value("DeviceInfo/magicAccEncKey", QByteArray()).toByteArray());
-        setHearingAidEnabled(settings.value("DeviceInfo/hearingAidEnabled", false).toBool());
+        const QString prefix = group + '/';
+        setDeviceName(settings.value(prefix + "deviceName", "").toString());
+        setModel(static_cast<AirPodsModel>(settings.value(prefix + "model", (int)(AirPodsModel::Unknown)).toInt()));
+        setMagicAccIRK(settings.value(prefix + "magicAccIRK", QByteArray()).toByteArray());
+        setMagicAccEncKey(settings.value(prefix + "magicAccEncKey", QByteArray()).toByteArray());
+        setHearingAidEnabled(settings.value(prefix + "hearingAidEnabled", false).toBool());
     }
 
     void updateBatteryStatus()
@@ -217,6 +236,7 @@ signals:
     void oneBudANCModeChanged(bool enabled);
     void modelChanged();
     void bluetoothAddressChanged(const QString &address);
+    void connectedChanged(bool connected);
 
 private:
     QString m_batteryStatus;
@@ -233,5 +253,6 @@ private:
     QString m_modelNumber;
     QString m_manufacturer;
     QString m_bluetoothAddress;
+    bool m_connected = false;
     EarDetection *m_earDetection;
 };
@@ -0,0 +1,198 @@
+#include "devicemanager.h"
+#include "deviceinfo.hpp"
+#include "ble/bleutils.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QSettings>
+
+namespace
+{
+    constexpr const char *DEVICES_GROUP = "Devices";
+    constexpr const char *LEGACY_GROUP = "DeviceInfo"; // Single-device settings from before Devices/
+    // Random addresses rotate every few minutes; forget them all rather than track their age
+    constexpr int MAX_RESOLVED_ADDRESSES = 256;
+}
+
+DeviceManager::DeviceManager(QSettings *settings, QObject *parent) : QObject(parent), m_settings(settings)
+{
+    load();
+}
+
+void DeviceManager::load()
+{
+    m_settings->beginGroup(DEVICES_GROUP);
+    const QStringList groups = m_settings->childGroups();
+    m_settings->endGroup();
+
+    for (const QString &group : groups)
+    {
+        const QBluetoothAddress address(QString(group).replace('_', ':'));
+        if (address.isNull())
+        {
+            continue;
+        }
+        DeviceInfo *device = createDevice();
+        device->loadFromSettings(*m_settings, groupFor(address.toString()));
+        device->setBluetoothAddress(address.toString());
+        m_byAddress.insert(address.toUInt64(), device);
+    }
+
+    if (m_settings->childGroups().contains(LEGACY_GROUP) || m_devices.isEmpty())
+    {
+        // Its address was never stored, so it becomes the placeholder and the first connection adopts it
+        DeviceInfo *placeholder = createDevice();
+        placeholder->loadFromSettings(*m_settings);
+    }
+    m_active = m_devices.constFirst();
+    LOG_INFO("Loaded " << m_byAddress.size() << " known device(s)");
+}
+
+DeviceInfo *DeviceManager::createDevice()
+{
+    DeviceInfo *device = new DeviceInfo(this);
+    connect(device, &DeviceInfo::deviceNameChanged, this, &DeviceManager::devicesChanged);
+    m_devices.append(device);
+    return device;
+}
+
+DeviceInfo *DeviceManager::addDevice(const QBluetoothAddress &address)
+{
+    if (DeviceInfo *known = device(address))
+    {
+        return known;
+    }
+
+    DeviceInfo *device = nullptr;
+    for (DeviceInfo *candidate : std::as_const(m_devices))
+    {
+        if (candidate->bluetoothAddress().isEmpty())
+        {
+            device = candidate;
+            break;
+        }
+    }
+    if (device)
+    {
+        LOG_INFO("Adopting the unaddressed device for " << address.toString());
+        device->setBluetoothAddress(address.toString());
+        m_byAddress.insert(address.toUInt64(), device);
+        if (!address.isNull())
+        {
+            save(device);
+            m_settings->remove(LEGACY_GROUP);
+        }
+    }
+    else
+    {
+        LOG_INFO("New device " << address.toString());
+        device = createDevice();
+        device->setBluetoothAddress(address.toString());
+        m_byAddress.insert(address.toUInt64(), device);
+    }
+    emit devicesChanged();
+    return device;
+}
+
+void DeviceManager::setActive(DeviceInfo *device)
+{
+    if (!device || device == m_active)
+    {
+        return;
+    }
+    DeviceInfo *previous = m_active;
+    m_active = device;
+    LOG_INFO("Active device is now " << device->deviceName() << " (" << device->bluetoothAddress() << ")");
+    emit activeChanged(device, previous);
+}
+
+void DeviceManager::select(const QString &address)
+{
+    DeviceInfo *selected = device(QBluetoothAddress(address));
+    if (!selected)
+    {
+        LOG_WARN("Cannot select unknown device " << address);
+        return;
+    }
+    setActive(selected);
+}
+
+bool DeviceManager::allConnected() const
+{
+    for (const DeviceInfo *device : m_devices)
+    {
+        if (!device->isConnected() && !device->magicAccIRK().isEmpty())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+DeviceInfo *DeviceManager::resolveAdvertisement(const QString &address)
+{
+    const auto cached = m_resolved.constFind(address);
+    if (cached != m_resolved.constEnd())
+    {
+        return cached.value();
+    }
+
+    static Metrics::Counter &resolutions = Metrics::counter("ble_rpa_resolutions_total");
+    resolutions.add();
+    DeviceInfo *match = nullptr;
+    for (DeviceInfo *device : std::as_const(m_devices))
+    {
+        if (!device->magicAccIRK().isEmpty() && BLEUtils::isValidIrkRpa(device->magicAccIRK(), address))
+        {
+            match = device;
+            break;
+        }
+    }
+
+    if (m_resolved.size() >= MAX_RESOLVED_ADDRESSES)
+    {
+        m_resolved.clear();
+    }
+    m_resolved.insert(address, match);
+    return match;
+}
+
+void DeviceManager::setMagicKeys(DeviceInfo *device, const QByteArray &irk, const QByteArray &encKey)
+{
+    device->setMagicAccIRK(irk);
+    device->setMagicAccEncKey(encKey);
+    // Addresses that matched nothing may belong to this device now
+    m_resolved.clear();
+    save(device);
+}
+
+void DeviceManager::save(DeviceInfo *device)
+{
+    const QBluetoothAddress address(device->bluetoothAddress());
+    if (address.isNull())
+    {
+        // Placeholder or simulator; keep the keys where the next run looks for them
+        device->saveToSettings(*m_settings);
+        return;
+    }
+    device->saveToSettings(*m_settings, groupFor(address.toString()));
+}
+
+QList<QObject *> DeviceManager::devicesForQml() const
+{
+    QList<QObject *> result;
+    result.reserve(m_byAddress.size());
+    for (DeviceInfo *device : m_devices)
+    {
+        if (!device->bluetoothAddress().isEmpty())
+        {
+            result.append(device);
+        }
+    }
+    return result;
+}
+
+QString DeviceManager::groupFor(const QString &address)
+{
+    return QString::fromLatin1(DEVICES_GROUP) + '/' + QString(address).replace(':', '_');
+}
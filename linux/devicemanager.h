@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QObject>
+#include <QBluetoothAddress>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include "deviceinfo.hpp"
+
+class QSettings;
+
+/**
+ * Every pair of AirPods we know about, keyed by identity address.
+ *
+ * Each device has its own DeviceInfo (with its Battery, EarDetection and Magic keys) and
+ * is persisted in its own settings group, Devices/<address>. Lookups by identity address
+ * are a hash probe; BLE advertisements carry a resolvable private address instead, which
+ * resolveAdvertisement() matches against the known IRKs once and then remembers until
+ * the address rotates.
+ *
+ * One device is active: the tray, D-Bus, the status page and the QML UI show and control
+ * that one. Before any AirPods have been seen the active device is an unaddressed
+ * placeholder, which the first connection adopts.
+ */
+class DeviceManager : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QList<QObject *> devices READ devicesForQml NOTIFY devicesChanged)
+    Q_PROPERTY(DeviceInfo *active READ active NOTIFY activeChanged)
+
+public:
+    explicit DeviceManager(QSettings *settings, QObject *parent = nullptr);
+
+    const QList<DeviceInfo *> &devices() const { return m_devices; }
+    DeviceInfo *device(quint64 address) const { return m_byAddress.value(address); }
+    DeviceInfo *device(const QBluetoothAddress &address) const { return device(address.toUInt64()); }
+    // The known device with this address, adopting the placeholder or creating one if needed
+    DeviceInfo *addDevice(const QBluetoothAddress &address);
+
+    DeviceInfo *active() const { return m_active; }
+    void setActive(DeviceInfo *device);
+    Q_INVOKABLE void select(const QString &address);
+
+    // True when no device with Magic keys is waiting to be seen over BLE
+    bool allConnected() const;
+
+    // The device whose IRK resolves this random address, or nullptr
+    DeviceInfo *resolveAdvertisement(const QString &address);
+
+    void setMagicKeys(DeviceInfo *device, const QByteArray &irk, const QByteArray &encKey);
+    void save(DeviceInfo *device);
+
+signals:
+    void devicesChanged();
+    void activeChanged(DeviceInfo *current, DeviceInfo *previous);
+
+private:
+    void load();
+    DeviceInfo *createDevice();
+    QList<QObject *> devicesForQml() const;
+    static QString groupFor(const QString &address);
+
+    QSettings *m_settings;
+    QList<DeviceInfo *> m_devices; // In the order they were first seen
+    QHash<quint64, DeviceInfo *> m_byAddress;
+    QHash<QString, DeviceInfo *> m_resolved; // Random address -> device, nullptr for no match
+    DeviceInfo *m_active = nullptr;
+};
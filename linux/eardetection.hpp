@@ -4,6 +4,7 @@
 #include <QByteArray>
 #include <QPair>
 #include "logger.h"
+#include "trace.h"
 
 class EarDetection : public QObject
 {
@@ -33,6 +34,7 @@ public:
 
     bool parseData(const QByteArray &data)
     {
+        TRACE_SCOPE("EarDetection::parseData");
         if (data.size() < 2)
         {
             return false;
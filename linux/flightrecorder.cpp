@@ -0,0 +1,228 @@
+#include "flightrecorder.h"
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+namespace
+{
+    constexpr std::size_t SLOT_COUNT = 1024; // Power of two
+    constexpr std::size_t PAYLOAD_BYTES = 64;
+
+    struct Slot
+    {
+        // Odd while the slot is being written, otherwise 2 * (record index + 1)
+        std::atomic<quint64> sequence{0};
+        qint64 timestampNs;
+        quint16 size;
+        FlightRecorder::Channel channel;
+        char payload[PAYLOAD_BYTES];
+    };
+
+    std::array<Slot, SLOT_COUNT> slots;
+    std::atomic<quint64> nextIndex{0};
+    const qint64 startNs = [] {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }();
+
+    const char *channelName(FlightRecorder::Channel channel)
+    {
+        switch (channel)
+        {
+        case FlightRecorder::Channel::FromAirPods:
+            return "airpods -> host ";
+        case FlightRecorder::Channel::ToAirPods:
+            return "host -> airpods ";
+        case FlightRecorder::Channel::FromPhone:
+            return "phone -> host   ";
+        case FlightRecorder::Channel::ToPhone:
+            return "host -> phone   ";
+        }
+        return "?               ";
+    }
+
+    // Minimal formatting helpers; snprintf is not async-signal-safe
+    class LineWriter
+    {
+    public:
+        explicit LineWriter(int fd) : m_fd(fd) {}
+
+        void text(const char *s)
+        {
+            while (*s)
+            {
+                put(*s++);
+            }
+        }
+
+        void number(quint64 value, int minDigits = 1)
+        {
+            char digits[20];
+            int count = 0;
+            do
+            {
+                digits[count++] = char('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+            for (int i = count; i < minDigits; ++i)
+            {
+                put('0');
+            }
+            while (count > 0)
+            {
+                put(digits[--count]);
+            }
+        }
+
+        void hex(const char *data, std::size_t size)
+        {
+            static const char table[] = "0123456789abcdef";
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                const unsigned char byte = static_cast<unsigned char>(data[i]);
+                put(table[byte >> 4]);
+                put(table[byte & 0x0f]);
+            }
+        }
+
+        void flush()
+        {
+            std::size_t offset = 0;
+            while (offset < m_used)
+            {
+                const ssize_t written = ::write(m_fd, m_buffer + offset, m_used - offset);
+                if (written <= 0)
+                {
+                    break;
+                }
+                offset += static_cast<std::size_t>(written);
+            }
+            m_used = 0;
+        }
+
+    private:
+        void put(char c)
+        {
+            if (m_used == sizeof(m_buffer))
+            {
+                flush();
+            }
+            m_buffer[m_used++] = c;
+        }
+
+        int m_fd;
+        char m_buffer[512];
+        std::size_t m_used = 0;
+    };
+
+    void onDumpSignal(int)
+    {
+        const int savedErrno = errno;
+        FlightRecorder::dump(STDERR_FILENO);
+        errno = savedErrno;
+    }
+
+    void onFatalSignal(int signal)
+    {
+        LineWriter out(STDERR_FILENO);
+        out.text("librepods: fatal signal ");
+        out.number(static_cast<quint64>(signal));
+        out.text(", dumping flight recorder\n");
+        out.flush();
+        FlightRecorder::dump(STDERR_FILENO);
+        // SA_RESETHAND restored the default action, so this terminates as usual
+        ::raise(signal);
+    }
+}
+
+namespace FlightRecorder
+{
+    void record(Channel channel, const char *data, std::size_t size)
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        const quint64 index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+        Slot &slot = slots[index & (SLOT_COUNT - 1)];
+
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.timestampNs = qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+        slot.size = static_cast<quint16>(size > 0xffff ? 0xffff : size);
+        slot.channel = channel;
+        std::memcpy(slot.payload, data, size < PAYLOAD_BYTES ? size : PAYLOAD_BYTES);
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+    }
+
+    void dump(int fd)
+    {
+        LineWriter out(fd);
+        const quint64 end = nextIndex.load(std::memory_order_acquire);
+        const quint64 begin = end > SLOT_COUNT ? end - SLOT_COUNT : 0;
+
+        out.text("--- flight recorder: ");
+        out.number(end - begin);
+        out.text(" of ");
+        out.number(end);
+        out.text(" packets ---\n");
+
+        for (quint64 index = begin; index < end; ++index)
+        {
+            const Slot &slot = slots[index & (SLOT_COUNT - 1)];
+            const quint64 before = slot.sequence.load(std::memory_order_acquire);
+            if (before != 2 * index + 2)
+            {
+                continue; // Being written right now, or already overwritten
+            }
+            const qint64 timestampNs = slot.timestampNs;
+            const quint16 size = slot.size;
+            const Channel channel = slot.channel;
+            char payload[PAYLOAD_BYTES];
+            std::memcpy(payload, slot.payload, PAYLOAD_BYTES);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != before)
+            {
+                continue;
+            }
+
+            const quint64 sinceStartUs = static_cast<quint64>(timestampNs - startNs) / 1000;
+            out.text("[");
+            out.number(sinceStartUs / 1000000);
+            out.text(".");
+            out.number(sinceStartUs % 1000000, 6);
+            out.text("] ");
+            out.text(channelName(channel));
+            out.number(size);
+            out.text(" bytes: ");
+            out.hex(payload, size < PAYLOAD_BYTES ? size : PAYLOAD_BYTES);
+            out.text(size > PAYLOAD_BYTES ? "...\n" : "\n");
+        }
+        out.text("--- end of flight recorder ---\n");
+        out.flush();
+    }
+
+    void installSignalHandlers()
+    {
+        struct sigaction action
+        {
+        };
+        sigemptyset(&action.sa_mask);
+
+        action.sa_handler = onDumpSignal;
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &action, nullptr);
+
+        action.sa_handler = onFatalSignal;
+        action.sa_flags = SA_RESETHAND;
+        for (int signal : {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT})
+        {
+            sigaction(signal, &action, nullptr);
+        }
+    }
+}
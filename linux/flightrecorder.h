@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QByteArray>
+#include <cstddef>
+
+/**
+ * Always-on binary record of the most recent packets.
+ *
+ * record() copies the first bytes of a packet and a timestamp into a fixed lock-free
+ * ring; nothing is formatted until the ring is dumped. A dump is written on SIGUSR1
+ * and when the process crashes, so the packets leading up to a problem are available
+ * even when debug logging was off.
+ */
+namespace FlightRecorder
+{
+    enum class Channel : quint8
+    {
+        FromAirPods,
+        ToAirPods,
+        FromPhone,
+        ToPhone,
+    };
+
+    // Safe to call from any thread, never blocks or allocates
+    void record(Channel channel, const char *data, std::size_t size);
+    inline void record(Channel channel, const QByteArray &packet)
+    {
+        record(channel, packet.constData(), static_cast<std::size_t>(packet.size()));
+    }
+
+    // Writes the ring, oldest record first. Async-signal-safe.
+    void dump(int fd);
+
+    // Dumps to stderr on SIGUSR1 and before dying on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT
+    void installSignalHandlers();
+}
@@ -0,0 +1,390 @@
+#include "ioworker.h"
+#include "relayengine.h"
+#include "transports.h"
+#include "airpods_packets.h"
+#include "flightrecorder.h"
+#include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <QThread>
+#include <QTimer>
+
+namespace
+{
+    constexpr int NOTIFICATION_RETRY_MS = 2000;
+    constexpr int BACKLOG_RETRY_MS = 10;
+}
+
+bool IoWorker::Link::isOpen() const
+{
+    return transport && transport->isOpen();
+}
+
+IoWorker::IoWorker(QObject *parent) : QObject(parent)
+{
+    m_relay = new RelayEngine(this);
+    connect(m_relay, &RelayEngine::phoneConnected, this, &IoWorker::onPhoneConnected);
+    connect(m_relay, &RelayEngine::phoneDisconnected, this, [this]()
+            { postEvent(IoEvent::Type::PhoneDisconnected); });
+    connect(m_relay, &RelayEngine::phoneTookAirPods, this, [this]()
+            { postEvent(IoEvent::Type::PhoneTookAirPods); });
+    connect(m_relay, &RelayEngine::phoneReleasedAirPods, this, [this]()
+            { postEvent(IoEvent::Type::PhoneReleasedAirPods); });
+    connect(m_relay, &RelayEngine::phoneRequestedDisconnect, this, [this]()
+            {
+        if (!m_relayLink) {
+            return;
+        }
+        const quint64 address = m_relayLink->address;
+        closeLink(address);
+        LOG_INFO("Disconnected from AirPods");
+        postEvent(IoEvent::Type::PhoneDisconnectRequest, QByteArray(), address); });
+
+    m_backlogTimer = new QTimer(this);
+    m_backlogTimer->setSingleShot(true);
+    m_backlogTimer->setInterval(BACKLOG_RETRY_MS);
+    connect(m_backlogTimer, &QTimer::timeout, this, &IoWorker::flushBacklog);
+}
+
+IoWorker::~IoWorker()
+{
+    disconnectAllAirPods();
+    m_relay->disconnectPhone();
+}
+
+void IoWorker::setCrossDeviceEnabled(bool enabled)
+{
+    m_relay->setEnabled(enabled);
+}
+
+void IoWorker::postEvent(IoEvent::Type type, const QByteArray &data, quint64 device)
+{
+    IoEvent event{type, data, Metrics::nowNs(), device};
+    if (!m_backlog.empty() || !m_events.push(std::move(event)))
+    {
+        // Never drop state deltas: keep them in order on this side until the GUI catches up
+        m_backlog.push_back(std::move(event));
+        if (!m_backlogTimer->isActive())
+        {
+            m_backlogTimer->start();
+        }
+    }
+
+    if (!m_wakeupPending.exchange(true, std::memory_order_acq_rel))
+    {
+        emit eventsAvailable();
+    }
+}
+
+void IoWorker::flushBacklog()
+{
+    while (!m_backlog.empty() && m_events.push(std::move(m_backlog.front())))
+    {
+        m_backlog.pop_front();
+    }
+
+    if (!m_backlog.empty())
+    {
+        m_backlogTimer->start();
+    }
+    if (!m_wakeupPending.exchange(true, std::memory_order_acq_rel))
+    {
+        emit eventsAvailable();
+    }
+}
+
+void IoWorker::connectToAirPods(const QBluetoothAddress &address)
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, address]() { connectToAirPods(address); }, Qt::QueuedConnection);
+        return;
+    }
+
+    const quint64 key = address.toUInt64();
+    auto existing = m_links.find(key);
+    if (existing != m_links.end() && existing->second->isOpen())
+    {
+        LOG_INFO("Already connected to " << address.toString());
+        return;
+    }
+    closeLink(key);
+
+    auto owned = std::make_unique<Link>();
+    Link *link = owned.get();
+    link->address = key;
+    link->traceId = m_nextTraceId++;
+    link->transport = Transports::createAirPodsTransport(address, this);
+    link->notificationRetryTimer = new QTimer(this);
+    link->notificationRetryTimer->setSingleShot(true);
+    link->notificationRetryTimer->setInterval(NOTIFICATION_RETRY_MS);
+    m_links.emplace(key, std::move(owned));
+
+    if (!m_relayLink && (m_relayAddress == 0 || m_relayAddress == key))
+    {
+        m_relayLink = link;
+        m_relayAddress = key;
+        m_relay->setAirPodsTransport(link->transport, &link->writes);
+    }
+
+    Trace::asyncBegin("airpods.connect", link->traceId);
+    connect(link->notificationRetryTimer, &QTimer::timeout, this, [this, link]()
+            {
+        if (link->lastBatteryStatus.isEmpty()) {
+            send(link, AirPodsPackets::Connection::REQUEST_NOTIFICATIONS);
+        } });
+    connect(link->transport, &Transport::connected, this, [this, link]()
+            {
+        LOG_INFO("Connected to device, sending initial packets");
+        Trace::asyncEnd("airpods.connect", link->traceId);
+        Trace::asyncBegin("airpods.handshake", link->traceId);
+        postEvent(IoEvent::Type::AirPodsConnected, QByteArray(), link->address);
+        send(link, AirPodsPackets::Connection::HANDSHAKE); });
+    connect(link->transport, &Transport::readyRead, this, [this, link]()
+            { onAirPodsReadyRead(link); });
+    connect(link->transport, &Transport::bytesWritten, this, [link]()
+            { link->writes.flush(link->transport); });
+    connect(link->transport, &Transport::disconnected, this, [this, link]()
+            { postEvent(IoEvent::Type::AirPodsDisconnected, QByteArray(), link->address); });
+    connect(link->transport, &Transport::errorOccurred, this, [this, link](const QString &message)
+            {
+        LOG_ERROR("Socket error: " << message);
+        postEvent(IoEvent::Type::AirPodsError, message.toUtf8(), link->address); });
+
+    link->transport->open();
+}
+
+void IoWorker::disconnectAirPods(const QBluetoothAddress &address)
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, address]() { disconnectAirPods(address); }, Qt::QueuedConnection);
+        return;
+    }
+
+    const quint64 key = address.toUInt64();
+    if (m_links.count(key))
+    {
+        LOG_WARN("Socket is still open, closing it");
+        closeLink(key);
+    }
+    if (key == m_relayAddress && m_relay->isPhoneOpen())
+    {
+        m_relay->sendToPhone(AirPodsPackets::Connection::AIRPODS_DISCONNECTED);
+    }
+}
+
+void IoWorker::disconnectAllAirPods()
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this]() { disconnectAllAirPods(); }, Qt::QueuedConnection);
+        return;
+    }
+
+    while (!m_links.empty())
+    {
+        closeLink(m_links.begin()->first);
+    }
+}
+
+void IoWorker::closeLink(quint64 address)
+{
+    auto it = m_links.find(address);
+    if (it == m_links.end())
+    {
+        return;
+    }
+
+    std::unique_ptr<Link> link = std::move(it->second);
+    m_links.erase(it);
+    if (m_relayLink == link.get())
+    {
+        m_relay->setAirPodsTransport(nullptr);
+        m_relayLink = nullptr;
+    }
+
+    const bool wasConnected = link->isOpen();
+    delete link->notificationRetryTimer;
+    link->transport->disconnect(this);
+    link->transport->close();
+    link->transport->deleteLater();
+
+    if (wasConnected)
+    {
+        postEvent(IoEvent::Type::AirPodsDisconnected, QByteArray(), address);
+    }
+}
+
+void IoWorker::setRelayDevice(const QBluetoothAddress &address)
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, address]() { setRelayDevice(address); }, Qt::QueuedConnection);
+        return;
+    }
+
+    m_relayAddress = address.toUInt64();
+    auto it = m_links.find(m_relayAddress);
+    Link *link = it != m_links.end() ? it->second.get() : nullptr;
+    if (link == m_relayLink)
+    {
+        return;
+    }
+    m_relayLink = link;
+    m_relay->setAirPodsTransport(link ? link->transport : nullptr, link ? &link->writes : nullptr);
+    if (m_relay->isPhoneOpen())
+    {
+        replayStatusToPhone();
+    }
+}
+
+void IoWorker::sendToAirPods(const QBluetoothAddress &address, const QByteArray &packet)
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, address, packet]() { sendToAirPods(address, packet); }, Qt::QueuedConnection);
+        return;
+    }
+
+    auto it = m_links.find(address.toUInt64());
+    if (it == m_links.end())
+    {
+        LOG_ERROR("No link to " << address.toString() << ", cannot write packet");
+        return;
+    }
+    send(it->second.get(), packet);
+}
+
+void IoWorker::send(Link *link, const QByteArray &packet)
+{
+    if (!link->isOpen())
+    {
+        LOG_ERROR("Socket is not open, cannot write packet");
+        return;
+    }
+    FlightRecorder::record(FlightRecorder::Channel::ToAirPods, packet);
+    switch (link->writes.write(link->transport, packet.constData(), packet.size()))
+    {
+    case WriteQueue::Result::Written:
+        LOG_DEBUG("Packet written: " << packet.toHex());
+        break;
+    case WriteQueue::Result::Queued:
+        LOG_DEBUG("Socket backed up, packet queued: " << packet.toHex());
+        break;
+    case WriteQueue::Result::QueuedDroppingOldest:
+    {
+        static Metrics::Counter &dropped = Metrics::counter("airpods_write_dropped_total");
+        dropped.add();
+        LOG_WARN("Socket backed up, dropped the oldest queued packet");
+        break;
+    }
+    case WriteQueue::Result::Failed:
+        LOG_ERROR("Failed to write packet: " << packet.toHex());
+        break;
+    }
+}
+
+void IoWorker::onAirPodsReadyRead(Link *link)
+{
+    TRACE_SCOPE("IoWorker::onAirPodsReadyRead");
+    QByteArray data = link->transport->readAll();
+    FlightRecorder::record(FlightRecorder::Channel::FromAirPods, data);
+
+    // Forward first: the phone should not wait for anything we do locally
+    if (link == m_relayLink)
+    {
+        m_relay->forwardToPhone(data);
+    }
+
+    // The connection handshake only involves the socket, so answer it right here
+    if (data.startsWith(AirPodsPackets::Parse::HANDSHAKE_ACK))
+    {
+        Trace::instant("airpods.handshake_ack");
+        send(link, AirPodsPackets::Connection::SET_SPECIFIC_FEATURES);
+        return;
+    }
+    if (data.startsWith(AirPodsPackets::Parse::FEATURES_ACK))
+    {
+        Trace::asyncEnd("airpods.handshake", link->traceId);
+        send(link, AirPodsPackets::Connection::REQUEST_NOTIFICATIONS);
+        link->notificationRetryTimer->start();
+        return;
+    }
+
+    if (data.startsWith(AirPodsPackets::Parse::BATTERY_STATUS))
+    {
+        link->lastBatteryStatus = data;
+    }
+    else if (data.startsWith(AirPodsPackets::Parse::EAR_DETECTION))
+    {
+        link->lastEarDetectionStatus = data;
+    }
+
+    postEvent(IoEvent::Type::AirPodsPacket, data, link->address);
+}
+
+void IoWorker::connectToPhone(const QBluetoothAddress &address)
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, address]() { connectToPhone(address); }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (address.isNull() && Transports::backend() != Transports::Backend::Simulator)
+    {
+        m_relay->setPhoneTransportFactory(nullptr);
+        return;
+    }
+    m_relay->setPhoneTransportFactory([address](QObject *parent)
+                                      { return Transports::createPhoneTransport(address, parent); });
+    m_relay->connectToPhone();
+}
+
+void IoWorker::onPhoneConnected()
+{
+    postEvent(IoEvent::Type::PhoneConnected);
+    replayStatusToPhone();
+}
+
+void IoWorker::replayStatusToPhone()
+{
+    if (!m_relayLink)
+    {
+        return;
+    }
+    if (!m_relayLink->lastBatteryStatus.isEmpty())
+    {
+        m_relay->forwardToPhone(m_relayLink->lastBatteryStatus);
+        LOG_DEBUG("Sent last battery status to phone: " << m_relayLink->lastBatteryStatus.toHex());
+    }
+    if (!m_relayLink->lastEarDetectionStatus.isEmpty())
+    {
+        m_relay->forwardToPhone(m_relayLink->lastEarDetectionStatus);
+        LOG_DEBUG("Sent last ear detection status to phone: " << m_relayLink->lastEarDetectionStatus.toHex());
+    }
+}
+
+void IoWorker::disconnectPhone()
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this]() { disconnectPhone(); }, Qt::QueuedConnection);
+        return;
+    }
+
+    m_relay->disconnectPhone();
+}
+
+void IoWorker::sendToPhone(const QByteArray &packet)
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, packet]() { sendToPhone(packet); }, Qt::QueuedConnection);
+        return;
+    }
+
+    m_relay->sendToPhone(packet);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QBluetoothAddress>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+#include "spscqueue.hpp"
+#include "writequeue.h"
+
+class QTimer;
+class RelayEngine;
+class Transport;
+
+// State delta handed from the I/O thread to the GUI thread
+struct IoEvent
+{
+    enum class Type : quint8
+    {
+        AirPodsConnected,
+        AirPodsDisconnected,
+        AirPodsError,             // data: socket error string
+        AirPodsPacket,            // data: raw AACP packet
+        PhoneConnected,
+        PhoneDisconnected,
+        PhoneTookAirPods,         // Phone reported that it is now connected to the AirPods
+        PhoneReleasedAirPods,     // Phone reported that it let go of the AirPods
+        PhoneDisconnectRequest,   // AirPods socket was closed on the phone's behalf
+    };
+
+    Type type = Type::AirPodsPacket;
+    QByteArray data;
+    qint64 timestampNs = 0; // Metrics::nowNs() when the I/O thread posted the event
+    quint64 device = 0;     // QBluetoothAddress::toUInt64() of the AirPods, for the AirPods* types
+};
+
+/**
+ * Owns the AirPods and phone links on a dedicated thread.
+ *
+ * There is one link per pair of AirPods, looked up by address; each transport's
+ * handlers are bound to their link, so incoming data never has to be matched to a
+ * device. The phone relay follows one of them, see setRelayDevice().
+ *
+ * Reads, the connection handshake and the phone relay (see RelayEngine) all happen on the I/O thread,
+ * so they keep running while the GUI thread is busy rendering QML or blocked on
+ * PulseAudio, D-Bus or QProcess. Everything the GUI needs to know is pushed through
+ * a single-producer/single-consumer queue and picked up with drainEvents().
+ *
+ * All public slots are safe to call from any thread; calls from a foreign thread are
+ * re-posted to the I/O thread.
+ */
+class IoWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit IoWorker(QObject *parent = nullptr);
+    ~IoWorker();
+
+    // Consumer side, GUI thread only. Calls handler(IoEvent &) for every pending event.
+    template <typename Handler>
+    void drainEvents(Handler &&handler)
+    {
+        // Clear the flag first so that a push racing with the drain triggers a new wakeup
+        m_wakeupPending.store(false, std::memory_order_release);
+        IoEvent event;
+        while (m_events.pop(event))
+        {
+            handler(event);
+        }
+    }
+
+    void setCrossDeviceEnabled(bool enabled);
+
+public slots:
+    // Opens a link to these AirPods; links to other AirPods stay up
+    void connectToAirPods(const QBluetoothAddress &address);
+    void disconnectAirPods(const QBluetoothAddress &address);
+    void disconnectAllAirPods();
+    void sendToAirPods(const QBluetoothAddress &address, const QByteArray &packet);
+    // The AirPods whose traffic is relayed to the phone
+    void setRelayDevice(const QBluetoothAddress &address);
+
+    void connectToPhone(const QBluetoothAddress &address);
+    void disconnectPhone();
+    void sendToPhone(const QByteArray &packet);
+
+signals:
+    // Emitted once when the event queue goes from drained to non-empty
+    void eventsAvailable();
+
+private:
+    struct Link
+    {
+        quint64 address = 0;
+        Transport *transport = nullptr;
+        QTimer *notificationRetryTimer = nullptr;
+        quint64 traceId = 0;
+        WriteQueue writes; // Shared with the relay while this is the relay link
+
+        // Latest status packets, so a phone connecting later gets them too
+        QByteArray lastBatteryStatus;
+        QByteArray lastEarDetectionStatus;
+
+        bool isOpen() const;
+    };
+
+    void postEvent(IoEvent::Type type, const QByteArray &data = QByteArray(), quint64 device = 0);
+    void flushBacklog();
+
+    void onAirPodsReadyRead(Link *link);
+    void onPhoneConnected();
+    void replayStatusToPhone();
+    void closeLink(quint64 address);
+    void send(Link *link, const QByteArray &packet);
+
+    std::unordered_map<quint64, std::unique_ptr<Link>> m_links;
+    Link *m_relayLink = nullptr;
+    quint64 m_relayAddress = 0;
+    quint64 m_nextTraceId = 1;
+    RelayEngine *m_relay = nullptr;
+    QTimer *m_backlogTimer = nullptr;
+
+    std::atomic<bool> m_wakeupPending{false};
+    SpscQueue<IoEvent, 256> m_events;
+    std::deque<IoEvent> m_backlog; // I/O thread only, used while the GUI lags behind
+};
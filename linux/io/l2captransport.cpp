@@ -0,0 +1,104 @@
+#include "l2captransport.h"
+#include "logger.h"
+
+#include <QtEndian>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// The few BlueZ definitions needed here, so building does not depend on libbluetooth headers
+namespace
+{
+    constexpr int BTPROTO_L2CAP_ = 0;
+    constexpr int SOL_L2CAP_ = 6;
+    constexpr int L2CAP_OPTIONS_ = 0x01;
+
+    struct BdAddr
+    {
+        quint8 b[6];
+    } __attribute__((packed));
+
+    struct SockAddrL2
+    {
+        sa_family_t l2_family;
+        quint16 l2_psm;
+        BdAddr l2_bdaddr;
+        quint16 l2_cid;
+        quint8 l2_bdaddr_type;
+    };
+
+    struct L2capOptions
+    {
+        quint16 omtu;
+        quint16 imtu;
+        quint16 flush_to;
+        quint8 mode;
+        quint8 fcs;
+        quint8 max_tx;
+        quint16 txwin_size;
+    };
+
+    void setBufferSize(int fd, int option, int size, const char *name)
+    {
+        if (size > 0 && ::setsockopt(fd, SOL_SOCKET, option, &size, sizeof(size)) < 0)
+        {
+            LOG_WARN("Failed to set " << name << " to " << size << ": " << std::strerror(errno));
+        }
+    }
+}
+
+L2capTransport::L2capTransport(const QBluetoothAddress &address, quint16 psm, const Options &options, QObject *parent)
+    : SocketTransport(parent), m_address(address), m_psm(psm), m_options(options)
+{
+}
+
+int L2capTransport::connectDescriptor(bool &inProgress, QString &error)
+{
+    const int fd = ::socket(AF_BLUETOOTH, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, BTPROTO_L2CAP_);
+    if (fd < 0)
+    {
+        error = QString::fromLocal8Bit(std::strerror(errno));
+        return -1;
+    }
+
+    if (m_options.mtu > 0)
+    {
+        L2capOptions l2capOptions{};
+        socklen_t length = sizeof(l2capOptions);
+        if (::getsockopt(fd, SOL_L2CAP_, L2CAP_OPTIONS_, &l2capOptions, &length) == 0)
+        {
+            l2capOptions.imtu = static_cast<quint16>(m_options.mtu);
+            if (::setsockopt(fd, SOL_L2CAP_, L2CAP_OPTIONS_, &l2capOptions, length) < 0)
+            {
+                LOG_WARN("Failed to set L2CAP MTU to " << m_options.mtu << ": " << std::strerror(errno));
+            }
+        }
+    }
+    setBufferSize(fd, SO_SNDBUF, m_options.sendBuffer, "SO_SNDBUF");
+    setBufferSize(fd, SO_RCVBUF, m_options.receiveBuffer, "SO_RCVBUF");
+
+    SockAddrL2 addr{};
+    addr.l2_family = AF_BLUETOOTH;
+    addr.l2_psm = qToLittleEndian(m_psm);
+    // bdaddr_t is stored least significant byte first
+    const quint64 address = m_address.toUInt64();
+    for (int i = 0; i < 6; ++i)
+    {
+        addr.l2_bdaddr.b[i] = static_cast<quint8>(address >> (8 * i));
+    }
+
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        if (errno == EINPROGRESS || errno == EAGAIN)
+        {
+            inProgress = true;
+            return fd;
+        }
+        error = QString::fromLocal8Bit(std::strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+    inProgress = false;
+    return fd;
+}
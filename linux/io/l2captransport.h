@@ -0,0 +1,35 @@
+#pragma once
+
+#include "sockettransport.h"
+
+#include <QBluetoothAddress>
+
+/**
+ * L2CAP channel on a raw BlueZ AF_BLUETOOTH socket, connected by PSM.
+ *
+ * Unlike QtBluetooth this allows connecting without an SDP lookup and tuning the
+ * channel: the incoming MTU and the kernel socket buffers. Smaller buffers keep
+ * fewer packets queued in the kernel, which bounds the latency added under load.
+ */
+class L2capTransport : public SocketTransport
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        int mtu = 0;            // Incoming MTU; 0 keeps the kernel default
+        int sendBuffer = 0;     // SO_SNDBUF in bytes; 0 keeps the kernel default
+        int receiveBuffer = 0;  // SO_RCVBUF in bytes; 0 keeps the kernel default
+    };
+
+    L2capTransport(const QBluetoothAddress &address, quint16 psm, const Options &options = Options(),
+                   QObject *parent = nullptr);
+
+protected:
+    int connectDescriptor(bool &inProgress, QString &error) override;
+
+private:
+    QBluetoothAddress m_address;
+    quint16 m_psm;
+    Options m_options;
+};
@@ -0,0 +1,59 @@
+#include "localtransport.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+LocalTransport::LocalTransport(const QString &path, QObject *parent) : SocketTransport(parent), m_path(path)
+{
+}
+
+LocalTransport::~LocalTransport()
+{
+    if (m_adoptedFd >= 0)
+    {
+        ::close(m_adoptedFd);
+    }
+}
+
+LocalTransport *LocalTransport::fromDescriptor(int fd, QObject *parent)
+{
+    LocalTransport *transport = new LocalTransport(QString(), parent);
+    transport->m_adoptedFd = fd;
+    return transport;
+}
+
+int LocalTransport::connectDescriptor(bool &inProgress, QString &error)
+{
+    inProgress = false;
+    if (m_adoptedFd >= 0)
+    {
+        const int fd = m_adoptedFd;
+        m_adoptedFd = -1;
+        return fd;
+    }
+
+    const QByteArray path = m_path.toLocal8Bit();
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.isEmpty() || path.size() >= static_cast<int>(sizeof(addr.sun_path)))
+    {
+        error = QStringLiteral("Invalid socket path: %1").arg(m_path);
+        return -1;
+    }
+    std::memcpy(addr.sun_path, path.constData(), path.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        error = QString::fromLocal8Bit(std::strerror(errno));
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
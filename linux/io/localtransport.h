@@ -0,0 +1,28 @@
+#pragma once
+
+#include "sockettransport.h"
+
+/**
+ * SOCK_SEQPACKET Unix socket standing in for an L2CAP channel.
+ *
+ * Packet boundaries survive the trip just like they do over L2CAP, so the relay and
+ * the parsers see exactly what they would see from real hardware. Either connects to
+ * a listening socket path or adopts one end of a socketpair().
+ */
+class LocalTransport : public SocketTransport
+{
+    Q_OBJECT
+public:
+    explicit LocalTransport(const QString &path, QObject *parent = nullptr);
+    ~LocalTransport();
+
+    // Takes ownership of an already connected SOCK_SEQPACKET descriptor
+    static LocalTransport *fromDescriptor(int fd, QObject *parent = nullptr);
+
+protected:
+    int connectDescriptor(bool &inProgress, QString &error) override;
+
+private:
+    QString m_path;
+    int m_adoptedFd = -1;
+};
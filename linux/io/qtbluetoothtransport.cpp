@@ -0,0 +1,79 @@
+#include "qtbluetoothtransport.h"
+
+#include <QBluetoothSocket>
+
+QtBluetoothTransport::QtBluetoothTransport(const QBluetoothAddress &address, const QBluetoothUuid &service, QObject *parent)
+    : Transport(parent), m_address(address), m_service(service)
+{
+}
+
+QtBluetoothTransport::~QtBluetoothTransport()
+{
+    close();
+}
+
+void QtBluetoothTransport::open()
+{
+    close();
+
+    m_socket = new QBluetoothSocket(QBluetoothServiceInfo::L2capProtocol, this);
+    connect(m_socket, &QBluetoothSocket::connected, this, &Transport::connected);
+    connect(m_socket, &QBluetoothSocket::disconnected, this, &Transport::disconnected);
+    connect(m_socket, &QBluetoothSocket::readyRead, this, &Transport::readyRead);
+    connect(m_socket, &QBluetoothSocket::bytesWritten, this, &Transport::bytesWritten);
+    connect(m_socket, QOverload<QBluetoothSocket::SocketError>::of(&QBluetoothSocket::errorOccurred),
+            this, [this]()
+            { emit errorOccurred(m_socket->errorString()); });
+
+    m_socket->connectToService(m_address, m_service);
+}
+
+void QtBluetoothTransport::close()
+{
+    if (!m_socket)
+    {
+        return;
+    }
+    m_socket->disconnect(this);
+    m_socket->close();
+    m_socket->deleteLater();
+    m_socket = nullptr;
+}
+
+Transport::State QtBluetoothTransport::state() const
+{
+    if (!m_socket)
+    {
+        return State::Closed;
+    }
+    switch (m_socket->state())
+    {
+    case QBluetoothSocket::SocketState::ConnectedState:
+        return State::Open;
+    case QBluetoothSocket::SocketState::ServiceLookupState:
+    case QBluetoothSocket::SocketState::ConnectingState:
+        return State::Connecting;
+    default:
+        return State::Closed;
+    }
+}
+
+qint64 QtBluetoothTransport::write(const char *data, qint64 size)
+{
+    return m_socket ? m_socket->write(data, size) : -1;
+}
+
+QByteArray QtBluetoothTransport::readAll()
+{
+    return m_socket ? m_socket->readAll() : QByteArray();
+}
+
+qint64 QtBluetoothTransport::bytesToWrite() const
+{
+    return m_socket ? m_socket->bytesToWrite() : 0;
+}
+
+QString QtBluetoothTransport::errorString() const
+{
+    return m_socket ? m_socket->errorString() : QString();
+}
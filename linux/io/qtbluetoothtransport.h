@@ -0,0 +1,33 @@
+#pragma once
+
+#include "transport.h"
+
+#include <QBluetoothAddress>
+#include <QBluetoothUuid>
+
+class QBluetoothSocket;
+
+// L2CAP channel opened through QtBluetooth's service lookup
+class QtBluetoothTransport : public Transport
+{
+    Q_OBJECT
+public:
+    QtBluetoothTransport(const QBluetoothAddress &address, const QBluetoothUuid &service, QObject *parent = nullptr);
+    ~QtBluetoothTransport();
+
+    void open() override;
+    void close() override;
+    State state() const override;
+
+    using Transport::write;
+    qint64 write(const char *data, qint64 size) override;
+    QByteArray readAll() override;
+    qint64 bytesToWrite() const override;
+
+    QString errorString() const override;
+
+private:
+    QBluetoothAddress m_address;
+    QBluetoothUuid m_service;
+    QBluetoothSocket *m_socket = nullptr;
+};
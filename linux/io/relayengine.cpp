@@ -0,0 +1,322 @@
+#include "relayengine.h"
+#include "airpods_packets.h"
+#include "flightrecorder.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QTimer>
+#include <cstring>
+
+namespace
+{
+    constexpr int FRAME_RESERVE_BYTES = 1024;   // Covers every AACP packet seen in practice
+    constexpr int INITIAL_BACKOFF_MS = 1000;
+    constexpr int MAX_BACKOFF_MS = 60000;
+
+    // Mirrors RelayEngine::Stats for the process-wide metrics snapshot
+    struct RelayMetrics
+    {
+        Metrics::Counter &toPhonePackets = Metrics::counter("relay_to_phone_packets_total");
+        Metrics::Counter &toPhoneBytes = Metrics::counter("relay_to_phone_bytes_total");
+        Metrics::Counter &toAirPodsPackets = Metrics::counter("relay_to_airpods_packets_total");
+        Metrics::Counter &toAirPodsBytes = Metrics::counter("relay_to_airpods_bytes_total");
+        Metrics::Counter &dropped = Metrics::counter("relay_dropped_total");
+        Metrics::Counter &reconnectAttempts = Metrics::counter("relay_phone_reconnect_attempts_total");
+    };
+
+    RelayMetrics &relayMetrics()
+    {
+        static RelayMetrics metrics;
+        return metrics;
+    }
+}
+
+RelayEngine::RelayEngine(QObject *parent) : QObject(parent), m_backoffMs(INITIAL_BACKOFF_MS)
+{
+    m_frame.reserve(FRAME_RESERVE_BYTES);
+    m_frame.append(AirPodsPackets::Phone::NOTIFICATION); // Header stays in place, payload is copied behind it
+    m_phone.queue = &m_phone.ownQueue;
+    m_airPods.queue = &m_airPods.ownQueue;
+
+    m_reconnectTimer = new QTimer(this);
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout, this, [this]()
+            {
+        if (m_reconnectWanted) {
+            attemptPhoneConnection();
+        } });
+}
+
+RelayEngine::~RelayEngine()
+{
+    disconnectPhone();
+    setAirPodsTransport(nullptr);
+}
+
+bool RelayEngine::isOpen(const Channel &channel) const
+{
+    return channel.transport && channel.transport->isOpen();
+}
+
+bool RelayEngine::isPhoneOpen() const
+{
+    return isOpen(m_phone);
+}
+
+bool RelayEngine::writeFrame(Channel &channel, const char *data, qint64 size)
+{
+    if (!isOpen(channel))
+    {
+        return false;
+    }
+    FlightRecorder::record(&channel == &m_phone ? FlightRecorder::Channel::ToPhone : FlightRecorder::Channel::ToAirPods,
+                           data, static_cast<std::size_t>(size));
+
+    const WriteQueue::Result result = channel.queue->write(channel.transport, data, size);
+    if (result == WriteQueue::Result::QueuedDroppingOldest)
+    {
+        ++m_stats.dropped;
+        relayMetrics().dropped.add();
+    }
+    return result != WriteQueue::Result::Failed;
+}
+
+void RelayEngine::flushPending(Channel &channel)
+{
+    if (channel.transport)
+    {
+        channel.queue->flush(channel.transport);
+    }
+}
+
+void RelayEngine::setAirPodsTransport(Transport *transport, WriteQueue *queue)
+{
+    if (m_airPods.transport)
+    {
+        m_airPods.transport->disconnect(this);
+    }
+    m_airPods.transport = transport;
+    m_airPods.ownQueue.clear();
+    m_airPods.queue = queue ? queue : &m_airPods.ownQueue;
+
+    if (transport)
+    {
+        connect(transport, &Transport::bytesWritten, this, [this]()
+                { flushPending(m_airPods); });
+    }
+}
+
+void RelayEngine::forwardToPhone(const QByteArray &packet)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    if (!isOpen(m_phone))
+    {
+        // One connection attempt at a time, throttled by the backoff timer
+        m_reconnectWanted = true;
+        if (!m_reconnectTimer->isActive())
+        {
+            attemptPhoneConnection();
+        }
+        return;
+    }
+
+    const int headerSize = AirPodsPackets::Phone::NOTIFICATION.size();
+    m_frame.resize(headerSize + packet.size());
+    std::memcpy(m_frame.data() + headerSize, packet.constData(), packet.size());
+
+    if (writeFrame(m_phone, m_frame.constData(), m_frame.size()))
+    {
+        ++m_stats.toPhonePackets;
+        m_stats.toPhoneBytes += m_frame.size();
+        relayMetrics().toPhonePackets.add();
+        relayMetrics().toPhoneBytes.add(m_frame.size());
+    }
+}
+
+void RelayEngine::sendToPhone(const QByteArray &packet)
+{
+    if (!writeFrame(m_phone, packet.constData(), packet.size()))
+    {
+        LOG_WARN("Phone socket is not open, cannot send packet");
+        return;
+    }
+    LOG_DEBUG("Sent packet to phone: " << packet.toHex());
+}
+
+void RelayEngine::setPhoneTransportFactory(TransportFactory factory)
+{
+    disconnectPhone();
+    m_phoneFactory = std::move(factory);
+    m_backoffMs = INITIAL_BACKOFF_MS;
+}
+
+void RelayEngine::connectToPhone()
+{
+    if (m_reconnectTimer->isActive())
+    {
+        m_reconnectWanted = true;
+        return;
+    }
+    attemptPhoneConnection();
+}
+
+void RelayEngine::attemptPhoneConnection()
+{
+    m_reconnectWanted = false;
+    if (!isEnabled() || m_phone.transport)
+    {
+        return; // Disabled, or a connection is already open or in flight
+    }
+    if (!m_phoneFactory)
+    {
+        LOG_DEBUG("No phone endpoint configured, not connecting to phone");
+        return;
+    }
+
+    ++m_stats.reconnectAttempts;
+    relayMetrics().reconnectAttempts.add();
+    Transport *transport = m_phoneFactory(this);
+    m_phone.transport = transport;
+
+    connect(transport, &Transport::connected, this, [this]()
+            {
+        LOG_INFO("Connected to phone");
+        m_backoffMs = INITIAL_BACKOFF_MS;
+        m_phoneWasConnected = true;
+        emit phoneConnected(); });
+    connect(transport, &Transport::readyRead, this, &RelayEngine::onPhoneReadyRead);
+    connect(transport, &Transport::bytesWritten, this, [this]()
+            { flushPending(m_phone); });
+    connect(transport, &Transport::disconnected, this, &RelayEngine::onPhoneLinkDown);
+    connect(transport, &Transport::errorOccurred, this, [this](const QString &message)
+            {
+        LOG_ERROR("Phone socket error: " << message);
+        onPhoneLinkDown(); });
+
+    transport->open();
+}
+
+void RelayEngine::onPhoneLinkDown()
+{
+    if (!m_phone.transport)
+    {
+        return;
+    }
+
+    m_phone.transport->disconnect(this);
+    m_phone.transport->close();
+    m_phone.transport->deleteLater();
+    m_phone.transport = nullptr;
+    m_phone.queue->clear();
+
+    if (m_phoneWasConnected)
+    {
+        m_phoneWasConnected = false;
+        emit phoneDisconnected();
+    }
+    scheduleReconnect();
+}
+
+void RelayEngine::scheduleReconnect()
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    LOG_DEBUG("Next phone connection attempt in " << m_backoffMs << " ms");
+    m_reconnectTimer->start(m_backoffMs);
+    m_backoffMs = qMin(m_backoffMs * 2, MAX_BACKOFF_MS);
+}
+
+void RelayEngine::disconnectPhone()
+{
+    m_reconnectTimer->stop();
+    m_reconnectWanted = false;
+
+    if (!m_phone.transport)
+    {
+        return;
+    }
+
+    m_phone.transport->disconnect(this);
+    m_phone.transport->close();
+    m_phone.transport->deleteLater();
+    m_phone.transport = nullptr;
+    m_phone.queue->clear();
+
+    if (m_phoneWasConnected)
+    {
+        m_phoneWasConnected = false;
+        emit phoneDisconnected();
+    }
+}
+
+void RelayEngine::onPhoneReadyRead()
+{
+    const QByteArray data = m_phone.transport->readAll();
+    FlightRecorder::record(FlightRecorder::Channel::FromPhone, data);
+    LOG_DEBUG("Data received from phone: " << data.toHex());
+    handlePhonePacket(data);
+}
+
+void RelayEngine::handlePhonePacket(const QByteArray &packet)
+{
+    if (packet.startsWith(AirPodsPackets::Phone::NOTIFICATION))
+    {
+        // Forward the payload in place instead of copying it out with mid()
+        const int headerSize = AirPodsPackets::Phone::NOTIFICATION.size();
+        const qint64 payloadSize = packet.size() - headerSize;
+        if (writeFrame(m_airPods, packet.constData() + headerSize, payloadSize))
+        {
+            ++m_stats.toAirPodsPackets;
+            m_stats.toAirPodsBytes += payloadSize;
+            relayMetrics().toAirPodsPackets.add();
+            relayMetrics().toAirPodsBytes.add(payloadSize);
+        }
+        else
+        {
+            LOG_ERROR("Socket is not open, cannot relay packet to AirPods");
+        }
+    }
+    else if (packet.startsWith(AirPodsPackets::Phone::CONNECTED))
+    {
+        LOG_INFO("AirPods connected");
+        emit phoneTookAirPods();
+    }
+    else if (packet.startsWith(AirPodsPackets::Phone::DISCONNECTED))
+    {
+        LOG_INFO("AirPods disconnected");
+        emit phoneReleasedAirPods();
+    }
+    else if (packet.startsWith(AirPodsPackets::Phone::STATUS_REQUEST))
+    {
+        LOG_INFO("Connection status request received");
+        sendToPhone(isOpen(m_airPods) ? AirPodsPackets::Phone::CONNECTED
+                                      : AirPodsPackets::Phone::DISCONNECTED);
+    }
+    else if (packet.startsWith(AirPodsPackets::Phone::DISCONNECT_REQUEST))
+    {
+        LOG_INFO("Disconnect request received");
+        if (isOpen(m_airPods))
+        {
+            emit phoneRequestedDisconnect();
+        }
+    }
+    else
+    {
+        if (writeFrame(m_airPods, packet.constData(), packet.size()))
+        {
+            ++m_stats.toAirPodsPackets;
+            m_stats.toAirPodsBytes += packet.size();
+            relayMetrics().toAirPodsPackets.add();
+            relayMetrics().toAirPodsBytes.add(packet.size());
+        }
+        else
+        {
+            LOG_ERROR("Socket is not open, cannot relay packet to AirPods");
+        }
+    }
+}
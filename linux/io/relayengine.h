@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <atomic>
+
+#include "transport.h"
+#include "writequeue.h"
+
+class QTimer;
+
+/**
+ * Phone <-> AirPods relay used for cross-device handoff. Lives on the I/O thread.
+ *
+ * Packets are forwarded as soon as they are read, before any local parsing. The
+ * phone-bound NOTIFICATION header is assembled into a preallocated frame buffer, and
+ * phone-to-AirPods payloads are written straight from the received buffer, so the
+ * steady state does not allocate. When a link backs up, packets queue in a small
+ * bounded WriteQueue (oldest dropped first) until the socket drains. The AirPods side
+ * can share its queue with the owner of the link, so local writes keep their place. Reconnects to the
+ * phone use exponential backoff and are only attempted while there is traffic to relay.
+ *
+ * Both ends are plain Transports, so the engine runs the same against Bluetooth and
+ * against local stand-ins (see tools/relaybench.cpp).
+ */
+class RelayEngine : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        quint64 toPhonePackets = 0;
+        quint64 toPhoneBytes = 0;
+        quint64 toAirPodsPackets = 0;
+        quint64 toAirPodsBytes = 0;
+        quint64 dropped = 0;
+        quint64 reconnectAttempts = 0;
+    };
+
+    explicit RelayEngine(QObject *parent = nullptr);
+    ~RelayEngine();
+
+    // Thread-safe
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // I/O thread only
+    // Not owned; the AirPods side is opened and closed by the caller. Pass the queue the
+    // caller writes its own packets through, if any, so both go out in order.
+    void setAirPodsTransport(Transport *transport, WriteQueue *queue = nullptr);
+    // Replaces the phone endpoint, dropping any current phone connection
+    void setPhoneTransportFactory(TransportFactory factory);
+    void connectToPhone();
+    void disconnectPhone();
+    bool isPhoneOpen() const;
+
+    // Forward an AirPods packet to the phone, prefixed with the NOTIFICATION header
+    void forwardToPhone(const QByteArray &packet);
+    // Send a control packet to the phone as-is
+    void sendToPhone(const QByteArray &packet);
+
+    const Stats &stats() const { return m_stats; }
+
+signals:
+    void phoneConnected();
+    void phoneDisconnected();
+    void phoneTookAirPods();
+    void phoneReleasedAirPods();
+    void phoneRequestedDisconnect();
+
+private:
+    struct Channel
+    {
+        Transport *transport = nullptr;
+        WriteQueue *queue = nullptr;
+        WriteQueue ownQueue; // Used unless the AirPods side is given a shared one
+    };
+
+    bool isOpen(const Channel &channel) const;
+    bool writeFrame(Channel &channel, const char *data, qint64 size);
+    void flushPending(Channel &channel);
+
+    void attemptPhoneConnection();
+    void onPhoneLinkDown();
+    void scheduleReconnect();
+    void onPhoneReadyRead();
+    void handlePhonePacket(const QByteArray &packet);
+
+    Channel m_phone;
+    Channel m_airPods;
+    TransportFactory m_phoneFactory;
+    bool m_phoneWasConnected = false;
+    bool m_reconnectWanted = false;
+    int m_backoffMs;
+    QTimer *m_reconnectTimer = nullptr;
+    QByteArray m_frame; // Preallocated NOTIFICATION + packet buffer
+    Stats m_stats;
+    std::atomic<bool> m_enabled{false};
+};
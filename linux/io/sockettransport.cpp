@@ -0,0 +1,206 @@
+#include "sockettransport.h"
+
+#include <QSocketNotifier>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr int MAX_PACKET_BYTES = 64 * 1024;
+
+    QString errnoString(int error)
+    {
+        return QString::fromLocal8Bit(std::strerror(error));
+    }
+}
+
+SocketTransport::~SocketTransport()
+{
+    close();
+}
+
+void SocketTransport::open()
+{
+    close();
+    m_errorString.clear();
+
+    bool inProgress = false;
+    QString error;
+    const int fd = connectDescriptor(inProgress, error);
+    if (fd < 0)
+    {
+        fail(error);
+        return;
+    }
+
+    m_fd = fd;
+    m_state = State::Connecting;
+    const int flags = ::fcntl(m_fd, F_GETFL);
+    ::fcntl(m_fd, F_SETFL, flags | O_NONBLOCK);
+
+    m_readNotifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    m_readNotifier->setEnabled(!inProgress);
+    connect(m_readNotifier, &QSocketNotifier::activated, this, &SocketTransport::onReadable);
+    m_writeNotifier = new QSocketNotifier(m_fd, QSocketNotifier::Write, this);
+    m_writeNotifier->setEnabled(inProgress);
+    connect(m_writeNotifier, &QSocketNotifier::activated, this, &SocketTransport::onWritable);
+
+    if (!inProgress)
+    {
+        // Stay asynchronous like a Bluetooth connect, so callers can hook up signals first
+        QMetaObject::invokeMethod(this, [this]()
+                                  {
+            if (m_state == State::Connecting) {
+                m_state = State::Open;
+                emit connected();
+            } }, Qt::QueuedConnection);
+    }
+}
+
+void SocketTransport::close()
+{
+    delete m_readNotifier;
+    m_readNotifier = nullptr;
+    delete m_writeNotifier;
+    m_writeNotifier = nullptr;
+
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_state = State::Closed;
+    m_readBuffer.clear();
+    m_writeQueue.clear();
+    m_queuedBytes = 0;
+}
+
+// A failed socket is done for good: closing it here lets the next open() start over
+// instead of callers finding it still open after the link is gone
+void SocketTransport::fail(const QString &message)
+{
+    close();
+    m_errorString = message;
+    QMetaObject::invokeMethod(this, [this, message]()
+                              { emit errorOccurred(message); }, Qt::QueuedConnection);
+}
+
+void SocketTransport::finishConnect()
+{
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (::getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+    {
+        error = errno;
+    }
+    if (error != 0)
+    {
+        fail(errnoString(error));
+        return;
+    }
+
+    m_state = State::Open;
+    m_readNotifier->setEnabled(true);
+    m_writeNotifier->setEnabled(!m_writeQueue.empty());
+    emit connected();
+}
+
+qint64 SocketTransport::write(const char *data, qint64 size)
+{
+    if (m_state != State::Open)
+    {
+        return -1;
+    }
+
+    if (m_writeQueue.empty())
+    {
+        const ssize_t sent = ::send(m_fd, data, size, MSG_NOSIGNAL);
+        if (sent == size)
+        {
+            return size;
+        }
+        if (sent >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            fail(errnoString(sent < 0 ? errno : EMSGSIZE));
+            return -1;
+        }
+    }
+
+    // Kernel buffer is full: keep the packet whole and retry when the socket drains
+    m_writeQueue.emplace_back(data, size);
+    m_queuedBytes += size;
+    m_writeNotifier->setEnabled(true);
+    return size;
+}
+
+void SocketTransport::onWritable()
+{
+    if (m_state == State::Connecting)
+    {
+        finishConnect();
+        return;
+    }
+
+    qint64 written = 0;
+    while (!m_writeQueue.empty())
+    {
+        const QByteArray &packet = m_writeQueue.front();
+        const ssize_t sent = ::send(m_fd, packet.constData(), packet.size(), MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            fail(errnoString(errno));
+            return;
+        }
+        written += packet.size();
+        m_queuedBytes -= packet.size();
+        m_writeQueue.pop_front();
+    }
+
+    m_writeNotifier->setEnabled(!m_writeQueue.empty());
+    if (written > 0)
+    {
+        emit bytesWritten(written);
+    }
+}
+
+void SocketTransport::onReadable()
+{
+    if (m_scratch.isEmpty())
+    {
+        m_scratch.resize(MAX_PACKET_BYTES);
+    }
+
+    const ssize_t received = ::recv(m_fd, m_scratch.data(), m_scratch.size(), 0);
+    if (received < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            fail(errnoString(errno));
+        }
+        return;
+    }
+    if (received == 0)
+    {
+        // Orderly shutdown from the peer
+        close();
+        emit disconnected();
+        return;
+    }
+
+    m_readBuffer.append(m_scratch.constData(), received);
+    emit readyRead();
+}
+
+QByteArray SocketTransport::readAll()
+{
+    QByteArray data;
+    data.swap(m_readBuffer);
+    return data;
+}
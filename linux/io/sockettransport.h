@@ -0,0 +1,55 @@
+#pragma once
+
+#include "transport.h"
+
+#include <deque>
+
+class QSocketNotifier;
+
+/**
+ * Transport over a non-blocking SOCK_SEQPACKET descriptor.
+ *
+ * Subclasses only create and connect the descriptor; reads, queued writes and the
+ * completion of an in-progress connect() are handled here with QSocketNotifier.
+ */
+class SocketTransport : public Transport
+{
+    Q_OBJECT
+public:
+    using Transport::Transport;
+    ~SocketTransport();
+
+    void open() override;
+    void close() override;
+    State state() const override { return m_state; }
+
+    using Transport::write;
+    qint64 write(const char *data, qint64 size) override;
+    QByteArray readAll() override;
+    qint64 bytesToWrite() const override { return m_queuedBytes; }
+
+    QString errorString() const override { return m_errorString; }
+
+protected:
+    // Returns a non-blocking descriptor, or -1 with error set. inProgress is set when
+    // connect() returned EINPROGRESS and completion has to be waited for.
+    virtual int connectDescriptor(bool &inProgress, QString &error) = 0;
+
+    int descriptor() const { return m_fd; }
+
+private:
+    void onReadable();
+    void onWritable();
+    void finishConnect();
+    void fail(const QString &message);
+
+    int m_fd = -1;
+    State m_state = State::Closed;
+    QSocketNotifier *m_readNotifier = nullptr;
+    QSocketNotifier *m_writeNotifier = nullptr;
+    QByteArray m_readBuffer;
+    QByteArray m_scratch; // Receive buffer, sized for the largest packet once
+    std::deque<QByteArray> m_writeQueue;
+    qint64 m_queuedBytes = 0;
+    QString m_errorString;
+};
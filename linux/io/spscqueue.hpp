@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Head and tail live on separate cache lines, and each side keeps a cached copy of
+// the other side's index so the common case touches no shared cache line at all.
+template <typename T, std::size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer side. Returns false if the queue is full; value is left untouched.
+    bool push(T &&value)
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tailCache == Capacity)
+        {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head - m_tailCache == Capacity)
+            {
+                return false;
+            }
+        }
+
+        m_slots[head & (Capacity - 1)] = std::move(value);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool pop(T &value)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_headCache)
+        {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail == m_headCache)
+            {
+                return false;
+            }
+        }
+
+        value = std::move(m_slots[tail & (Capacity - 1)]);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate; only meaningful for diagnostics.
+    std::size_t sizeApprox() const
+    {
+        return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed);
+    }
+
+    static constexpr std::size_t capacity() { return Capacity; }
+
+private:
+    alignas(64) std::atomic<std::size_t> m_head{0};
+    alignas(64) std::size_t m_tailCache = 0; // Producer only
+    alignas(64) std::atomic<std::size_t> m_tail{0};
+    alignas(64) std::size_t m_headCache = 0; // Consumer only
+    alignas(64) std::array<T, Capacity> m_slots{};
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <functional>
+
+/**
+ * Packet-oriented link to a peer (AirPods, phone, or a local stand-in).
+ *
+ * Every write() is sent as a single packet, the way an L2CAP channel behaves, and
+ * readAll() returns whatever has arrived since the last call. open() is asynchronous:
+ * it finishes with either connected() or errorOccurred(). close() tears the link down
+ * without emitting anything.
+ */
+class Transport : public QObject
+{
+    Q_OBJECT
+public:
+    enum class State
+    {
+        Closed,
+        Connecting,
+        Open,
+    };
+
+    using QObject::QObject;
+
+    virtual void open() = 0;
+    virtual void close() = 0;
+    virtual State state() const = 0;
+    bool isOpen() const { return state() == State::Open; }
+
+    virtual qint64 write(const char *data, qint64 size) = 0;
+    qint64 write(const QByteArray &packet) { return write(packet.constData(), packet.size()); }
+    virtual QByteArray readAll() = 0;
+    // Bytes accepted by write() that have not reached the kernel yet
+    virtual qint64 bytesToWrite() const = 0;
+
+    virtual QString errorString() const = 0;
+
+signals:
+    void connected();
+    void disconnected();
+    void readyRead();
+    void bytesWritten(qint64 bytes); // Never emitted from inside write()
+    void errorOccurred(const QString &message);
+};
+
+// Creates a fresh, unopened transport for every connection attempt
+using TransportFactory = std::function<Transport *(QObject *parent)>;
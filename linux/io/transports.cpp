@@ -0,0 +1,107 @@
+#include "transports.h"
+#include "l2captransport.h"
+#include "localtransport.h"
+#include "qtbluetoothtransport.h"
+#include "logger.h"
+
+#include <QBluetoothUuid>
+#include <QDir>
+#include <QStandardPaths>
+
+namespace
+{
+    const QBluetoothUuid AIRPODS_SERVICE_UUID("74ec2172-0bad-4d01-8f77-997b2be0722a");
+    const QBluetoothUuid PHONE_SERVICE_UUID("1abbb9a4-10e4-4000-a75c-8953c5471342");
+    constexpr quint16 AACP_PSM = 0x1001;
+    constexpr quint16 ATT_PSM = 0x001F;
+
+    Transports::Backend readBackend()
+    {
+        const QByteArray name = qgetenv("LIBREPODS_TRANSPORT").toLower();
+        if (name == "bluez")
+        {
+            LOG_INFO("Using BlueZ L2CAP transport");
+            return Transports::Backend::BlueZ;
+        }
+        if (name == "sim")
+        {
+            LOG_INFO("Using simulator transport in " << Transports::simulatorSocketPath(QString()));
+            return Transports::Backend::Simulator;
+        }
+        if (!name.isEmpty() && name != "qt")
+        {
+            LOG_WARN("Unknown LIBREPODS_TRANSPORT '" << name << "', using QtBluetooth");
+        }
+        return Transports::Backend::QtBluetooth;
+    }
+
+    L2capTransport::Options l2capOptions()
+    {
+        L2capTransport::Options options;
+        options.mtu = qEnvironmentVariableIntValue("LIBREPODS_L2CAP_MTU");
+        options.sendBuffer = qEnvironmentVariableIntValue("LIBREPODS_L2CAP_SNDBUF");
+        options.receiveBuffer = qEnvironmentVariableIntValue("LIBREPODS_L2CAP_RCVBUF");
+        return options;
+    }
+}
+
+namespace Transports
+{
+    Backend backend()
+    {
+        static const Backend selected = readBackend();
+        return selected;
+    }
+
+    Transport *createAirPodsTransport(const QBluetoothAddress &address, QObject *parent)
+    {
+        switch (backend())
+        {
+        case Backend::BlueZ:
+            return new L2capTransport(address, AACP_PSM, l2capOptions(), parent);
+        case Backend::Simulator:
+            return new LocalTransport(simulatorSocketPath("airpods"), parent);
+        case Backend::QtBluetooth:
+            break;
+        }
+        return new QtBluetoothTransport(address, AIRPODS_SERVICE_UUID, parent);
+    }
+
+    Transport *createPhoneTransport(const QBluetoothAddress &address, QObject *parent)
+    {
+        switch (backend())
+        {
+        case Backend::Simulator:
+            return new LocalTransport(simulatorSocketPath("phone"), parent);
+        case Backend::BlueZ:
+            // The phone app only publishes its service by UUID, so it still needs an SDP lookup
+        case Backend::QtBluetooth:
+            break;
+        }
+        return new QtBluetoothTransport(address, PHONE_SERVICE_UUID, parent);
+    }
+
+    Transport *createAttTransport(const QBluetoothAddress &address, QObject *parent)
+    {
+        if (backend() == Backend::Simulator)
+        {
+            return new LocalTransport(simulatorSocketPath("att"), parent);
+        }
+        return new L2capTransport(address, ATT_PSM, L2capTransport::Options(), parent);
+    }
+
+    QString simulatorSocketPath(const QString &link)
+    {
+        QString dir = qEnvironmentVariable("LIBREPODS_SIM_DIR");
+        if (dir.isEmpty())
+        {
+            QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+            if (runtimeDir.isEmpty())
+            {
+                runtimeDir = QDir::tempPath();
+            }
+            dir = runtimeDir + "/librepods-sim";
+        }
+        return link.isEmpty() ? dir : dir + "/" + link + ".sock";
+    }
+}
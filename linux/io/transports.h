@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QBluetoothAddress>
+#include <QString>
+
+class QObject;
+class Transport;
+
+/**
+ * Picks the transport backend for the AirPods and phone links.
+ *
+ * LIBREPODS_TRANSPORT selects the backend:
+ *   qt     QtBluetooth, service lookup by UUID (default)
+ *   bluez  raw BlueZ L2CAP socket, tunable with LIBREPODS_L2CAP_MTU,
+ *          LIBREPODS_L2CAP_SNDBUF and LIBREPODS_L2CAP_RCVBUF
+ *   sim    Unix sockets served by the simulator, see simulatorSocketPath()
+ */
+namespace Transports
+{
+    enum class Backend
+    {
+        QtBluetooth,
+        BlueZ,
+        Simulator,
+    };
+
+    Backend backend();
+
+    Transport *createAirPodsTransport(const QBluetoothAddress &address, QObject *parent);
+    Transport *createPhoneTransport(const QBluetoothAddress &address, QObject *parent);
+    // ATT bearer for the audio tuning characteristics; always a BlueZ socket, since
+    // QtBluetooth cannot connect by PSM
+    Transport *createAttTransport(const QBluetoothAddress &address, QObject *parent);
+
+    // Socket the simulator listens on for the given link ("airpods" or "phone").
+    // Lives in LIBREPODS_SIM_DIR, or $XDG_RUNTIME_DIR/librepods-sim by default.
+    QString simulatorSocketPath(const QString &link);
+}
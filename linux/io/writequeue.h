@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QByteArray>
+#include <cstddef>
+#include <deque>
+
+#include "transport.h"
+
+// Backpressure for one Transport. Frames are written straight through until more than
+// HIGH_WATER_BYTES sit unsent, then they queue (oldest dropped first) behind each other
+// until the socket drains below LOW_WATER_BYTES. Call flush() on bytesWritten().
+class WriteQueue
+{
+public:
+    static constexpr qint64 HIGH_WATER_BYTES = 8 * 1024;
+    static constexpr qint64 LOW_WATER_BYTES = 2 * 1024;
+    static constexpr std::size_t MAX_PENDING_FRAMES = 64;
+
+    enum class Result
+    {
+        Written,
+        Queued,
+        QueuedDroppingOldest,
+        Failed,
+    };
+
+    // The transport must be open
+    Result write(Transport *transport, const char *data, qint64 size)
+    {
+        // Keep ordering by queueing behind anything already pending
+        if (!m_pending.empty() || transport->bytesToWrite() > HIGH_WATER_BYTES)
+        {
+            const bool full = m_pending.size() >= MAX_PENDING_FRAMES;
+            if (full)
+            {
+                m_pending.pop_front();
+            }
+            m_pending.emplace_back(data, size);
+            return full ? Result::QueuedDroppingOldest : Result::Queued;
+        }
+
+        // Always one write per frame: L2CAP is packet oriented, so splitting would split the packet
+        return transport->write(data, size) == size ? Result::Written : Result::Failed;
+    }
+
+    void flush(Transport *transport)
+    {
+        while (!m_pending.empty() && transport->isOpen() && transport->bytesToWrite() <= LOW_WATER_BYTES)
+        {
+            const QByteArray &frame = m_pending.front();
+            transport->write(frame.constData(), frame.size());
+            m_pending.pop_front();
+        }
+    }
+
+    void clear() { m_pending.clear(); }
+
+private:
+    std::deque<QByteArray> m_pending;
+};
@@ -5,7 +5,28 @@
 
 Q_DECLARE_LOGGING_CATEGORY(librepods)
 
-#define LOG_INFO(msg) qCInfo(librepods) << "\033[32m" << msg << "\033[0m"
-#define LOG_WARN(msg) qCWarning(librepods) << "\033[33m" << msg << "\033[0m"
-#define LOG_ERROR(msg) qCCritical(librepods) << "\033[31m" << msg << "\033[0m"
-#define LOG_DEBUG(msg) qCDebug(librepods) << "\033[34m" << msg << "\033[0m"
+// Lowest level compiled in, set through the LIBREPODS_LOG_LEVEL CMake option. Anything
+// below it compiles to nothing; anything above it is still filtered at runtime by the
+// logging category, which skips evaluating the message when the level is disabled.
+#define LIBREPODS_LOG_LEVEL_DEBUG 0
+#define LIBREPODS_LOG_LEVEL_INFO 1
+#define LIBREPODS_LOG_LEVEL_WARN 2
+#define LIBREPODS_LOG_LEVEL_ERROR 3
+
+#ifndef LIBREPODS_LOG_LEVEL
+#define LIBREPODS_LOG_LEVEL LIBREPODS_LOG_LEVEL_DEBUG
+#endif
+
+#define LIBREPODS_LOG(level, stream, color, msg)                 \
+    do                                                            \
+    {                                                             \
+        if constexpr (LIBREPODS_LOG_LEVEL <= (level))             \
+        {                                                         \
+            stream(librepods) << color << msg << "\033[0m";       \
+        }                                                         \
+    } while (0)
+
+#define LOG_INFO(msg) LIBREPODS_LOG(LIBREPODS_LOG_LEVEL_INFO, qCInfo, "\033[32m", msg)
+#define LOG_WARN(msg) LIBREPODS_LOG(LIBREPODS_LOG_LEVEL_WARN, qCWarning, "\033[33m", msg)
+#define LOG_ERROR(msg) LIBREPODS_LOG(LIBREPODS_LOG_LEVEL_ERROR, qCCritical, "\033[31m", msg)
+#define LOG_DEBUG(msg) LIBREPODS_LOG(LIBREPODS_LOG_LEVEL_DEBUG, qCDebug, "\033[34m", msg)
@@ -1,11 +1,8 @@
 #include <QSettings>
-#include <QLocalServer>
-#include <QLocalSocket>
 #include <QApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
 #include <QBluetoothLocalDevice>
-#include <QBluetoothSocket>
 #include <QQuickWindow>
 #include <QLoggingCategory>
 #include <QThread>
@@ -16,20 +13,37 @@
 #include <QLibraryInfo>
 #include <QDir>
 #include <QStandardPaths>
+#include <QSaveFile>
 
 #include "airpods_packets.h"
 #include "logger.h"
+#include "flightrecorder.h"
+#include "metrics.h"
+#include "trace.h"
 #include "media/mediacontroller.h"
 #include "trayiconmanager.h"
 #include "enums.h"
 #include "battery.hpp"
 #include "BluetoothMonitor.h"
+#include "preconnector.h"
 #include "autostartmanager.hpp"
 #include "deviceinfo.hpp"
+#include "devicemanager.h"
+#include "connectionsupervisor.h"
+#include "commandqueue.h"
+#include "dbusservice.h"
+#include "status/statuspage.h"
+#include "att/audioadjustments.h"
+#include "control/controlserver.h"
+#include "singleinstance.h"
 #include "ble/blemanager.h"
 #include "ble/bleutils.h"
+#include "io/ioworker.h"
+#include "io/transports.h"
 #include "QRCodeImageProvider.hpp"
 #include "systemsleepmonitor.hpp"
+#include "powerstatemonitor.hpp"
+#include "ble/scanscheduler.h"
 
 using namespace AirpodsTrayApp::Enums;
 
@@ -40,23 +54,95 @@ class AirPodsTrayApp : public QObject {
     Q_PROPERTY(bool airpodsConnected READ areAirpodsConnected NOTIFY airPodsStatusChanged)
     Q_PROPERTY(int earDetectionBehavior READ earDetectionBehavior WRITE setEarDetectionBehavior NOTIFY earDetectionBehaviorChanged)
     Q_PROPERTY(bool crossDeviceEnabled READ crossDeviceEnabled WRITE setCrossDeviceEnabled NOTIFY crossDeviceEnabledChanged)
+    Q_PROPERTY(bool preConnectEnabled READ preConnectEnabled WRITE setPreConnectEnabled NOTIFY preConnectEnabledChanged)
+    Q_PROPERTY(bool headsetForAnyRecording READ headsetForAnyRecording WRITE setHeadsetForAnyRecording NOTIFY headsetForAnyRecordingChanged)
     Q_PROPERTY(AutoStartManager *autoStartManager READ autoStartManager CONSTANT)
     Q_PROPERTY(bool notificationsEnabled READ notificationsEnabled WRITE setNotificationsEnabled NOTIFY notificationsEnabledChanged)
     Q_PROPERTY(int retryAttempts READ retryAttempts WRITE setRetryAttempts NOTIFY retryAttemptsChanged)
     Q_PROPERTY(bool hideOnStart READ hideOnStart CONSTANT)
-    Q_PROPERTY(DeviceInfo *deviceInfo READ deviceInfo CONSTANT)
+    Q_PROPERTY(DeviceInfo *deviceInfo READ deviceInfo NOTIFY deviceInfoChanged)
+    Q_PROPERTY(DeviceManager *devices READ devices CONSTANT)
     Q_PROPERTY(QString phoneMacStatus READ phoneMacStatus NOTIFY phoneMacStatusChanged)
     Q_PROPERTY(bool hearingAidEnabled READ hearingAidEnabled WRITE setHearingAidEnabled NOTIFY hearingAidEnabledChanged)
+    Q_PROPERTY(AudioAdjustments *audioAdjustments READ audioAdjustments CONSTANT)
 
 public:
     AirPodsTrayApp(bool debugMode, bool hideOnStart, QQmlApplicationEngine *parent = nullptr)
         : QObject(parent), debugMode(debugMode), m_settings(new QSettings("AirPodsTrayApp", "AirPodsTrayApp"))
         , m_autoStartManager(new AutoStartManager(this)), m_hideOnStart(hideOnStart), parent(parent)
-        , m_deviceInfo(new DeviceInfo(this)), m_bleManager(new BleManager(this))
+        , m_devices(new DeviceManager(m_settings, this)), m_deviceInfo(m_devices->active())
         , m_systemSleepMonitor(new SystemSleepMonitor(this))
     {
         QLoggingCategory::setFilterRules(QString("librepods.debug=%1").arg(debugMode ? "true" : "false"));
         LOG_INFO("Initializing LibrePods");
+        const qint64 startupNs = Metrics::nowNs();
+
+        // What users wait for at login; everything below should stay out of its way
+        connect(m_deviceInfo, &DeviceInfo::batteryStatusChanged, this, [startupNs]()
+        {
+            static Metrics::Histogram &firstBattery = Metrics::histogram("startup_to_first_battery");
+            const qint64 nowNs = Metrics::nowNs();
+            firstBattery.record(nowNs - startupNs);
+            Trace::complete("startup.first_battery", startupNs, nowNs);
+        }, Qt::SingleShotConnection);
+
+        // Sockets and BLE discovery run on their own thread so UI work never delays packet handling
+        m_ioThread = new QThread(this);
+        m_ioThread->setObjectName("librepods-io");
+        m_ioWorker = new IoWorker();
+        m_ioWorker->moveToThread(m_ioThread);
+        m_bleManager = new BleManager();
+        m_bleManager->moveToThread(m_ioThread);
+        connect(m_ioThread, &QThread::finished, m_ioWorker, &QObject::deleteLater);
+        connect(m_ioThread, &QThread::finished, m_bleManager, &QObject::deleteLater);
+        connect(m_ioWorker, &IoWorker::eventsAvailable, this, &AirPodsTrayApp::drainIoEvents, Qt::QueuedConnection);
+        m_ioThread->start();
+
+        // Retries with backoff for every device; the links themselves are opened on the I/O thread
+        m_connections = new ConnectionSupervisor(this);
+        connect(m_connections, &ConnectionSupervisor::connectRequested, this, [this](const QBluetoothAddress &address)
+        {
+            m_ioWorker->connectToAirPods(address);
+        });
+        connect(m_connections, &ConnectionSupervisor::disconnectRequested, this, [this](const QBluetoothAddress &address)
+        {
+            m_ioWorker->disconnectAirPods(address);
+        });
+
+        // Opening the case near known AirPods connects them before they reach the ears
+        m_preConnector = new PreConnector(this);
+        connect(m_connections, &ConnectionSupervisor::stateChanged, this, [this](const QBluetoothAddress &address, ConnectionSupervisor::State state)
+        {
+            DeviceInfo *device = m_devices->device(address);
+            if (device && state == ConnectionSupervisor::State::Ready)
+            {
+                m_preConnector->onConnected(device);
+            }
+        });
+        connect(m_connections, &ConnectionSupervisor::gaveUp, this, [this](const QBluetoothAddress &address)
+        {
+            if (DeviceInfo *device = m_devices->device(address))
+            {
+                m_preConnector->onConnectFailed(device);
+            }
+        });
+
+        // Control commands are paced per device and kind, and confirmed by their echo
+        m_commands = new CommandQueue(this);
+        connect(m_commands, &CommandQueue::writeRequested, this, [this](const QBluetoothAddress &address, const QByteArray &packet)
+        {
+            if (DeviceInfo *device = m_devices->device(address))
+            {
+                writePacketToDevice(device, packet, "Control command written: ");
+            }
+        });
+        connect(m_commands, &CommandQueue::replayRequested, this, [this](const QBluetoothAddress &address, const QByteArray &packet)
+        {
+            if (DeviceInfo *device = m_devices->device(address))
+            {
+                parseData(device, packet);
+            }
+        });
 
         // Initialize tray icon and connect signals
         trayManager = new TrayIconManager(this);
@@ -66,9 +152,7 @@ public:
         connect(trayManager, &TrayIconManager::openSettings, this, &AirPodsTrayApp::onOpenSettings);
         connect(trayManager, &TrayIconManager::noiseControlChanged, this, &AirPodsTrayApp::setNoiseControlMode);
         connect(trayManager, &TrayIconManager::conversationalAwarenessToggled, this, &AirPodsTrayApp::setConversationalAwareness);
-        connect(m_deviceInfo, &DeviceInfo::batteryStatusChanged, trayManager, &TrayIconManager::updateBatteryStatus);
-        connect(m_deviceInfo, &DeviceInfo::noiseControlModeChanged, trayManager, &TrayIconManager::updateNoiseControlState);
-        connect(m_deviceInfo, &DeviceInfo::conversationalAwarenessChanged, trayManager, &TrayIconManager::updateConversationalAwareness);
+        connect(trayManager, &TrayIconManager::deviceSelected, m_devices, &DeviceManager::select);
         connect(trayManager, &TrayIconManager::notificationsEnabledChanged, this, &AirPodsTrayApp::saveNotificationsEnabled);
         connect(trayManager, &TrayIconManager::notificationsEnabledChanged, this, &AirPodsTrayApp::notificationsEnabledChanged);
 
@@ -80,38 +164,95 @@ public:
         monitor = new BluetoothMonitor(this);
         connect(monitor, &BluetoothMonitor::deviceConnected, this, &AirPodsTrayApp::bluezDeviceConnected);
         connect(monitor, &BluetoothMonitor::deviceDisconnected, this, &AirPodsTrayApp::bluezDeviceDisconnected);
+        connect(monitor, &BluetoothMonitor::connectFinished, this, [this](const QString &address, bool success)
+        {
+            DeviceInfo *device = m_devices->device(QBluetoothAddress(address));
+            if (device && !success)
+            {
+                m_preConnector->onConnectFailed(device);
+            }
+        });
+        // BlueZ reports the connection as deviceConnected(), which takes it from there
+        connect(m_preConnector, &PreConnector::preConnectRequested, this, [this](DeviceInfo *device)
+        {
+            monitor->connectDevice(device->bluetoothAddress());
+        });
+        // Aborts a Connect still in progress, or drops the link, which BlueZ then reports as usual
+        connect(m_preConnector, &PreConnector::preConnectCancelled, this, [this](DeviceInfo *device)
+        {
+            monitor->cancelConnect(device->bluetoothAddress());
+        });
 
         connect(m_bleManager, &BleManager::deviceFound, this, &AirPodsTrayApp::bleDeviceFound);
-        connect(m_deviceInfo->getBattery(), &Battery::primaryChanged, this, &AirPodsTrayApp::primaryChanged);
+        // Scanning is duty-cycled; see ScanScheduler for when and how much
+        m_scanScheduler = new ScanScheduler(m_bleManager, this);
+        m_powerStateMonitor = new PowerStateMonitor(this);
+        connect(m_powerStateMonitor, &PowerStateMonitor::onBatteryChanged, m_scanScheduler, &ScanScheduler::setOnBattery);
+        connect(m_powerStateMonitor, &PowerStateMonitor::screenLockedChanged, m_scanScheduler, &ScanScheduler::setScreenLocked);
+        connect(m_scanScheduler, &ScanScheduler::modeChanged, this, [this](ScanScheduler::Mode mode)
+        {
+            // The call state comes from advertisements; without them it would never be cleared
+            if (mode == ScanScheduler::Mode::Off || mode == ScanScheduler::Mode::Paused)
+            {
+                mediaController->setCallActive(false);
+            }
+        });
+        connect(m_preConnector, &PreConnector::preConnectRequested, this, [this]()
+        {
+            m_scanScheduler->boost("lid opened");
+        });
         connect(m_systemSleepMonitor, &SystemSleepMonitor::systemGoingToSleep, this, &AirPodsTrayApp::onSystemGoingToSleep);
         connect(m_systemSleepMonitor, &SystemSleepMonitor::systemWakingUp, this, &AirPodsTrayApp::onSystemWakingUp);
 
+        // Device state for status bars and scripts
+        m_dbusService = new DBusService(m_deviceInfo, this);
+        m_dbusService->setHandlers({
+            [this](int mode) { return setNoiseControlModeInt(mode); },
+            [this](bool enabled) { return setConversationalAwareness(enabled); },
+            [this](bool enabled) { return setHearingAidEnabled(enabled); },
+            [this](int level) { return setAdaptiveNoiseLevel(level); },
+            [this](bool enabled) { return setOneBudANCMode(enabled); },
+            [this](const QString &name) { return renameAirPods(name); },
+        });
+        m_dbusService->registerOnSessionBus();
+        m_statusPage = new StatusPage(m_deviceInfo, this);
+        m_statusPage->open();
+
+        // Transparency, loud sound reduction and hearing aid tuning, over ATT
+        m_audioAdjustments = new AudioAdjustments(this);
+
+        // Everything above shows the active device; follow it when the user picks another pair
+        bindActiveDevice();
+        connect(m_devices, &DeviceManager::activeChanged, this, &AirPodsTrayApp::onActiveDeviceChanged);
+        connect(m_devices, &DeviceManager::devicesChanged, this, &AirPodsTrayApp::updateTrayDevices);
+        updateTrayDevices();
+
         // Load settings
         CrossDevice.isEnabled = loadCrossDeviceEnabled();
+        m_ioWorker->setCrossDeviceEnabled(CrossDevice.isEnabled);
+        updatePreConnectTakeover();
+        m_preConnector->setEnabled(loadPreConnectEnabled());
+        m_headsetForAnyRecording = loadHeadsetForAnyRecording();
+        mediaController->setHeadsetForAnyRecording(m_headsetForAnyRecording);
         setEarDetectionBehavior(loadEarDetectionSettings());
+        mediaController->setEarDetectionGracePeriods(m_settings->value("earDetection/pauseDelayMs", 300).toInt(),
+                                                     m_settings->value("earDetection/profileOffDelayMs", 5000).toInt());
         setRetryAttempts(loadRetryAttempts());
 
+        // Startup is asynchronous from here: PulseAudio connects on a worker thread (MediaController) and
+        // AirPods that are already connected come back from BlueZ as deviceConnected(), while the phone
+        // link and the BLE scan start right away since they do not depend on either
         monitor->checkAlreadyConnectedDevices();
         LOG_INFO("AirPodsTrayApp initialized");
+        Trace::complete("startup.AirPodsTrayApp", startupNs, Metrics::nowNs());
 
-        QBluetoothLocalDevice localDevice;
-
-        const QList<QBluetoothAddress> connectedDevices = localDevice.connectedDevices();
-        for (const QBluetoothAddress &address : connectedDevices) {
-            QBluetoothDeviceInfo device(address, "", 0);
-            if (isAirPodsDevice(device)) {
-                connectToDevice(device);
-
-                // On startup after reboot, activate A2DP profile for already connected AirPods
-                QTimer::singleShot(2000, this, [this, address]()
-                {
-                    QString formattedAddress = address.toString().replace(":", "_");
-                    mediaController->setConnectedDeviceMacAddress(formattedAddress);
-                    mediaController->activateA2dpProfile();
-                    LOG_INFO("A2DP profile activation attempted for AirPods found on startup");
-                });
-                return;
-            }
+        if (Transports::backend() == Transports::Backend::Simulator)
+        {
+            // The simulator stands in for AirPods that are already connected and playing audio
+            mediaController->setAssumeAirPodsOutput(true);
+            connectToDevice(QBluetoothDeviceInfo(QBluetoothAddress(), "Simulated AirPods", 0));
+            connectToPhone();
+            return;
         }
 
         initializeDBus();
@@ -122,19 +263,24 @@ public:
         saveCrossDeviceEnabled();
         saveEarDetectionSettings();
 
-        delete socket;
-        delete phoneSocket;
+        m_ioThread->quit();
+        m_ioThread->wait();
     }
 
-    bool areAirpodsConnected() const { return socket && socket->isOpen() && socket->state() == QBluetoothSocket::SocketState::ConnectedState; }
+    bool areAirpodsConnected() const { return m_deviceInfo->isConnected(); }
+    DBusService *dbusService() const { return m_dbusService; }
     int earDetectionBehavior() const { return mediaController->getEarDetectionBehavior(); }
     bool crossDeviceEnabled() const { return CrossDevice.isEnabled; }
+    bool preConnectEnabled() const { return m_preConnector->isEnabled(); }
+    bool headsetForAnyRecording() const { return m_headsetForAnyRecording; }
     AutoStartManager *autoStartManager() const { return m_autoStartManager; }
     bool notificationsEnabled() const { return trayManager->notificationsEnabled(); }
     void setNotificationsEnabled(bool enabled) { trayManager->setNotificationsEnabled(enabled); }
     int retryAttempts() const { return m_retryAttempts; }
     bool hideOnStart() const { return m_hideOnStart; }
     DeviceInfo *deviceInfo() const { return m_deviceInfo; }
+    DeviceManager *devices() const { return m_devices; }
+    AudioAdjustments *audioAdjustments() const { return m_audioAdjustments; }
     QString phoneMacStatus() const { return m_phoneMacStatus; }
     bool hearingAidEnabled() const { return m_deviceInfo->hearingAidEnabled(); }
 
@@ -162,10 +308,9 @@ private:
             return;
         }
 
-        if (phoneSocket && phoneSocket->isOpen())
+        if (m_phoneConnected)
         {
-            phoneSocket->write(AirPodsPackets::Phone::NOTIFICATION);
-            LOG_DEBUG("Sent notification packet to Android: " << AirPodsPackets::Phone::NOTIFICATION.toHex());
+            m_ioWorker->sendToPhone(AirPodsPackets::Phone::NOTIFICATION);
         }
         else
         {
@@ -185,57 +330,64 @@ public slots:
         connectToDevice(device);
     }
 
-    void setNoiseControlMode(NoiseControlMode mode)
+    bool setNoiseControlMode(NoiseControlMode mode)
     {
         if (m_deviceInfo->noiseControlMode() == mode)
         {
             LOG_INFO("Noise control mode is already set to: " << static_cast<int>(mode));
-            return;
+            return true;
         }
         LOG_INFO("Setting noise control mode to: " << mode);
         QByteArray packet = AirPodsPackets::NoiseControl::getPacketForMode(mode);
-        writePacketToSocket(packet, "Noise control mode packet written: ");
+        return sendControlCommand(packet);
     }
-    void setNoiseControlModeInt(int mode)
+    bool setNoiseControlModeInt(int mode)
     {
         if (mode < 0 || mode > static_cast<int>(NoiseControlMode::Adaptive))
         {
             LOG_ERROR("Invalid noise control mode: " << mode);
-            return;
+            return false;
         }
-        setNoiseControlMode(static_cast<NoiseControlMode>(mode));
+        return setNoiseControlMode(static_cast<NoiseControlMode>(mode));
     }
 
-    void setConversationalAwareness(bool enabled)
+    bool setConversationalAwareness(bool enabled)
     {
         LOG_INFO("Setting conversational awareness to: " << (enabled ? "enabled" : "disabled"));
         QByteArray packet = enabled ? AirPodsPackets::ConversationalAwareness::ENABLED
                                     : AirPodsPackets::ConversationalAwareness::DISABLED;
 
-        writePacketToSocket(packet, "Conversational awareness packet written: ");
+        DeviceInfo *device = m_deviceInfo;
+        const bool previous = device->conversationalAwareness();
+        if (!sendControlCommand(packet, [device, previous]() { device->setConversationalAwareness(previous); }))
+        {
+            return false;
+        }
         m_deviceInfo->setConversationalAwareness(enabled);
+        return true;
     }
 
-    void setOneBudANCMode(bool enabled)
+    bool setOneBudANCMode(bool enabled)
     {
         if (m_deviceInfo->oneBudANCMode() == enabled)
         {
             LOG_INFO("One Bud ANC mode is already " << (enabled ? "enabled" : "disabled"));
-            return;
+            return true;
         }
 
         LOG_INFO("Setting One Bud ANC mode to: " << (enabled ? "enabled" : "disabled"));
         QByteArray packet = enabled ? AirPodsPackets::OneBudANCMode::ENABLED
                                     : AirPodsPackets::OneBudANCMode::DISABLED;
 
-        if (writePacketToSocket(packet, "One Bud ANC mode packet written: "))
-        {
-            m_deviceInfo->setOneBudANCMode(enabled);
-        }
-        else
+        DeviceInfo *device = m_deviceInfo;
+        const bool previous = device->oneBudANCMode();
+        if (!sendControlCommand(packet, [device, previous]() { device->setOneBudANCMode(previous); }))
         {
             LOG_ERROR("Failed to send One Bud ANC mode command: socket not open");
+            return false;
         }
+        m_deviceInfo->setOneBudANCMode(enabled);
+        return true;
     }
 
     void setRetryAttempts(int attempts)
@@ -244,6 +396,7 @@ public slots:
         {
             LOG_DEBUG("Setting retry attempts to: " << attempts);
             m_retryAttempts = attempts;
+            m_connections->setMaxAttempts(attempts);
             emit retryAttemptsChanged(attempts);
             saveRetryAttempts(attempts);
         }
@@ -251,54 +404,69 @@ public slots:
 
     void initiateMagicPairing()
     {
-        if (!socket || !socket->isOpen())
+        requestMagicCloudKeys(m_deviceInfo);
+    }
+
+    void requestMagicCloudKeys(DeviceInfo *device)
+    {
+        if (!device->isConnected())
         {
             LOG_ERROR("Socket nicht offen, Magic Pairing kann nicht gestartet werden");
             return;
         }
 
-        writePacketToSocket(AirPodsPackets::MagicPairing::REQUEST_MAGIC_CLOUD_KEYS, "Magic Pairing packet written: ");
+        writePacketToDevice(device, AirPodsPackets::MagicPairing::REQUEST_MAGIC_CLOUD_KEYS, "Magic Pairing packet written: ");
     }
 
-    void setAdaptiveNoiseLevel(int level)
+    bool setAdaptiveNoiseLevel(int level)
     {
         level = qBound(0, level, 100);
-        if (m_deviceInfo->adaptiveNoiseLevel() != level && m_deviceInfo->adaptiveModeActive())
+        if (m_deviceInfo->adaptiveNoiseLevel() == level)
+        {
+            return true;
+        }
+        if (!m_deviceInfo->adaptiveModeActive())
+        {
+            return false;
+        }
+        QByteArray packet = AirPodsPackets::AdaptiveNoise::getPacket(level);
+        DeviceInfo *device = m_deviceInfo;
+        const int previous = device->adaptiveNoiseLevel();
+        if (!sendControlCommand(packet, [device, previous]() { device->setAdaptiveNoiseLevel(previous); }))
         {
-            QByteArray packet = AirPodsPackets::AdaptiveNoise::getPacket(level);
-            writePacketToSocket(packet, "Adaptive noise level packet written: ");
-            m_deviceInfo->setAdaptiveNoiseLevel(level);
+            return false;
         }
+        m_deviceInfo->setAdaptiveNoiseLevel(level);
+        return true;
     }
 
-    void renameAirPods(const QString &newName)
+    bool renameAirPods(const QString &newName)
     {
         if (newName.isEmpty())
         {
             LOG_WARN("Cannot set empty name");
-            return;
+            return false;
         }
         if (newName.size() > 32)
         {
             LOG_WARN("Name is too long, must be 32 characters or less");
-            return;
+            return false;
         }
         if (newName == m_deviceInfo->deviceName())
         {
             LOG_INFO("Name is already set to: " << newName);
-            return;
+            return true;
         }
 
         QByteArray packet = AirPodsPackets::Rename::getPacket(newName);
-        if (writePacketToSocket(packet, "Rename packet written: "))
-        {
-            LOG_INFO("Sent rename command for new name: " << newName);
-            m_deviceInfo->setDeviceName(newName);
-        }
-        else
+        if (!writePacketToSocket(packet, "Rename packet written: "))
         {
             LOG_ERROR("Failed to send rename command: socket not open");
+            return false;
         }
+        LOG_INFO("Sent rename command for new name: " << newName);
+        m_deviceInfo->setDeviceName(newName);
+        return true;
     }
 
     void setEarDetectionBehavior(int behavior)
@@ -323,11 +491,43 @@ public slots:
         }
 
         CrossDevice.isEnabled = enabled;
+        m_ioWorker->setCrossDeviceEnabled(enabled);
         saveCrossDeviceEnabled();
+        updatePreConnectTakeover();
         connectToPhone();
         emit crossDeviceEnabledChanged(enabled);
     }
 
+    void setPreConnectEnabled(bool enabled)
+    {
+        if (m_preConnector->isEnabled() == enabled)
+        {
+            return;
+        }
+        LOG_INFO("Connecting when the case opens is now " << (enabled ? "enabled" : "disabled"));
+        m_preConnector->setEnabled(enabled);
+        savePreConnectEnabled(enabled);
+        emit preConnectEnabledChanged(enabled);
+    }
+
+    void setHeadsetForAnyRecording(bool any)
+    {
+        if (m_headsetForAnyRecording == any)
+        {
+            return;
+        }
+        m_headsetForAnyRecording = any;
+        mediaController->setHeadsetForAnyRecording(any);
+        saveHeadsetForAnyRecording(any);
+        emit headsetForAnyRecordingChanged(any);
+    }
+
+    // Opening the case must not pull the AirPods away from the phone while it is using them
+    void updatePreConnectTakeover()
+    {
+        m_preConnector->setTakeoverAllowed(!CrossDevice.isEnabled || CrossDevice.isAvailable);
+    }
+
     void setPhoneMac(const QString &mac)
     {
         if (mac.isEmpty()) {
@@ -359,11 +559,7 @@ public slots:
         }
 
         // If a phone socket exists, restart connection using the new MAC
-        if (phoneSocket && phoneSocket->isOpen()) {
-            phoneSocket->close();
-            phoneSocket->deleteLater();
-            phoneSocket = nullptr;
-        }
+        m_ioWorker->disconnectPhone();
         connectToPhone();
     }
 
@@ -373,21 +569,44 @@ public slots:
         emit phoneMacStatusChanged();
     }
 
-    void setHearingAidEnabled(bool enabled)
+    bool setHearingAidEnabled(bool enabled)
     {
         LOG_INFO("Setting hearing aid to: " << (enabled ? "enabled" : "disabled"));
         QByteArray packet = enabled ? AirPodsPackets::HearingAid::ENABLED
                                     : AirPodsPackets::HearingAid::DISABLED;
 
-        writePacketToSocket(packet, "Hearing aid packet written: ");
+        DeviceInfo *device = m_deviceInfo;
+        const bool previous = device->hearingAidEnabled();
+        if (!sendControlCommand(packet, [device, previous]() { device->setHearingAidEnabled(previous); }))
+        {
+            return false;
+        }
         m_deviceInfo->setHearingAidEnabled(enabled);
+        return true;
+    }
+
+    // Through the command queue, which drops superseded writes and calls rollback if the AirPods never confirm
+    bool sendControlCommand(const QByteArray &packet, std::function<void()> rollback = nullptr)
+    {
+        if (!m_deviceInfo->isConnected())
+        {
+            LOG_ERROR("Socket is not open, cannot write packet");
+            return false;
+        }
+        m_commands->submit(QBluetoothAddress(m_deviceInfo->bluetoothAddress()), packet, std::move(rollback));
+        return true;
     }
 
     bool writePacketToSocket(const QByteArray &packet, const QString &logMessage)
     {
-        if (socket && socket->isOpen())
+        return writePacketToDevice(m_deviceInfo, packet, logMessage);
+    }
+
+    bool writePacketToDevice(DeviceInfo *device, const QByteArray &packet, const QString &logMessage)
+    {
+        if (device->isConnected())
         {
-            socket->write(packet);
+            m_ioWorker->sendToAirPods(QBluetoothAddress(device->bluetoothAddress()), packet);
             LOG_DEBUG(logMessage << packet.toHex());
             return true;
         }
@@ -401,6 +620,12 @@ public slots:
     bool loadCrossDeviceEnabled() { return m_settings->value("crossdevice/enabled", false).toBool(); }
     void saveCrossDeviceEnabled() { m_settings->setValue("crossdevice/enabled", CrossDevice.isEnabled); }
 
+    bool loadPreConnectEnabled() const { return m_settings->value("bluetooth/preConnectOnLidOpen", true).toBool(); }
+    void savePreConnectEnabled(bool enabled) { m_settings->setValue("bluetooth/preConnectOnLidOpen", enabled); }
+
+    bool loadHeadsetForAnyRecording() const { return m_settings->value("audio/headsetForAnyRecording", false).toBool(); }
+    void saveHeadsetForAnyRecording(bool any) { m_settings->setValue("audio/headsetForAnyRecording", any); }
+
     int loadEarDetectionSettings() { return m_settings->value("earDetection/setting", MediaController::EarDetectionBehavior::PauseWhenOneRemoved).toInt(); }
     void saveEarDetectionSettings() { m_settings->setValue("earDetection/setting", mediaController->getEarDetectionBehavior()); }
 
@@ -412,16 +637,14 @@ public slots:
 
     void onSystemGoingToSleep()
     {
-        if (m_bleManager->isScanning())
-        {
-            LOG_INFO("Stopping BLE scan before going to sleep");
-            m_bleManager->stopScan();
-        }
+        LOG_INFO("Stopping BLE scan before going to sleep");
+        m_scanScheduler->setSleeping(true);
     }
     void onSystemWakingUp()
     {
         LOG_INFO("System is waking up, starting ble scan");
-        m_bleManager->startScan();
+        m_scanScheduler->setSleeping(false);
+        m_scanScheduler->boost("wake-up");
 
         // Check if AirPods are already connected and activate A2DP profile
         if (areAirpodsConnected() && m_deviceInfo && !m_deviceInfo->bluetoothAddress().isEmpty())
@@ -478,49 +701,47 @@ private slots:
         }
     }
 
-    void sendHandshake() {
-        LOG_INFO("Connected to device, sending initial packets");
-        writePacketToSocket(AirPodsPackets::Connection::HANDSHAKE, "Handshake packet written: ");
-    }
-
     void bluezDeviceConnected(const QString &address, const QString &name)
     {
         QBluetoothDeviceInfo device(QBluetoothAddress(address), name, 0);
         connectToDevice(device);
 
-        // After system reboot, AirPods might be connected but A2DP profile not active
-        // Attempt to activate A2DP profile after a delay to ensure connection is established
-        QTimer::singleShot(2000, this, [this, address]()
+        // After system reboot, AirPods might be connected but A2DP profile not active. The card
+        // shows up in PulseAudio shortly after this; activate the profile as soon as it does.
+        // An unaddressed active device is the placeholder, which this connection is about to adopt.
+        const QString activeAddress = m_deviceInfo->bluetoothAddress();
+        if (!address.isEmpty() && (address == activeAddress || activeAddress.isEmpty()))
         {
-            if (!address.isEmpty())
-            {
-                QString formattedAddress = address;
-                formattedAddress = formattedAddress.replace(":", "_");
-                mediaController->setConnectedDeviceMacAddress(formattedAddress);
-                mediaController->activateA2dpProfile();
-                LOG_INFO("A2DP profile activation attempted for newly connected device");
-            }
-        });
+            mediaController->prepareDevice(QString(address).replace(":", "_"));
+            mediaController->activateA2dpProfile();
+            LOG_INFO("A2DP profile activation requested for newly connected device");
+        }
     }
 
     void onDeviceDisconnected(const QBluetoothAddress &address)
     {
         LOG_INFO("Device disconnected: " << address.toString());
-        if (socket)
+        DeviceInfo *device = m_devices->device(address);
+        m_connections->cancel(address);
+        m_ioWorker->disconnectAirPods(address);
+        if (!device)
         {
-            LOG_WARN("Socket is still open, closing it");
-            socket->close();
-            socket = nullptr;
+            return;
         }
-        if (phoneSocket && phoneSocket->isOpen())
+
+        // Keep who it is for the device list, forget what only held while connected
+        device->resetState();
+        updateScanNeeds();
+        m_scanScheduler->boost("disconnected");
+
+        if (device != m_deviceInfo)
         {
-            phoneSocket->write(AirPodsPackets::Connection::AIRPODS_DISCONNECTED);
-            LOG_DEBUG("AIRPODS_DISCONNECTED packet written: " << AirPodsPackets::Connection::AIRPODS_DISCONNECTED.toHex());
+            return;
         }
-
-        // Clear the device name and model
-        m_deviceInfo->reset();
-        m_bleManager->startScan();
+        m_audioAdjustments->disconnectFromDevice();
+        mediaController->setCallActive(false);
+        m_dbusService->setConnected(false);
+        m_statusPage->setConnected(false);
         emit airPodsStatusChanged();
 
         // Show system notification
@@ -528,19 +749,103 @@ private slots:
             tr("AirPods Disconnected"),
             tr("Your AirPods have been disconnected"));
         trayManager->resetTrayIcon();
+        activateConnectedDevice();
     }
 
     void bluezDeviceDisconnected(const QString &address, const QString &name)
     {
-        if (address == m_deviceInfo->bluetoothAddress())
+        if (m_devices->device(QBluetoothAddress(address)))
         {
             onDeviceDisconnected(QBluetoothAddress(address));
         } else {
-            LOG_WARN("Disconnected device does not match connected device: " << address << " != " << m_deviceInfo->bluetoothAddress());
+            LOG_WARN("Disconnected device is not one of ours: " << address << " (" << name << ")");
+        }
+    }
+
+    // Makes another connected device active if the active one is gone
+    void activateConnectedDevice()
+    {
+        if (m_deviceInfo->isConnected())
+        {
+            return;
+        }
+        for (DeviceInfo *device : m_devices->devices())
+        {
+            if (device->isConnected())
+            {
+                m_devices->setActive(device);
+                return;
+            }
+        }
+    }
+
+    void onActiveDeviceChanged(DeviceInfo *current, DeviceInfo *previous)
+    {
+        previous->disconnect(trayManager);
+        disconnect(previous->getBattery(), &Battery::primaryChanged, this, &AirPodsTrayApp::primaryChanged);
+        m_deviceInfo = current;
+        bindActiveDevice();
+
+        m_dbusService->setDeviceInfo(current);
+        m_dbusService->setConnected(current->isConnected());
+        m_statusPage->setDeviceInfo(current);
+        m_statusPage->setConnected(current->isConnected());
+
+        const QBluetoothAddress address(current->bluetoothAddress());
+        m_ioWorker->setRelayDevice(address);
+        m_audioAdjustments->disconnectFromDevice();
+        mediaController->setCallActive(false); // The new device's advertisements report its own
+        updateScanNeeds();
+        if (current->isConnected())
+        {
+            if (!address.isNull())
+            {
+                m_audioAdjustments->connectToDevice(address);
+            }
+            mediaController->setConnectedDeviceMacAddress(current->bluetoothAddress().replace(":", "_"));
+        }
+
+        emit deviceInfoChanged();
+        emit airPodsStatusChanged();
+        emit hearingAidEnabledChanged(current->hearingAidEnabled());
+    }
+
+    void bindActiveDevice()
+    {
+        connect(m_deviceInfo, &DeviceInfo::batteryStatusChanged, trayManager, &TrayIconManager::updateBatteryStatus);
+        connect(m_deviceInfo, &DeviceInfo::noiseControlModeChanged, trayManager, &TrayIconManager::updateNoiseControlState);
+        connect(m_deviceInfo, &DeviceInfo::conversationalAwarenessChanged, trayManager, &TrayIconManager::updateConversationalAwareness);
+        connect(m_deviceInfo->getBattery(), &Battery::primaryChanged, this, &AirPodsTrayApp::primaryChanged);
+
+        if (m_deviceInfo->isConnected())
+        {
+            trayManager->updateBatteryStatus(m_deviceInfo->batteryStatus());
+        }
+        else
+        {
+            trayManager->resetTrayIcon();
         }
+        trayManager->updateNoiseControlState(m_deviceInfo->noiseControlMode());
+        trayManager->updateConversationalAwareness(m_deviceInfo->conversationalAwareness());
+        trayManager->setActiveDevice(m_deviceInfo->bluetoothAddress());
     }
 
-    void parseMetadata(const QByteArray &data)
+    void updateTrayDevices()
+    {
+        QList<QPair<QString, QString>> devices;
+        for (DeviceInfo *device : m_devices->devices())
+        {
+            if (!device->bluetoothAddress().isEmpty())
+            {
+                devices.append({device->bluetoothAddress(),
+                                device->deviceName().isEmpty() ? device->bluetoothAddress() : device->deviceName()});
+            }
+        }
+        trayManager->setDevices(devices);
+        trayManager->setActiveDevice(m_deviceInfo->bluetoothAddress());
+    }
+
+    void parseMetadata(DeviceInfo *device, const QByteArray &data)
     {
         // Verify the data starts with the METADATA header
         if (!data.startsWith(AirPodsPackets::Parse::METADATA))
@@ -578,18 +883,18 @@ private slots:
             return str;
         };
 
-        m_deviceInfo->setDeviceName(extractString());
-        m_deviceInfo->setModelNumber(extractString());
-        m_deviceInfo->setManufacturer(extractString());
+        device->setDeviceName(extractString());
+        device->setModelNumber(extractString());
+        device->setManufacturer(extractString());
 
-        m_deviceInfo->setModel(parseModelNumber(m_deviceInfo->modelNumber()));
+        device->setModel(parseModelNumber(device->modelNumber()));
         emit modelChanged();
 
         // Log extracted metadata
         LOG_INFO("Parsed AirPods metadata:");
-        LOG_INFO("Device Name: " << m_deviceInfo->deviceName());
-        LOG_INFO("Model Number: " << m_deviceInfo->modelNumber());
-        LOG_INFO("Manufacturer: " << m_deviceInfo->manufacturer());
+        LOG_INFO("Device Name: " << device->deviceName());
+        LOG_INFO("Model Number: " << device->modelNumber());
+        LOG_INFO("Manufacturer: " << device->manufacturer());
     }
 
     QString getEarStatus(char value)
@@ -600,85 +905,155 @@ private slots:
 
     void connectToDevice(const QBluetoothDeviceInfo &device)
     {
-        if (socket && socket->isOpen() && socket->peerAddress() == device.address())
+        DeviceInfo *info = m_devices->addDevice(device.address());
+        if (info->isConnected())
         {
             LOG_INFO("Already connected to the device: " << device.name());
             return;
         }
 
         LOG_INFO("Connecting to device: " << device.name());
+        m_connections->connectDevice(device.address());
+        notifyAndroidDevice();
+    }
 
-        // Clean up any existing socket
-        if (socket)
-        {
-            socket->close();
-            socket->deleteLater();
-            socket = nullptr;
-        }
-
-        QBluetoothSocket *localSocket = new QBluetoothSocket(QBluetoothServiceInfo::L2capProtocol);
-        socket = localSocket;
+    void drainIoEvents()
+    {
+        m_ioWorker->drainEvents([this](IoEvent &event) { handleIoEvent(event); });
+    }
 
-        // Connection handler
-        auto handleConnection = [this, localSocket]()
+    void handleIoEvent(const IoEvent &event)
+    {
+        // Set for the AirPods* events; the links are only ever opened for known devices
+        DeviceInfo *device = m_devices->device(event.device);
+        const QBluetoothAddress eventAddress(event.device);
+        switch (event.type)
         {
-            connect(localSocket, &QBluetoothSocket::readyRead, this, [this, localSocket]()
-                    {
-            QByteArray data = localSocket->readAll();
-            QMetaObject::invokeMethod(this, "parseData", Qt::QueuedConnection, Q_ARG(QByteArray, data));
-            QMetaObject::invokeMethod(this, "relayPacketToPhone", Qt::QueuedConnection, Q_ARG(QByteArray, data)); });
-            sendHandshake();
-        };
-
-        // Error handler with retry
-        auto handleError = [this, device, localSocket](QBluetoothSocket::SocketError error)
+        case IoEvent::Type::AirPodsConnected:
         {
-            LOG_ERROR("Socket error: " << error << ", " << localSocket->errorString());
-
-            static int retryCount = 0;
-            if (retryCount < m_retryAttempts)
+            m_connections->onConnected(eventAddress);
+            if (!device)
             {
-                retryCount++;
-                LOG_INFO("Retrying connection (attempt " << retryCount << ")");
-                QTimer::singleShot(1500, this, [this, device]()
-                                   { connectToDevice(device); });
+                break;
             }
-            else
+            device->setConnected(true);
+            const QBluetoothAddress address(device->bluetoothAddress());
+            if (device == m_deviceInfo)
             {
-                LOG_ERROR("Failed to connect after 3 attempts");
-                retryCount = 0;
+                if (!address.isNull())
+                {
+                    m_audioAdjustments->connectToDevice(address);
+                }
             }
-        };
-
-        connect(localSocket, &QBluetoothSocket::connected, this, handleConnection);
-        connect(localSocket, QOverload<QBluetoothSocket::SocketError>::of(&QBluetoothSocket::errorOccurred),
-                this, handleError);
-
-        localSocket->connectToService(device.address(), QBluetoothUuid("74ec2172-0bad-4d01-8f77-997b2be0722a"));
-        m_deviceInfo->setBluetoothAddress(device.address().toString());
-        notifyAndroidDevice();
+            else if (!m_deviceInfo->isConnected())
+            {
+                // Newly connected AirPods take over unless the user is already using another pair
+                m_devices->setActive(device);
+            }
+            break;
+        }
+        case IoEvent::Type::AirPodsDisconnected:
+            m_connections->onLinkLost(eventAddress);
+            m_commands->clear(eventAddress);
+            if (device)
+            {
+                device->setConnected(false);
+            }
+            break;
+        case IoEvent::Type::AirPodsError:
+            m_connections->onError(eventAddress, QString::fromUtf8(event.data));
+            m_commands->clear(eventAddress);
+            if (device)
+            {
+                device->setConnected(false);
+            }
+            break;
+        case IoEvent::Type::AirPodsPacket:
+        {
+            static Metrics::Histogram &readToHandled = Metrics::histogram("aacp_read_to_handled");
+            // Time spent in the I/O -> GUI queue, keyed by the post time
+            Trace::asyncBegin("io.queue", static_cast<quint64>(event.timestampNs), event.timestampNs);
+            Trace::asyncEnd("io.queue", static_cast<quint64>(event.timestampNs));
+            m_connections->onPacketReceived(eventAddress);
+            if (device)
+            {
+                parseData(device, event.data);
+            }
+            readToHandled.record(Metrics::nowNs() - event.timestampNs);
+            break;
+        }
+        case IoEvent::Type::PhoneConnected:
+            m_phoneConnected = true;
+            break;
+        case IoEvent::Type::PhoneDisconnected:
+            m_phoneConnected = false;
+            break;
+        case IoEvent::Type::PhoneTookAirPods:
+            isConnectedLocally = true;
+            CrossDevice.isAvailable = false;
+            break;
+        case IoEvent::Type::PhoneReleasedAirPods:
+            isConnectedLocally = false;
+            CrossDevice.isAvailable = true;
+            break;
+        case IoEvent::Type::PhoneDisconnectRequest:
+        {
+            // The phone has the AirPods now; do not fight it for the link
+            m_connections->cancel(eventAddress);
+            if (!device)
+            {
+                break;
+            }
+            device->setConnected(false);
+            QProcess process;
+            process.start("bluetoothctl", QStringList() << "disconnect" << device->bluetoothAddress());
+            process.waitForFinished();
+            QString output = process.readAllStandardOutput().trimmed();
+            LOG_INFO("Bluetoothctl output: " << output);
+            isConnectedLocally = false;
+            CrossDevice.isAvailable = true;
+            break;
+        }
+        }
+        if (!areAirpodsConnected())
+        {
+            m_audioAdjustments->disconnectFromDevice();
+            mediaController->setCallActive(false);
+        }
+        updatePreConnectTakeover();
+        m_dbusService->setConnected(areAirpodsConnected());
+        m_statusPage->setConnected(areAirpodsConnected());
     }
 
-    void parseData(const QByteArray &data)
+    // Everything about the device goes to its own DeviceInfo; audio and UI side effects only follow the active one
+    void parseData(DeviceInfo *device, const QByteArray &data)
     {
+        TRACE_SCOPE("AirPodsTrayApp::parseData");
         LOG_DEBUG("Received: " << data.toHex());
 
-        if (data.startsWith(AirPodsPackets::Parse::HANDSHAKE_ACK))
+        // AACP packets start with 04 00 04 00 followed by the opcode
+        static Metrics::CounterFamily &packetsByOpcode = Metrics::counterFamily("aacp_packets_total", "opcode");
+        static Metrics::Counter &shortPackets = Metrics::counter("aacp_short_packets_total");
+        if (data.size() > 4)
         {
-            writePacketToSocket(AirPodsPackets::Connection::SET_SPECIFIC_FEATURES, "Set specific features packet written: ");
+            packetsByOpcode.at(static_cast<quint8>(data[4])).add();
         }
-        else if (data.startsWith(AirPodsPackets::Parse::FEATURES_ACK))
+        else
         {
-            writePacketToSocket(AirPodsPackets::Connection::REQUEST_NOTIFICATIONS, "Request notifications packet written: ");
+            shortPackets.add();
+        }
 
-            QTimer::singleShot(2000, this, [this]() {
-                if (m_deviceInfo->batteryStatus().isEmpty()) {
-                    writePacketToSocket(AirPodsPackets::Connection::REQUEST_NOTIFICATIONS, "Request notifications packet written: ");
-                }
-            });
+        // Handshake and feature acknowledgements are answered on the I/O thread
+
+        // Echoes of control commands that a newer write is about to overwrite would only make the UI jump back
+        if (!m_commands->onNotification(QBluetoothAddress(device->bluetoothAddress()), data))
+        {
+            LOG_DEBUG("Superseded control command echo: " << data.toHex());
+            return;
         }
+
         // Magic Cloud Keys Response
-        else if (data.startsWith(AirPodsPackets::MagicPairing::MAGIC_CLOUD_KEYS_HEADER))
+        if (data.startsWith(AirPodsPackets::MagicPairing::MAGIC_CLOUD_KEYS_HEADER))
         {
             auto keys = AirPodsPackets::MagicPairing::parseMagicCloudKeysPacket(data);
             LOG_INFO("Received Magic Cloud Keys:");
@@ -686,24 +1061,22 @@ private slots:
             LOG_INFO("MagicAccEncKey: " << keys.magicAccEncKey.toHex());
 
             // Store the keys
-            m_deviceInfo->setMagicAccIRK(keys.magicAccIRK);
-            m_deviceInfo->setMagicAccEncKey(keys.magicAccEncKey);
-            m_deviceInfo->saveToSettings(*m_settings);
+            m_devices->setMagicKeys(device, keys.magicAccIRK, keys.magicAccEncKey);
         }
         // Get CA state
         else if (data.startsWith(AirPodsPackets::ConversationalAwareness::HEADER)) {
             if (auto result = AirPodsPackets::ConversationalAwareness::parseState(data))
             {
-                m_deviceInfo->setConversationalAwareness(result.value());
-                LOG_INFO("Conversational awareness state received: " << m_deviceInfo->conversationalAwareness());
+                device->setConversationalAwareness(result.value());
+                LOG_INFO("Conversational awareness state received: " << device->conversationalAwareness());
             }
         }
         // Hearing Aid state
         else if (data.startsWith(AirPodsPackets::HearingAid::HEADER)) {
             if (auto result = AirPodsPackets::HearingAid::parseState(data))
             {
-                m_deviceInfo->setHearingAidEnabled(result.value());
-                LOG_INFO("Hearing aid state received: " << m_deviceInfo->hearingAidEnabled());
+                device->setHearingAidEnabled(result.value());
+                LOG_INFO("Hearing aid state received: " << device->hearingAidEnabled());
             }
         }
         // Noise Control Mode
@@ -711,46 +1084,62 @@ private slots:
         {
             if (auto value = AirPodsPackets::NoiseControl::parseMode(data))
             {
-                m_deviceInfo->setNoiseControlMode(value.value());
-                LOG_INFO("Noise control mode received: " << m_deviceInfo->noiseControlMode());
+                device->setNoiseControlMode(value.value());
+                LOG_INFO("Noise control mode received: " << device->noiseControlMode());
             }
         }
         // Ear Detection
         else if (data.size() == 8 && data.startsWith(AirPodsPackets::Parse::EAR_DETECTION))
         {
-            m_deviceInfo->getEarDetection()->parseData(data);
-            mediaController->handleEarDetection(m_deviceInfo->getEarDetection());
+            device->getEarDetection()->parseData(data);
+            if (device == m_deviceInfo)
+            {
+                mediaController->handleEarDetection(device->getEarDetection());
+            }
         }
         // Battery Status
         else if ((data.size() == 22 || data.size() == 12) && data.startsWith(AirPodsPackets::Parse::BATTERY_STATUS))
         {
-            m_deviceInfo->getBattery()->parsePacket(data);
-            m_deviceInfo->updateBatteryStatus();
-            LOG_INFO("Battery status: " << m_deviceInfo->batteryStatus());
+            device->getBattery()->parsePacket(data);
+            device->updateBatteryStatus();
+            LOG_INFO("Battery status: " << device->batteryStatus());
         }
         // Conversational Awareness Data
         else if (data.size() == 10 && data.startsWith(AirPodsPackets::ConversationalAwareness::DATA_HEADER))
         {
             LOG_INFO("Received conversational awareness data");
-            mediaController->handleConversationalAwareness(data);
+            if (device == m_deviceInfo)
+            {
+                mediaController->handleConversationalAwareness(data);
+            }
         }
         else if (data.startsWith(AirPodsPackets::Parse::METADATA))
         {
-            parseMetadata(data);
-            initiateMagicPairing();
-            mediaController->setConnectedDeviceMacAddress(m_deviceInfo->bluetoothAddress().replace(":", "_"));
-            if (m_deviceInfo->getEarDetection()->oneOrMorePodsInEar()) // AirPods get added as output device only after this
+            parseMetadata(device, data);
+            m_devices->save(device);
+            requestMagicCloudKeys(device);
+            if (device == m_deviceInfo)
             {
-                mediaController->activateA2dpProfile();
+                mediaController->setConnectedDeviceMacAddress(device->bluetoothAddress().replace(":", "_"));
+                if (device->getEarDetection()->oneOrMorePodsInEar()) // AirPods get added as output device only after this
+                {
+                    mediaController->activateA2dpProfile();
+                }
+                emit airPodsStatusChanged();
             }
-            m_bleManager->stopScan();
-            emit airPodsStatusChanged();
+            // Keep scanning while other known AirPods can only be seen over BLE
+            updateScanNeeds();
+        }
+        else if (data.size() > AirPodsPackets::AdaptiveNoise::HEADER.size() && data.startsWith(AirPodsPackets::AdaptiveNoise::HEADER))
+        {
+            device->setAdaptiveNoiseLevel(static_cast<quint8>(data.at(AirPodsPackets::AdaptiveNoise::HEADER.size())));
+            LOG_INFO("Adaptive noise level received: " << device->adaptiveNoiseLevel());
         }
         else if (data.startsWith(AirPodsPackets::OneBudANCMode::HEADER)) {
             if (auto value = AirPodsPackets::OneBudANCMode::parseState(data))
             {
-                m_deviceInfo->setOneBudANCMode(value.value());
-                LOG_INFO("One Bud ANC mode received: " << m_deviceInfo->oneBudANCMode());
+                device->setOneBudANCMode(value.value());
+                LOG_INFO("One Bud ANC mode received: " << device->oneBudANCMode());
             }
         }
         else
@@ -764,7 +1153,7 @@ private slots:
             return;
         }
 
-        if (phoneSocket && phoneSocket->isOpen()) {
+        if (m_phoneConnected) {
             LOG_INFO("Already connected to the phone");
             return;
         }
@@ -775,115 +1164,35 @@ private slots:
         {
             phoneAddress = QBluetoothAddress(env.value("PHONE_MAC_ADDRESS"));
         }
-        phoneSocket = new QBluetoothSocket(QBluetoothServiceInfo::L2capProtocol);
-        connect(phoneSocket, &QBluetoothSocket::connected, this, [this]() {
-            LOG_INFO("Connected to phone");
-            if (!lastBatteryStatus.isEmpty()) {
-                phoneSocket->write(lastBatteryStatus);
-                LOG_DEBUG("Sent last battery status to phone: " << lastBatteryStatus.toHex());
-            }
-            if (!lastEarDetectionStatus.isEmpty()) {
-                phoneSocket->write(lastEarDetectionStatus);
-                LOG_DEBUG("Sent last ear detection status to phone: " << lastEarDetectionStatus.toHex());
-            }
-        });
-
-        connect(phoneSocket, QOverload<QBluetoothSocket::SocketError>::of(&QBluetoothSocket::errorOccurred), this, [this](QBluetoothSocket::SocketError error) {
-            LOG_ERROR("Phone socket error: " << error << ", " << phoneSocket->errorString());
-        });
-
-        phoneSocket->connectToService(phoneAddress, QBluetoothUuid("1abbb9a4-10e4-4000-a75c-8953c5471342"));
+        m_ioWorker->connectToPhone(phoneAddress);
     }
 
-    void relayPacketToPhone(const QByteArray &packet)
+    void bleDeviceFound(const BleInfo &device)
     {
-        if (!CrossDevice.isEnabled) {
+        // AirPods across the room are neither resolved, decrypted nor shown
+        if (!device.near) {
             return;
         }
-        if (phoneSocket && phoneSocket->isOpen())
-        {
-            phoneSocket->write(AirPodsPackets::Phone::NOTIFICATION + packet);
-        }
-        else
-        {
-            connectToPhone();
-            LOG_WARN("Phone socket is not open, cannot relay packet");
-        }
-    }
-
-    void handlePhonePacket(const QByteArray &packet) {
-        if (packet.startsWith(AirPodsPackets::Phone::NOTIFICATION))
-        {
-            QByteArray airpodsPacket = packet.mid(4);
-            if (socket && socket->isOpen()) {
-                socket->write(airpodsPacket);
-                LOG_DEBUG("Relayed packet to AirPods: " << airpodsPacket.toHex());
-            } else {
-                LOG_ERROR("Socket is not open, cannot relay packet to AirPods");
-            }
-        }
-        else if (packet.startsWith(AirPodsPackets::Phone::CONNECTED))
-        {
-            LOG_INFO("AirPods connected");
-            isConnectedLocally = true;
-            CrossDevice.isAvailable = false;
-        }
-        else if (packet.startsWith(AirPodsPackets::Phone::DISCONNECTED))
-        {
-            LOG_INFO("AirPods disconnected");
-            isConnectedLocally = false;
-            CrossDevice.isAvailable = true;
-        }
-        else if (packet.startsWith(AirPodsPackets::Phone::STATUS_REQUEST))
-        {
-            LOG_INFO("Connection status request received");
-            QByteArray response = (socket && socket->isOpen()) ? AirPodsPackets::Phone::CONNECTED
-                                                               : AirPodsPackets::Phone::DISCONNECTED;
-            phoneSocket->write(response);
-            LOG_DEBUG("Sent connection status response: " << response.toHex());
-        }
-        else if (packet.startsWith(AirPodsPackets::Phone::DISCONNECT_REQUEST))
-        {
-            LOG_INFO("Disconnect request received");
-            if (socket && socket->isOpen()) {
-                socket->close();
-                LOG_INFO("Disconnected from AirPods");
-                QProcess process;
-                process.start("bluetoothctl", QStringList() << "disconnect" << m_deviceInfo->bluetoothAddress());
-                process.waitForFinished();
-                QString output = process.readAllStandardOutput().trimmed();
-                LOG_INFO("Bluetoothctl output: " << output);
-                isConnectedLocally = false;
-                CrossDevice.isAvailable = true;
+        if (DeviceInfo *info = m_devices->resolveAdvertisement(device.address)) {
+            m_scanScheduler->onKnownDeviceSeen();
+            info->setModel(device.modelName);
+            auto decryptet = BLEUtils::decryptLastBytes(device.encryptedPayload, info->magicAccEncKey());
+            info->getBattery()->parseEncryptedPacket(decryptet, device.primaryLeft, device.isThisPodInTheCase, isModelHeadset(info->model()));
+            info->getEarDetection()->overrideEarDetectionStatus(device.isPrimaryInEar, device.isSecondaryInEar);
+            // Showing the battery of a first, unconfirmed advertisement is harmless; connecting is not.
+            // Adapters without RSSI leave nothing to be confident about, so they are taken as near.
+            if (device.rssi == 0 || device.proximityConfidence >= ProximityEstimator::MIN_CONFIDENCE) {
+                m_preConnector->onAdvertisement(info, device);
             }
-        }
-        else
-        {
-            if (socket && socket->isOpen()) {
-                socket->write(packet);
-                LOG_DEBUG("Relayed packet to AirPods: " << packet.toHex());
-            } else {
-                LOG_ERROR("Socket is not open, cannot relay packet to AirPods");
+            if (info == m_deviceInfo) {
+                // The state is that of whatever the AirPods are connected to, so only while that is us
+                const bool call = device.connectionState == BleInfo::ConnectionState::CALL ||
+                                  device.connectionState == BleInfo::ConnectionState::RINGING;
+                mediaController->setCallActive(info->isConnected() && call);
             }
         }
     }
 
-    void onPhoneDataReceived() {
-        QByteArray data = phoneSocket->readAll();
-        LOG_DEBUG("Data received from phone: " << data.toHex());
-        QMetaObject::invokeMethod(this, "handlePhonePacket", Qt::QueuedConnection, Q_ARG(QByteArray, data));
-    }
-
-    void bleDeviceFound(const BleInfo &device)
-    {
-        if (BLEUtils::isValidIrkRpa(m_deviceInfo->magicAccIRK(), device.address)) {
-            m_deviceInfo->setModel(device.modelName);
-            auto decryptet = BLEUtils::decryptLastBytes(device.encryptedPayload, m_deviceInfo->magicAccEncKey());
-            m_deviceInfo->getBattery()->parseEncryptedPacket(decryptet, device.primaryLeft, device.isThisPodInTheCase, isModelHeadset(m_deviceInfo->model()));
-            m_deviceInfo->getEarDetection()->overrideEarDetectionStatus(device.isPrimaryInEar, device.isSecondaryInEar);
-        }
-    }
-
 public:
     void handleMediaStateChange(MediaController::MediaState state) {
         if (state == MediaController::MediaState::Playing) {
@@ -897,10 +1206,9 @@ public:
     {
         if (!CrossDevice.isEnabled) return;
 
-        if (phoneSocket && phoneSocket->isOpen())
+        if (m_phoneConnected)
         {
-            phoneSocket->write(AirPodsPackets::Phone::DISCONNECT_REQUEST);
-            LOG_DEBUG("Sent disconnect request to Android: " << AirPodsPackets::Phone::DISCONNECT_REQUEST.toHex());
+            m_ioWorker->sendToPhone(AirPodsPackets::Phone::DISCONNECT_REQUEST);
         }
         else
         {
@@ -909,11 +1217,11 @@ public:
     }
 
     bool isPhoneConnected() {
-        return phoneSocket && phoneSocket->isOpen();
+        return m_phoneConnected;
     }
 
     void connectToAirPods(bool force) {
-        if (socket && socket->isOpen()) {
+        if (areAirpodsConnected()) {
             LOG_INFO("Already connected to AirPods");
             return;
         }
@@ -942,10 +1250,20 @@ public:
     void initializeBluetooth() {
         connectToPhone();
 
-        m_deviceInfo->loadFromSettings(*m_settings);
-        if (!areAirpodsConnected()) {
-            m_bleManager->startScan();
+        updateScanNeeds();
+        m_scanScheduler->boost("startup");
+    }
+
+    void updateScanNeeds()
+    {
+        bool someConnected = false;
+        for (const DeviceInfo *device : m_devices->devices())
+        {
+            someConnected = someConnected || device->isConnected();
         }
+        m_scanScheduler->setSomeConnected(someConnected);
+        m_scanScheduler->setWatchingCalls(m_deviceInfo->isConnected());
+        m_scanScheduler->setNeeded(!m_devices->allConnected());
     }
 
     void loadMainModule() {
@@ -964,17 +1282,22 @@ signals:
     void airPodsStatusChanged();
     void earDetectionBehaviorChanged(int behavior);
     void crossDeviceEnabledChanged(bool enabled);
+    void preConnectEnabledChanged(bool enabled);
+    void headsetForAnyRecordingChanged(bool any);
     void notificationsEnabledChanged(bool enabled);
     void retryAttemptsChanged(int attempts);
     void oneBudANCModeChanged(bool enabled);
     void phoneMacStatusChanged();
     void hearingAidEnabledChanged(bool enabled);
+    void deviceInfoChanged();
 
 private:
-    QBluetoothSocket *socket = nullptr;
-    QBluetoothSocket *phoneSocket = nullptr;
-    QByteArray lastBatteryStatus;
-    QByteArray lastEarDetectionStatus;
+    QThread *m_ioThread = nullptr;
+    IoWorker *m_ioWorker = nullptr;
+    ConnectionSupervisor *m_connections = nullptr;
+    CommandQueue *m_commands = nullptr;
+    PreConnector *m_preConnector = nullptr;
+    bool m_phoneConnected = false;
     MediaController* mediaController;
     TrayIconManager *trayManager;
     BluetoothMonitor *monitor;
@@ -982,13 +1305,32 @@ private:
     AutoStartManager *m_autoStartManager;
     int m_retryAttempts = 3;
     bool m_hideOnStart = false;
-    DeviceInfo *m_deviceInfo;
-    BleManager *m_bleManager;
+    bool m_headsetForAnyRecording = false;
+    DeviceManager *m_devices;
+    DeviceInfo *m_deviceInfo; // The active device, see DeviceManager
+    BleManager *m_bleManager = nullptr;
     SystemSleepMonitor *m_systemSleepMonitor = nullptr;
+    PowerStateMonitor *m_powerStateMonitor = nullptr;
+    ScanScheduler *m_scanScheduler = nullptr;
+    DBusService *m_dbusService = nullptr;
+    StatusPage *m_statusPage = nullptr;
+    AudioAdjustments *m_audioAdjustments = nullptr;
     QString m_phoneMacStatus;
 };
 
 int main(int argc, char *argv[]) {
+    FlightRecorder::installSignalHandlers();
+
+    // Settle this before paying for Qt: a second launch only hands over its arguments
+    if (!SingleInstance::acquire()) {
+        LOG_INFO("Another instance already running! Forwarding arguments...");
+        if (SingleInstance::forwardArguments(argc, argv)) {
+            return 0;
+        }
+        LOG_ERROR("The running instance did not respond");
+        return 1;
+    }
+
     QApplication app(argc, argv);
 
     // Load translations
@@ -1010,25 +1352,6 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    QLocalServer::removeServer("app_server");
-
-    QFile stale("/tmp/app_server");
-    if (stale.exists())
-        stale.remove();
-
-    QLocalSocket socket_check;
-    socket_check.connectToServer("app_server");
-
-    if (socket_check.waitForConnected(300)) {
-        LOG_INFO("Another instance already running! Reopening window...");
-
-        socket_check.write("reopen");
-        socket_check.flush();
-        socket_check.waitForBytesWritten(200);
-        socket_check.disconnectFromServer();
-
-        return 0;
-    }
     app.setDesktopFileName("me.kavishdevar.librepods");
     app.setQuitOnLastWindowClosed(false);
 
@@ -1042,9 +1365,18 @@ int main(int argc, char *argv[]) {
             hideOnStart = true;
     }
 
+    // LIBREPODS_TRACE=/path/trace.json records trace events for Perfetto / chrome://tracing, startup included
+    const QString tracePath = qEnvironmentVariable("LIBREPODS_TRACE");
+    if (!tracePath.isEmpty()) {
+        Trace::start(tracePath);
+    }
+
     QQmlApplicationEngine engine;
     qmlRegisterType<Battery>("me.kavishdevar.Battery", 1, 0, "Battery");
     qmlRegisterType<DeviceInfo>("me.kavishdevar.DeviceInfo", 1, 0, "DeviceInfo");
+    qmlRegisterUncreatableType<DeviceManager>("me.kavishdevar.DeviceInfo", 1, 0, "DeviceManager", "Provided by the app");
+    qmlRegisterUncreatableType<AudioAdjustments>("me.kavishdevar.AudioAdjustments", 1, 0, "AudioAdjustments", "Provided by the app");
+    qmlRegisterUncreatableType<TuningModel>("me.kavishdevar.AudioAdjustments", 1, 0, "TuningModel", "Provided by the app");
     AirPodsTrayApp *trayApp = new AirPodsTrayApp(debugMode, hideOnStart, &engine);
     engine.rootContext()->setContextProperty("airPodsTrayApp", trayApp);
 
@@ -1058,67 +1390,53 @@ int main(int argc, char *argv[]) {
     }
 
     engine.addImageProvider("qrcode", new QRCodeImageProvider());
-    trayApp->loadMainModule();
-
-    QLocalServer server;
-    QLocalServer::removeServer("app_server");
+    // Loading QML is the slowest part of startup; let the tray and the queued replies go first
+    QTimer::singleShot(0, trayApp, &AirPodsTrayApp::loadMainModule);
+
+    ControlServer controlServer(trayApp->dbusService());
+    controlServer.listen();
+    auto reopen = [&engine, &trayApp]() {
+        LOG_INFO("Reopening app window");
+        QObject *rootObject = engine.rootObjects().isEmpty() ? nullptr : engine.rootObjects().first();
+        if (rootObject) {
+            QMetaObject::invokeMethod(rootObject, "reopen", Q_ARG(QVariant, "app"));
+        }
+        else
+        {
+            trayApp->loadMainModule();
+        }
+    };
+    QObject::connect(&controlServer, &ControlServer::reopenRequested, reopen);
+    QObject::connect(&controlServer, &ControlServer::activateRequested, [reopen](const QStringList &arguments) {
+        LOG_DEBUG("Second launch with arguments: " << arguments);
+        if (!arguments.contains("--hide")) {
+            reopen();
+        }
+    });
 
-    if (!server.listen("app_server"))
-    {
-        LOG_ERROR("Unable to start the listening server");
-        LOG_DEBUG("Server error: " << server.errorString());
-    }
-    else
-    {
-        LOG_DEBUG("Server started, waiting for connections...");
-    }
-    QObject::connect(&server, &QLocalServer::newConnection, [&]() {
-        QLocalSocket* socket = server.nextPendingConnection();
-        // Handles Proper Connection
-        QObject::connect(socket, &QLocalSocket::readyRead, [socket, &engine, &trayApp]() {
-            QString msg = socket->readAll();
-            // Check if the message is "reopen", if so, trigger onOpenApp function
-            if (msg == "reopen") {
-                LOG_INFO("Reopening app window");
-                QObject *rootObject = engine.rootObjects().first();
-                if (rootObject) {
-                    QMetaObject::invokeMethod(rootObject, "reopen", Q_ARG(QVariant, "app"));
-                }
-                else
-                {
-                    trayApp->loadMainModule();
-                }
+    // Periodic metrics snapshot, e.g. LIBREPODS_METRICS_INTERVAL=60 for once a minute
+    const int metricsInterval = qEnvironmentVariableIntValue("LIBREPODS_METRICS_INTERVAL");
+    if (metricsInterval > 0) {
+        QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+        if (runtimeDir.isEmpty()) {
+            runtimeDir = QDir::tempPath();
+        }
+        const QString metricsPath = runtimeDir + "/librepods-metrics.txt";
+        QTimer *metricsTimer = new QTimer(&app);
+        QObject::connect(metricsTimer, &QTimer::timeout, [metricsPath]() {
+            QSaveFile file(metricsPath);
+            if (file.open(QIODevice::WriteOnly)) {
+                file.write(Metrics::snapshotText().toUtf8());
+                file.commit();
             }
-            else
-            {
-                LOG_ERROR("Unknown message received: " << msg);
-            }
-            socket->disconnectFromServer();
-        });
-        // Handles connection errors
-        QObject::connect(socket, &QLocalSocket::errorOccurred, [socket]() {
-            LOG_ERROR("Failed to connect to the duplicate app instance");
-            LOG_DEBUG("Connection error: " << socket->errorString());
-        });
-
-        // Handle server-level errors
-        QObject::connect(&server, &QLocalServer::serverError, [&]() {
-            LOG_ERROR("Server failed to accept a new connection");
-            LOG_DEBUG("Server error: " << server.errorString());
         });
-    });
+        metricsTimer->start(metricsInterval * 1000);
+        LOG_INFO("Writing metrics to " << metricsPath << " every " << metricsInterval << "s");
+    }
 
     QObject::connect(&app, &QCoreApplication::aboutToQuit, [&]() {
-        LOG_DEBUG("Application quitting. Cleaning up local server...");
-
-        if (server.isListening()) {
-            server.close();
-        }
-
-        QLocalServer::removeServer("app_server");
-        QFile stale("/tmp/app_server");
-        if (stale.exists())
-            stale.remove();
+        LOG_DEBUG("Application quitting");
+        Trace::stop();
     });
     return app.exec();
 }
@@ -0,0 +1,125 @@
+#include "duckingengine.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QSet>
+#include <QTimer>
+
+namespace {
+  constexpr qreal DUCK_LEVEL = 0.20;
+  constexpr int DUCK_RAMP_MS = 250;
+  constexpr int RESTORE_RAMP_MS = 750;
+  constexpr int RAMP_TICK_MS = 20;
+  // Pauses between sentences are shorter than this
+  constexpr int RELEASE_HANGOVER_MS = 1500;
+
+  bool isExcludedRole(const QString &role) {
+    static const QSet<QString> excluded = {"phone", "event", "notification", "alert", "a11y", "accessibility"};
+    return excluded.contains(role);
+  }
+}
+
+DuckingEngine::DuckingEngine(PulseAudioController *pulseAudio, QObject *parent)
+    : QObject(parent), m_pulseAudio(pulseAudio), m_rampTimer(new QTimer(this)), m_releaseTimer(new QTimer(this)) {
+  m_rampTimer->setInterval(RAMP_TICK_MS);
+  connect(m_rampTimer, &QTimer::timeout, this, &DuckingEngine::onRampTick);
+  m_releaseTimer->setSingleShot(true);
+  m_releaseTimer->setInterval(RELEASE_HANGOVER_MS);
+  connect(m_releaseTimer, &QTimer::timeout, this, [this]() {
+    LOG_INFO("Conversation over, restoring volume");
+    m_target = 1.0;
+    startRamp();
+  });
+}
+
+void DuckingEngine::duck(const QString &sinkMatch) {
+  if (m_releaseTimer->isActive()) {
+    static Metrics::Counter &coalesced = Metrics::counter("ducking_coalesced_total");
+    coalesced.add();
+    m_releaseTimer->stop();
+  }
+  m_target = DUCK_LEVEL;
+  if (m_streams.isEmpty() && !m_snapshotPending) {
+    takeSnapshot(sinkMatch);
+  } else {
+    startRamp();
+  }
+}
+
+void DuckingEngine::release() {
+  if (isDucked() && !m_releaseTimer->isActive()) {
+    m_releaseTimer->start();
+  }
+}
+
+void DuckingEngine::restore() {
+  m_releaseTimer->stop();
+  m_rampTimer->stop();
+  m_target = 1.0;
+  m_level = 1.0;
+  applyLevel();
+  m_streams.clear();
+}
+
+void DuckingEngine::takeSnapshot(const QString &sinkMatch) {
+  static Metrics::Counter &ducks = Metrics::counter("ducking_events_total");
+  ducks.add();
+  m_snapshotPending = true;
+  m_pulseAudio->listSinkInputs([this, sinkMatch](const QList<PulseAudioController::SinkInput> &inputs,
+                                                 const QHash<quint32, QString> &sinkNames) {
+    m_snapshotPending = false;
+    if (!isDucked()) {
+      return; // Voice ended before the streams were listed
+    }
+    for (const PulseAudioController::SinkInput &input : inputs) {
+      if (isExcludedRole(input.role)) {
+        LOG_DEBUG("Not ducking sink input " << input.index << " with role " << input.role);
+        continue;
+      }
+      if (!sinkMatch.isEmpty() && !sinkNames.value(input.sink).contains(sinkMatch)) {
+        continue;
+      }
+      m_streams.insert(input.index, Stream{input.volume});
+    }
+    LOG_INFO("Ducking " << m_streams.size() << " stream(s) to " << qRound(DUCK_LEVEL * 100) << "%");
+    startRamp();
+  });
+}
+
+void DuckingEngine::startRamp() {
+  if (m_streams.isEmpty() || qFuzzyCompare(m_level, m_target)) {
+    return;
+  }
+  if (!m_rampTimer->isActive()) {
+    m_lastTickNs = Metrics::nowNs();
+    m_rampTimer->start();
+  }
+}
+
+void DuckingEngine::onRampTick() {
+  const qint64 nowNs = Metrics::nowNs();
+  const qreal elapsedMs = (nowNs - m_lastTickNs) / 1e6;
+  m_lastTickNs = nowNs;
+
+  // Both ramps cover the whole range in their time, so a direction change mid-ramp stays smooth
+  const int rampMs = m_target < m_level ? DUCK_RAMP_MS : RESTORE_RAMP_MS;
+  const qreal step = (1.0 - DUCK_LEVEL) * elapsedMs / rampMs;
+  m_level = m_target < m_level ? qMax(m_target, m_level - step) : qMin(m_target, m_level + step);
+  applyLevel();
+
+  if (qFuzzyCompare(m_level, m_target)) {
+    m_rampTimer->stop();
+    if (!isDucked()) {
+      m_streams.clear(); // Streams may have come and gone; list them afresh next time
+    }
+  }
+}
+
+void DuckingEngine::applyLevel() {
+  const pa_volume_t factor = static_cast<pa_volume_t>(m_level * PA_VOLUME_NORM);
+  for (auto it = m_streams.constBegin(); it != m_streams.constEnd(); ++it) {
+    pa_cvolume volume = it->original;
+    pa_sw_cvolume_multiply_scalar(&volume, &it->original, factor);
+    m_pulseAudio->setSinkInputVolume(it.key(), volume);
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef DUCKINGENGINE_H
+#define DUCKINGENGINE_H
+
+#include <QObject>
+#include <QHash>
+#include "pulseaudiocontroller.h"
+
+class QTimer;
+
+// Lowers the volume of the streams playing on the AirPods while conversational awareness
+// hears the wearer speak, and brings it back afterwards.
+//
+// Only playback streams (sink inputs) are touched, never the sink itself, and calls,
+// notifications and other event sounds are left alone. Volumes ramp on a timer instead of
+// jumping. A voice that stops only restores the volume after a short hangover, so the
+// start/stop bursts of a conversation coalesce into one duck. Nothing here waits for the
+// sound server: the streams are listed once per duck and every volume change is
+// fire-and-forget.
+class DuckingEngine : public QObject
+{
+  Q_OBJECT
+public:
+  explicit DuckingEngine(PulseAudioController *pulseAudio, QObject *parent = nullptr);
+
+  // sinkMatch selects the sinks whose streams are ducked, by a substring of the sink name
+  // (the AirPods' address); empty means every sink
+  void duck(const QString &sinkMatch);
+  void release();
+  // Back to full volume right away, e.g. when conversational awareness is switched off
+  void restore();
+
+  bool isDucked() const { return m_target < 1.0; }
+
+private:
+  struct Stream
+  {
+    pa_cvolume original;
+  };
+
+  void takeSnapshot(const QString &sinkMatch);
+  void startRamp();
+  void onRampTick();
+  void applyLevel();
+
+  PulseAudioController *m_pulseAudio;
+  QTimer *m_rampTimer;
+  QTimer *m_releaseTimer;
+  QHash<quint32, Stream> m_streams; // Ducked sink inputs and their volume before ducking
+  bool m_snapshotPending = false;
+  qreal m_level = 1.0;  // Current fraction of the original volume
+  qreal m_target = 1.0;
+  qint64 m_lastTickNs = 0;
+};
+
+#endif // DUCKINGENGINE_H
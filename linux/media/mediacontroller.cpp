@@ -1,8 +1,12 @@
 #include "mediacontroller.h"
 #include "logger.h"
+#include "metrics.h"
+#include "trace.h"
 #include "eardetection.hpp"
 #include "playerstatuswatcher.h"
 #include "pulseaudiocontroller.h"
+#include "duckingengine.h"
+#include "profilepolicy.h"
 
 #include <QDebug>
 #include <QProcess>
@@ -10,17 +14,92 @@
 #include <QRegularExpression>
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
+#include <QFutureWatcher>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace {
+  // BlueZ reports the device connected a little before PulseAudio adds its card
+  constexpr int CARD_LOOKUP_ATTEMPTS = 20;
+  constexpr int CARD_LOOKUP_INTERVAL_MS = 150;
+  constexpr int DEFAULT_PAUSE_GRACE_MS = 300;
+  constexpr int DEFAULT_TEARDOWN_GRACE_MS = 5000;
+}
 
 MediaController::MediaController(QObject *parent) : QObject(parent) {
   m_pulseAudio = new PulseAudioController(this);
-  if (!m_pulseAudio->initialize())
+  m_ducking = new DuckingEngine(m_pulseAudio, this);
+  m_profilePolicy = new ProfilePolicy(m_pulseAudio, this);
+  connect(m_profilePolicy, &ProfilePolicy::wantsHeadsetChanged, this, [this]()
+  {
+    if (m_profileWanted == Profile::Unknown && m_profileApplied == Profile::On) {
+      m_profileWanted = Profile::On; // Switched on at connect rather than by ear detection
+    }
+    applyProfile();
+  });
+
+  m_pauseTimer = new QTimer(this);
+  m_pauseTimer->setSingleShot(true);
+  m_pauseTimer->setInterval(DEFAULT_PAUSE_GRACE_MS);
+  connect(m_pauseTimer, &QTimer::timeout, this, &MediaController::onPauseGraceExpired);
+  m_teardownTimer = new QTimer(this);
+  m_teardownTimer->setSingleShot(true);
+  m_teardownTimer->setInterval(DEFAULT_TEARDOWN_GRACE_MS);
+  connect(m_teardownTimer, &QTimer::timeout, this, [this]()
+  {
+    LOG_INFO("Both AirPods stayed out of ear, switching the profile off");
+    requestProfile(false);
+  });
+
+  // Connecting to the sound server can take a while at login, so it happens off the GUI thread
+  const qint64 startNs = Metrics::nowNs();
+  m_pulseAudioReady = QtConcurrent::run([pulseAudio = m_pulseAudio, startNs]()
+  {
+    const bool success = pulseAudio->initialize();
+    Trace::complete("pulseaudio.initialize", startNs, Metrics::nowNs());
+    return success;
+  });
+  auto *watcher = new QFutureWatcher<bool>(this);
+  connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher]()
+  {
+    watcher->deleteLater();
+    onPulseAudioInitialized(watcher->result());
+  });
+  watcher->setFuture(m_pulseAudioReady);
+}
+
+void MediaController::onPulseAudioInitialized(bool success)
+{
+  if (!success)
   {
     LOG_ERROR("Failed to initialize PulseAudio controller");
+    return;
+  }
+  m_profilePolicy->start();
+
+  // A device may have connected while the context was still coming up
+  if (m_lookingUpCard)
+  {
+    lookUpCard();
+    return;
+  }
+  if (!connectedDeviceMacAddress.isEmpty() && m_deviceOutputName.isEmpty())
+  {
+    m_deviceOutputName = getAudioDeviceName();
+    m_profilePolicy->setCard(m_deviceOutputName);
+    LOG_INFO("Device output name set to: " << m_deviceOutputName);
+  }
+  if (m_activateA2dpWhenReady)
+  {
+    m_activateA2dpWhenReady = false;
+    activateA2dpProfile();
   }
 }
 
 void MediaController::handleEarDetection(EarDetection *earDetection)
 {
+  TRACE_SCOPE("MediaController::handleEarDetection");
+  const qint64 startNs = Metrics::nowNs();
   if (earDetectionBehavior == Disabled)
   {
     LOG_DEBUG("Ear detection is disabled, ignoring status");
@@ -31,8 +110,7 @@ void MediaController::handleEarDetection(EarDetection *earDetection)
   bool secondaryInEar = earDetection->isSecondaryInEar();
 
   LOG_DEBUG("Ear detection status: primaryInEar="
-            << primaryInEar << ", secondaryInEar=" << secondaryInEar
-            << ", isAirPodsActive=" << isActiveOutputDeviceAirPods());
+            << primaryInEar << ", secondaryInEar=" << secondaryInEar);
 
   // First handle playback pausing based on selected behavior
   bool shouldPause = false;
@@ -49,20 +127,34 @@ void MediaController::handleEarDetection(EarDetection *earDetection)
     shouldResume = primaryInEar || secondaryInEar;
   }
 
-  if (shouldPause && isActiveOutputDeviceAirPods())
+  // Adjusting a pod reads as out of ear for a moment; only pause if it stays out
+  if (shouldPause)
   {
-    if (getCurrentMediaState() == Playing)
+    if (!m_pauseTimer->isActive())
     {
-      LOG_DEBUG("Pausing playback for ear detection");
-      pause();
+      m_earRemovedNs = startNs;
+      m_pauseTimer->start();
     }
   }
+  else if (m_pauseTimer->isActive())
+  {
+    static Metrics::Counter &pausesAvoided = Metrics::counter("ear_pause_avoided_total");
+    pausesAvoided.add();
+    LOG_DEBUG("Pod back in before the pause grace period ended");
+    m_pauseTimer->stop();
+  }
 
   // Then handle device profile switching
   if (primaryInEar || secondaryInEar)
   {
     LOG_INFO("At least one AirPod is in ear");
-    activateA2dpProfile();
+    if (m_teardownTimer->isActive())
+    {
+      static Metrics::Counter &teardownsAvoided = Metrics::counter("a2dp_teardown_avoided_total");
+      teardownsAvoided.add();
+      m_teardownTimer->stop();
+    }
+    requestProfile(true);
 
     // Resume if conditions are met and we previously paused
     if (shouldResume && !pausedByAppServices.isEmpty() && isActiveOutputDeviceAirPods())
@@ -70,10 +162,151 @@ void MediaController::handleEarDetection(EarDetection *earDetection)
       play();
     }
   }
-  else
+  else if (!m_teardownTimer->isActive() && m_profileWanted != Profile::Off)
   {
     LOG_INFO("Both AirPods are out of ear");
-    removeAudioOutputDevice();
+    m_teardownTimer->start();
+  }
+}
+
+void MediaController::onPauseGraceExpired()
+{
+  if (isActiveOutputDeviceAirPods() && getCurrentMediaState() == Playing)
+  {
+    LOG_DEBUG("Pausing playback for ear detection");
+    static Metrics::Histogram &earToPause = Metrics::histogram("ear_event_to_pause");
+    pause();
+    earToPause.record(Metrics::nowNs() - m_earRemovedNs);
+  }
+}
+
+void MediaController::setEarDetectionGracePeriods(int pauseMs, int teardownMs)
+{
+  m_pauseTimer->setInterval(qMax(0, pauseMs));
+  m_teardownTimer->setInterval(qMax(0, teardownMs));
+  LOG_INFO("Ear detection grace periods: pause " << m_pauseTimer->interval() << " ms, profile off "
+           << m_teardownTimer->interval() << " ms");
+}
+
+void MediaController::resetEarDetectionState()
+{
+  // Pending pauses and profile switches belonged to the previous device
+  m_pauseTimer->stop();
+  m_teardownTimer->stop();
+  m_profileWanted = Profile::Unknown;
+  m_profileApplied = Profile::Unknown;
+  m_headsetApplied = false;
+  m_cardProfiles.clear();
+}
+
+void MediaController::setCallActive(bool active)
+{
+  m_profilePolicy->setCallActive(active);
+}
+
+void MediaController::setHeadsetForAnyRecording(bool any)
+{
+  m_profilePolicy->setCountAllRecordings(any);
+}
+
+void MediaController::requestProfile(bool on)
+{
+  m_profileWanted = on ? Profile::On : Profile::Off;
+  applyProfile();
+}
+
+// Switches the card on a worker thread, one switch at a time. Whatever is wanted once a switch
+// finishes is applied next, so a pod that goes back in while the profile is going off only
+// costs the switch already under way.
+void MediaController::applyProfile()
+{
+  if (!m_profileJob.isFinished() || m_profileWanted == Profile::Unknown) {
+    return;
+  }
+  const bool headset = m_profileWanted == Profile::On && m_profilePolicy->wantsHeadset();
+  if (m_profileWanted == m_profileApplied && (m_profileApplied == Profile::Off || headset == m_headsetApplied)) {
+    return;
+  }
+  if (!m_pulseAudioReady.isFinished() || m_lookingUpCard) {
+    if (m_profileWanted == Profile::On) {
+      activateA2dpProfile(); // Deferred until the card is known
+    }
+    return;
+  }
+  if (connectedDeviceMacAddress.isEmpty() || m_deviceOutputName.isEmpty()) {
+    LOG_WARN("Connected device MAC address or output name is empty, cannot switch the profile");
+    return;
+  }
+
+  const bool on = m_profileWanted == Profile::On;
+  const QString cardName = m_deviceOutputName;
+  const qint64 startNs = Metrics::nowNs();
+  auto *watcher = new QFutureWatcher<ProfileSwitch>(this);
+  connect(watcher, &QFutureWatcher<ProfileSwitch>::finished, this, [this, watcher, on, headset, cardName, startNs]()
+  {
+    watcher->deleteLater();
+    static Metrics::Histogram &profileSwitch = Metrics::histogram("a2dp_profile_switch");
+    static Metrics::Histogram &headsetSwitch = Metrics::histogram("headset_profile_switch");
+    const qint64 nowNs = Metrics::nowNs();
+    (headset ? headsetSwitch : profileSwitch).record(nowNs - startNs);
+    Trace::complete(headset ? "pulseaudio.profile_headset" : on ? "pulseaudio.profile_on" : "pulseaudio.profile_off",
+                    startNs, nowNs);
+
+    const ProfileSwitch result = watcher->result();
+    if (cardName != m_deviceOutputName) {
+      return; // Another device by now
+    }
+    m_cardProfiles = result.available;
+    const QString &profile = result.profile;
+    if (profile.isEmpty()) {
+      if (on) {
+        // Not listed at all; this path knows how to bring it back
+        LOG_WARN("A2DP profile could not be switched on, retrying the slow way");
+        activateA2dpProfile();
+      } else {
+        LOG_ERROR("Failed to remove AirPods as audio output device");
+      }
+      return;
+    }
+    LOG_INFO("Card profile set to " << profile);
+    m_profileApplied = on ? Profile::On : Profile::Off;
+    m_headsetApplied = headset;
+    applyProfile();
+  });
+  m_profileJob = QtConcurrent::run(&MediaController::switchProfile, m_pulseAudio, cardName, on, headset, m_cardProfiles);
+  watcher->setFuture(m_profileJob);
+}
+
+// Runs on a worker thread. The card's profiles are listed only when nothing is cached yet, or
+// when the cached list turns out to be stale, so a switch is usually a single PulseAudio call.
+MediaController::ProfileSwitch MediaController::switchProfile(PulseAudioController *pulseAudio, const QString &cardName,
+                                                              bool on, bool headset, const QStringList &cached)
+{
+  ProfileSwitch result;
+  result.available = cached;
+  if (!on) {
+    if (pulseAudio->setCardProfile(cardName, "off")) {
+      result.profile = QStringLiteral("off");
+    }
+    return result;
+  }
+
+  for (bool fresh = cached.isEmpty();; fresh = true) {
+    if (fresh) {
+      result.available = pulseAudio->getCardProfiles(cardName);
+    }
+    QString profile = ProfilePolicy::pick(result.available, headset);
+    if (profile.isEmpty() && headset) {
+      // No microphone profile; better to keep playing than to go silent
+      profile = ProfilePolicy::pick(result.available, false);
+    }
+    if (!profile.isEmpty() && pulseAudio->setCardProfile(cardName, profile)) {
+      result.profile = profile;
+      return result;
+    }
+    if (fresh) {
+      return result;
+    }
   }
 }
 
@@ -95,6 +328,10 @@ void MediaController::followMediaChanges() {
 }
 
 bool MediaController::isActiveOutputDeviceAirPods() {
+  TRACE_SCOPE("MediaController::isActiveOutputDeviceAirPods");
+  if (assumeAirPodsOutput) {
+    return true;
+  }
   QString defaultSink = m_pulseAudio->getDefaultSink();
   LOG_DEBUG("Default sink: " << defaultSink);
   return defaultSink.contains(connectedDeviceMacAddress);
@@ -111,24 +348,13 @@ void MediaController::handleConversationalAwareness(const QByteArray &data) {
     switch (flag) {
     case 0x01:
         LOG_INFO("Conversational awareness event: voice detected");
-
-        if (initialVolume == -1 && isActiveOutputDeviceAirPods()) {
-            QString sink = m_pulseAudio->getDefaultSink();
-            initialVolume = m_pulseAudio->getSinkVolume(sink);
-            LOG_DEBUG("Initial volume saved: " << initialVolume << "%");
-        }
-
-        if (initialVolume != -1) {
-            QString sink = m_pulseAudio->getDefaultSink();
-            int target = initialVolume * 0.20;
-            m_pulseAudio->setSinkVolume(sink, target);
-            LOG_INFO("Volume lowered to " << target << "%");
-        }
+        // Only what plays on the AirPods; the simulator has no sink of its own
+        m_ducking->duck(assumeAirPodsOutput ? QString() : connectedDeviceMacAddress);
         break;
 
     case 0x08:
         LOG_INFO("Conversational awareness disabled");
-        initialVolume = -1;
+        m_ducking->restore();
         break;
 
     case 0x09:
@@ -137,13 +363,7 @@ void MediaController::handleConversationalAwareness(const QByteArray &data) {
 
     default:
         LOG_INFO("Conversational awareness event: voice ended");
-
-        if (initialVolume != -1 && isActiveOutputDeviceAirPods()) {
-            QString sink = m_pulseAudio->getDefaultSink();
-            m_pulseAudio->setSinkVolume(sink, initialVolume);
-            LOG_INFO("Volume restored to " << initialVolume << "%");
-            initialVolume = -1;
-        }
+        m_ducking->release();
         break;
     }
 }
@@ -154,9 +374,9 @@ bool MediaController::isA2dpProfileAvailable() {
     return false;
   }
 
-  return m_pulseAudio->isProfileAvailable(m_deviceOutputName, "a2dp-sink-sbc_xq") || 
-         m_pulseAudio->isProfileAvailable(m_deviceOutputName, "a2dp-sink-sbc") ||
-         m_pulseAudio->isProfileAvailable(m_deviceOutputName, "a2dp-sink");
+  // One listing instead of a query per profile, kept for getPreferredA2dpProfile()
+  m_cardProfiles = m_pulseAudio->getCardProfiles(m_deviceOutputName);
+  return !ProfilePolicy::pick(m_cardProfiles, false).isEmpty();
 }
 
 QString MediaController::getPreferredA2dpProfile() {
@@ -164,23 +384,14 @@ QString MediaController::getPreferredA2dpProfile() {
     return QString();
   }
 
-  if (!m_cachedA2dpProfile.isEmpty() && 
-      m_pulseAudio->isProfileAvailable(m_deviceOutputName, m_cachedA2dpProfile)) {
-    return m_cachedA2dpProfile;
+  if (m_cardProfiles.isEmpty()) {
+    m_cardProfiles = m_pulseAudio->getCardProfiles(m_deviceOutputName);
   }
-
-  QStringList profiles = {"a2dp-sink-sbc_xq", "a2dp-sink-sbc", "a2dp-sink"};
-
-  for (const QString &profile : profiles) {
-    if (m_pulseAudio->isProfileAvailable(m_deviceOutputName, profile)) {
-      LOG_INFO("Selected best available A2DP profile: " << profile);
-      m_cachedA2dpProfile = profile;
-      return profile;
-    }
+  const QString profile = ProfilePolicy::pick(m_cardProfiles, false);
+  if (!profile.isEmpty()) {
+    LOG_INFO("Selected best available A2DP profile: " << profile);
   }
-
-  m_cachedA2dpProfile.clear();
-  return QString();
+  return profile;
 }
 
 bool MediaController::restartWirePlumber() {
@@ -197,6 +408,18 @@ bool MediaController::restartWirePlumber() {
 }
 
 void MediaController::activateA2dpProfile() {
+  TRACE_SCOPE("MediaController::activateA2dpProfile");
+  if (!m_pulseAudioReady.isFinished()) {
+    LOG_DEBUG("PulseAudio is not ready yet, activating A2DP profile once it is");
+    m_activateA2dpWhenReady = true;
+    return;
+  }
+  if (m_lookingUpCard) {
+    LOG_DEBUG("Bluetooth card not found yet, activating A2DP profile once it is");
+    m_activateA2dpWhenReady = true;
+    return;
+  }
+
   if (connectedDeviceMacAddress.isEmpty() || m_deviceOutputName.isEmpty()) {
     LOG_WARN("Connected device MAC address or output name is empty, cannot activate A2DP profile");
     return;
@@ -206,6 +429,8 @@ void MediaController::activateA2dpProfile() {
     LOG_WARN("A2DP profile not available, attempting to restart WirePlumber");
     if (restartWirePlumber()) {
       m_deviceOutputName = getAudioDeviceName();
+      m_profilePolicy->setCard(m_deviceOutputName);
+      m_cardProfiles.clear();
       if (!isA2dpProfileAvailable()) {
         LOG_ERROR("A2DP profile still not available after WirePlumber restart");
         return;
@@ -225,11 +450,20 @@ void MediaController::activateA2dpProfile() {
   LOG_INFO("Activating A2DP profile for AirPods: " << preferredProfile);
   if (!m_pulseAudio->setCardProfile(m_deviceOutputName, preferredProfile)) {
     LOG_ERROR("Failed to activate A2DP profile: " << preferredProfile);
+    m_cardProfiles.clear(); // Maybe no longer offered
+    return;
   }
+  m_profileApplied = Profile::On;
+  m_headsetApplied = false;
   LOG_INFO("A2DP profile activated successfully");
+  if (m_profilePolicy->wantsHeadset()) {
+    m_profileWanted = Profile::On;
+    applyProfile(); // Something was recording already
+  }
 }
 
 void MediaController::removeAudioOutputDevice() {
+  TRACE_SCOPE("MediaController::removeAudioOutputDevice");
   if (connectedDeviceMacAddress.isEmpty() || m_deviceOutputName.isEmpty()) {
     LOG_WARN("Connected device MAC address or output name is empty, cannot remove audio output device");
     return;
@@ -238,16 +472,89 @@ void MediaController::removeAudioOutputDevice() {
   LOG_INFO("Removing AirPods as audio output device");
   if (!m_pulseAudio->setCardProfile(m_deviceOutputName, "off")) {
     LOG_ERROR("Failed to remove AirPods as audio output device");
+    return;
   }
+  m_profileApplied = Profile::Off;
 }
 
 void MediaController::setConnectedDeviceMacAddress(const QString &macAddress) {
+  if (macAddress == connectedDeviceMacAddress && (m_lookingUpCard || !m_deviceOutputName.isEmpty())) {
+    return; // Already known, or prepareDevice() is on it
+  }
+  m_lookingUpCard = false; // Looked up right here instead
+  resetEarDetectionState();
   connectedDeviceMacAddress = macAddress;
   m_deviceOutputName = getAudioDeviceName();
-  m_cachedA2dpProfile.clear();
+  m_profilePolicy->setCard(m_deviceOutputName);
   LOG_INFO("Device output name set to: " << m_deviceOutputName);
 }
 
+void MediaController::prepareDevice(const QString &macAddress) {
+  if (macAddress == connectedDeviceMacAddress && (m_lookingUpCard || !m_deviceOutputName.isEmpty())) {
+    return;
+  }
+  resetEarDetectionState();
+  connectedDeviceMacAddress = macAddress;
+  m_deviceOutputName.clear();
+  m_profilePolicy->setCard(QString());
+  m_lookingUpCard = true;
+  m_cardLookupAttempts = 0;
+  if (m_pulseAudioReady.isFinished()) {
+    lookUpCard(); // Otherwise onPulseAudioInitialized() starts it
+  }
+}
+
+void MediaController::lookUpCard() {
+  if (!m_cardLookup.isFinished()) {
+    return; // The running lookup starts another one if the address changed under it
+  }
+  const QString macAddress = connectedDeviceMacAddress;
+  ++m_cardLookupAttempts;
+  auto *watcher = new QFutureWatcher<QString>(this);
+  connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, macAddress]()
+  {
+    watcher->deleteLater();
+    if (!m_lookingUpCard) {
+      return;
+    }
+    if (macAddress != connectedDeviceMacAddress) {
+      m_cardLookupAttempts = 0;
+      lookUpCard();
+      return;
+    }
+
+    const QString cardName = watcher->result();
+    if (cardName.isEmpty()) {
+      if (m_cardLookupAttempts < CARD_LOOKUP_ATTEMPTS) {
+        QTimer::singleShot(CARD_LOOKUP_INTERVAL_MS, this, [this]() {
+          if (m_lookingUpCard) {
+            lookUpCard();
+          }
+        });
+        return;
+      }
+      LOG_ERROR("No matching Bluetooth card found for MAC address: " << macAddress);
+      m_lookingUpCard = false;
+      m_activateA2dpWhenReady = false;
+      return;
+    }
+
+    m_lookingUpCard = false;
+    m_deviceOutputName = cardName;
+    m_profilePolicy->setCard(cardName);
+    LOG_INFO("Device output name set to: " << m_deviceOutputName << " (after " << m_cardLookupAttempts << " lookup(s))");
+    if (m_activateA2dpWhenReady) {
+      m_activateA2dpWhenReady = false;
+      activateA2dpProfile();
+    }
+  });
+  m_cardLookup = QtConcurrent::run([pulseAudio = m_pulseAudio, macAddress]()
+  {
+    return pulseAudio->getCardNameForDevice(macAddress);
+  });
+  watcher->setFuture(m_cardLookup);
+}
+
 MediaController::MediaState MediaController::mediaStateFromPlayerctlOutput(
     const QString &output) const {
   if (output == "Playing") {
@@ -261,6 +568,9 @@ MediaController::MediaState MediaController::mediaStateFromPlayerctlOutput(
 
 MediaController::MediaState MediaController::getCurrentMediaState() const
 {
+  TRACE_SCOPE("MediaController::getCurrentMediaState");
+  static Metrics::Histogram &queryDuration = Metrics::histogram("mpris_playback_status");
+  Metrics::ScopedTimer timer(queryDuration);
   return mediaStateFromPlayerctlOutput(PlayerStatusWatcher::getCurrentPlaybackStatus(""));
 }
 
@@ -301,6 +611,9 @@ QStringList MediaController::getPlayingMediaPlayers()
 
 void MediaController::play()
 {
+  TRACE_SCOPE("MediaController::play");
+  static Metrics::Histogram &playDuration = Metrics::histogram("mpris_play");
+  Metrics::ScopedTimer timer(playDuration);
   if (pausedByAppServices.isEmpty())
   {
     LOG_INFO("No services to resume");
@@ -349,6 +662,9 @@ void MediaController::play()
 
 void MediaController::pause()
 {
+  TRACE_SCOPE("MediaController::pause");
+  static Metrics::Histogram &pauseDuration = Metrics::histogram("mpris_pause");
+  Metrics::ScopedTimer timer(pauseDuration);
   QDBusConnection bus = QDBusConnection::sessionBus();
   QStringList services = bus.interface()->registeredServiceNames().value();
 
@@ -405,6 +721,10 @@ void MediaController::pause()
 }
 
 MediaController::~MediaController() {
+  // The PulseAudio controller is deleted with us; do not pull it out from under initialize()
+  m_pulseAudioReady.waitForFinished();
+  m_cardLookup.waitForFinished();
+  m_profileJob.waitForFinished();
 }
 
 QString MediaController::getAudioDeviceName()
@@ -2,9 +2,13 @@
 #define MEDIACONTROLLER_H
 
 #include <QObject>
+#include <QFuture>
 #include "pulseaudiocontroller.h"
 
 class QProcess;
+class QTimer;
+class DuckingEngine;
+class ProfilePolicy;
 class EarDetection;
 class PlayerStatusWatcher;
 class QDBusInterface;
@@ -34,16 +38,28 @@ public:
   void handleEarDetection(EarDetection*);
   void followMediaChanges();
   bool isActiveOutputDeviceAirPods();
+  // For simulated AirPods, which never show up as an audio sink
+  void setAssumeAirPodsOutput(bool assume) { assumeAirPodsOutput = assume; }
   void handleConversationalAwareness(const QByteArray &data);
   void activateA2dpProfile();
   void removeAudioOutputDevice();
   void setConnectedDeviceMacAddress(const QString &macAddress);
+  // Like setConnectedDeviceMacAddress(), but looks the card up off the GUI thread and keeps
+  // trying while it has not appeared yet; activateA2dpProfile() waits for it meanwhile
+  void prepareDevice(const QString &macAddress);
   bool isA2dpProfileAvailable();
   QString getPreferredA2dpProfile();
   bool restartWirePlumber();
 
   void setEarDetectionBehavior(EarDetectionBehavior behavior);
   inline EarDetectionBehavior getEarDetectionBehavior() const { return earDetectionBehavior; }
+  // How long pods must stay out before playback pauses, and before the A2DP profile is switched off
+  void setEarDetectionGracePeriods(int pauseMs, int teardownMs);
+  // Whether the AirPods report a call, which wants the headset profile like an open microphone does.
+  // Only known while BLE advertisements are heard, so callers clear it when they stop.
+  void setCallActive(bool active);
+  // Whether recording from any microphone wants the headset profile; otherwise only recording from the AirPods does
+  void setHeadsetForAnyRecording(bool any);
 
   void play();
   void pause();
@@ -56,15 +72,47 @@ private:
   MediaState mediaStateFromPlayerctlOutput(const QString &output) const;
   QString getAudioDeviceName();
   QStringList getPlayingMediaPlayers();
+  void onPulseAudioInitialized(bool success);
+  void lookUpCard();
+  void onPauseGraceExpired();
+  void requestProfile(bool on);
+  void applyProfile();
+  void resetEarDetectionState();
+
+  struct ProfileSwitch
+  {
+    QString profile; // Profile that was set, empty on failure
+    QStringList available; // What the card offered, for the next switch
+  };
+  static ProfileSwitch switchProfile(PulseAudioController *pulseAudio, const QString &cardName, bool on, bool headset,
+                                     const QStringList &cached);
 
   QStringList pausedByAppServices;
-  int initialVolume = -1;
   QString connectedDeviceMacAddress;
+  bool assumeAirPodsOutput = false;
   EarDetectionBehavior earDetectionBehavior = PauseWhenOneRemoved;
   QString m_deviceOutputName;
   PlayerStatusWatcher *playerStatusWatcher = nullptr;
   PulseAudioController *m_pulseAudio = nullptr;
-  QString m_cachedA2dpProfile;
+  DuckingEngine *m_ducking = nullptr;
+  ProfilePolicy *m_profilePolicy = nullptr;
+  QFuture<bool> m_pulseAudioReady;
+  bool m_activateA2dpWhenReady = false;
+  QFuture<QString> m_cardLookup;
+  bool m_lookingUpCard = false; // From prepareDevice() until the card is found or we give up
+  int m_cardLookupAttempts = 0;
+
+  // Ear detection hysteresis: removing a pod only pauses, and removing both only switches the
+  // profile off, once they have stayed out for the grace period; putting one back cancels it
+  enum class Profile { Unknown, On, Off };
+  QTimer *m_pauseTimer = nullptr;
+  QTimer *m_teardownTimer = nullptr;
+  qint64 m_earRemovedNs = 0;
+  Profile m_profileWanted = Profile::Unknown;
+  Profile m_profileApplied = Profile::Unknown;
+  bool m_headsetApplied = false; // The profile that is on was picked for the microphone
+  QFuture<ProfileSwitch> m_profileJob;
+  QStringList m_cardProfiles; // Available profiles of m_deviceOutputName, listed once per card
 };
 
 #endif // MEDIACONTROLLER_H
\ No newline at end of file
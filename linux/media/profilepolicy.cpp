@@ -0,0 +1,108 @@
+#include "profilepolicy.h"
+#include "pulseaudiocontroller.h"
+#include "logger.h"
+
+#include <QTimer>
+
+namespace {
+  constexpr int RELEASE_DELAY_MS = 3000;
+
+  // Best first; PipeWire and PulseAudio name them differently
+  const QStringList A2DP_PROFILES = {"a2dp-sink-sbc_xq", "a2dp-sink-sbc", "a2dp-sink", "a2dp_sink"};
+  const QStringList HEADSET_PROFILES = {"headset-head-unit-msbc", "headset-head-unit", "headset_head_unit",
+                                        "headset-head-unit-cvsd"};
+}
+
+ProfilePolicy::ProfilePolicy(PulseAudioController *pulseAudio, QObject *parent)
+    : QObject(parent), m_pulseAudio(pulseAudio), m_releaseTimer(new QTimer(this)) {
+  m_releaseTimer->setSingleShot(true);
+  m_releaseTimer->setInterval(RELEASE_DELAY_MS);
+  connect(m_releaseTimer, &QTimer::timeout, this, [this]() { setWantsHeadset(false); });
+  connect(m_pulseAudio, &PulseAudioController::captureStreamsChanged, this, &ProfilePolicy::recount);
+}
+
+void ProfilePolicy::start() {
+  m_pulseAudio->watchCaptureStreams();
+  recount();
+}
+
+void ProfilePolicy::setCallActive(bool active) {
+  if (m_callActive != active) {
+    LOG_INFO("AirPods call state: " << (active ? "in a call" : "no call"));
+    m_callActive = active;
+    update();
+  }
+}
+
+void ProfilePolicy::setCard(const QString &cardName) {
+  if (m_cardName != cardName) {
+    m_cardName = cardName;
+    recount();
+  }
+}
+
+void ProfilePolicy::setCountAllRecordings(bool all) {
+  if (m_countAllRecordings != all) {
+    LOG_INFO("Headset profile for " << (all ? "any recording" : "recordings from the AirPods only"));
+    m_countAllRecordings = all;
+    recount();
+  }
+}
+
+void ProfilePolicy::recount() {
+  // A call app opening the microphone sends a burst of events; one listing covers them all
+  if (m_recountPending) {
+    return;
+  }
+  m_recountPending = true;
+  QTimer::singleShot(0, this, [this]() {
+    const QString cardName = m_countAllRecordings ? QString() : m_cardName;
+    auto counted = [this, cardName](int count) {
+      m_recountPending = false;
+      if (cardName != (m_countAllRecordings ? QString() : m_cardName)) {
+        recount(); // Counted for a card or setting that has changed since
+        return;
+      }
+      if (m_captureStreams != count) {
+        LOG_DEBUG("Capture streams: " << count);
+        m_captureStreams = count;
+        update();
+      }
+    };
+    if (cardName.isEmpty() && !m_countAllRecordings) {
+      counted(0); // No AirPods card to record from
+      return;
+    }
+    m_pulseAudio->countCaptureStreams(cardName, counted);
+  });
+}
+
+void ProfilePolicy::update() {
+  const bool headset = m_captureStreams > 0 || m_callActive;
+  if (headset == m_wantsHeadset) {
+    m_releaseTimer->stop();
+  } else if (headset) {
+    setWantsHeadset(true);
+  } else if (!m_releaseTimer->isActive()) {
+    m_releaseTimer->start(); // Back to A2DP unless the microphone is reopened meanwhile
+  }
+}
+
+void ProfilePolicy::setWantsHeadset(bool headset) {
+  m_releaseTimer->stop();
+  if (m_wantsHeadset == headset) {
+    return;
+  }
+  m_wantsHeadset = headset;
+  LOG_INFO((headset ? "Microphone in use, headset profile wanted" : "Microphone released, A2DP wanted"));
+  emit wantsHeadsetChanged(headset);
+}
+
+QString ProfilePolicy::pick(const QStringList &available, bool headset) {
+  for (const QString &profile : headset ? HEADSET_PROFILES : A2DP_PROFILES) {
+    if (available.contains(profile)) {
+      return profile;
+    }
+  }
+  return QString();
+}
@@ -0,0 +1,56 @@
+#ifndef PROFILEPOLICY_H
+#define PROFILEPOLICY_H
+
+#include <QObject>
+#include <QStringList>
+
+class PulseAudioController;
+class QTimer;
+
+// Decides whether the AirPods should be in a headset (HFP/HSP) profile, which has a
+// microphone but poor audio, or in the best A2DP profile.
+//
+// Headset profiles are wanted while something records from the AirPods, i.e. there is a
+// capture stream on a source of their card that is neither a monitor of a sink nor a
+// level meter, or while the AirPods report a call or an incoming call. In A2DP the card
+// has no source, so recording from any other microphone only counts with
+// setCountAllRecordings(). Going back to A2DP waits a moment, because call apps tend to
+// close and reopen the microphone when a call is set up or muted.
+class ProfilePolicy : public QObject
+{
+  Q_OBJECT
+public:
+  explicit ProfilePolicy(PulseAudioController *pulseAudio, QObject *parent = nullptr);
+
+  // Once PulseAudio is up
+  void start();
+  // Call state of the AirPods, e.g. from the BLE status of a call on the phone
+  void setCallActive(bool active);
+  // The AirPods' card, empty while there is none
+  void setCard(const QString &cardName);
+  // Whether any recording wants the headset profile, not just one from the AirPods
+  void setCountAllRecordings(bool all);
+  bool wantsHeadset() const { return m_wantsHeadset; }
+
+  // Best profile of the wanted kind among what the card offers, empty if none
+  static QString pick(const QStringList &available, bool headset);
+
+signals:
+  void wantsHeadsetChanged(bool headset);
+
+private:
+  void recount();
+  void update();
+  void setWantsHeadset(bool headset);
+
+  PulseAudioController *m_pulseAudio;
+  QTimer *m_releaseTimer;
+  QString m_cardName;
+  bool m_countAllRecordings = false;
+  int m_captureStreams = 0;
+  bool m_recountPending = false;
+  bool m_callActive = false;
+  bool m_wantsHeadset = false;
+};
+
+#endif // PROFILEPOLICY_H
@@ -1,5 +1,8 @@
 #include "pulseaudiocontroller.h"
 #include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+#include <QSet>
 #include <QThread>
 
 PulseAudioController::PulseAudioController(QObject *parent)
@@ -81,6 +84,7 @@ void PulseAudioController::contextStateCallback(pa_context *c, void *userdata)
 
 QString PulseAudioController::getDefaultSink()
 {
+    TRACE_SCOPE("PulseAudioController::getDefaultSink");
     if (!m_initialized) return QString();
 
     struct CallbackData {
@@ -112,6 +116,7 @@ QString PulseAudioController::getDefaultSink()
 
 int PulseAudioController::getSinkVolume(const QString &sinkName)
 {
+    TRACE_SCOPE("PulseAudioController::getSinkVolume");
     if (!m_initialized) return -1;
 
     struct CallbackData {
@@ -151,6 +156,7 @@ int PulseAudioController::getSinkVolume(const QString &sinkName)
 
 bool PulseAudioController::setSinkVolume(const QString &sinkName, int volumePercent)
 {
+    TRACE_SCOPE("PulseAudioController::setSinkVolume");
     if (!m_initialized) return false;
 
     pa_cvolume volume;
@@ -174,6 +180,7 @@ bool PulseAudioController::setSinkVolume(const QString &sinkName, int volumePerc
 
 bool PulseAudioController::setCardProfile(const QString &cardName, const QString &profileName)
 {
+    TRACE_SCOPE("PulseAudioController::setCardProfile");
     if (!m_initialized) return false;
 
     pa_threaded_mainloop_lock(m_mainloop);
@@ -196,6 +203,7 @@ bool PulseAudioController::setCardProfile(const QString &cardName, const QString
 
 QString PulseAudioController::getCardNameForDevice(const QString &macAddress)
 {
+    TRACE_SCOPE("PulseAudioController::getCardNameForDevice");
     if (!m_initialized) return QString();
 
     struct CallbackData {
@@ -238,6 +246,7 @@ QString PulseAudioController::getCardNameForDevice(const QString &macAddress)
 
 bool PulseAudioController::isProfileAvailable(const QString &cardName, const QString &profileName)
 {
+    TRACE_SCOPE("PulseAudioController::isProfileAvailable");
     if (!m_initialized) return false;
 
     struct CallbackData {
@@ -284,10 +293,272 @@ bool PulseAudioController::isProfileAvailable(const QString &cardName, const QSt
     return data.available;
 }
 
+namespace
+{
+    // Filled on the mainloop thread by two list operations; handed back once both are done
+    struct SinkInputListing
+    {
+        PulseAudioController *controller;
+        PulseAudioController::SinkInputsCallback done;
+        QList<PulseAudioController::SinkInput> inputs;
+        QHash<quint32, QString> sinkNames;
+        int pending = 2;
+    };
+
+    void finishListing(SinkInputListing *listing)
+    {
+        if (--listing->pending > 0)
+        {
+            return;
+        }
+        QMetaObject::invokeMethod(listing->controller, [listing]()
+        {
+            listing->done(listing->inputs, listing->sinkNames);
+            delete listing;
+        }, Qt::QueuedConnection);
+    }
+}
+
+void PulseAudioController::listSinkInputs(SinkInputsCallback done)
+{
+    if (!m_initialized)
+    {
+        done({}, {});
+        return;
+    }
+
+    auto *listing = new SinkInputListing{this, std::move(done), {}, {}};
+    auto inputCallback = [](pa_context *, const pa_sink_input_info *info, int eol, void *userdata) {
+        auto *listing = static_cast<SinkInputListing *>(userdata);
+        if (eol != 0)
+        {
+            finishListing(listing);
+            return;
+        }
+        const char *role = pa_proplist_gets(info->proplist, PA_PROP_MEDIA_ROLE);
+        listing->inputs.append({info->index, info->sink, QString::fromUtf8(role ? role : ""), info->volume});
+    };
+    auto sinkCallback = [](pa_context *, const pa_sink_info *info, int eol, void *userdata) {
+        auto *listing = static_cast<SinkInputListing *>(userdata);
+        if (eol != 0)
+        {
+            finishListing(listing);
+            return;
+        }
+        listing->sinkNames.insert(info->index, QString::fromUtf8(info->name));
+    };
+
+    pa_threaded_mainloop_lock(m_mainloop);
+    pa_operation *inputs = pa_context_get_sink_input_info_list(m_context, inputCallback, listing);
+    pa_operation *sinks = pa_context_get_sink_info_list(m_context, sinkCallback, listing);
+    // A list that could not be requested counts as done and empty
+    if (!inputs)
+    {
+        finishListing(listing);
+    }
+    if (!sinks)
+    {
+        finishListing(listing);
+    }
+    if (inputs) pa_operation_unref(inputs);
+    if (sinks) pa_operation_unref(sinks);
+    pa_threaded_mainloop_unlock(m_mainloop);
+}
+
+void PulseAudioController::setSinkInputVolume(quint32 index, const pa_cvolume &volume)
+{
+    if (!m_initialized) return;
+
+    pa_threaded_mainloop_lock(m_mainloop);
+    pa_operation *op = pa_context_set_sink_input_volume(m_context, index, &volume, nullptr, nullptr);
+    if (op) pa_operation_unref(op);
+    pa_threaded_mainloop_unlock(m_mainloop);
+}
+
+QStringList PulseAudioController::getCardProfiles(const QString &cardName)
+{
+    TRACE_SCOPE("PulseAudioController::getCardProfiles");
+    if (!m_initialized) return QStringList();
+
+    struct CallbackData {
+        QStringList profiles;
+        QString targetCard;
+        pa_threaded_mainloop *mainloop;
+    } data;
+    data.targetCard = cardName;
+    data.mainloop = m_mainloop;
+
+    auto callback = [](pa_context *c, const pa_card_info *info, int eol, void *userdata) {
+        CallbackData *d = static_cast<CallbackData*>(userdata);
+        if (eol != 0)
+        {
+            pa_threaded_mainloop_signal(d->mainloop, 0);
+            return;
+        }
+        for (uint32_t i = 0; i < info->n_profiles; i++)
+        {
+            if (info->profiles2[i]->available != 0)
+            {
+                d->profiles << QString::fromUtf8(info->profiles2[i]->name);
+            }
+        }
+    };
+
+    pa_threaded_mainloop_lock(m_mainloop);
+    pa_operation *op = pa_context_get_card_info_by_name(m_context, cardName.toUtf8().constData(), callback, &data);
+    if (op)
+    {
+        waitForOperation(op);
+        pa_operation_unref(op);
+    }
+    pa_threaded_mainloop_unlock(m_mainloop);
+
+    return data.profiles;
+}
+
+void PulseAudioController::watchCaptureStreams()
+{
+    if (!m_initialized) return;
+
+    auto callback = [](pa_context *, pa_subscription_event_type_t type, uint32_t, void *userdata) {
+        const auto kind = type & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+        // Changes cover streams moving, e.g. onto the AirPods once they offer a microphone
+        if ((type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT
+            && (kind == PA_SUBSCRIPTION_EVENT_NEW || kind == PA_SUBSCRIPTION_EVENT_REMOVE
+                || kind == PA_SUBSCRIPTION_EVENT_CHANGE))
+        {
+            auto *controller = static_cast<PulseAudioController *>(userdata);
+            QMetaObject::invokeMethod(controller, &PulseAudioController::captureStreamsChanged, Qt::QueuedConnection);
+        }
+    };
+
+    pa_threaded_mainloop_lock(m_mainloop);
+    pa_context_set_subscribe_callback(m_context, callback, this);
+    pa_operation *op = pa_context_subscribe(m_context, PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT, nullptr, nullptr);
+    if (op) pa_operation_unref(op);
+    pa_threaded_mainloop_unlock(m_mainloop);
+}
+
+namespace
+{
+    struct CaptureListing
+    {
+        PulseAudioController *controller;
+        std::function<void(int)> done;
+        QString cardName; // Only count outputs on this card's sources; any source if empty
+        quint32 card = PA_INVALID_INDEX;
+        QList<quint32> outputSources; // Source of every counted output
+        QSet<quint32> monitorSources;
+        QHash<quint32, quint32> sourceCards; // Source -> card it belongs to
+        int pending = 3;
+    };
+
+    void finishCaptureListing(CaptureListing *listing)
+    {
+        if (--listing->pending > 0)
+        {
+            return;
+        }
+        QMetaObject::invokeMethod(listing->controller, [listing]()
+        {
+            int count = 0;
+            for (quint32 source : std::as_const(listing->outputSources))
+            {
+                if (listing->monitorSources.contains(source))
+                {
+                    continue;
+                }
+                if (listing->cardName.isEmpty()
+                    || (listing->card != PA_INVALID_INDEX && listing->sourceCards.value(source, PA_INVALID_INDEX) == listing->card))
+                {
+                    ++count;
+                }
+            }
+            listing->done(count);
+            delete listing;
+        }, Qt::QueuedConnection);
+    }
+}
+
+void PulseAudioController::countCaptureStreams(const QString &cardName, std::function<void(int count)> done)
+{
+    if (!m_initialized)
+    {
+        done(0);
+        return;
+    }
+
+    auto *listing = new CaptureListing{this, std::move(done), cardName};
+    auto outputCallback = [](pa_context *, const pa_source_output_info *info, int eol, void *userdata) {
+        auto *listing = static_cast<CaptureListing *>(userdata);
+        if (eol != 0)
+        {
+            finishCaptureListing(listing);
+            return;
+        }
+        // Level meters (e.g. pavucontrol) are peak-detect streams, which report "peaks" here
+        if (info->resample_method && qstrcmp(info->resample_method, "peaks") == 0)
+        {
+            return;
+        }
+        listing->outputSources.append(info->source);
+    };
+    auto sourceCallback = [](pa_context *, const pa_source_info *info, int eol, void *userdata) {
+        auto *listing = static_cast<CaptureListing *>(userdata);
+        if (eol != 0)
+        {
+            finishCaptureListing(listing);
+            return;
+        }
+        if (info->monitor_of_sink != PA_INVALID_INDEX)
+        {
+            listing->monitorSources.insert(info->index);
+        }
+        listing->sourceCards.insert(info->index, info->card);
+    };
+    auto cardCallback = [](pa_context *, const pa_card_info *info, int eol, void *userdata) {
+        auto *listing = static_cast<CaptureListing *>(userdata);
+        if (eol != 0)
+        {
+            finishCaptureListing(listing);
+            return;
+        }
+        listing->card = info->index;
+    };
+
+    pa_threaded_mainloop_lock(m_mainloop);
+    pa_operation *outputs = pa_context_get_source_output_info_list(m_context, outputCallback, listing);
+    pa_operation *sources = pa_context_get_source_info_list(m_context, sourceCallback, listing);
+    // A card that is gone ends with eol < 0, which still counts as done
+    pa_operation *card = cardName.isEmpty()
+        ? nullptr
+        : pa_context_get_card_info_by_name(m_context, cardName.toUtf8().constData(), cardCallback, listing);
+    if (!outputs)
+    {
+        finishCaptureListing(listing);
+    }
+    if (!sources)
+    {
+        finishCaptureListing(listing);
+    }
+    if (!card)
+    {
+        finishCaptureListing(listing);
+    }
+    if (outputs) pa_operation_unref(outputs);
+    if (sources) pa_operation_unref(sources);
+    if (card) pa_operation_unref(card);
+    pa_threaded_mainloop_unlock(m_mainloop);
+}
+
 bool PulseAudioController::waitForOperation(pa_operation *op)
 {
     if (!op) return false;
 
+    // Every query goes through here, so this is the round trip to the sound server
+    static Metrics::Histogram &callDuration = Metrics::histogram("pulseaudio_call");
+    Metrics::ScopedTimer timer(callDuration);
+
     while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
     {
         pa_threaded_mainloop_wait(m_mainloop);
@@ -3,7 +3,12 @@
 
 #include <QString>
 #include <QObject>
+#include <QHash>
+#include <QList>
+#include <QStringList>
 #include <pulse/pulseaudio.h>
+#include <atomic>
+#include <functional>
 
 class PulseAudioController : public QObject
 {
@@ -13,6 +18,7 @@ public:
     explicit PulseAudioController(QObject *parent = nullptr);
     ~PulseAudioController();
 
+    // Blocks until the context is ready; may run on any thread, the queries below return defaults until then
     bool initialize();
     QString getDefaultSink();
     int getSinkVolume(const QString &sinkName);
@@ -20,11 +26,36 @@ public:
     bool setCardProfile(const QString &cardName, const QString &profileName);
     QString getCardNameForDevice(const QString &macAddress);
     bool isProfileAvailable(const QString &cardName, const QString &profileName);
+    // Profiles the card can switch to right now, in the card's order
+    QStringList getCardProfiles(const QString &cardName);
+
+    struct SinkInput
+    {
+        quint32 index;
+        quint32 sink;
+        QString role; // media.role, e.g. "music", "phone" or "event"; often empty
+        pa_cvolume volume;
+    };
+    using SinkInputsCallback = std::function<void(const QList<SinkInput> &inputs, const QHash<quint32, QString> &sinkNames)>;
+
+    // These two return without waiting for the sound server; done runs on this object's thread
+    void listSinkInputs(SinkInputsCallback done);
+    void setSinkInputVolume(quint32 index, const pa_cvolume &volume);
+
+    // Starts emitting captureStreamsChanged(); call once initialize() succeeded
+    void watchCaptureStreams();
+    // Recording streams on the sources of cardName, or on any source if it is empty, leaving out
+    // monitors of sinks and level meters; done runs on this object's thread
+    void countCaptureStreams(const QString &cardName, std::function<void(int count)> done);
+
+signals:
+    // A recording stream came, went or moved to another source
+    void captureStreamsChanged();
 
 private:
     pa_threaded_mainloop *m_mainloop;
     pa_context *m_context;
-    bool m_initialized;
+    std::atomic<bool> m_initialized;
 
     static void contextStateCallback(pa_context *c, void *userdata);
     static void sinkInfoCallback(pa_context *c, const pa_sink_info *info, int eol, void *userdata);
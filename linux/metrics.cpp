@@ -0,0 +1,173 @@
+#include "metrics.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <time.h>
+
+namespace
+{
+    struct Registry
+    {
+        QMutex mutex;
+        // std::map keeps the snapshot sorted and never moves the metrics themselves
+        std::map<QString, std::unique_ptr<Metrics::Counter>> counters;
+        std::map<QString, std::unique_ptr<Metrics::CounterFamily>> families;
+        std::map<QString, std::unique_ptr<Metrics::Histogram>> histograms;
+    };
+
+    Registry &registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    template <typename T, typename... Args>
+    T &lookup(std::map<QString, std::unique_ptr<T>> &map, const QString &name, Args &&...args)
+    {
+        QMutexLocker locker(&registry().mutex);
+        std::unique_ptr<T> &slot = map[name];
+        if (!slot)
+        {
+            slot = std::make_unique<T>(std::forward<Args>(args)...);
+        }
+        return *slot;
+    }
+
+    QString micros(quint64 nanoseconds)
+    {
+        return QString::number(nanoseconds / 1000.0, 'f', 1);
+    }
+}
+
+namespace Metrics
+{
+    int Histogram::bucketFor(quint64 value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<int>(value);
+        }
+        const int exponent = 63 - __builtin_clzll(value);
+        const int shift = exponent - SUB_BUCKET_BITS;
+        const int subBucket = static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+        return (shift + 1) * SUB_BUCKETS + subBucket;
+    }
+
+    quint64 Histogram::bucketMidpoint(int bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return static_cast<quint64>(bucket);
+        }
+        const int shift = bucket / SUB_BUCKETS - 1;
+        const quint64 lower = static_cast<quint64>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return lower + ((quint64(1) << shift) >> 1);
+    }
+
+    void Histogram::record(qint64 nanoseconds)
+    {
+        const quint64 value = nanoseconds > 0 ? static_cast<quint64>(nanoseconds) : 0;
+        m_buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        quint64 previous = m_max.load(std::memory_order_relaxed);
+        while (value > previous && !m_max.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    quint64 Histogram::percentile(double fraction) const
+    {
+        // Buckets are read one by one while writers keep going, so the total is taken
+        // from the buckets themselves rather than from m_count
+        quint64 total = 0;
+        for (const auto &bucket : m_buckets)
+        {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        const quint64 rank = std::max<quint64>(1, static_cast<quint64>(fraction * total + 0.5));
+        quint64 seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; ++i)
+        {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return std::min(bucketMidpoint(i), max());
+            }
+        }
+        return max();
+    }
+
+    Counter &counter(const QString &name)
+    {
+        return lookup(registry().counters, name);
+    }
+
+    CounterFamily &counterFamily(const QString &name, const QString &label)
+    {
+        return lookup(registry().families, name, label);
+    }
+
+    Histogram &histogram(const QString &name)
+    {
+        return lookup(registry().histograms, name);
+    }
+
+    qint64 nowNs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    QString snapshotText()
+    {
+        QString text;
+        QTextStream out(&text);
+        Registry &metrics = registry();
+        QMutexLocker locker(&metrics.mutex);
+
+        for (const auto &[name, counter] : metrics.counters)
+        {
+            out << name << ' ' << counter->value() << '\n';
+        }
+        for (const auto &[name, family] : metrics.families)
+        {
+            for (int key = 0; key < 256; ++key)
+            {
+                const quint64 value = family->at(static_cast<quint8>(key)).value();
+                if (value != 0)
+                {
+                    out << name << '{' << family->label() << "=\"0x"
+                        << QString::number(key, 16).rightJustified(2, '0') << "\"} " << value << '\n';
+                }
+            }
+        }
+        for (const auto &[name, histogram] : metrics.histograms)
+        {
+            const quint64 count = histogram->count();
+            out << name << "_us count=" << count;
+            if (count != 0)
+            {
+                out << " mean=" << micros(histogram->sum() / count)
+                    << " p50=" << micros(histogram->percentile(0.50))
+                    << " p90=" << micros(histogram->percentile(0.90))
+                    << " p99=" << micros(histogram->percentile(0.99))
+                    << " max=" << micros(histogram->max());
+            }
+            out << '\n';
+        }
+        return text;
+    }
+}
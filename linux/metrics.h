@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QString>
+#include <array>
+#include <atomic>
+
+/**
+ * Process-wide counters and latency histograms.
+ *
+ * Lookups by name take a lock, so hot paths look a metric up once and keep the
+ * reference (a function-local static is the usual way); updating it afterwards is a
+ * relaxed atomic add. Metrics live until the process exits. snapshotText() renders
+ * everything recorded so far, one metric per line.
+ */
+namespace Metrics
+{
+    class Counter
+    {
+    public:
+        void add(quint64 amount = 1) { m_value.fetch_add(amount, std::memory_order_relaxed); }
+        quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<quint64> m_value{0};
+    };
+
+    // One counter per value of an 8-bit label, e.g. the AACP opcode
+    class CounterFamily
+    {
+    public:
+        explicit CounterFamily(const QString &label) : m_label(label) {}
+
+        Counter &at(quint8 key) { return m_counters[key]; }
+        const Counter &at(quint8 key) const { return m_counters[key]; }
+        const QString &label() const { return m_label; }
+
+    private:
+        QString m_label;
+        std::array<Counter, 256> m_counters;
+    };
+
+    /**
+     * Log-linear histogram of durations in nanoseconds: every power of two is split into
+     * 16 equal buckets, which bounds the error of any reported percentile to about 3%
+     * over the whole range without having to pick bucket boundaries up front.
+     */
+    class Histogram
+    {
+    public:
+        static constexpr int SUB_BUCKET_BITS = 4;
+        static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        void record(qint64 nanoseconds);
+
+        quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+        quint64 sum() const { return m_sum.load(std::memory_order_relaxed); }
+        quint64 max() const { return m_max.load(std::memory_order_relaxed); }
+        // Approximate value below which the given fraction (0..1) of the samples fall
+        quint64 percentile(double fraction) const;
+
+    private:
+        static int bucketFor(quint64 value);
+        static quint64 bucketMidpoint(int bucket);
+
+        std::array<std::atomic<quint64>, BUCKET_COUNT> m_buckets{};
+        std::atomic<quint64> m_count{0};
+        std::atomic<quint64> m_sum{0};
+        std::atomic<quint64> m_max{0};
+    };
+
+    Counter &counter(const QString &name);
+    CounterFamily &counterFamily(const QString &name, const QString &label);
+    Histogram &histogram(const QString &name);
+
+    // Monotonic clock used for every latency measurement
+    qint64 nowNs();
+
+    // Records the lifetime of the timer into a histogram
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Histogram &histogram) : m_histogram(histogram), m_startNs(nowNs()) {}
+        ~ScopedTimer() { m_histogram.record(nowNs() - m_startNs); }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        Histogram &m_histogram;
+        qint64 m_startNs;
+    };
+
+    QString snapshotText();
+}
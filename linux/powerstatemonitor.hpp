@@ -0,0 +1,97 @@
+#ifndef POWERSTATEMONITOR_HPP
+#define POWERSTATEMONITOR_HPP
+
+#include <QObject>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusVariant>
+#include "logger.h"
+
+// Whether the laptop runs on battery (UPower) and whether the session is locked (logind)
+class PowerStateMonitor : public QObject {
+    Q_OBJECT
+
+public:
+    explicit PowerStateMonitor(QObject *parent = nullptr) : QObject(parent) {
+        QDBusConnection systemBus = QDBusConnection::systemBus();
+        if (!systemBus.isConnected()) {
+            LOG_WARN("Cannot connect to system D-Bus, assuming mains power and an unlocked session");
+            return;
+        }
+
+        systemBus.connect("org.freedesktop.UPower", "/org/freedesktop/UPower", "org.freedesktop.DBus.Properties",
+                          "PropertiesChanged", this, SLOT(handlePropertiesChanged(QString, QVariantMap, QStringList)));
+        getProperty("org.freedesktop.UPower", "/org/freedesktop/UPower", "org.freedesktop.UPower", "OnBattery");
+
+        // Signals come from the session's real path, so look it up instead of listening on .../session/auto
+        QDBusMessage getSession = QDBusMessage::createMethodCall("org.freedesktop.login1", "/org/freedesktop/login1",
+                                                                 "org.freedesktop.login1.Manager", "GetSession");
+        getSession << QStringLiteral("auto");
+        auto *watcher = new QDBusPendingCallWatcher(systemBus.asyncCall(getSession), this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *call) {
+            call->deleteLater();
+            QDBusPendingReply<QDBusObjectPath> reply = *call;
+            if (reply.isError()) {
+                LOG_DEBUG("No logind session, screen lock is not tracked: " << reply.error().message());
+                return;
+            }
+            const QString path = reply.value().path();
+            QDBusConnection::systemBus().connect("org.freedesktop.login1", path, "org.freedesktop.DBus.Properties",
+                                                 "PropertiesChanged", this,
+                                                 SLOT(handlePropertiesChanged(QString, QVariantMap, QStringList)));
+            getProperty("org.freedesktop.login1", path, "org.freedesktop.login1.Session", "LockedHint");
+        });
+    }
+
+    bool isOnBattery() const { return m_onBattery; }
+    bool isScreenLocked() const { return m_screenLocked; }
+
+signals:
+    void onBatteryChanged(bool onBattery);
+    void screenLockedChanged(bool locked);
+
+private slots:
+    void handlePropertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &) {
+        if (interface == "org.freedesktop.UPower" && changed.contains("OnBattery")) {
+            setOnBattery(changed.value("OnBattery").toBool());
+        } else if (interface == "org.freedesktop.login1.Session" && changed.contains("LockedHint")) {
+            setScreenLocked(changed.value("LockedHint").toBool());
+        }
+    }
+
+private:
+    void getProperty(const QString &service, const QString &path, const QString &interface, const QString &name) {
+        QDBusMessage get = QDBusMessage::createMethodCall(service, path, "org.freedesktop.DBus.Properties", "Get");
+        get << interface << name;
+        auto *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(get), this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, interface, name](QDBusPendingCallWatcher *call) {
+            call->deleteLater();
+            QDBusPendingReply<QDBusVariant> reply = *call;
+            if (!reply.isError()) {
+                handlePropertiesChanged(interface, {{name, reply.value().variant()}}, {});
+            }
+        });
+    }
+
+    void setOnBattery(bool onBattery) {
+        if (m_onBattery != onBattery) {
+            m_onBattery = onBattery;
+            emit onBatteryChanged(onBattery);
+        }
+    }
+
+    void setScreenLocked(bool locked) {
+        if (m_screenLocked != locked) {
+            m_screenLocked = locked;
+            emit screenLockedChanged(locked);
+        }
+    }
+
+    bool m_onBattery = false;
+    bool m_screenLocked = false;
+};
+
+#endif // POWERSTATEMONITOR_HPP
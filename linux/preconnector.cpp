@@ -0,0 +1,77 @@
+#include "preconnector.h"
+#include "deviceinfo.hpp"
+#include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+
+PreConnector::PreConnector(QObject *parent) : QObject(parent)
+{
+}
+
+void PreConnector::onAdvertisement(DeviceInfo *device, const BleInfo &info)
+{
+    if (!info.isThisPodInTheCase && !info.isOnePodInCase && !info.areBothPodsInCase)
+    {
+        return;
+    }
+    if (info.lidState == BleInfo::LidState::UNKNOWN)
+    {
+        return;
+    }
+
+    Lid &lid = m_lids[device];
+    const bool opened = info.lidState == BleInfo::LidState::OPEN
+                        && (lid.state != BleInfo::LidState::OPEN || info.lidOpenCounter != lid.openCounter);
+    const bool closed = info.lidState == BleInfo::LidState::CLOSED && lid.state != BleInfo::LidState::CLOSED;
+    lid.state = info.lidState;
+    lid.openCounter = info.lidOpenCounter;
+
+    // Lid state is tracked regardless, so enabling the feature does not act on a stale edge
+    const bool available = info.connectionState == BleInfo::ConnectionState::DISCONNECTED && m_takeoverAllowed;
+    if (opened && m_enabled && available && !lid.pending && !device->isConnected())
+    {
+        static Metrics::Counter &requested = Metrics::counter("lid_preconnect_total");
+        requested.add();
+        LOG_INFO("Lid of " << device->deviceName() << " opened, connecting ahead of time");
+        lid.pending = true;
+        lid.openedNs = Metrics::nowNs();
+        Trace::instant("lid.opened");
+        emit preConnectRequested(device);
+    }
+    else if (closed && lid.pending && info.areBothPodsInCase)
+    {
+        static Metrics::Counter &cancelled = Metrics::counter("lid_preconnect_cancelled_total");
+        cancelled.add();
+        LOG_INFO("Lid of " << device->deviceName() << " closed again, cancelling the pre-connect");
+        lid.pending = false;
+        emit preConnectCancelled(device);
+    }
+}
+
+void PreConnector::onConnected(DeviceInfo *device)
+{
+    const auto it = m_lids.find(device);
+    if (it == m_lids.end() || !it->pending)
+    {
+        return;
+    }
+    static Metrics::Histogram &lidOpenToReady = Metrics::histogram("lid_open_to_ready");
+    const qint64 nowNs = Metrics::nowNs();
+    lidOpenToReady.record(nowNs - it->openedNs);
+    Trace::complete("airpods.lid_open_to_ready", it->openedNs, nowNs);
+    it->pending = false;
+}
+
+void PreConnector::onConnectFailed(DeviceInfo *device)
+{
+    const auto it = m_lids.find(device);
+    if (it != m_lids.end())
+    {
+        it->pending = false;
+    }
+}
+
+bool PreConnector::isPending(DeviceInfo *device) const
+{
+    return m_lids.value(device).pending;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QObject>
+#include <QHash>
+
+#include "ble/blemanager.h"
+
+class DeviceInfo;
+
+/**
+ * Starts connecting to known AirPods as soon as their case is opened nearby.
+ *
+ * The case advertises its lid state and a counter that goes up every time the lid
+ * opens. An opening (either a closed -> open edge or a new counter value) of a device
+ * that is not connected asks for a pre-connect, so BlueZ, the AACP handshake and the
+ * PulseAudio card are under way while the pods are still on their way to the ears.
+ * Closing the lid again with both pods inside before the link is up cancels it.
+ *
+ * It never takes the AirPods away from another device: the advertisement has to say
+ * they are connected to nothing, and the caller clears setTakeoverAllowed() while the
+ * cross-device link reports that the phone has them. The whole feature is a user
+ * setting (setEnabled()).
+ *
+ * Lid state only means something while a pod is in the case, so advertisements from
+ * pods that are out are ignored. Like ConnectionSupervisor, this only asks; the caller
+ * connects and reports back with onConnected() and onConnectFailed().
+ */
+class PreConnector : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PreConnector(QObject *parent = nullptr);
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+    void setTakeoverAllowed(bool allowed) { m_takeoverAllowed = allowed; }
+
+    void onAdvertisement(DeviceInfo *device, const BleInfo &info);
+    void onConnected(DeviceInfo *device);
+    void onConnectFailed(DeviceInfo *device);
+    bool isPending(DeviceInfo *device) const;
+
+signals:
+    void preConnectRequested(DeviceInfo *device);
+    void preConnectCancelled(DeviceInfo *device);
+
+private:
+    struct Lid
+    {
+        BleInfo::LidState state = BleInfo::LidState::UNKNOWN;
+        quint8 openCounter = 0;
+        bool pending = false; // Asked for a pre-connect that has not finished yet
+        qint64 openedNs = 0;
+    };
+
+    QHash<DeviceInfo *, Lid> m_lids;
+    bool m_enabled = true;
+    bool m_takeoverAllowed = true;
+};
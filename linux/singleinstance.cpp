@@ -0,0 +1,118 @@
+#include "singleinstance.h"
+#include "control/controlprotocol.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr int FORWARD_TIMEOUT_MS = 3000; // Only paid when the primary is itself still starting
+    constexpr int FORWARD_RETRY_MS = 20;
+    constexpr int REPLY_TIMEOUT_MS = 2000; // A primary that is stuck must not hang the second launch too
+
+    std::string lockPath()
+    {
+        const char *runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+        std::string dir = runtimeDir && *runtimeDir ? std::string(runtimeDir) + "/librepods"
+                                                    : "/tmp/librepods-" + std::to_string(::getuid());
+        ::mkdir(dir.c_str(), 0700);
+        return dir + "/instance.lock";
+    }
+
+    int connectToPrimary()
+    {
+        const std::string path = ControlProtocol::socketPath();
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            return -1;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
+
+namespace SingleInstance
+{
+    bool acquire()
+    {
+        // Intentionally leaked: the descriptor, and with it the lock, lives as long as the process.
+        // O_CLOEXEC keeps helpers started with QProcess from inheriting it.
+        const std::string path = lockPath();
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0)
+        {
+            std::fprintf(stderr, "librepods: cannot open %s: %s, not enforcing a single instance\n",
+                         path.c_str(), std::strerror(errno));
+            return true;
+        }
+        if (::flock(fd, LOCK_EX | LOCK_NB) < 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        return true;
+    }
+
+    bool forwardArguments(int argc, char *argv[])
+    {
+        std::string arguments;
+        for (int i = 1; i < argc; ++i)
+        {
+            if (i > 1)
+            {
+                arguments += '\0';
+            }
+            arguments += argv[i];
+        }
+        const std::string frame = ControlProtocol::encodeFrame(ControlProtocol::MessageType::Activate, arguments);
+
+        int fd = -1;
+        for (int waited = 0; (fd = connectToPrimary()) < 0 && waited < FORWARD_TIMEOUT_MS; waited += FORWARD_RETRY_MS)
+        {
+            const timespec delay{0, FORWARD_RETRY_MS * 1000000L};
+            ::nanosleep(&delay, nullptr);
+        }
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        const timeval timeout{REPLY_TIMEOUT_MS / 1000, (REPLY_TIMEOUT_MS % 1000) * 1000};
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        bool forwarded = ::send(fd, frame.data(), frame.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(frame.size());
+        if (forwarded)
+        {
+            // Wait for the acknowledgement so the caller knows the request was taken; a timeout counts as a failure
+            char reply[ControlProtocol::HEADER_SIZE];
+            forwarded = ::recv(fd, reply, sizeof(reply), MSG_WAITALL) == static_cast<ssize_t>(sizeof(reply)) &&
+                        static_cast<ControlProtocol::MessageType>(reply[1]) == ControlProtocol::MessageType::Ok;
+        }
+        ::close(fd);
+        return forwarded;
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/**
+ * Decides which launch of librepods keeps running, before Qt is even initialised.
+ *
+ * The first process takes an exclusive flock() on $XDG_RUNTIME_DIR/librepods/instance.lock
+ * and holds it until it exits; the kernel drops the lock on crash too, so there is no
+ * stale state to probe or clean up. Later launches fail the non-blocking lock at once and
+ * hand their command line to the running instance over the control socket.
+ */
+namespace SingleInstance
+{
+    // True if this process is now the primary instance
+    bool acquire();
+
+    // Sends argv (minus argv[0]) to the primary instance; waits briefly if it is still
+    // starting up and has not opened its control socket yet
+    bool forwardArguments(int argc, char *argv[]);
+}
@@ -0,0 +1,180 @@
+/*
+ * librepods status page: read AirPods state without any IPC.
+ *
+ * The running app keeps a small file in $XDG_RUNTIME_DIR/librepods/status up to date.
+ * Map it once with librepods_status_map(), then call librepods_status_read() as often
+ * as needed; each read is a copy of the page guarded by a sequence counter, with no
+ * system calls. Header-only C, usable from C++ as well.
+ *
+ *     const struct librepods_status_page *page = librepods_status_map(NULL);
+ *     struct librepods_status status;
+ *     if (page && librepods_status_read(page, &status) == 0 && status.connected)
+ *         printf("%s: L %u%% R %u%%\n", status.name, status.left.level, status.right.level);
+ *     librepods_status_unmap(page);
+ *
+ * The layout only ever grows at the end: fields are never moved or reinterpreted without
+ * bumping LIBREPODS_STATUS_VERSION.
+ */
+#ifndef LIBREPODS_STATUS_H
+#define LIBREPODS_STATUS_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIBREPODS_STATUS_MAGIC 0x5350524cu /* "LRPS" */
+#define LIBREPODS_STATUS_VERSION 1
+#define LIBREPODS_STATUS_FILE_SIZE 4096
+
+/* Values of librepods_status.primary_ear / secondary_ear */
+enum librepods_ear_status
+{
+    LIBREPODS_EAR_IN_EAR = 0,
+    LIBREPODS_EAR_NOT_IN_EAR = 1,
+    LIBREPODS_EAR_IN_CASE = 2,
+    LIBREPODS_EAR_DISCONNECTED = 3,
+};
+
+/* Values of librepods_status.noise_control_mode */
+enum librepods_noise_control_mode
+{
+    LIBREPODS_NOISE_OFF = 0,
+    LIBREPODS_NOISE_CANCELLATION = 1,
+    LIBREPODS_NOISE_TRANSPARENCY = 2,
+    LIBREPODS_NOISE_ADAPTIVE = 3,
+};
+
+struct librepods_status_component
+{
+    uint8_t level;     /* 0-100 */
+    uint8_t charging;  /* 0 or 1 */
+    uint8_t available; /* 0 when the component is not reporting */
+    uint8_t reserved;
+};
+
+struct librepods_status
+{
+    uint64_t updated_ns;          /* CLOCK_MONOTONIC time of the last update */
+    uint8_t connected;            /* 0 or 1 */
+    uint8_t noise_control_mode;   /* enum librepods_noise_control_mode */
+    uint8_t primary_ear;          /* enum librepods_ear_status */
+    uint8_t secondary_ear;        /* enum librepods_ear_status */
+    uint8_t left_in_ear;          /* 0 or 1 */
+    uint8_t right_in_ear;         /* 0 or 1 */
+    uint8_t conversational_awareness;
+    uint8_t reserved;
+    struct librepods_status_component left;
+    struct librepods_status_component right;
+    struct librepods_status_component case_;
+    struct librepods_status_component headset; /* AirPods Max */
+    char model[32];               /* e.g. "AirPodsPro2USBC", NUL-terminated */
+    char name[64];                /* Device name, UTF-8, NUL-terminated */
+};
+
+struct librepods_status_page
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t status_size;         /* sizeof(struct librepods_status) of the writer */
+    uint32_t sequence;            /* Odd while the writer is updating the page */
+    uint32_t writer_pid;          /* 0 once the app has exited */
+    struct librepods_status status;
+};
+
+/* Writes $XDG_RUNTIME_DIR/librepods/status into buffer; returns 0 on success */
+static inline int librepods_status_default_path(char *buffer, size_t size)
+{
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    int written;
+    if (!runtime_dir || !*runtime_dir)
+        return -1;
+    written = snprintf(buffer, size, "%s/librepods/status", runtime_dir);
+    return written > 0 && (size_t)written < size ? 0 : -1;
+}
+
+/* Maps the page read-only; path may be NULL for the default. Returns NULL on failure. */
+static inline const struct librepods_status_page *librepods_status_map(const char *path)
+{
+    char default_path[4096];
+    const struct librepods_status_page *page;
+    void *mapping;
+    int fd;
+
+    if (!path)
+    {
+        if (librepods_status_default_path(default_path, sizeof(default_path)) != 0)
+            return NULL;
+        path = default_path;
+    }
+
+    /* O_CLOEXEC is POSIX 2008, hidden by a strict -std=c99/c11 unless the includer asked for it */
+#ifdef O_CLOEXEC
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+#else
+    fd = open(path, O_RDONLY);
+    if (fd >= 0)
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+    if (fd < 0)
+        return NULL;
+    mapping = mmap(NULL, LIBREPODS_STATUS_FILE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    page = (const struct librepods_status_page *)mapping;
+    if (page->magic != LIBREPODS_STATUS_MAGIC || page->version != LIBREPODS_STATUS_VERSION ||
+        page->status_size < sizeof(struct librepods_status))
+    {
+        munmap(mapping, LIBREPODS_STATUS_FILE_SIZE);
+        return NULL;
+    }
+    return page;
+}
+
+static inline void librepods_status_unmap(const struct librepods_status_page *page)
+{
+    if (page)
+        munmap((void *)page, LIBREPODS_STATUS_FILE_SIZE);
+}
+
+/* Copies a consistent snapshot into out. Returns 0 on success, -1 if the writer kept the page busy. */
+static inline int librepods_status_read(const struct librepods_status_page *page, struct librepods_status *out)
+{
+    int attempt;
+    for (attempt = 0; attempt < 1000; ++attempt)
+    {
+        const uint32_t before = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1u)
+            continue;
+        memcpy(out, (const void *)&page->status, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->sequence, __ATOMIC_RELAXED) == before)
+        {
+            out->model[sizeof(out->model) - 1] = '\0';
+            out->name[sizeof(out->name) - 1] = '\0';
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Nonzero while the app that wrote the page is running */
+static inline int librepods_status_writer_alive(const struct librepods_status_page *page)
+{
+    return __atomic_load_n(&page->writer_pid, __ATOMIC_RELAXED) != 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBREPODS_STATUS_H */
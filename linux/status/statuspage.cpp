@@ -0,0 +1,197 @@
+#include "statuspage.h"
+#include "librepods_status.h"
+#include "deviceinfo.hpp"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaEnum>
+#include <QStandardPaths>
+#include <QTimer>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static_assert(sizeof(librepods_status_page) <= LIBREPODS_STATUS_FILE_SIZE, "status page must fit in one page");
+static_assert(static_cast<int>(EarDetection::EarDetectionStatus::InEar) == LIBREPODS_EAR_IN_EAR &&
+                  static_cast<int>(EarDetection::EarDetectionStatus::Disconnected) == LIBREPODS_EAR_DISCONNECTED,
+              "librepods_ear_status must match EarDetection::EarDetectionStatus");
+static_assert(static_cast<int>(NoiseControlMode::Adaptive) == LIBREPODS_NOISE_ADAPTIVE,
+              "librepods_noise_control_mode must match NoiseControlMode");
+
+namespace
+{
+    void copyString(char *destination, std::size_t size, const QByteArray &source)
+    {
+        const std::size_t length = std::min<std::size_t>(size - 1, static_cast<std::size_t>(source.size()));
+        std::memcpy(destination, source.constData(), length);
+        std::memset(destination + length, 0, size - length);
+    }
+
+    librepods_status_component component(const Battery *battery, Battery::Component which)
+    {
+        const Battery::BatteryState state = battery->getState(which);
+        librepods_status_component result{};
+        result.level = state.level;
+        result.charging = state.status == Battery::BatteryStatus::Charging;
+        result.available = state.status != Battery::BatteryStatus::Disconnected;
+        return result;
+    }
+}
+
+StatusPage::StatusPage(DeviceInfo *deviceInfo, QObject *parent) : QObject(parent), m_deviceInfo(deviceInfo)
+{
+    m_updateTimer = new QTimer(this);
+    m_updateTimer->setSingleShot(true);
+    m_updateTimer->setInterval(0);
+    connect(m_updateTimer, &QTimer::timeout, this, &StatusPage::publish);
+    bind();
+}
+
+void StatusPage::setDeviceInfo(DeviceInfo *deviceInfo)
+{
+    if (m_deviceInfo == deviceInfo)
+    {
+        return;
+    }
+    m_deviceInfo->disconnect(this);
+    m_deviceInfo->getBattery()->disconnect(this);
+    m_deviceInfo->getEarDetection()->disconnect(this);
+    m_deviceInfo = deviceInfo;
+    bind();
+    scheduleUpdate();
+}
+
+void StatusPage::bind()
+{
+    connect(m_deviceInfo, &DeviceInfo::deviceNameChanged, this, &StatusPage::scheduleUpdate);
+    connect(m_deviceInfo, &DeviceInfo::modelChanged, this, &StatusPage::scheduleUpdate);
+    connect(m_deviceInfo, &DeviceInfo::noiseControlModeChangedInt, this, &StatusPage::scheduleUpdate);
+    connect(m_deviceInfo, &DeviceInfo::conversationalAwarenessChanged, this, &StatusPage::scheduleUpdate);
+    connect(m_deviceInfo->getBattery(), &Battery::batteryStatusChanged, this, &StatusPage::scheduleUpdate);
+    connect(m_deviceInfo->getBattery(), &Battery::primaryChanged, this, &StatusPage::scheduleUpdate);
+    connect(m_deviceInfo->getEarDetection(), &EarDetection::statusChanged, this, &StatusPage::scheduleUpdate);
+}
+
+StatusPage::~StatusPage()
+{
+    if (!m_page)
+    {
+        return;
+    }
+    // Leave the file for readers that still have it mapped, but show that nobody is behind it
+    m_connected = false;
+    publish();
+    __atomic_store_n(&m_page->writer_pid, 0u, __ATOMIC_RELEASE);
+    munmap(m_page, LIBREPODS_STATUS_FILE_SIZE);
+}
+
+QString StatusPage::defaultPath()
+{
+    QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (runtimeDir.isEmpty())
+    {
+        runtimeDir = QDir::tempPath();
+    }
+    return runtimeDir + "/librepods/status";
+}
+
+bool StatusPage::open(const QString &path)
+{
+    if (m_page)
+    {
+        return true;
+    }
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        LOG_ERROR("Cannot open status page " << path << ": " << std::strerror(errno));
+        return false;
+    }
+    void *mapping = MAP_FAILED;
+    if (::ftruncate(fd, LIBREPODS_STATUS_FILE_SIZE) == 0)
+    {
+        mapping = mmap(nullptr, LIBREPODS_STATUS_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const int savedErrno = errno;
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        LOG_ERROR("Cannot map status page " << path << ": " << std::strerror(savedErrno));
+        return false;
+    }
+
+    m_page = static_cast<librepods_status_page *>(mapping);
+    // Keep the sequence of a previous run so a reader caught mid-update still retries
+    const uint32_t sequence = __atomic_load_n(&m_page->sequence, __ATOMIC_RELAXED) & ~1u;
+    __atomic_store_n(&m_page->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    m_page->magic = LIBREPODS_STATUS_MAGIC;
+    m_page->version = LIBREPODS_STATUS_VERSION;
+    m_page->status_size = sizeof(librepods_status);
+    m_page->writer_pid = static_cast<uint32_t>(::getpid());
+    __atomic_store_n(&m_page->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    LOG_INFO("Publishing status page at " << path);
+    publish();
+    return true;
+}
+
+void StatusPage::setConnected(bool connected)
+{
+    if (m_connected != connected)
+    {
+        m_connected = connected;
+        scheduleUpdate();
+    }
+}
+
+void StatusPage::scheduleUpdate()
+{
+    if (m_page && !m_updateTimer->isActive())
+    {
+        m_updateTimer->start();
+    }
+}
+
+void StatusPage::publish()
+{
+    if (!m_page)
+    {
+        return;
+    }
+
+    // Build the snapshot first so the odd-sequence window is only the copy
+    librepods_status status{};
+    const Battery *battery = m_deviceInfo->getBattery();
+    const EarDetection *earDetection = m_deviceInfo->getEarDetection();
+    status.updated_ns = static_cast<uint64_t>(Metrics::nowNs());
+    status.connected = m_connected;
+    status.noise_control_mode = static_cast<uint8_t>(m_deviceInfo->noiseControlMode());
+    status.primary_ear = static_cast<uint8_t>(earDetection->getprimaryStatus());
+    status.secondary_ear = static_cast<uint8_t>(earDetection->getsecondaryStatus());
+    status.left_in_ear = m_deviceInfo->isLeftPodInEar();
+    status.right_in_ear = m_deviceInfo->isRightPodInEar();
+    status.conversational_awareness = m_deviceInfo->conversationalAwareness();
+    status.left = component(battery, Battery::Component::Left);
+    status.right = component(battery, Battery::Component::Right);
+    status.case_ = component(battery, Battery::Component::Case);
+    status.headset = component(battery, Battery::Component::Headset);
+    copyString(status.model, sizeof(status.model),
+               QMetaEnum::fromType<AirPodsModel>().valueToKey(static_cast<int>(m_deviceInfo->model())));
+    copyString(status.name, sizeof(status.name), m_deviceInfo->deviceName().toUtf8());
+
+    const uint32_t sequence = __atomic_load_n(&m_page->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_page->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    std::memcpy(&m_page->status, &status, sizeof(status));
+    __atomic_store_n(&m_page->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+
+class DeviceInfo;
+class QTimer;
+struct librepods_status_page;
+
+/**
+ * Writer side of the shared-memory status page (see librepods_status.h).
+ *
+ * Mirrors DeviceInfo, Battery and EarDetection into a memory-mapped file. Change
+ * notifications are batched like the D-Bus properties: the page is rewritten once per
+ * event loop pass, under the sequence counter so readers never see a torn update.
+ */
+class StatusPage : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StatusPage(DeviceInfo *deviceInfo, QObject *parent = nullptr);
+    ~StatusPage();
+
+    // Creates or reuses the file; readers that already mapped it keep working
+    bool open(const QString &path = defaultPath());
+    static QString defaultPath();
+
+    void setConnected(bool connected);
+    // Follows another device, e.g. when the user switches between AirPods
+    void setDeviceInfo(DeviceInfo *deviceInfo);
+
+private:
+    void bind();
+    void scheduleUpdate();
+    void publish();
+
+    DeviceInfo *m_deviceInfo;
+    librepods_status_page *m_page = nullptr;
+    bool m_connected = false;
+    QTimer *m_updateTimer;
+};
@@ -0,0 +1,736 @@
+// airpodssim: simulated AirPods for running librepods end to end without hardware.
+//
+// Listens on the simulator socket (see Transports::simulatorSocketPath()) and speaks AACP
+// as described in "AAP Definitions.md": it answers the handshake, feature and notification
+// requests the way real AirPods do, then generates battery, ear detection, conversational
+// awareness and head tracking traffic, either on fixed or randomised intervals or from a
+// script. A fake MPRIS player on the session bus measures how long the app takes to pause
+// after the AirPods leave the ear and to resume after they are put back.
+//
+// Start the simulator first, then the app with LIBREPODS_TRANSPORT=sim.
+
+#include "io/localtransport.h"
+#include "io/transports.h"
+#include "airpods_packets.h"
+#include "logger.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusAbstractAdaptor>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QTextStream>
+#include <QTimer>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(librepods, "librepods")
+
+namespace
+{
+    namespace Sim
+    {
+        const QByteArray HANDSHAKE_ACK = QByteArray::fromHex("010004000000");
+        const QByteArray FEATURES_ACK = QByteArray::fromHex("040004002b000000");
+        const QByteArray SET_FEATURES_HEADER = QByteArray::fromHex("040004004d00");
+        const QByteArray REQUEST_NOTIFICATIONS_HEADER = QByteArray::fromHex("040004000f00");
+        const QByteArray HEAD_TRACKING_HEADER = QByteArray::fromHex("040004001700");
+        const QByteArray HEAD_TRACKING_START = QByteArray::fromHex("04000400170000001000100008a102420b080e10021a0501409c0000");
+        const QByteArray HEAD_TRACKING_STOP = QByteArray::fromHex("040004001700000010001100087e1002420b084e10021a050100000000");
+        constexpr int HEAD_TRACKING_PACKET_BYTES = 60;
+
+        constexpr quint8 IN_EAR = 0x00;
+        constexpr quint8 OUT_OF_EAR = 0x01;
+        constexpr quint8 IN_CASE = 0x02;
+    }
+
+    int signalPipe[2] = {-1, -1};
+
+    void onSignal(int)
+    {
+        const char byte = 1;
+        [[maybe_unused]] const ssize_t written = ::write(signalPipe[1], &byte, 1);
+    }
+
+    qint64 elapsedNs(const QElapsedTimer &timer)
+    {
+        return timer.isValid() ? timer.nsecsElapsed() : 0;
+    }
+
+    // Start/stop latency samples for one kind of app reaction
+    struct Reaction
+    {
+        const char *name;
+        std::vector<qint64> samples;
+        QElapsedTimer pending;
+        int missed = 0;
+
+        void start()
+        {
+            if (pending.isValid())
+            {
+                ++missed; // The previous trigger never got a reaction
+            }
+            pending.start();
+        }
+
+        void finish()
+        {
+            if (pending.isValid())
+            {
+                samples.push_back(pending.nsecsElapsed());
+                pending.invalidate();
+            }
+        }
+
+        void print() const
+        {
+            std::vector<qint64> sorted = samples;
+            std::sort(sorted.begin(), sorted.end());
+            auto at = [&sorted](double p)
+            {
+                const std::size_t index = static_cast<std::size_t>(std::ceil(p * sorted.size())) - 1;
+                return sorted[std::min(index, sorted.size() - 1)] / 1e6;
+            };
+            std::printf("%-18s %zu samples, %d missed", name, sorted.size(), missed + (pending.isValid() ? 1 : 0));
+            if (!sorted.empty())
+            {
+                std::printf(", p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms", at(0.5), at(0.9), at(0.99),
+                            sorted.back() / 1e6);
+            }
+            std::printf("\n");
+        }
+    };
+}
+
+// Minimal org.mpris.MediaPlayer2.Player that is always "playing" until the app pauses it
+class FakeMprisPlayer : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.mpris.MediaPlayer2.Player")
+    Q_PROPERTY(QString PlaybackStatus READ playbackStatus)
+    Q_PROPERTY(bool CanPlay READ canControl)
+    Q_PROPERTY(bool CanPause READ canControl)
+
+public:
+    explicit FakeMprisPlayer(QObject *parent) : QDBusAbstractAdaptor(parent) {}
+
+    QString playbackStatus() const { return m_playing ? "Playing" : "Paused"; }
+    bool canControl() const { return true; }
+    bool isPlaying() const { return m_playing; }
+
+public slots:
+    void Play() { setPlaying(true); }
+    void Pause() { setPlaying(false); }
+    void PlayPause() { setPlaying(!m_playing); }
+    void Stop() { setPlaying(false); }
+
+signals:
+    void playingChanged(bool playing);
+
+private:
+    void setPlaying(bool playing)
+    {
+        if (playing == m_playing)
+        {
+            return;
+        }
+        m_playing = playing;
+        emit playingChanged(playing);
+
+        QDBusMessage message = QDBusMessage::createSignal("/org/mpris/MediaPlayer2", "org.freedesktop.DBus.Properties",
+                                                          "PropertiesChanged");
+        message << QString("org.mpris.MediaPlayer2.Player") << QVariantMap{{"PlaybackStatus", playbackStatus()}}
+                << QStringList();
+        QDBusConnection::sessionBus().send(message);
+    }
+
+    bool m_playing = true;
+};
+
+class AirPodsSimulator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        int batteryIntervalMs = 5000;
+        int earIntervalMs = 0;
+        int caIntervalMs = 0;
+        int headTrackingHz = 0;
+        bool forceHeadTracking = false;
+        bool randomise = false;
+        quint32 seed = 0;
+        QString scriptPath;
+        bool loopScript = false;
+    };
+
+    AirPodsSimulator(const Options &options, QObject *parent = nullptr)
+        : QObject(parent), m_options(options), m_random(options.seed)
+    {
+        m_batteryTimer = addTimer(&AirPodsSimulator::sendBattery);
+        m_earTimer = addTimer(&AirPodsSimulator::toggleEar);
+        m_caTimer = addTimer(&AirPodsSimulator::sendConversationBurst);
+        m_scriptTimer = addTimer(&AirPodsSimulator::runScriptStep);
+        m_headTrackingTimer = new QTimer(this);
+        m_headTrackingTimer->setTimerType(Qt::PreciseTimer);
+        connect(m_headTrackingTimer, &QTimer::timeout, this, &AirPodsSimulator::sendHeadTracking);
+    }
+
+    bool listen(const QString &path)
+    {
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        ::unlink(path.toLocal8Bit().constData());
+
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        const QByteArray encoded = path.toLocal8Bit();
+        if (encoded.size() >= static_cast<int>(sizeof(addr.sun_path)))
+        {
+            LOG_ERROR("Socket path too long: " << path);
+            return false;
+        }
+        std::memcpy(addr.sun_path, encoded.constData(), encoded.size());
+
+        m_listenFd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listenFd < 0 || ::bind(m_listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+            ::listen(m_listenFd, 1) < 0)
+        {
+            LOG_ERROR("Cannot listen on " << path << ": " << std::strerror(errno));
+            return false;
+        }
+        m_path = path;
+
+        QSocketNotifier *notifier = new QSocketNotifier(m_listenFd, QSocketNotifier::Read, this);
+        connect(notifier, &QSocketNotifier::activated, this, &AirPodsSimulator::onNewConnection);
+        LOG_INFO("Simulated AirPods listening on " << path);
+        return true;
+    }
+
+    ~AirPodsSimulator()
+    {
+        if (m_listenFd >= 0)
+        {
+            ::close(m_listenFd);
+            ::unlink(m_path.toLocal8Bit().constData());
+        }
+    }
+
+    void attachPlayer(FakeMprisPlayer *player)
+    {
+        m_player = player;
+        connect(player, &FakeMprisPlayer::playingChanged, this, [this](bool playing)
+                {
+            if (playing) {
+                m_resume.finish();
+            } else {
+                m_pause.finish();
+            } });
+    }
+
+    void printReport() const
+    {
+        std::printf("packets sent       %llu\n", static_cast<unsigned long long>(m_packetsSent));
+        std::printf("packets received   %llu\n", static_cast<unsigned long long>(m_packetsReceived));
+        std::printf("handshake          %.1f ms after connect\n", m_handshakeNs / 1e6);
+        std::printf("features request   %.1f ms after handshake ack\n", m_featuresNs / 1e6);
+        std::printf("notifications req  %.1f ms after features ack\n", m_notificationsNs / 1e6);
+        if (m_player)
+        {
+            m_pause.print();
+            m_resume.print();
+        }
+    }
+
+private:
+    using Handler = void (AirPodsSimulator::*)();
+
+    QTimer *addTimer(Handler handler)
+    {
+        QTimer *timer = new QTimer(this);
+        timer->setSingleShot(true);
+        timer->setTimerType(Qt::PreciseTimer);
+        connect(timer, &QTimer::timeout, this, handler);
+        return timer;
+    }
+
+    // Fixed interval, or exponentially distributed around it when randomising
+    int nextInterval(int meanMs)
+    {
+        if (!m_options.randomise || meanMs <= 0)
+        {
+            return meanMs;
+        }
+        std::exponential_distribution<double> distribution(1.0 / meanMs);
+        return std::max(1, static_cast<int>(distribution(m_random)));
+    }
+
+    void onNewConnection()
+    {
+        const int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+        if (m_link)
+        {
+            LOG_WARN("Replacing existing app connection");
+            dropLink();
+        }
+
+        m_link = LocalTransport::fromDescriptor(fd, this);
+        connect(m_link, &Transport::readyRead, this, &AirPodsSimulator::onPacket);
+        connect(m_link, &Transport::disconnected, this, [this]()
+                {
+            LOG_INFO("App disconnected");
+            dropLink(); });
+        connect(m_link, &Transport::errorOccurred, this, [this](const QString &message)
+                {
+            LOG_WARN("Link error: " << message);
+            dropLink(); });
+        m_link->open();
+        m_phase.start();
+        LOG_INFO("App connected");
+    }
+
+    void dropLink()
+    {
+        stopTraffic();
+        if (m_link)
+        {
+            m_link->disconnect(this);
+            m_link->close();
+            m_link->deleteLater();
+            m_link = nullptr;
+        }
+    }
+
+    void send(const QByteArray &packet)
+    {
+        if (m_link && m_link->isOpen())
+        {
+            m_link->write(packet);
+            ++m_packetsSent;
+        }
+    }
+
+    void onPacket()
+    {
+        const QByteArray packet = m_link->readAll();
+        ++m_packetsReceived;
+        LOG_DEBUG("Received: " << packet.toHex());
+
+        if (packet.startsWith(AirPodsPackets::Connection::HANDSHAKE))
+        {
+            m_handshakeNs = elapsedNs(m_phase);
+            send(Sim::HANDSHAKE_ACK);
+            m_phase.start();
+        }
+        else if (packet.startsWith(Sim::SET_FEATURES_HEADER))
+        {
+            m_featuresNs = elapsedNs(m_phase);
+            send(Sim::FEATURES_ACK);
+            m_phase.start();
+        }
+        else if (packet.startsWith(Sim::REQUEST_NOTIFICATIONS_HEADER))
+        {
+            m_notificationsNs = elapsedNs(m_phase);
+            sendInitialState();
+            startTraffic();
+        }
+        else if (packet.startsWith(Sim::HEAD_TRACKING_START))
+        {
+            startHeadTracking();
+        }
+        else if (packet.startsWith(Sim::HEAD_TRACKING_STOP))
+        {
+            if (!m_options.forceHeadTracking)
+            {
+                m_headTrackingTimer->stop();
+            }
+        }
+        else if (packet.startsWith(ControlCommand::HEADER))
+        {
+            // Real AirPods confirm control commands by echoing the new value
+            send(packet);
+        }
+    }
+
+    void sendInitialState()
+    {
+        send(metadataPacket());
+        sendBattery();
+        sendEar(m_primary, m_secondary);
+        send(ControlCommand::createCommand(0x0D, 0x02)); // Noise cancellation
+        send(ControlCommand::createCommand(0x28, 0x01)); // Conversational awareness enabled
+    }
+
+    void startTraffic()
+    {
+        m_batteryTimer->start(nextInterval(m_options.batteryIntervalMs));
+        if (m_options.earIntervalMs > 0)
+        {
+            m_earTimer->start(nextInterval(m_options.earIntervalMs));
+        }
+        if (m_options.caIntervalMs > 0)
+        {
+            m_caTimer->start(nextInterval(m_options.caIntervalMs));
+        }
+        if (m_options.forceHeadTracking)
+        {
+            startHeadTracking();
+        }
+        if (!m_options.scriptPath.isEmpty())
+        {
+            loadScript();
+            m_scriptIndex = 0;
+            scheduleScriptStep();
+        }
+    }
+
+    void stopTraffic()
+    {
+        for (QTimer *timer : {m_batteryTimer, m_earTimer, m_caTimer, m_scriptTimer, m_headTrackingTimer})
+        {
+            timer->stop();
+        }
+        m_caBurstStep = 0;
+    }
+
+    static QByteArray metadataPacket()
+    {
+        QByteArray packet = AirPodsPackets::Parse::METADATA;
+        packet.append(QByteArray::fromHex("0002d5000400"));
+        for (const char *field : {"LibrePods Simulator", "A3048", "Apple Inc.", "SIMULATOR01", "7A305", "7A305",
+                                  "1.0.0", "com.apple.accessory.updater.app.71", "SIMULATOR02", "SIMULATOR03", "0"})
+        {
+            packet.append(field);
+            packet.append('\0');
+        }
+        return packet;
+    }
+
+    void sendBattery()
+    {
+        // Drain slowly so the app sees changing values; wrap around instead of dying
+        if (++m_batterySends % 10 == 0)
+        {
+            m_batteryLevel = m_batteryLevel > 5 ? m_batteryLevel - 1 : 100;
+        }
+        const char level = static_cast<char>(m_batteryLevel);
+        QByteArray packet = AirPodsPackets::Parse::BATTERY_STATUS;
+        packet.append(char(0x03));
+        packet.append(QByteArray::fromRawData("\x04\x01", 2)).append(level).append(QByteArray::fromRawData("\x02\x01", 2));
+        packet.append(QByteArray::fromRawData("\x02\x01", 2)).append(level).append(QByteArray::fromRawData("\x02\x01", 2));
+        packet.append(QByteArray::fromRawData("\x08\x01", 2)).append(char(0x40)).append(QByteArray::fromRawData("\x02\x01", 2));
+        send(packet);
+
+        if (m_link)
+        {
+            m_batteryTimer->start(nextInterval(m_options.batteryIntervalMs));
+        }
+    }
+
+    void sendEar(quint8 primary, quint8 secondary)
+    {
+        const bool wasInEar = m_primary == Sim::IN_EAR && m_secondary == Sim::IN_EAR;
+        const bool nowInEar = primary == Sim::IN_EAR && secondary == Sim::IN_EAR;
+        m_primary = primary;
+        m_secondary = secondary;
+
+        // Latency is measured from the moment the packet leaves the simulator
+        if (m_player && wasInEar && !nowInEar && m_player->isPlaying())
+        {
+            m_pause.start();
+        }
+        else if (m_player && !wasInEar && nowInEar && !m_player->isPlaying())
+        {
+            m_resume.start();
+        }
+
+        QByteArray packet = AirPodsPackets::Parse::EAR_DETECTION;
+        packet.append(char(primary)).append(char(secondary));
+        send(packet);
+    }
+
+    void toggleEar()
+    {
+        if (m_primary == Sim::IN_EAR && m_secondary == Sim::IN_EAR)
+        {
+            const bool both = !m_options.randomise || std::bernoulli_distribution(0.5)(m_random);
+            const bool primaryOut = both || std::bernoulli_distribution(0.5)(m_random);
+            sendEar(primaryOut ? Sim::OUT_OF_EAR : Sim::IN_EAR, (both || !primaryOut) ? Sim::OUT_OF_EAR : Sim::IN_EAR);
+        }
+        else
+        {
+            sendEar(Sim::IN_EAR, Sim::IN_EAR);
+        }
+        m_earTimer->start(nextInterval(m_options.earIntervalMs));
+    }
+
+    // Someone starts talking: volume levels ramp down, hold, then come back up
+    void sendConversationBurst()
+    {
+        static const quint8 levels[] = {0x01, 0x02, 0x02, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+        constexpr int steps = sizeof(levels) / sizeof(levels[0]);
+
+        QByteArray packet = AirPodsPackets::ConversationalAwareness::DATA_HEADER;
+        packet.append(char(levels[m_caBurstStep]));
+        send(packet);
+
+        if (++m_caBurstStep < steps)
+        {
+            m_caTimer->start(100);
+        }
+        else
+        {
+            m_caBurstStep = 0;
+            if (m_options.caIntervalMs > 0)
+            {
+                m_caTimer->start(nextInterval(m_options.caIntervalMs));
+            }
+        }
+    }
+
+    void startHeadTracking()
+    {
+        const int hz = m_options.headTrackingHz > 0 ? m_options.headTrackingHz : 50;
+        m_headTrackingTimer->start(std::max(1, 1000 / hz));
+    }
+
+    void sendHeadTracking()
+    {
+        QByteArray packet(Sim::HEAD_TRACKING_PACKET_BYTES, '\0');
+        std::memcpy(packet.data(), Sim::HEAD_TRACKING_HEADER.constData(), Sim::HEAD_TRACKING_HEADER.size());
+
+        // Slow head turn, enough to see movement in a plot
+        const double phase = m_headTrackingSamples++ * 0.05;
+        const qint16 values[] = {qint16(std::sin(phase) * 8000), qint16(std::cos(phase) * 8000), qint16(std::sin(phase / 2) * 4000)};
+        for (int i = 0; i < 3; ++i)
+        {
+            qToLittleEndian(values[i], packet.data() + 43 + 2 * i);
+        }
+        qToLittleEndian(qint16(std::sin(phase * 3) * 500), packet.data() + 51);
+        qToLittleEndian(qint16(std::cos(phase * 3) * 500), packet.data() + 53);
+        send(packet);
+    }
+
+    // Script lines: "<delay ms> <command> [args]", '#' starts a comment.
+    //   ear <in|out|case> <in|out|case>   battery <percent>   noise <1-4>
+    //   ca <level>   ca-burst   head-tracking <on|off>   raw <hex>
+    void loadScript()
+    {
+        m_script.clear();
+        QFile file(m_options.scriptPath);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            LOG_ERROR("Cannot open script " << m_options.scriptPath);
+            return;
+        }
+        QTextStream stream(&file);
+        while (!stream.atEnd())
+        {
+            const QString line = stream.readLine().section('#', 0, 0).trimmed();
+            if (!line.isEmpty())
+            {
+                m_script.append(line.split(' ', Qt::SkipEmptyParts));
+            }
+        }
+    }
+
+    void scheduleScriptStep()
+    {
+        if (m_scriptIndex >= m_script.size())
+        {
+            if (!m_options.loopScript || m_script.isEmpty())
+            {
+                return;
+            }
+            m_scriptIndex = 0;
+        }
+        m_scriptTimer->start(m_script.at(m_scriptIndex).value(0).toInt());
+    }
+
+    static quint8 podState(const QString &word)
+    {
+        return word == "in" ? Sim::IN_EAR : word == "case" ? Sim::IN_CASE : Sim::OUT_OF_EAR;
+    }
+
+    void runScriptStep()
+    {
+        const QStringList step = m_script.at(m_scriptIndex++);
+        const QString command = step.value(1);
+
+        if (command == "ear")
+        {
+            sendEar(podState(step.value(2)), podState(step.value(3)));
+        }
+        else if (command == "battery")
+        {
+            m_batteryLevel = qBound(0, step.value(2).toInt(), 100);
+            sendBattery();
+        }
+        else if (command == "noise")
+        {
+            send(ControlCommand::createCommand(0x0D, quint8(step.value(2).toInt())));
+        }
+        else if (command == "ca")
+        {
+            QByteArray packet = AirPodsPackets::ConversationalAwareness::DATA_HEADER;
+            packet.append(char(step.value(2).toInt()));
+            send(packet);
+        }
+        else if (command == "ca-burst")
+        {
+            m_caBurstStep = 0;
+            sendConversationBurst();
+        }
+        else if (command == "head-tracking")
+        {
+            if (step.value(2) == "on")
+            {
+                startHeadTracking();
+            }
+            else
+            {
+                m_headTrackingTimer->stop();
+            }
+        }
+        else if (command == "raw")
+        {
+            send(QByteArray::fromHex(step.mid(2).join("").toLatin1()));
+        }
+        else
+        {
+            LOG_WARN("Unknown script command: " << step.join(' '));
+        }
+
+        scheduleScriptStep();
+    }
+
+    Options m_options;
+    std::mt19937 m_random;
+    QString m_path;
+    int m_listenFd = -1;
+    Transport *m_link = nullptr;
+    FakeMprisPlayer *m_player = nullptr;
+
+    QTimer *m_batteryTimer;
+    QTimer *m_earTimer;
+    QTimer *m_caTimer;
+    QTimer *m_scriptTimer;
+    QTimer *m_headTrackingTimer;
+
+    quint8 m_primary = Sim::IN_EAR;
+    quint8 m_secondary = Sim::IN_EAR;
+    int m_batteryLevel = 100;
+    quint64 m_batterySends = 0;
+    int m_caBurstStep = 0;
+    quint64 m_headTrackingSamples = 0;
+    QList<QStringList> m_script;
+    int m_scriptIndex = 0;
+
+    QElapsedTimer m_phase;
+    qint64 m_handshakeNs = 0;
+    qint64 m_featuresNs = 0;
+    qint64 m_notificationsNs = 0;
+    quint64 m_packetsSent = 0;
+    quint64 m_packetsReceived = 0;
+    Reaction m_pause{"pause latency"};
+    Reaction m_resume{"resume latency"};
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("airpodssim");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulated AirPods for librepods (run the app with LIBREPODS_TRANSPORT=sim)");
+    parser.addHelpOption();
+    parser.addOption({"socket", "Socket to listen on.", "path", Transports::simulatorSocketPath("airpods")});
+    parser.addOption({"battery-interval", "Milliseconds between battery notifications.", "ms", "5000"});
+    parser.addOption({"ear-interval", "Milliseconds between ear detection changes, 0 to disable.", "ms", "0"});
+    parser.addOption({"ca-interval", "Milliseconds between conversational awareness bursts, 0 to disable.", "ms", "0"});
+    parser.addOption({"head-tracking", "Stream head tracking data even if the app does not ask for it."});
+    parser.addOption({"head-tracking-rate", "Head tracking packets per second.", "hz", "50"});
+    parser.addOption({"random", "Randomise intervals and ear changes with this seed.", "seed"});
+    parser.addOption({"script", "Play events from a script file.", "file"});
+    parser.addOption({"loop", "Repeat the script."});
+    parser.addOption({"no-mpris", "Do not register the fake MPRIS player."});
+    parser.addOption({"duration", "Exit and print the report after this many seconds.", "seconds", "0"});
+    parser.addOption({"debug", "Log every packet."});
+    parser.process(app);
+
+    QLoggingCategory::setFilterRules(QString("librepods.debug=%1").arg(parser.isSet("debug") ? "true" : "false"));
+
+    AirPodsSimulator::Options options;
+    options.batteryIntervalMs = std::max(1, parser.value("battery-interval").toInt());
+    options.earIntervalMs = std::max(0, parser.value("ear-interval").toInt());
+    options.caIntervalMs = std::max(0, parser.value("ca-interval").toInt());
+    options.forceHeadTracking = parser.isSet("head-tracking");
+    options.headTrackingHz = std::max(1, parser.value("head-tracking-rate").toInt());
+    options.randomise = parser.isSet("random");
+    options.seed = parser.value("random").toUInt();
+    options.scriptPath = parser.value("script");
+    options.loopScript = parser.isSet("loop");
+
+    AirPodsSimulator simulator(options);
+    if (!simulator.listen(parser.value("socket")))
+    {
+        return 1;
+    }
+
+    QObject mprisRoot;
+    if (!parser.isSet("no-mpris"))
+    {
+        FakeMprisPlayer *player = new FakeMprisPlayer(&mprisRoot);
+        QDBusConnection bus = QDBusConnection::sessionBus();
+        if (bus.registerObject("/org/mpris/MediaPlayer2", &mprisRoot, QDBusConnection::ExportAdaptors) &&
+            bus.registerService("org.mpris.MediaPlayer2.librepods_sim"))
+        {
+            simulator.attachPlayer(player);
+        }
+        else
+        {
+            LOG_WARN("Could not register the fake MPRIS player, pause latency will not be measured");
+        }
+    }
+
+    // Ctrl+C prints the report instead of just killing the process
+    if (::pipe2(signalPipe, O_CLOEXEC) == 0)
+    {
+        QSocketNotifier *notifier = new QSocketNotifier(signalPipe[0], QSocketNotifier::Read, &app);
+        QObject::connect(notifier, &QSocketNotifier::activated, &app, &QCoreApplication::quit);
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+    }
+
+    if (const int duration = parser.value("duration").toInt(); duration > 0)
+    {
+        QTimer::singleShot(duration * 1000, &app, &QCoreApplication::quit);
+    }
+
+    app.exec();
+    simulator.printReport();
+    return 0;
+}
+
+#include "airpodssim.moc"
@@ -0,0 +1,477 @@
+// fakebluez: a stand-in for the parts of BlueZ the advertisement monitor talks to.
+//
+// Owns org.bluez on the session bus and exports /org/bluez/hci0 with an
+// AdvertisementMonitorManager1. A monitor that registers is enumerated and activated the
+// way bluetoothd does it, then fed Apple proximity pairing advertisements from fake
+// devices: DeviceFound() once per device, then Device1 PropertiesChanged with new RSSI and
+// manufacturer data. It can also release the monitor, restart as if bluetoothd had been
+// restarted (announcing the adapter again with InterfacesAdded), reject registrations or
+// claim no or_patterns support, and reports how long the app took to register again.
+//
+// Start it first, then the app with LIBREPODS_BLE_MONITOR_BUS=session.
+
+#include "logger.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusAbstractAdaptor>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusObjectPath>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusVariant>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(librepods, "librepods")
+
+typedef QMap<quint16, QDBusVariant> ManufacturerDataMap;
+typedef QMap<QDBusObjectPath, QMap<QString, QVariantMap>> ManagedObjectList;
+Q_DECLARE_METATYPE(ManufacturerDataMap)
+Q_DECLARE_METATYPE(ManagedObjectList)
+
+namespace
+{
+    const QString SERVICE = QStringLiteral("org.bluez");
+    const QString ADAPTER_PATH = QStringLiteral("/org/bluez/hci0");
+    const QString MANAGER_INTERFACE = QStringLiteral("org.bluez.AdvertisementMonitorManager1");
+    const QString MONITOR_INTERFACE = QStringLiteral("org.bluez.AdvertisementMonitor1");
+    const QString DEVICE_INTERFACE = QStringLiteral("org.bluez.Device1");
+    const QString PROPERTIES_INTERFACE = QStringLiteral("org.freedesktop.DBus.Properties");
+    const QString OBJECT_MANAGER_INTERFACE = QStringLiteral("org.freedesktop.DBus.ObjectManager");
+    constexpr quint16 APPLE_COMPANY_ID = 0x004C;
+
+    int signalPipe[2] = {-1, -1};
+
+    QString byteHex(int value)
+    {
+        return QStringLiteral("%1").arg(value & 0xFF, 2, 16, QLatin1Char('0')).toUpper();
+    }
+
+    void onSignal(int)
+    {
+        const char byte = 1;
+        [[maybe_unused]] const ssize_t written = ::write(signalPipe[1], &byte, 1);
+    }
+}
+
+class FakeBluez;
+
+class ManagerAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.bluez.AdvertisementMonitorManager1")
+    Q_PROPERTY(QStringList SupportedMonitorTypes READ supportedMonitorTypes)
+public:
+    ManagerAdaptor(QObject *adapter, FakeBluez *bluez) : QDBusAbstractAdaptor(adapter), m_bluez(bluez) {}
+    QStringList supportedMonitorTypes() const;
+
+public slots:
+    void RegisterMonitor(const QDBusObjectPath &application, const QDBusMessage &message);
+    void UnregisterMonitor(const QDBusObjectPath &application, const QDBusMessage &message);
+
+private:
+    FakeBluez *m_bluez;
+};
+
+class DeviceAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.bluez.Device1")
+    Q_PROPERTY(QString Address MEMBER address)
+    Q_PROPERTY(QString Alias MEMBER alias)
+    Q_PROPERTY(qint16 RSSI MEMBER rssi)
+    Q_PROPERTY(ManufacturerDataMap ManufacturerData MEMBER manufacturerData)
+public:
+    explicit DeviceAdaptor(QObject *device) : QDBusAbstractAdaptor(device) {}
+
+    QString address;
+    QString alias;
+    qint16 rssi = -60;
+    ManufacturerDataMap manufacturerData;
+};
+
+class FakeBluez : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        int devices = 1;
+        int intervalMs = 1000;
+        int releaseAfterMs = 0;
+        int restartAfterMs = 0;
+        int restartGapMs = 2000;
+        bool reject = false;
+        bool noOrPatterns = false;
+        quint32 seed = 1;
+    };
+
+    explicit FakeBluez(const Options &options)
+        : m_options(options), m_bus(QDBusConnection::sessionBus()), m_random(options.seed)
+    {
+        m_advertiseTimer = new QTimer(this);
+        m_advertiseTimer->setInterval(m_options.intervalMs);
+        connect(m_advertiseTimer, &QTimer::timeout, this, &FakeBluez::advertise);
+    }
+
+    bool start()
+    {
+        if (!m_bus.isConnected())
+        {
+            LOG_ERROR("No session bus");
+            return false;
+        }
+        if (!exportAdapter())
+        {
+            return false;
+        }
+        if (m_options.releaseAfterMs > 0)
+        {
+            QTimer::singleShot(m_options.releaseAfterMs, this, &FakeBluez::releaseMonitor);
+        }
+        if (m_options.restartAfterMs > 0)
+        {
+            QTimer::singleShot(m_options.restartAfterMs, this, &FakeBluez::restart);
+        }
+        LOG_INFO("Fake BlueZ ready on the session bus, adapter " << ADAPTER_PATH);
+        return true;
+    }
+
+    QStringList supportedMonitorTypes() const
+    {
+        return m_options.noOrPatterns ? QStringList() : QStringList{QStringLiteral("or_patterns")};
+    }
+
+    void registerMonitor(const QDBusObjectPath &application, const QDBusMessage &message)
+    {
+        ++m_registrations;
+        if (m_options.reject)
+        {
+            ++m_rejections;
+            LOG_INFO("Rejecting RegisterMonitor from " << message.service());
+            message.setDelayedReply(true);
+            m_bus.send(message.createErrorReply(QStringLiteral("org.bluez.Error.Failed"), QStringLiteral("Rejected by fakebluez")));
+            return;
+        }
+        if (m_lostTimer.isValid())
+        {
+            const qint64 ms = m_lostTimer.elapsed();
+            m_reregisterMs.push_back(ms);
+            m_lostTimer.invalidate();
+            LOG_INFO("Monitor registered again " << ms << " ms after it was lost");
+        }
+        m_appService = message.service();
+        m_appPath = application.path();
+        LOG_INFO("RegisterMonitor " << m_appPath << " from " << m_appService);
+
+        // bluetoothd reads the monitors from the application's object manager, then activates them
+        QDBusMessage getObjects = QDBusMessage::createMethodCall(m_appService, m_appPath, OBJECT_MANAGER_INTERFACE, "GetManagedObjects");
+        auto *watcher = new QDBusPendingCallWatcher(m_bus.asyncCall(getObjects), this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *call)
+        {
+            call->deleteLater();
+            QDBusPendingReply<ManagedObjectList> reply = *call;
+            if (reply.isError())
+            {
+                LOG_ERROR("GetManagedObjects failed: " << reply.error().message());
+                return;
+            }
+            const ManagedObjectList objects = reply.value();
+            for (auto it = objects.constBegin(); it != objects.constEnd(); ++it)
+            {
+                const QVariantMap properties = it.value().value(MONITOR_INTERFACE);
+                if (properties.value("Type").toString() != QStringLiteral("or_patterns"))
+                {
+                    continue;
+                }
+                m_monitorPath = it.key().path();
+                ++m_activations;
+                LOG_INFO("Activating monitor " << m_monitorPath);
+                callMonitor("Activate");
+                m_announced.clear();
+                m_advertiseTimer->start();
+                return;
+            }
+            LOG_WARN("The application has no or_patterns monitor");
+        });
+    }
+
+    void unregisterMonitor(const QDBusObjectPath &application)
+    {
+        if (application.path() != m_appPath)
+        {
+            return;
+        }
+        LOG_INFO("UnregisterMonitor " << m_appPath);
+        forgetMonitor();
+    }
+
+    void printReport() const
+    {
+        std::printf("registrations: %d (rejected %d), activations: %d\n", m_registrations, m_rejections, m_activations);
+        std::printf("releases sent: %d, restarts: %d, advertisements sent: %d\n", m_releases, m_restarts, m_advertisements);
+        for (qint64 ms : m_reregisterMs)
+        {
+            std::printf("registered again after: %lld ms\n", static_cast<long long>(ms));
+        }
+        if (m_lostTimer.isValid())
+        {
+            std::printf("not registered again for %lld ms\n", static_cast<long long>(m_lostTimer.elapsed()));
+        }
+    }
+
+private:
+    bool exportAdapter()
+    {
+        m_adapter = new QObject(this);
+        new ManagerAdaptor(m_adapter, this);
+        if (!m_bus.registerObject(ADAPTER_PATH, m_adapter, QDBusConnection::ExportAdaptors))
+        {
+            LOG_ERROR("Cannot export " << ADAPTER_PATH << ": " << m_bus.lastError().message());
+            return false;
+        }
+        if (!m_bus.registerService(SERVICE))
+        {
+            LOG_ERROR("Cannot own " << SERVICE << " on the session bus: " << m_bus.lastError().message());
+            return false;
+        }
+        return true;
+    }
+
+    void callMonitor(const char *method, const QVariantList &arguments = QVariantList())
+    {
+        QDBusMessage call = QDBusMessage::createMethodCall(m_appService, m_monitorPath, MONITOR_INTERFACE, method);
+        call.setArguments(arguments);
+        m_bus.asyncCall(call);
+    }
+
+    void forgetMonitor()
+    {
+        m_advertiseTimer->stop();
+        m_appService.clear();
+        m_appPath.clear();
+        m_monitorPath.clear();
+    }
+
+    void advertise()
+    {
+        if (m_monitorPath.isEmpty())
+        {
+            return;
+        }
+        for (int i = 0; i < m_options.devices; ++i)
+        {
+            const QString path = QStringLiteral("%1/dev_F0_00_00_00_00_%2").arg(ADAPTER_PATH, byteHex(i));
+            DeviceAdaptor *device = deviceAt(path, i);
+            device->rssi = static_cast<qint16>(std::clamp(device->rssi + static_cast<int>(m_random() % 7) - 3, -95, -40));
+            device->manufacturerData[APPLE_COMPANY_ID] = QDBusVariant(proximityPairing());
+            ++m_advertisements;
+
+            if (!m_announced.contains(path))
+            {
+                // The matching advertisement is already in the properties when bluetoothd reports the device
+                m_announced.append(path);
+                callMonitor("DeviceFound", {QVariant::fromValue(QDBusObjectPath(path))});
+                continue;
+            }
+            QVariantMap changed;
+            changed.insert("RSSI", QVariant::fromValue(device->rssi));
+            changed.insert("ManufacturerData", QVariant::fromValue(device->manufacturerData));
+            QDBusMessage signal = QDBusMessage::createSignal(path, PROPERTIES_INTERFACE, "PropertiesChanged");
+            signal << DEVICE_INTERFACE << changed << QStringList();
+            m_bus.send(signal);
+        }
+    }
+
+    DeviceAdaptor *deviceAt(const QString &path, int index)
+    {
+        if (QObject *object = m_devices.value(path))
+        {
+            return object->findChild<DeviceAdaptor *>();
+        }
+        QObject *object = new QObject(this);
+        DeviceAdaptor *device = new DeviceAdaptor(object);
+        device->address = QStringLiteral("F0:00:00:00:00:%1").arg(byteHex(index));
+        device->alias = QStringLiteral("Fake AirPods %1").arg(index + 1);
+        m_bus.registerObject(path, object, QDBusConnection::ExportAdaptors);
+        m_devices.insert(path, object);
+        return device;
+    }
+
+    // Paired AirPods Pro 2, lid open, not connected to anything; the last 16 bytes are the encrypted part
+    QByteArray proximityPairing()
+    {
+        QByteArray data = QByteArray::fromHex("07190114202b888f310000");
+        const quint8 battery = static_cast<quint8>(m_random() % 10);
+        data[6] = static_cast<char>(battery << 4 | battery);
+        for (int i = 0; i < 16; ++i)
+        {
+            data.append(static_cast<char>(m_random() & 0xFF));
+        }
+        return data;
+    }
+
+    void releaseMonitor()
+    {
+        if (m_monitorPath.isEmpty())
+        {
+            LOG_WARN("No monitor to release");
+            return;
+        }
+        ++m_releases;
+        LOG_INFO("Releasing monitor " << m_monitorPath);
+        callMonitor("Release");
+        forgetMonitor();
+        m_lostTimer.start();
+    }
+
+    // Like bluetoothd going away and coming back: every registration is gone, without a Release
+    void restart()
+    {
+        ++m_restarts;
+        LOG_INFO("Restarting, back in " << m_options.restartGapMs << " ms");
+        const bool hadMonitor = !m_monitorPath.isEmpty();
+        forgetMonitor();
+        m_bus.unregisterService(SERVICE);
+        m_bus.unregisterObject(ADAPTER_PATH);
+        for (auto it = m_devices.constBegin(); it != m_devices.constEnd(); ++it)
+        {
+            m_bus.unregisterObject(it.key());
+            it.value()->deleteLater();
+        }
+        m_devices.clear();
+        delete m_adapter;
+        if (hadMonitor)
+        {
+            m_lostTimer.start();
+        }
+
+        QTimer::singleShot(m_options.restartGapMs, this, [this]()
+        {
+            if (!exportAdapter())
+            {
+                QCoreApplication::exit(1);
+                return;
+            }
+            QVariantMap manager;
+            manager.insert("SupportedMonitorTypes", supportedMonitorTypes());
+            QMap<QString, QVariantMap> interfaces;
+            interfaces.insert(MANAGER_INTERFACE, manager);
+            QDBusMessage signal = QDBusMessage::createSignal(QStringLiteral("/"), OBJECT_MANAGER_INTERFACE, "InterfacesAdded");
+            signal << QVariant::fromValue(QDBusObjectPath(ADAPTER_PATH)) << QVariant::fromValue(interfaces);
+            m_bus.send(signal);
+            LOG_INFO("Back, announced " << ADAPTER_PATH);
+        });
+    }
+
+    Options m_options;
+    QDBusConnection m_bus;
+    std::mt19937 m_random;
+    QObject *m_adapter = nullptr;
+    QTimer *m_advertiseTimer = nullptr;
+    QString m_appService;
+    QString m_appPath;
+    QString m_monitorPath;
+    QHash<QString, QObject *> m_devices;
+    QStringList m_announced; // Devices reported with DeviceFound() to the current monitor
+    QElapsedTimer m_lostTimer; // Since the monitor was released or the restart
+    std::vector<qint64> m_reregisterMs;
+    int m_registrations = 0;
+    int m_rejections = 0;
+    int m_activations = 0;
+    int m_releases = 0;
+    int m_restarts = 0;
+    int m_advertisements = 0;
+};
+
+QStringList ManagerAdaptor::supportedMonitorTypes() const
+{
+    return m_bluez->supportedMonitorTypes();
+}
+
+void ManagerAdaptor::RegisterMonitor(const QDBusObjectPath &application, const QDBusMessage &message)
+{
+    m_bluez->registerMonitor(application, message);
+}
+
+void ManagerAdaptor::UnregisterMonitor(const QDBusObjectPath &application, const QDBusMessage &)
+{
+    m_bluez->unregisterMonitor(application);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("fakebluez");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Stand-in BlueZ advertisement monitor manager (run the app with LIBREPODS_BLE_MONITOR_BUS=session)");
+    parser.addHelpOption();
+    parser.addOption({"devices", "Number of fake AirPods advertising.", "count", "1"});
+    parser.addOption({"interval", "Milliseconds between advertisements of each device.", "ms", "1000"});
+    parser.addOption({"release-after", "Release the monitor after this many milliseconds, 0 to never.", "ms", "0"});
+    parser.addOption({"restart-after", "Restart as if bluetoothd was restarted after this many milliseconds, 0 to never.", "ms", "0"});
+    parser.addOption({"restart-gap", "Milliseconds the restart leaves the adapter away.", "ms", "2000"});
+    parser.addOption({"reject", "Reject every RegisterMonitor call."});
+    parser.addOption({"no-or-patterns", "Claim that or_patterns monitors are not supported."});
+    parser.addOption({"seed", "Seed for RSSI and battery values.", "seed", "1"});
+    parser.addOption({"duration", "Exit and print the report after this many seconds.", "seconds", "0"});
+    parser.addOption({"debug", "Log every call."});
+    parser.process(app);
+
+    QLoggingCategory::setFilterRules(QString("librepods.debug=%1").arg(parser.isSet("debug") ? "true" : "false"));
+    qDBusRegisterMetaType<ManufacturerDataMap>();
+    qDBusRegisterMetaType<ManagedObjectList>();
+    qDBusRegisterMetaType<QMap<QString, QVariantMap>>();
+
+    FakeBluez::Options options;
+    options.devices = std::max(1, parser.value("devices").toInt());
+    options.intervalMs = std::max(10, parser.value("interval").toInt());
+    options.releaseAfterMs = std::max(0, parser.value("release-after").toInt());
+    options.restartAfterMs = std::max(0, parser.value("restart-after").toInt());
+    options.restartGapMs = std::max(0, parser.value("restart-gap").toInt());
+    options.reject = parser.isSet("reject");
+    options.noOrPatterns = parser.isSet("no-or-patterns");
+    options.seed = parser.value("seed").toUInt();
+
+    FakeBluez bluez(options);
+    if (!bluez.start())
+    {
+        return 1;
+    }
+
+    // Ctrl+C prints the report instead of just killing the process
+    if (::pipe2(signalPipe, O_CLOEXEC) == 0)
+    {
+        QSocketNotifier *notifier = new QSocketNotifier(signalPipe[0], QSocketNotifier::Read, &app);
+        QObject::connect(notifier, &QSocketNotifier::activated, &app, &QCoreApplication::quit);
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+    }
+
+    if (const int duration = parser.value("duration").toInt(); duration > 0)
+    {
+        QTimer::singleShot(duration * 1000, &app, &QCoreApplication::quit);
+    }
+
+    app.exec();
+    bluez.printReport();
+    return 0;
+}
+
+#include "fakebluez.moc"
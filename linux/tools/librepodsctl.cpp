@@ -0,0 +1,268 @@
+// librepodsctl: command-line client for a running librepods, over its local control socket.
+// Plain POSIX, no Qt, so a hotkey binding costs a fork/exec and one round trip.
+//
+//   librepodsctl state
+//   librepodsctl anc off|nc|transparency|adaptive
+//   librepodsctl ca on|off
+//   librepodsctl adaptive <0-100>
+//   librepodsctl rename <name>
+//   librepodsctl watch
+//   librepodsctl open
+//   librepodsctl metrics
+
+#include "control/controlprotocol.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using ControlProtocol::MessageType;
+
+namespace
+{
+    void usage()
+    {
+        std::fprintf(stderr,
+                     "Usage: librepodsctl <command> [argument]\n"
+                     "\n"
+                     "Commands:\n"
+                     "  state                                 Print the current device state\n"
+                     "  anc off|nc|transparency|adaptive      Set the noise control mode\n"
+                     "  ca on|off                             Toggle conversational awareness\n"
+                     "  adaptive <0-100>                      Set the adaptive noise level\n"
+                     "  rename <name>                         Rename the AirPods\n"
+                     "  watch                                 Print the state, then every change\n"
+                     "  open                                  Open the librepods window\n"
+                     "  metrics                               Print the metrics snapshot\n");
+    }
+
+    int connectToServer()
+    {
+        const std::string path = ControlProtocol::socketPath();
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            std::fprintf(stderr, "librepodsctl: socket path too long: %s\n", path.c_str());
+            return -1;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            std::fprintf(stderr, "librepodsctl: librepods is not running (%s: %s)\n", path.c_str(), std::strerror(errno));
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            return -1;
+        }
+        return fd;
+    }
+
+    bool sendAll(int fd, const std::string &data)
+    {
+        std::size_t sent = 0;
+        while (sent < data.size())
+        {
+            const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool receive(int fd, ControlProtocol::FrameReader &reader, MessageType &type, std::string &payload)
+    {
+        char buffer[4096];
+        bool error = false;
+        while (!reader.next(type, payload, error))
+        {
+            if (error)
+            {
+                std::fprintf(stderr, "librepodsctl: malformed response\n");
+                return false;
+            }
+            const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            reader.append(buffer, static_cast<std::size_t>(n));
+        }
+        return true;
+    }
+
+    void printFields(const std::string &payload, const char *prefix)
+    {
+        ControlProtocol::decodeFields(payload, [prefix](const std::string &key, const ControlProtocol::Value &value)
+                                      {
+            std::printf("%s%s=", prefix, key.c_str());
+            if (const bool *b = std::get_if<bool>(&value)) {
+                std::printf("%s\n", *b ? "true" : "false");
+            } else if (const int32_t *i = std::get_if<int32_t>(&value)) {
+                std::printf("%d\n", *i);
+            } else {
+                std::printf("%s\n", std::get<std::string>(value).c_str());
+            } });
+        std::fflush(stdout);
+    }
+
+    bool parseByte(const char *text, int min, int max, uint8_t &out)
+    {
+        char *end = nullptr;
+        const long value = std::strtol(text, &end, 10);
+        if (!*text || *end || value < min || value > max)
+        {
+            return false;
+        }
+        out = static_cast<uint8_t>(value);
+        return true;
+    }
+
+    bool buildRequest(int argc, char *argv[], std::string &request, bool &watch)
+    {
+        const std::string command = argv[1];
+        const char *argument = argc > 2 ? argv[2] : nullptr;
+        watch = false;
+
+        if (command == "state" && !argument)
+        {
+            request = ControlProtocol::encodeFrame(MessageType::GetState);
+        }
+        else if (command == "watch" && !argument)
+        {
+            request = ControlProtocol::encodeFrame(MessageType::Subscribe);
+            watch = true;
+        }
+        else if (command == "open" && !argument)
+        {
+            request = ControlProtocol::encodeFrame(MessageType::Reopen);
+        }
+        else if (command == "metrics" && !argument)
+        {
+            request = ControlProtocol::encodeFrame(MessageType::GetMetrics);
+        }
+        else if (command == "anc" && argument)
+        {
+            static const char *const modes[] = {"off", "nc", "transparency", "adaptive"};
+            uint8_t mode = 0xFF;
+            for (uint8_t i = 0; i < 4; ++i)
+            {
+                if (std::strcmp(argument, modes[i]) == 0)
+                {
+                    mode = i;
+                }
+            }
+            if (mode == 0xFF && !parseByte(argument, 0, 3, mode))
+            {
+                return false;
+            }
+            request = ControlProtocol::encodeFrame(MessageType::SetNoiseControlMode, std::string(1, static_cast<char>(mode)));
+        }
+        else if (command == "ca" && argument && (std::strcmp(argument, "on") == 0 || std::strcmp(argument, "off") == 0))
+        {
+            const char enabled = std::strcmp(argument, "on") == 0 ? 1 : 0;
+            request = ControlProtocol::encodeFrame(MessageType::SetConversationalAwareness, std::string(1, enabled));
+        }
+        else if (command == "adaptive" && argument)
+        {
+            uint8_t level;
+            if (!parseByte(argument, 0, 100, level))
+            {
+                return false;
+            }
+            request = ControlProtocol::encodeFrame(MessageType::SetAdaptiveNoiseLevel, std::string(1, static_cast<char>(level)));
+        }
+        else if (command == "rename" && argument && *argument)
+        {
+            request = ControlProtocol::encodeFrame(MessageType::Rename, argument);
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string request;
+    bool watch = false;
+    if (argc < 2 || argc > 3 || !buildRequest(argc, argv, request, watch))
+    {
+        usage();
+        return 2;
+    }
+
+    const int fd = connectToServer();
+    if (fd < 0)
+    {
+        return 1;
+    }
+    if (!sendAll(fd, request))
+    {
+        std::fprintf(stderr, "librepodsctl: %s\n", std::strerror(errno));
+        ::close(fd);
+        return 1;
+    }
+
+    ControlProtocol::FrameReader reader;
+    MessageType type;
+    std::string payload;
+    int status = 1;
+    while (receive(fd, reader, type, payload))
+    {
+        switch (type)
+        {
+        case MessageType::Ok:
+            status = 0;
+            break;
+        case MessageType::Error:
+            std::fprintf(stderr, "librepodsctl: %s\n", payload.c_str());
+            status = 1;
+            break;
+        case MessageType::State:
+            printFields(payload, "");
+            status = 0;
+            break;
+        case MessageType::Event:
+            printFields(payload, "changed ");
+            break;
+        case MessageType::TextPart:
+            std::fwrite(payload.data(), 1, payload.size(), stdout);
+            continue; // The rest follows
+        case MessageType::Text:
+            std::fwrite(payload.data(), 1, payload.size(), stdout);
+            status = 0;
+            break;
+        default:
+            break;
+        }
+        if (!watch)
+        {
+            break;
+        }
+    }
+
+    ::close(fd);
+    return status;
+}
@@ -0,0 +1,278 @@
+// relaybench: drives synthetic AACP traffic through RelayEngine over local stand-ins
+// for the AirPods and phone L2CAP channels, and reports end-to-end relay latency and
+// throughput. Both ends are SOCK_SEQPACKET socketpairs, so packet boundaries behave
+// like L2CAP; the relay itself runs unmodified on this thread's event loop.
+//
+//   relaybench [--direction to-phone|to-airpods] [--rate 1000] [--duration 5] [--size 32] [--no-phone]
+
+#include "io/relayengine.h"
+#include "io/localtransport.h"
+#include "airpods_packets.h"
+#include "logger.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+Q_LOGGING_CATEGORY(librepods, "librepods")
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        bool toPhone = true;
+        bool phoneAbsent = false;
+        int rate = 1000;      // packets per second, 0 = as fast as possible
+        int durationSec = 5;
+        int size = 32;        // AACP packet size, without the relay header
+    };
+
+    // Synthetic AACP packet: battery status header, then sequence number and send timestamp
+    constexpr int SEQ_BYTES = 8;
+    constexpr int STAMP_BYTES = 8;
+
+    qint64 nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    double percentile(const std::vector<qint64> &sorted, double p)
+    {
+        if (sorted.empty())
+        {
+            return 0.0;
+        }
+        const std::size_t index = static_cast<std::size_t>(std::ceil(p * sorted.size())) - 1;
+        return sorted[std::min(index, sorted.size() - 1)] / 1000.0;
+    }
+
+    void generate(int fd, const QByteArray &prefix, const Options &options, quint64 total,
+                  std::atomic<bool> &stop, std::atomic<qint64> &firstSendNs, std::atomic<quint64> &sent)
+    {
+        const QByteArray &header = AirPodsPackets::Parse::BATTERY_STATUS;
+        const int stampOffset = prefix.size() + header.size() + SEQ_BYTES;
+
+        QByteArray packet(prefix.size() + std::max<int>(options.size, header.size() + SEQ_BYTES + STAMP_BYTES), '\0');
+        std::memcpy(packet.data(), prefix.constData(), prefix.size());
+        std::memcpy(packet.data() + prefix.size(), header.constData(), header.size());
+
+        const auto interval = options.rate > 0 ? std::chrono::nanoseconds(1000000000LL / options.rate)
+                                               : std::chrono::nanoseconds(0);
+        auto next = Clock::now();
+        firstSendNs.store(nowNs());
+
+        for (quint64 seq = 0; seq < total && !stop.load(std::memory_order_relaxed); ++seq)
+        {
+            if (interval.count() > 0)
+            {
+                std::this_thread::sleep_until(next);
+                next += interval;
+            }
+            const qint64 stamp = nowNs();
+            std::memcpy(packet.data() + prefix.size() + header.size(), &seq, SEQ_BYTES);
+            std::memcpy(packet.data() + stampOffset, &stamp, STAMP_BYTES);
+            if (::send(fd, packet.constData(), packet.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(packet.size()))
+            {
+                break;
+            }
+            sent.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void sink(int fd, const QByteArray &prefix, quint64 total, std::vector<qint64> &latencies,
+              std::atomic<qint64> &lastReceiveNs)
+    {
+        const int stampOffset = prefix.size() + AirPodsPackets::Parse::BATTERY_STATUS.size() + SEQ_BYTES;
+        QByteArray buffer(64 * 1024, '\0');
+
+        while (latencies.size() < total)
+        {
+            const ssize_t received = ::recv(fd, buffer.data(), buffer.size(), 0);
+            if (received <= 0)
+            {
+                break;
+            }
+            const qint64 now = nowNs();
+            if (received < stampOffset + STAMP_BYTES || std::memcmp(buffer.constData(), prefix.constData(), prefix.size()) != 0)
+            {
+                continue; // Not one of ours, e.g. a control packet from the relay
+            }
+            qint64 stamp;
+            std::memcpy(&stamp, buffer.constData() + stampOffset, STAMP_BYTES);
+            latencies.push_back(now - stamp);
+            lastReceiveNs.store(now, std::memory_order_relaxed);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("relaybench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Relay latency and throughput benchmark");
+    parser.addHelpOption();
+    parser.addOption({"direction", "to-phone (default) or to-airpods.", "direction", "to-phone"});
+    parser.addOption({"rate", "Packets per second, 0 for as fast as possible.", "pps", "1000"});
+    parser.addOption({"duration", "Seconds of traffic.", "seconds", "5"});
+    parser.addOption({"size", "AACP packet size in bytes.", "bytes", "32"});
+    parser.addOption({"no-phone", "Leave the phone side unreachable and count reconnect attempts."});
+    parser.addOption({"debug", "Enable relay debug logging."});
+    parser.process(app);
+
+    Options options;
+    options.toPhone = parser.value("direction") != "to-airpods";
+    options.phoneAbsent = parser.isSet("no-phone");
+    options.rate = std::max(0, parser.value("rate").toInt());
+    options.durationSec = std::max(1, parser.value("duration").toInt());
+    options.size = parser.value("size").toInt();
+    QLoggingCategory::setFilterRules(QString("librepods.debug=%1").arg(parser.isSet("debug") ? "true" : "false"));
+
+    if (options.phoneAbsent && !options.toPhone)
+    {
+        std::fprintf(stderr, "--no-phone only makes sense with --direction to-phone\n");
+        return 1;
+    }
+
+    int airPodsPair[2];
+    int phonePair[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, airPodsPair) < 0 ||
+        ::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, phonePair) < 0)
+    {
+        std::perror("socketpair");
+        return 1;
+    }
+
+    RelayEngine relay;
+    relay.setEnabled(true);
+
+    LocalTransport *airPodsLink = LocalTransport::fromDescriptor(airPodsPair[0], &relay);
+    relay.setAirPodsTransport(airPodsLink);
+    // Same wiring as IoWorker: everything read from the AirPods goes to the phone first
+    QObject::connect(airPodsLink, &Transport::readyRead, &relay, [&relay, airPodsLink]()
+                     { relay.forwardToPhone(airPodsLink->readAll()); });
+    airPodsLink->open();
+
+    if (options.phoneAbsent)
+    {
+        ::close(phonePair[0]);
+        ::close(phonePair[1]);
+        phonePair[0] = phonePair[1] = -1;
+        relay.setPhoneTransportFactory([](QObject *parent) -> Transport *
+                                       { return new LocalTransport(QStringLiteral("/nonexistent/librepods-phone"), parent); });
+    }
+    else
+    {
+        // The socketpair can only be handed out once; later attempts behave like an absent phone
+        relay.setPhoneTransportFactory([fd = phonePair[0]](QObject *parent) mutable -> Transport *
+                                       {
+            if (fd < 0) {
+                return new LocalTransport(QString(), parent);
+            }
+            return LocalTransport::fromDescriptor(std::exchange(fd, -1), parent); });
+    }
+
+    const int sourceFd = options.toPhone ? airPodsPair[1] : phonePair[1];
+    const int sinkFd = options.toPhone ? phonePair[1] : airPodsPair[1];
+    const QByteArray sourcePrefix = options.toPhone ? QByteArray() : AirPodsPackets::Phone::NOTIFICATION;
+    const QByteArray sinkPrefix = options.toPhone ? AirPodsPackets::Phone::NOTIFICATION : QByteArray();
+    const quint64 total = options.rate > 0 ? quint64(options.rate) * options.durationSec : 1000000;
+
+    std::atomic<bool> stop{false};
+    std::atomic<qint64> firstSendNs{0};
+    std::atomic<qint64> lastReceiveNs{0};
+    std::atomic<quint64> sent{0};
+    std::vector<qint64> latencies;
+    latencies.reserve(total);
+    std::thread generator;
+    std::thread receiver;
+
+    auto start = [&]()
+    {
+        if (generator.joinable())
+        {
+            return;
+        }
+        if (sinkFd >= 0)
+        {
+            receiver = std::thread([&]()
+                                   {
+                sink(sinkFd, sinkPrefix, total, latencies, lastReceiveNs);
+                QMetaObject::invokeMethod(&app, &QCoreApplication::quit, Qt::QueuedConnection); });
+        }
+        generator = std::thread([&]()
+                                { generate(sourceFd, sourcePrefix, options, total, stop, firstSendNs, sent); });
+    };
+
+    if (options.phoneAbsent)
+    {
+        QTimer::singleShot(0, &app, start);
+    }
+    else
+    {
+        QObject::connect(&relay, &RelayEngine::phoneConnected, &app, start);
+        relay.connectToPhone();
+    }
+
+    // Whatever is still in flight after a second of grace counts as lost
+    QTimer::singleShot((options.durationSec + 1) * 1000, &app, &QCoreApplication::quit);
+    app.exec();
+
+    stop.store(true);
+    if (sinkFd >= 0)
+    {
+        ::shutdown(sinkFd, SHUT_RDWR);
+    }
+    ::shutdown(sourceFd, SHUT_RDWR);
+    if (generator.joinable())
+    {
+        generator.join();
+    }
+    if (receiver.joinable())
+    {
+        receiver.join();
+    }
+
+    const RelayEngine::Stats &stats = relay.stats();
+    std::printf("direction          %s\n", options.toPhone ? "airpods -> phone" : "phone -> airpods");
+    std::printf("packets sent       %llu\n", static_cast<unsigned long long>(sent.load()));
+    std::printf("packets received   %zu\n", latencies.size());
+    std::printf("relay dropped      %llu\n", static_cast<unsigned long long>(stats.dropped));
+    std::printf("phone attempts     %llu\n", static_cast<unsigned long long>(stats.reconnectAttempts));
+
+    if (!latencies.empty())
+    {
+        const double elapsedSec = (lastReceiveNs.load() - firstSendNs.load()) / 1e9;
+        std::sort(latencies.begin(), latencies.end());
+        std::printf("throughput         %.0f packets/s\n", elapsedSec > 0 ? latencies.size() / elapsedSec : 0.0);
+        std::printf("latency p50        %.1f us\n", percentile(latencies, 0.50));
+        std::printf("latency p90        %.1f us\n", percentile(latencies, 0.90));
+        std::printf("latency p99        %.1f us\n", percentile(latencies, 0.99));
+        std::printf("latency p99.9      %.1f us\n", percentile(latencies, 0.999));
+        std::printf("latency max        %.1f us\n", latencies.back() / 1000.0);
+    }
+
+    for (int fd : {airPodsPair[1], phonePair[1]})
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    return 0;
+}
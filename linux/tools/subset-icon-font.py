@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Subset the SF Symbols font down to the glyphs the QML files use.
+
+Icons are written in QML as escapes such as "\\uf958" (or as the literal private use
+character). Everything else in the 3.7 MB font is dropped, along with hinting and
+the tables Qt does not need to draw them.
+
+    subset-icon-font.py --font SF-Symbols-6.ttf --output icons.ttf Main.qml Icon.qml ...
+"""
+
+import argparse
+import re
+import sys
+from typing import Iterable, Set
+
+from fontTools import subset
+from fontTools.ttLib import TTFont
+
+ESCAPE = re.compile(r'\\u([0-9a-fA-F]{4})|\\u\{([0-9a-fA-F]{1,6})\}')
+
+
+def is_private_use(codepoint: int) -> bool:
+    # SF Symbols also spills into U+F900-U+FFFD, past the end of the BMP private use area
+    return 0xE000 <= codepoint <= 0xFFFD or codepoint >= 0xF0000
+
+
+def referenced_codepoints(paths: Iterable[str]) -> Set[int]:
+    codepoints: Set[int] = set()
+    for path in paths:
+        with open(path, encoding='utf-8') as f:
+            text = f.read()
+        for match in ESCAPE.finditer(text):
+            codepoints.add(int(match.group(1) or match.group(2), 16))
+        codepoints.update(ord(c) for c in text if is_private_use(ord(c)))
+    return {c for c in codepoints if is_private_use(c)}
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--font', required=True)
+    parser.add_argument('--output', required=True)
+    parser.add_argument('qml', nargs='+')
+    args = parser.parse_args()
+
+    codepoints = referenced_codepoints(args.qml)
+    font = TTFont(args.font)
+    cmap = font.getBestCmap()
+    missing = sorted(c for c in codepoints if c not in cmap)
+    if missing:
+        print('subset-icon-font: not in ' + args.font + ': ' + ', '.join('U+%04X' % c for c in missing),
+              file=sys.stderr)
+        return 1
+
+    options = subset.Options()
+    options.hinting = False
+    options.desubroutinize = True
+    options.layout_features = []
+    options.name_IDs = ['*']  # Keep the family name, QML looks the font up by it
+    options.notdef_outline = True
+    options.drop_tables += ['FFTM', 'GDEF']
+
+    subsetter = subset.Subsetter(options)
+    subsetter.populate(unicodes=codepoints)
+    subsetter.subset(font)
+    font.save(args.output)
+
+    print('subset-icon-font: kept %d glyphs: %s' % (len(codepoints), ' '.join('U+%04X' % c for c in sorted(codepoints))))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
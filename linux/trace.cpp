@@ -0,0 +1,164 @@
+#include "trace.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <cstdio>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace
+{
+    QMutex mutex;
+    QFile *output = nullptr;
+    bool firstEvent = true;
+
+    int threadId()
+    {
+        thread_local const int id = static_cast<int>(::syscall(SYS_gettid));
+        return id;
+    }
+
+    // Chrome wants microseconds; keep the nanoseconds as the fraction
+    QByteArray micros(qint64 nanoseconds)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%lld.%03lld", static_cast<long long>(nanoseconds / 1000),
+                      static_cast<long long>(nanoseconds % 1000));
+        return QByteArray(buffer);
+    }
+
+    void writeEvent(const QByteArray &fields, bool withThreadName = true);
+
+    // Emits the thread_name metadata event the first time a thread records something
+    void nameCurrentThread()
+    {
+        thread_local bool named = false;
+        if (named)
+        {
+            return;
+        }
+        named = true;
+
+        QString name = QThread::currentThread()->objectName();
+        if (name.isEmpty())
+        {
+            name = getpid() == threadId() ? QStringLiteral("main") : QStringLiteral("thread-%1").arg(threadId());
+        }
+        writeEvent("\"name\":\"thread_name\",\"ph\":\"M\",\"args\":{\"name\":\"" + name.toUtf8() + "\"}", false);
+    }
+
+    void writeEvent(const QByteArray &fields, bool withThreadName)
+    {
+        if (withThreadName)
+        {
+            nameCurrentThread();
+        }
+
+        QByteArray line;
+        line.reserve(fields.size() + 48);
+        line += "{";
+        line += fields;
+        line += ",\"pid\":" + QByteArray::number(getpid()) + ",\"tid\":" + QByteArray::number(threadId()) + "}";
+
+        QMutexLocker locker(&mutex);
+        if (output)
+        {
+            output->write(firstEvent ? "\n" : ",\n");
+            output->write(line);
+            firstEvent = false;
+        }
+    }
+
+    QByteArray nameField(const char *name)
+    {
+        return QByteArray("\"name\":\"") + name + "\",\"cat\":\"librepods\"";
+    }
+}
+
+namespace Trace
+{
+    bool start(const QString &path)
+    {
+        QMutexLocker locker(&mutex);
+        if (output)
+        {
+            return true;
+        }
+
+        auto *file = new QFile(path);
+        if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            LOG_ERROR("Cannot open trace file " << path << ": " << file->errorString());
+            delete file;
+            return false;
+        }
+        // The closing bracket is optional in the trace-event format, so a crash still leaves a readable file
+        file->write("[");
+        output = file;
+        firstEvent = true;
+        detail::active.store(true, std::memory_order_relaxed);
+        LOG_INFO("Writing trace events to " << path);
+        return true;
+    }
+
+    void stop()
+    {
+        QMutexLocker locker(&mutex);
+        detail::active.store(false, std::memory_order_relaxed);
+        if (output)
+        {
+            output->write("\n]\n");
+            output->close();
+            delete output;
+            output = nullptr;
+        }
+    }
+
+    void complete(const char *name, qint64 startNs, qint64 endNs)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        writeEvent(nameField(name) + ",\"ph\":\"X\",\"ts\":" + micros(startNs) + ",\"dur\":" + micros(endNs - startNs));
+    }
+
+    void instant(const char *name)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        writeEvent(nameField(name) + ",\"ph\":\"i\",\"s\":\"t\",\"ts\":" + micros(Metrics::nowNs()));
+    }
+
+    void asyncBegin(const char *name, quint64 id, qint64 timestampNs)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        writeEvent(nameField(name) + ",\"ph\":\"b\",\"id\":" + QByteArray::number(id) +
+                   ",\"ts\":" + micros(timestampNs ? timestampNs : Metrics::nowNs()));
+    }
+
+    void asyncEnd(const char *name, quint64 id, qint64 timestampNs)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        writeEvent(nameField(name) + ",\"ph\":\"e\",\"id\":" + QByteArray::number(id) +
+                   ",\"ts\":" + micros(timestampNs ? timestampNs : Metrics::nowNs()));
+    }
+
+    qint64 Span::now()
+    {
+        return Metrics::nowNs();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QString>
+#include <atomic>
+
+/**
+ * Chrome trace-event output (JSON, opens in Perfetto and chrome://tracing).
+ *
+ * Tracing is off unless start() was called (main() does so when LIBREPODS_TRACE names an
+ * output file). While it is off every entry point is a single relaxed atomic load; the
+ * span names are string literals and are not touched. Timestamps come from the same
+ * monotonic clock as Metrics::nowNs(), so IoEvent timestamps can be used directly.
+ */
+namespace Trace
+{
+    namespace detail
+    {
+        inline std::atomic<bool> active{false};
+    }
+
+    inline bool enabled() { return detail::active.load(std::memory_order_relaxed); }
+
+    bool start(const QString &path);
+    void stop();
+
+    // A finished span on the calling thread
+    void complete(const char *name, qint64 startNs, qint64 endNs);
+    void instant(const char *name);
+    // Spans that start and end on different threads or call stacks; matched by name and id
+    void asyncBegin(const char *name, quint64 id, qint64 timestampNs = 0);
+    void asyncEnd(const char *name, quint64 id, qint64 timestampNs = 0);
+
+    class Span
+    {
+    public:
+        explicit Span(const char *name) : m_name(name), m_startNs(enabled() ? now() : 0) {}
+        ~Span()
+        {
+            if (m_startNs != 0 && enabled())
+            {
+                complete(m_name, m_startNs, now());
+            }
+        }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+    private:
+        static qint64 now();
+
+        const char *m_name;
+        qint64 m_startNs;
+    };
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Traces the rest of the enclosing scope
+#define TRACE_SCOPE(name) Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
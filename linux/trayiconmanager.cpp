@@ -54,6 +54,36 @@ void TrayIconManager::updateConversationalAwareness(bool enabled)
     caToggleAction->setChecked(enabled);
 }
 
+void TrayIconManager::setDevices(const QList<QPair<QString, QString>> &devices)
+{
+    const QList<QAction *> actions = devicesGroup->actions();
+    for (QAction *action : actions)
+    {
+        delete action;
+    }
+
+    for (const auto &device : devices)
+    {
+        QAction *action = new QAction(device.second, devicesMenu);
+        action->setCheckable(true);
+        action->setData(device.first);
+        devicesGroup->addAction(action);
+        devicesMenu->addAction(action);
+        connect(action, &QAction::triggered, this, [this, address = device.first]()
+                { emit deviceSelected(address); });
+    }
+    devicesMenu->menuAction()->setVisible(devices.size() > 1);
+}
+
+void TrayIconManager::setActiveDevice(const QString &address)
+{
+    const QList<QAction *> actions = devicesGroup->actions();
+    for (QAction *action : actions)
+    {
+        action->setChecked(action->data().toString() == address);
+    }
+}
+
 void TrayIconManager::setupMenuActions()
 {
     // Open action
@@ -67,6 +97,11 @@ void TrayIconManager::setupMenuActions()
     trayMenu->addAction(settingsMenu);
     connect(settingsMenu, &QAction::triggered, qApp, [this](){emit openSettings();});
 
+    // Device selection, only shown with more than one pair
+    devicesMenu = trayMenu->addMenu(tr("Devices"));
+    devicesMenu->menuAction()->setVisible(false);
+    devicesGroup = new QActionGroup(devicesMenu);
+
     trayMenu->addSeparator();
 
     // Conversational Awareness Toggle
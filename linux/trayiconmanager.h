@@ -1,4 +1,6 @@
 #include <QObject>
+#include <QList>
+#include <QPair>
 #include <QSystemTrayIcon>
 
 #include "enums.h"
@@ -23,6 +25,10 @@ public:
 
     void showNotification(const QString &title, const QString &message);
 
+    // Address and display name of every known device; the submenu is hidden for fewer than two
+    void setDevices(const QList<QPair<QString, QString>> &devices);
+    void setActiveDevice(const QString &address);
+
     bool notificationsEnabled() const { return m_notificationsEnabled; }
     void setNotificationsEnabled(bool enabled)
     {
@@ -50,6 +56,8 @@ private:
     QMenu *trayMenu;
     QAction *caToggleAction;
     QActionGroup *noiseControlGroup;
+    QMenu *devicesMenu;
+    QActionGroup *devicesGroup;
     bool m_notificationsEnabled = true;
 
     void setupMenuActions();
@@ -60,6 +68,7 @@ signals:
     void trayClicked();
     void noiseControlChanged(AirpodsTrayApp::Enums::NoiseControlMode);
     void conversationalAwarenessToggled(bool enabled);
+    void deviceSelected(const QString &address);
     void openApp();
     void openSettings();
 };
\ No newline at end of file